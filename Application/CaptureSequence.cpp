@@ -0,0 +1,356 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include "CaptureSequence.h"
+#include "CpuMath.h"
+
+
+
+static bool parseCaptureFloat(const std::string& value, float& out)
+{
+	char* end = nullptr;
+	out = strtof(value.c_str(), &end);
+	return !value.empty() && *end == 0;
+}
+
+static bool parseCaptureUint(const std::string& value, uint32& out)
+{
+	char* end = nullptr;
+	const long v = strtol(value.c_str(), &end, 10);
+	out = uint32(v);
+	return !value.empty() && *end == 0 && v >= 0;
+}
+
+static bool parseCaptureVec3(const std::string& value, GlslVec3& out)
+{
+	char* end = nullptr;
+	const char* str = value.c_str();
+	float* components[3] = { &out.x, &out.y, &out.z };
+	for (int c = 0; c < 3; ++c)
+	{
+		*components[c] = strtof(str, &end);
+		if (end == str || *end != (c < 2 ? ',' : 0))
+		{
+			return false;
+		}
+		str = end + 1;
+	}
+	return true;
+}
+
+bool applyCaptureSetting(CaptureSceneState& state, const std::string& key, const std::string& value, std::string& error)
+{
+	struct FloatSetting
+	{
+		const char* Key;
+		float* Value;
+	};
+	const FloatSetting floatSettings[] = {
+		{ "camHeight",			&state.CamHeight },
+		{ "camForward",			&state.CamForward },
+		{ "viewYaw",			&state.ViewYaw },
+		{ "viewPitch",			&state.ViewPitch },
+		{ "sunPitch",			&state.SunPitch },
+		{ "sunYaw",				&state.SunYaw },
+		{ "sunIlluminance",		&state.SunIlluminanceScale },
+		{ "multipleScattering",	&state.MultipleScatteringFactor },
+		{ "miePhaseG",			&state.Atmosphere.mie_phase_function_g },
+		{ "bottomRadius",		&state.Atmosphere.bottom_radius },
+		{ "topRadius",			&state.Atmosphere.top_radius },
+	};
+	for (const FloatSetting& setting : floatSettings)
+	{
+		if (key == setting.Key)
+		{
+			if (!parseCaptureFloat(value, *setting.Value))
+			{
+				error = "invalid number for " + key + ": " + value;
+				return false;
+			}
+			return true;
+		}
+	}
+
+	struct Vec3Setting
+	{
+		const char* Key;
+		GlslVec3* Value;
+	};
+	GlslVec3 mieAbsorption = max3(state.Atmosphere.mie_extinction - state.Atmosphere.mie_scattering, splat3(0.0f));
+	const Vec3Setting vec3Settings[] = {
+		{ "groundAlbedo",		&state.Atmosphere.ground_albedo },
+		{ "rayleighScattering",	&state.Atmosphere.rayleigh_scattering },
+		{ "mieScattering",		&state.Atmosphere.mie_scattering },
+		{ "mieAbsorption",		&mieAbsorption },
+		{ "absorption",			&state.Atmosphere.absorption_extinction },
+	};
+	for (const Vec3Setting& setting : vec3Settings)
+	{
+		if (key == setting.Key)
+		{
+			if (!parseCaptureVec3(value, *setting.Value))
+			{
+				error = "invalid r,g,b value for " + key + ": " + value;
+				return false;
+			}
+			// Mie extinction is kept in sync as done by the UI.
+			state.Atmosphere.mie_extinction = state.Atmosphere.mie_scattering + mieAbsorption;
+			return true;
+		}
+	}
+
+	float number = 0.0f;
+	if (key == "rayleighScaleHeight" || key == "mieScaleHeight")
+	{
+		if (!parseCaptureFloat(value, number) || number <= 0.0f)
+		{
+			error = "invalid scale height: " + value;
+			return false;
+		}
+		DensityProfile& profile = key == "rayleighScaleHeight" ? state.Atmosphere.rayleigh_density : state.Atmosphere.mie_density;
+		profile.layers[1].exp_scale = -1.0f / number;
+		return true;
+	}
+	if (key == "scatteringOrders")
+	{
+		uint32 orders = 0;
+		if (!parseCaptureUint(value, orders) || orders < 1)
+		{
+			error = "invalid scattering order count: " + value;
+			return false;
+		}
+		state.ScatteringOrders = int(orders);
+		return true;
+	}
+	if (key == "method")
+	{
+		const char* methods[CaptureMethodCount] = { "bruneton2017", "pathtracing", "raymarching" };
+		for (int m = 0; m < CaptureMethodCount; ++m)
+		{
+			if (value == methods[m])
+			{
+				state.RenderingMethod = m;
+				return true;
+			}
+		}
+		error = "unknown method " + value + " (bruneton2017, pathtracing or raymarching)";
+		return false;
+	}
+
+	error = "unknown key " + key;
+	return false;
+}
+
+// Capture only keys.
+static bool applyCaptureShotSetting(CaptureShot& shot, const std::string& key, const std::string& value, std::string& error)
+{
+	uint32* values[] = { &shot.WaitFrameCount, &shot.PathTracingSampleCount, &shot.MaxFrameCount };
+	const char* keys[] = { "wait", "samples", "maxFrames" };
+	for (int k = 0; k < 3; ++k)
+	{
+		if (key == keys[k])
+		{
+			if (!parseCaptureUint(value, *values[k]))
+			{
+				error = "invalid count for " + key + ": " + value;
+				return false;
+			}
+			return true;
+		}
+	}
+	if (key == "skipScreenshot")
+	{
+		shot.SkipScreenshot = value != "0";
+		return true;
+	}
+	return applyCaptureSetting(shot.State, key, value, error);
+}
+
+bool parseCaptureScript(const std::string& script, std::vector<CaptureShot>& outShots, std::string& error)
+{
+	outShots.clear();
+	CaptureShot current;	// State and capture settings applied by the set commands
+
+	std::istringstream lines(script);
+	std::string line;
+	uint32 lineIndex = 0;
+	while (std::getline(lines, line))
+	{
+		lineIndex++;
+		const size_t comment = line.find('#');
+		if (comment != std::string::npos)
+		{
+			line.resize(comment);
+		}
+		std::istringstream tokens(line);
+		std::string command;
+		if (!(tokens >> command))
+		{
+			continue;
+		}
+
+		auto lineError = [&](const std::string& message)
+		{
+			error = "line " + std::to_string(lineIndex) + ": " + message;
+			return false;
+		};
+
+		CaptureShot* target = &current;
+		if (command == "reset")
+		{
+			current = CaptureShot();
+			continue;
+		}
+		else if (command == "capture")
+		{
+			outShots.push_back(current);
+			target = &outShots.back();
+			target->Line = lineIndex;
+			if (!(tokens >> target->Filename) || target->Filename.find('=') != std::string::npos)
+			{
+				return lineError("capture needs a file name");
+			}
+			if (target->Filename.size() >= sizeof(CaptureEvent::filename))
+			{
+				return lineError("file name too long");
+			}
+		}
+		else if (command != "set")
+		{
+			return lineError("unknown command " + command);
+		}
+
+		std::string setting;
+		while (tokens >> setting)
+		{
+			const size_t equal = setting.find('=');
+			if (equal == std::string::npos)
+			{
+				return lineError("expected key=value, got " + setting);
+			}
+			std::string settingError;
+			if (!applyCaptureShotSetting(*target, setting.substr(0, equal), setting.substr(equal + 1), settingError))
+			{
+				return lineError(settingError);
+			}
+		}
+	}
+	return true;
+}
+
+bool loadCaptureScript(const char* filepath, std::vector<CaptureShot>& outShots, std::string& error)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+	{
+		error = std::string("cannot open ") + filepath;
+		return false;
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+	return parseCaptureScript(content.str(), outShots, error);
+}
+
+
+
+void buildCaptureState(const std::vector<CaptureShot>& shots, CaptureSequenceRenderer& renderer, CaptureState& outState)
+{
+	outState = CaptureState();
+	outState.active = !shots.empty();
+	outState.events.resize(shots.size());
+	for (size_t s = 0; s < shots.size(); ++s)
+	{
+		const CaptureShot& shot = shots[s];
+		CaptureEvent& event = outState.events[s];
+		strncpy(event.filename, shot.Filename.c_str(), sizeof(event.filename) - 1);
+		event.filename[sizeof(event.filename) - 1] = 0;
+		event.skipScreenshot = shot.SkipScreenshot;
+		event.waitFrameCount = shot.WaitFrameCount;
+		event.pathTracingSampleCount = shot.State.RenderingMethod == CaptureMethodPathTracing ? shot.PathTracingSampleCount : 0;
+		event.maxFrameCount = shot.MaxFrameCount;
+		const CaptureSceneState sceneState = shot.State;
+		CaptureSequenceRenderer* target = &renderer;
+		event.stateSetup = [target, sceneState]() { target->setSceneState(sceneState); };
+	}
+}
+
+bool updateCaptureState(CaptureState& state, CaptureSequenceRenderer& renderer)
+{
+	if (!state.active)
+	{
+		return false;
+	}
+	state.totalFrameCount++;
+
+	while (state.eventId < state.events.size())
+	{
+		CaptureEvent& event = state.events[state.eventId];
+		if (!event.setupdone)
+		{
+			event.stateSetup();
+			event.setupdone = true;
+			state.frame = 0;
+			return true;		// The state is only rendered from the next frame on
+		}
+
+		state.frame++;
+		const bool ready = state.frame >= event.waitFrameCount && renderer.areLutsReady()
+			&& renderer.getPathTracingSampleCount() >= event.pathTracingSampleCount;
+		const bool timedOut = !ready && state.frame >= event.maxFrameCount;
+		if (!ready && !timedOut)
+		{
+			return true;
+		}
+
+		if (timedOut)
+		{
+			fprintf(stderr, "Capture %s timed out after %u frames (%u path tracing samples)\n", event.filename, state.frame, renderer.getPathTracingSampleCount());
+			state.timedOutCount++;
+		}
+		if (!event.skipScreenshot)
+		{
+			renderer.captureScreenshot(event.filename);
+			state.capturedCount++;
+		}
+		state.eventId++;
+	}
+
+	state.active = false;
+	return false;
+}
+
+
+
+void NullCaptureRenderer::setSceneState(const CaptureSceneState& state)
+{
+	// Same invalidations as the application: atmosphere and method changes rebuild the LUTs, any change restarts the path tracer.
+	const bool lutChange = memcmp(&state.Atmosphere, &mState.Atmosphere, sizeof(AtmosphereInfo)) != 0
+		|| state.RenderingMethod != mState.RenderingMethod || state.MultipleScatteringFactor != mState.MultipleScatteringFactor
+		|| state.ScatteringOrders != mState.ScatteringOrders;
+	mFramesSinceLutChange = lutChange ? 0 : mFramesSinceLutChange;
+	mPathTracingSampleCount = 0;
+	mState = state;
+}
+
+void NullCaptureRenderer::captureScreenshot(const char* filename)
+{
+	Capture capture;
+	capture.Filename = filename;
+	capture.State = mState;
+	capture.Frame = mFrame;
+	capture.PathTracingSampleCount = mPathTracingSampleCount;
+	mCaptures.push_back(capture);
+}
+
+void NullCaptureRenderer::renderFrame()
+{
+	mFrame++;
+	mFramesSinceLutChange++;
+	mPathTracingSampleCount += mState.RenderingMethod == CaptureMethodPathTracing ? 1 : 0;
+}
+
@@ -0,0 +1,147 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "SkyAtmosphereCommon.h"
+
+// Scripted capture sequences: a list of scene states to capture one after the other, waiting for each of them to be
+// fully rendered (LUTs rebuilt, path tracing samples accumulated). Scheduling only goes through CaptureSequenceRenderer,
+// so it does not depend on D3D and can be run against a null renderer.
+//
+// Script syntax, one command per line, # starting a comment:
+//   set <key>=<value> ...                 changes the state of all the following captures
+//   capture <file.exr> [<key>=<value> ...] captures the current state, the values only applying to this capture
+//   reset                                 goes back to the default state (Earth atmosphere, application startup view)
+// Scene keys: camHeight camForward (km), viewYaw viewPitch (degrees), sunPitch sunYaw (radians), sunIlluminance,
+//   method (bruneton2017, pathtracing or raymarching), multipleScattering (factor), scatteringOrders,
+//   groundAlbedo rayleighScattering mieScattering mieAbsorption absorption (r,g,b), miePhaseG,
+//   bottomRadius topRadius rayleighScaleHeight mieScaleHeight (km).
+// Capture keys: wait (minimum frames, 3 by default), samples (path tracing samples per pixel), maxFrames (timeout,
+//   1000 by default), skipScreenshot (1 to only go through the state).
+
+struct CaptureEvent
+{
+	bool setupdone = false;
+	bool skipScreenshot = false;
+	char filename[256];
+	std::function<void(void)> stateSetup;
+	uint32 waitFrameCount = 3;
+	uint32 pathTracingSampleCount = 0;		// 0 when not waiting for path tracing samples
+	uint32 maxFrameCount = 1000;			// The capture is taken anyway after that many frames
+};
+
+struct CaptureState
+{
+	bool active = false;
+	uint32 eventId = 0;
+	uint32 frame = 0;
+	std::vector<CaptureEvent> events;
+
+	uint32 capturedCount = 0;
+	uint32 timedOutCount = 0;			// Captures taken because maxFrameCount was reached
+	uint32 totalFrameCount = 0;
+};
+
+// Game::Method* values
+enum CaptureRenderingMethod
+{
+	CaptureMethodBruneton2017 = 0,
+	CaptureMethodPathTracing,
+	CaptureMethodRaymarching,
+	CaptureMethodCount
+};
+
+// Everything a script can set, with the application startup values.
+struct CaptureSceneState
+{
+	AtmosphereInfo Atmosphere;
+	float CamHeight = 0.5f;
+	float CamForward = -1.0f;
+	float ViewYaw = 0.0f;
+	float ViewPitch = 0.0f;
+	float SunPitch = 0.45f;
+	float SunYaw = 0.0f;
+	float SunIlluminanceScale = 1.0f;
+	int RenderingMethod = CaptureMethodRaymarching;
+	float MultipleScatteringFactor = 1.0f;
+	int ScatteringOrders = 4;
+
+	CaptureSceneState() { SetupEarthAtmosphere(Atmosphere); }
+};
+
+struct CaptureShot
+{
+	std::string Filename;
+	CaptureSceneState State;
+	uint32 WaitFrameCount = 3;
+	uint32 PathTracingSampleCount = 0;
+	uint32 MaxFrameCount = 1000;
+	bool SkipScreenshot = false;
+	uint32 Line = 0;					// Script line, for error messages
+};
+
+// Applies a single key=value, returns false with an error message for unknown keys or invalid values.
+bool applyCaptureSetting(CaptureSceneState& state, const std::string& key, const std::string& value, std::string& error);
+
+// Parses a whole script. error is prefixed with the line number.
+bool parseCaptureScript(const std::string& script, std::vector<CaptureShot>& outShots, std::string& error);
+bool loadCaptureScript(const char* filepath, std::vector<CaptureShot>& outShots, std::string& error);
+
+class CaptureSequenceRenderer
+{
+public:
+	virtual ~CaptureSequenceRenderer() {}
+
+	virtual void setSceneState(const CaptureSceneState& state) = 0;
+	// True once the last rendered frame did not need to rebuild any LUT: it shows the state set last.
+	virtual bool areLutsReady() const = 0;
+	// Samples per pixel accumulated since the path tracing accumulation was last restarted.
+	virtual uint32 getPathTracingSampleCount() const = 0;
+	virtual void captureScreenshot(const char* filename) = 0;
+};
+
+// Fills outState with one event per shot, setting the scene state of the shot on the renderer. The renderer must outlive the events.
+void buildCaptureState(const std::vector<CaptureShot>& shots, CaptureSequenceRenderer& renderer, CaptureState& outState);
+
+// Call once per frame after the frame has been rendered. Sets up the next state, to be rendered from the next frame on,
+// and captures the current one once it is ready. Returns false once all the events have been processed.
+bool updateCaptureState(CaptureState& state, CaptureSequenceRenderer& renderer);
+
+// Renderer without any GPU: LUTs are ready lutFrameCount frames after the atmosphere or the method changed and one path
+// tracing sample is accumulated per frame, restarting on any state change. Captures are only recorded.
+class NullCaptureRenderer : public CaptureSequenceRenderer
+{
+public:
+	explicit NullCaptureRenderer(uint32 lutFrameCount = 1) : mLutFrameCount(lutFrameCount) {}
+
+	struct Capture
+	{
+		std::string Filename;
+		CaptureSceneState State;
+		uint32 Frame;
+		uint32 PathTracingSampleCount;
+	};
+
+	void setSceneState(const CaptureSceneState& state) override;
+	bool areLutsReady() const override { return mFramesSinceLutChange >= mLutFrameCount; }
+	uint32 getPathTracingSampleCount() const override { return mPathTracingSampleCount; }
+	void captureScreenshot(const char* filename) override;
+
+	void renderFrame();		// Advances the simulated frame
+
+	const std::vector<Capture>& getCaptures() const { return mCaptures; }
+	uint32 getFrame() const { return mFrame; }
+
+private:
+	const uint32 mLutFrameCount;
+	CaptureSceneState mState;
+	uint32 mFrame = 0;
+	uint32 mFramesSinceLutChange = 0;
+	uint32 mPathTracingSampleCount = 0;
+	std::vector<Capture> mCaptures;
+};
+
@@ -0,0 +1,316 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#include "CpuBruneton.h"
+
+
+
+// functions.glsl is compiled in its own namespace with GLSL like vector types, in the same way
+// SkyAtmosphereBruneton.hlsl wraps it for HLSL. The types of definitions.glsl are declared again in there
+// using these vectors, so they do not clash with AtmosphereInfo and the GlslVec3 based code.
+namespace CpuBrunetonGlsl
+{
+
+#undef vec3
+
+struct vec2
+{
+	float x, y;
+
+	vec2() = default;
+	vec2(float x_, float y_) { x = x_; y = y_; }
+};
+
+struct vec3
+{
+	union
+	{
+		struct { float x, y, z; };
+		struct { float r, g, b; };
+	};
+
+	vec3() = default;
+	vec3(float a) { x = a; y = a; z = a; }	// HLSL like scalar to vector conversion, used by ComputeScatteringDensity
+	vec3(float x_, float y_, float z_) { x = x_; y = y_; z = z_; }
+};
+
+struct vec4
+{
+	union
+	{
+		struct { float x, y, z, w; };
+		struct { float r, g, b, a; };
+		vec3 rgb;
+	};
+
+	vec4() = default;
+	vec4(float x_, float y_, float z_, float w_) { x = x_; y = y_; z = z_; w = w_; }
+	vec4(const vec3& v, float w_) { x = v.x; y = v.y; z = v.z; w = w_; }
+};
+
+inline vec2 operator/(const vec2& a, const vec2& b) { return vec2(a.x / b.x, a.y / b.y); }
+
+inline vec3 operator+(const vec3& a, const vec3& b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline vec3 operator-(const vec3& a, const vec3& b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline vec3 operator*(const vec3& a, const vec3& b) { return vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline vec3 operator/(const vec3& a, const vec3& b) { return vec3(a.x / b.x, a.y / b.y, a.z / b.z); }
+inline vec3 operator*(const vec3& a, float b) { return vec3(a.x * b, a.y * b, a.z * b); }
+inline vec3 operator*(float a, const vec3& b) { return vec3(a * b.x, a * b.y, a * b.z); }
+inline vec3 operator/(const vec3& a, float b) { return vec3(a.x / b, a.y / b, a.z / b); }
+inline vec3 operator-(const vec3& a) { return vec3(-a.x, -a.y, -a.z); }
+inline vec3& operator+=(vec3& a, const vec3& b) { a = a + b; return a; }
+
+inline vec4 operator+(const vec4& a, const vec4& b) { return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+inline vec4 operator*(const vec4& a, float b) { return vec4(a.x * b, a.y * b, a.z * b, a.w * b); }
+inline vec4 operator/(const vec4& a, const vec4& b) { return vec4(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w); }
+
+// GLSL built-in functions, in float precision as on the GPU.
+inline float sqrt(float a) { return sqrtf(a); }
+inline float exp(float a) { return expf(a); }
+inline vec3 exp(const vec3& a) { return vec3(expf(a.x), expf(a.y), expf(a.z)); }
+inline float pow(float a, float b) { return powf(a, b); }
+inline float sin(float a) { return sinf(a); }
+inline float cos(float a) { return cosf(a); }
+inline float floor(float a) { return floorf(a); }
+inline float mod(float a, float b) { return a - b * floorf(a / b); }
+inline float min(float a, float b) { return a < b ? a : b; }
+inline float max(float a, float b) { return a > b ? a : b; }
+inline vec3 min(const vec3& a, const vec3& b) { return vec3(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z)); }
+inline float clamp(float a, float lo, float hi) { return min(max(a, lo), hi); }
+inline float smoothstep(float e0, float e1, float a) { const float t = clamp((a - e0) / (e1 - e0), 0.0f, 1.0f); return t * t * (3.0f - 2.0f * t); }
+inline float dot(const vec3& a, const vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const vec3& a) { return sqrtf(dot(a, a)); }
+inline vec3 normalize(const vec3& a) { return a / length(a); }
+
+// texture() with the linear clamp sampler used by generateSkyAtmosphereLUTs.
+vec4 texture(const CpuLut2D& tex, const vec2& uv)
+{
+	float rgba[4];
+	tex.sampleLinearClamp(uv.x, uv.y, rgba);
+	return vec4(rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+vec4 texture(const CpuLut3D& tex, const vec3& uvw)
+{
+	float rgba[4];
+	tex.sampleLinearClamp(uvw.x, uvw.y, uvw.z, rgba);
+	return vec4(rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+// Read by the GLSL code in place of the SKYATMOSPHERE_BUFFER constants. Only modified under BakeMutex.
+int TRANSMITTANCE_TEXTURE_WIDTH;
+int TRANSMITTANCE_TEXTURE_HEIGHT;
+int IRRADIANCE_TEXTURE_WIDTH;
+int IRRADIANCE_TEXTURE_HEIGHT;
+int SCATTERING_TEXTURE_R_SIZE;
+int SCATTERING_TEXTURE_MU_SIZE;
+int SCATTERING_TEXTURE_MU_S_SIZE;
+int SCATTERING_TEXTURE_NU_SIZE;
+std::mutex BakeMutex;
+
+#define IN(x) const x&
+#define OUT(x) x&
+#define TEMPLATE(x)
+#define TEMPLATE_ARGUMENT(x)
+#undef assert
+#define assert(x)
+
+#define D_UNREAL_ENGINE_4
+#define COMBINED_SCATTERING_TEXTURES
+#define sampler2D CpuLut2D
+#define sampler3D CpuLut3D
+
+#include "./Resources/Bruneton17/definitions.glsl"
+// The vendored shader code has unused parameters (e.g. single_mie_scattering_texture with COMBINED_SCATTERING_TEXTURES).
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4100)
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif
+#include "./Resources/Bruneton17/functions.glsl"
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// Units are macros with D_UNREAL_ENGINE_4, do not let them leak in the rest of the file.
+#undef PI
+#undef m
+#undef nm
+#undef rad
+#undef sr
+#undef watt
+#undef lm
+#undef km
+#undef m2
+#undef m3
+#undef pi
+#undef deg
+#undef cd
+#undef kcd
+
+AtmosphereParameters toGlslAtmosphereParameters(const AtmosphereInfo& info)
+{
+	// Same members in the same order, only the vector type differs.
+	static_assert(sizeof(AtmosphereParameters) == sizeof(AtmosphereInfo), "AtmosphereParameters layout mismatch");
+	static_assert(sizeof(vec3) == sizeof(GlslVec3), "vec3 layout mismatch");
+	AtmosphereParameters atmosphere;
+	memcpy(&atmosphere, &info, sizeof(AtmosphereParameters));
+	return atmosphere;
+}
+
+// Calls pass(x, y, frag_coord) for each texel of a Width x Height render target, one task per row.
+template<typename Pass>
+void runPass2D(CpuThreadPool& pool, uint32 Width, uint32 Height, const Pass& pass)
+{
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			pass(x, y, vec2(float(x) + 0.5f, float(y) + 0.5f));
+		}
+	});
+}
+
+// Calls pass(x, y, z, frag_coord) for each texel of a Width x Height x Depth render target, one task per row of a slice.
+// frag_coord.z is the slice center, as SV_Position plus the slice index + 0.5 in the shaders.
+template<typename Pass>
+void runPass3D(CpuThreadPool& pool, uint32 Width, uint32 Height, uint32 Depth, const Pass& pass)
+{
+	pool.parallelFor(Height * Depth, [&](uint32 task)
+	{
+		const uint32 y = task % Height;
+		const uint32 z = task / Height;
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			pass(x, y, z, vec3(float(x) + 0.5f, float(y) + 0.5f, float(z) + 0.5f));
+		}
+	});
+}
+
+void storeRGB(float* texel, const vec3& rgb)
+{
+	texel[0] = rgb.r;
+	texel[1] = rgb.g;
+	texel[2] = rgb.b;
+}
+
+}
+
+
+
+void bakeBrunetonLuts(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo, int NumScatteringOrder, CpuBrunetonLuts& outLuts)
+{
+	using namespace CpuBrunetonGlsl;
+	std::lock_guard<std::mutex> lock(BakeMutex);
+	TRANSMITTANCE_TEXTURE_WIDTH = int(lutInfo.TRANSMITTANCE_TEXTURE_WIDTH);
+	TRANSMITTANCE_TEXTURE_HEIGHT = int(lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT);
+	IRRADIANCE_TEXTURE_WIDTH = int(lutInfo.IRRADIANCE_TEXTURE_WIDTH);
+	IRRADIANCE_TEXTURE_HEIGHT = int(lutInfo.IRRADIANCE_TEXTURE_HEIGHT);
+	SCATTERING_TEXTURE_R_SIZE = int(lutInfo.SCATTERING_TEXTURE_R_SIZE);
+	SCATTERING_TEXTURE_MU_SIZE = int(lutInfo.SCATTERING_TEXTURE_MU_SIZE);
+	SCATTERING_TEXTURE_MU_S_SIZE = int(lutInfo.SCATTERING_TEXTURE_MU_S_SIZE);
+	SCATTERING_TEXTURE_NU_SIZE = int(lutInfo.SCATTERING_TEXTURE_NU_SIZE);
+
+	const auto atmosphere = toGlslAtmosphereParameters(info);
+	const uint32 ScatteringWidth = lutInfo.SCATTERING_TEXTURE_WIDTH;
+	const uint32 ScatteringHeight = lutInfo.SCATTERING_TEXTURE_HEIGHT;
+	const uint32 ScatteringDepth = lutInfo.SCATTERING_TEXTURE_DEPTH;
+
+	CpuLut2D& TransmittanceTex = outLuts.TransmittanceTex;
+	CpuLut2D& IrradianceTex = outLuts.IrradianceTex;
+	CpuLut3D& ScatteringTex = outLuts.ScatteringTex;
+	TransmittanceTex.Allocate(lutInfo.TRANSMITTANCE_TEXTURE_WIDTH, lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT);
+	IrradianceTex.Allocate(lutInfo.IRRADIANCE_TEXTURE_WIDTH, lutInfo.IRRADIANCE_TEXTURE_HEIGHT);
+	ScatteringTex.Allocate(ScatteringWidth, ScatteringHeight, ScatteringDepth);
+
+	// Same as TempLookUpTables. DeltaRaleighScattering also stores the multiple scattering of the previous order,
+	// because GLuint delta_multiple_scattering_texture = delta_rayleigh_scattering_texture in the reference implementation.
+	CpuLut2D DeltaIrradiance;
+	CpuLut3D DeltaRaleighScattering;
+	CpuLut3D DeltaMieScattering;
+	CpuLut3D DeltaScatteringDensity;
+	DeltaIrradiance.Allocate(lutInfo.IRRADIANCE_TEXTURE_WIDTH, lutInfo.IRRADIANCE_TEXTURE_HEIGHT);
+	DeltaRaleighScattering.Allocate(ScatteringWidth, ScatteringHeight, ScatteringDepth);
+	DeltaMieScattering.Allocate(ScatteringWidth, ScatteringHeight, ScatteringDepth);
+	DeltaScatteringDensity.Allocate(ScatteringWidth, ScatteringHeight, ScatteringDepth);
+
+	// LuminanceFromRadiance is the identity in generateSkyAtmosphereLUTs so it is not applied below.
+
+	// TransmittanceLutPS
+	runPass2D(pool, TransmittanceTex.Width, TransmittanceTex.Height, [&](uint32 x, uint32 y, const vec2& frag_coord)
+	{
+		float* texel = TransmittanceTex.texel(x, y);
+		storeRGB(texel, ComputeTransmittanceToTopAtmosphereBoundaryTexture(atmosphere, frag_coord));
+		texel[3] = 1.0f;
+	});
+
+	// DirectIrradianceLutPS. Irradiance is left to 0 as the direct irradiance is computed when rendering.
+	runPass2D(pool, DeltaIrradiance.Width, DeltaIrradiance.Height, [&](uint32 x, uint32 y, const vec2& frag_coord)
+	{
+		storeRGB(DeltaIrradiance.texel(x, y), ComputeDirectIrradianceTexture(atmosphere, TransmittanceTex, frag_coord));
+	});
+
+	// SingleScatteringLutPS
+	runPass3D(pool, ScatteringWidth, ScatteringHeight, ScatteringDepth, [&](uint32 x, uint32 y, uint32 z, const vec3& frag_coord)
+	{
+		vec3 DeltaRaleigh;
+		vec3 DeltaMie;
+		ComputeSingleScatteringTexture(atmosphere, TransmittanceTex, frag_coord, DeltaRaleigh, DeltaMie);
+		storeRGB(DeltaRaleighScattering.texel(x, y, z), DeltaRaleigh);
+		storeRGB(DeltaMieScattering.texel(x, y, z), DeltaMie);
+		float* texel = ScatteringTex.texel(x, y, z);
+		storeRGB(texel, DeltaRaleigh);
+		texel[3] = DeltaMie.r;
+	});
+
+	// Compute the 2nd to NumScatteringOrder-th orders of scattering, in sequence.
+	for (int ScatteringOrder = 2; ScatteringOrder <= NumScatteringOrder; ++ScatteringOrder)
+	{
+		// ScatteringDensityLutPS
+		runPass3D(pool, ScatteringWidth, ScatteringHeight, ScatteringDepth, [&](uint32 x, uint32 y, uint32 z, const vec3& frag_coord)
+		{
+			storeRGB(DeltaScatteringDensity.texel(x, y, z), ComputeScatteringDensityTexture(
+				atmosphere, TransmittanceTex, DeltaRaleighScattering,
+				DeltaMieScattering, DeltaRaleighScattering,
+				DeltaIrradiance, frag_coord,
+				ScatteringOrder));
+		});
+
+		// IndirectIrradianceLutPS, additively blended into Irradiance.
+		runPass2D(pool, DeltaIrradiance.Width, DeltaIrradiance.Height, [&](uint32 x, uint32 y, const vec2& frag_coord)
+		{
+			const vec3 IndirectIrradiance = ComputeIndirectIrradianceTexture(
+				atmosphere, DeltaRaleighScattering,
+				DeltaMieScattering, DeltaRaleighScattering,
+				frag_coord, ScatteringOrder - 1);
+			storeRGB(DeltaIrradiance.texel(x, y), IndirectIrradiance);
+			float* texel = IrradianceTex.texel(x, y);
+			texel[0] += IndirectIrradiance.r;
+			texel[1] += IndirectIrradiance.g;
+			texel[2] += IndirectIrradiance.b;
+		});
+
+		// MultipleScatteringLutPS, additively blended into Scattering (Blend0Nop1Add).
+		runPass3D(pool, ScatteringWidth, ScatteringHeight, ScatteringDepth, [&](uint32 x, uint32 y, uint32 z, const vec3& frag_coord)
+		{
+			float nu = 0.0f;
+			const vec3 DeltaMultipleScattering = ComputeMultipleScatteringTexture(
+				atmosphere, TransmittanceTex, DeltaScatteringDensity,
+				frag_coord, nu);
+			storeRGB(DeltaRaleighScattering.texel(x, y, z), DeltaMultipleScattering);
+			const vec3 ScatteringIncrement = DeltaMultipleScattering / RayleighPhaseFunction(nu);
+			float* texel = ScatteringTex.texel(x, y, z);
+			texel[0] += ScatteringIncrement.r;
+			texel[1] += ScatteringIncrement.g;
+			texel[2] += ScatteringIncrement.b;
+		});
+	}
+}
+
@@ -0,0 +1,27 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSkyAtmosphere.h"
+#include "CpuThreadPool.h"
+
+// CPU version of the Bruneton 2017 precomputation done by Game::generateSkyAtmosphereLUTs.
+// The passes run Resources/Bruneton17/functions.glsl compiled as C++, the very code used by the shaders, so both cannot drift apart.
+// It does not need a GPU and is meant to validate atmosphere presets or to bake the tables on build machines.
+
+// Same textures, layouts and content as LookUpTables.
+struct CpuBrunetonLuts
+{
+	CpuLut2D TransmittanceTex;	// Transmittance to the top atmosphere boundary, alpha is 1
+	CpuLut2D IrradianceTex;		// Indirect ground irradiance only, the direct one being evaluated when rendering
+	CpuLut3D ScatteringTex;		// The 4D (r, mu, mu_s, nu) table packed in 3D: Width = NU_SIZE * MU_S_SIZE, Height = MU_SIZE, Depth = R_SIZE.
+								// Rayleigh and multiple scattering in rgb, single Mie scattering red channel in alpha (COMBINED_SCATTERING_TEXTURES).
+};
+
+// Runs the transmittance, direct irradiance and single scattering passes, then the scattering density, indirect irradiance
+// and multiple scattering passes for each order from 2 to NumScatteringOrder, in the same sequence as the GPU.
+// Each pass is spread over the pool threads one row of a slice at a time. Texels are independent so the result does not
+// depend on the thread count. Bakes are serialised as the GLSL code reads the table sizes from globals.
+void bakeBrunetonLuts(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo, int NumScatteringOrder, CpuBrunetonLuts& outLuts);
+
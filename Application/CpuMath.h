@@ -0,0 +1,36 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+// HLSL-like helpers over GlslVec3 so that CPU ports of the shaders read like the original code.
+
+#include <cmath>
+#include "SkyAtmosphereCommon.h"
+
+inline GlslVec3 operator+(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline GlslVec3 operator-(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline GlslVec3 operator*(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x * b.x, a.y * b.y, a.z * b.z }; }
+inline GlslVec3 operator/(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x / b.x, a.y / b.y, a.z / b.z }; }
+inline GlslVec3 operator*(const GlslVec3& a, float b) { return GlslVec3{ a.x * b, a.y * b, a.z * b }; }
+inline GlslVec3 operator*(float a, const GlslVec3& b) { return GlslVec3{ a * b.x, a * b.y, a * b.z }; }
+inline GlslVec3 operator/(const GlslVec3& a, float b) { return GlslVec3{ a.x / b, a.y / b, a.z / b }; }
+inline GlslVec3 operator-(const GlslVec3& a) { return GlslVec3{ -a.x, -a.y, -a.z }; }
+inline GlslVec3& operator+=(GlslVec3& a, const GlslVec3& b) { a.x += b.x; a.y += b.y; a.z += b.z; return a; }
+inline GlslVec3& operator*=(GlslVec3& a, const GlslVec3& b) { a.x *= b.x; a.y *= b.y; a.z *= b.z; return a; }
+inline GlslVec3& operator*=(GlslVec3& a, float b) { a.x *= b; a.y *= b; a.z *= b; return a; }
+
+inline GlslVec3 splat3(float a) { return GlslVec3{ a, a, a }; }
+inline float dot(const GlslVec3& a, const GlslVec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline GlslVec3 cross(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+inline float length(const GlslVec3& a) { return sqrtf(dot(a, a)); }
+inline GlslVec3 normalize(const GlslVec3& a) { return a / length(a); }
+inline GlslVec3 exp3(const GlslVec3& a) { return GlslVec3{ expf(a.x), expf(a.y), expf(a.z) }; }
+inline GlslVec3 min3(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z }; }
+inline GlslVec3 max3(const GlslVec3& a, const GlslVec3& b) { return GlslVec3{ a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z }; }
+inline float mean(const GlslVec3& a) { return (a.x + a.y + a.z) * (1.0f / 3.0f); }
+
+inline float saturate(float a) { return a < 0.0f ? 0.0f : (a > 1.0f ? 1.0f : a); }
+inline float clampf(float a, float lo, float hi) { return a < lo ? lo : (a > hi ? hi : a); }
+inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+inline GlslVec3 lerp(const GlslVec3& a, const GlslVec3& b, float t) { return a + (b - a) * t; }
@@ -0,0 +1,1408 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "CpuPathTracer.h"
+#include "CpuSkyLuts.h"
+
+
+#define RAYDPOS 0.00001f
+
+// D_INTERSECTION_* and D_SCATT_TYPE_* values from RenderSkyPathTracing.hlsl, as floats to be stored in SIMD lanes.
+#define D_INTERSECTION_MEDIUM	0.0f
+#define D_INTERSECTION_NULL		1.0f
+#define D_INTERSECTION_GROUND	2.0f
+
+#define D_SCATT_TYPE_NONE		0.0f
+#define D_SCATT_TYPE_MIE		1.0f
+#define D_SCATT_TYPE_RAY		2.0f
+#define D_SCATT_TYPE_ABS		4.0f
+
+
+
+CpuPathTracingCamera getGameCamera(float viewYaw, float viewPitch, float camHeight, float camForward)
+{
+	viewPitch = clampf(viewPitch, -80.0f, 80.0f);
+	const float pitch = viewPitch * 3.14159f / 180.0f;
+	const float yaw = viewYaw * 3.14159f / 180.0f;
+
+	CpuPathTracingCamera camera;
+	camera.ViewDir = { cosf(pitch) * sinf(yaw), cosf(pitch) * cosf(yaw), sinf(pitch) };
+	camera.WorldPos = camera.ViewDir * camForward + GlslVec3{ 0.0f, 0.0f, camHeight };
+	return camera;
+}
+
+GlslVec3 getGameSunDirection(float sunPitch, float sunYaw)
+{
+	return { cosf(sunPitch) * sinf(sunYaw), cosf(sunPitch) * cosf(sunYaw), sinf(sunPitch) };
+}
+
+
+
+static uint32 wangHash(uint32 seed)
+{
+	seed = (seed ^ 61u) ^ (seed >> 16u);
+	seed *= 9u;
+	seed = seed ^ (seed >> 4u);
+	seed *= 0x27d4eb2du;
+	seed = seed ^ (seed >> 15u);
+	return seed;
+}
+
+// One sampler per lane. Lanes always draw together, whether they use the value or not.
+struct PathRandom8
+{
+	CpuPathSampler Lanes[8];
+
+	float next01(int l) { return Lanes[l].get1D(); }
+	float8 next01()
+	{
+		float values[8];
+		for (int l = 0; l < 8; ++l)
+		{
+			values[l] = next01(l);
+		}
+		return load8(values);
+	}
+	// infiniteTransmittanceIS numerator: -log(1 - zeta)
+	float8 nextExponential()
+	{
+		float values[8];
+		for (int l = 0; l < 8; ++l)
+		{
+			values[l] = -logf(1.0f - next01(l));
+		}
+		return load8(values);
+	}
+	// getUniformSphereSample
+	float8x3 nextUniformSphere()
+	{
+		float x[8], y[8], z[8];
+		for (int l = 0; l < 8; ++l)
+		{
+			float u, v;
+			Lanes[l].get2D(u, v);
+			const float phi = 2.0f * 3.14159f * u;
+			const float theta = 2.0f * acosf(sqrtf(1.0f - v));
+			x[l] = sinf(theta) * cosf(phi);
+			y[l] = cosf(theta);
+			z[l] = sinf(theta) * sinf(phi);
+		}
+		return { load8(x), load8(y), load8(z) };
+	}
+};
+
+// Single wavelength selected for each lane (ptc.wavelengthMask).
+struct WavelengthMask8
+{
+	float8 r, g, b;
+
+	float8 select(const float8 rgb[3]) const { return rgb[0] * r + rgb[1] * g + rgb[2] * b; }
+	float8 select(const GlslVec3& rgb) const { return r * rgb.x + g * rgb.y + b * rgb.z; }
+};
+
+struct PathMediumSample8
+{
+	float8 scattering;
+	float8 extinction;
+	float8 scatteringMie;
+	float8 albedo;
+};
+
+// Everything shared by the packets of an image.
+struct PathTracerContext
+{
+	CpuAtmosphereParameters Atmosphere;
+	const CpuPathTracingSettings* Settings;
+	const CpuLut2D* TransmittanceLut;
+	GlslVec3 ExtinctionMajorant;
+	GlslVec3 CameraRight;
+	GlslVec3 CameraUp;
+	float TanHalfFov;
+};
+
+static inline float8x3 select8x3(bool8 mask, const float8x3& a, const float8x3& b)
+{
+	return { select8(mask, a.x, b.x), select8(mask, a.y, b.y), select8(mask, a.z, b.z) };
+}
+
+static inline uint32 countLanes8(bool8 a)
+{
+	uint32 bits = uint32(movemask8(a));
+	bits = bits - ((bits >> 1) & 0x55u);
+	bits = (bits & 0x33u) + ((bits >> 2) & 0x33u);
+	return (bits + (bits >> 4)) & 0x0Fu;
+}
+
+// Rays traced by a packet or a wavefront stage, see CpuPathTracingStats.
+struct PathRayCounts
+{
+	uint64_t Extend = 0;
+	uint64_t Shadow = 0;
+};
+
+// raySphereIntersectNearest with the sphere centered on the origin.
+static float8 raySphereIntersectNearest8(const float8x3& r0, const float8x3& rd, float sR)
+{
+	const float8 zero = splat8(0.0f);
+	const float8 a = dot(rd, rd);
+	const float8 b = 2.0f * dot(rd, r0);
+	const float8 c = dot(r0, r0) - sR * sR;
+	const float8 delta = b * b - 4.0f * a * c;
+	const float8 sqrtDelta = sqrt8(max8(delta, zero));
+	const float8 sol0 = (-b - sqrtDelta) / (2.0f * a);
+	const float8 sol1 = (-b + sqrtDelta) / (2.0f * a);
+	const float8 sol = max8(select8(sol0 < zero, sol1, select8(sol1 < zero, sol0, min8(sol0, sol1))), zero);
+	const bool8 miss = (delta < zero) | (a == zero) | ((sol0 < zero) & (sol1 < zero));
+	return select8(miss, splat8(-1.0f), sol);
+}
+
+static bool8 insideAnyVolume8(const PathTracerContext& ctx, const float8x3& rayO)
+{
+	const float8 h = length(rayO);
+	const bool8 belowGround = (h - ctx.Atmosphere.BottomRadius) < splat8(PLANET_RADIUS_OFFSET);
+	const bool8 aboveTop = (ctx.Atmosphere.TopRadius - h) < splat8(-PLANET_RADIUS_OFFSET);
+	return !(belowGround | aboveTop);
+}
+
+static PathMediumSample8 sampleMedium8(const PathTracerContext& ctx, const WavelengthMask8& mask, const float8x3& P)
+{
+	const MediumSample8 medium = sampleMedium8(length(P) - ctx.Atmosphere.BottomRadius, ctx.Atmosphere);
+	PathMediumSample8 s;
+	s.scattering = mask.select(medium.scattering);
+	s.extinction = mask.select(medium.extinction);
+	s.scatteringMie = mask.select(medium.scatteringMie);
+	float8 albedo[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		albedo[c] = medium.scattering[c] / max8(splat8(0.001f), medium.extinction[c]);	// getAlbedo, clamp included to match the GPU images
+	}
+	s.albedo = mask.select(albedo);
+	return s;
+}
+
+static float8 hgPhase8(float g, float8 cosTheta)
+{
+	const float k = 3.0f / (8.0f * PI) * (1.0f - g * g) / (2.0f + g * g);
+	const float8 d = (1.0f + g * g) + 2.0f * g * cosTheta;
+	return k * (1.0f + cosTheta * cosTheta) / (d * sqrt8(d));
+}
+
+// TransmittanceEstimation from P toward direction for the lanes in mask, 0 for the others.
+static float8 transmittanceEstimation8(const PathTracerContext& ctx, PathRandom8& rnd, const WavelengthMask8& mask, float8 majorant,
+	bool8 lanes, const float8x3& P, const float8x3& direction)
+{
+	const float8 zero = splat8(0.0f);
+	const float8 one = splat8(1.0f);
+	const float8x3 P0 = P + direction * splat8(RAYDPOS);
+	const bool8 earthHit = raySphereIntersectNearest8(P0, direction, ctx.Atmosphere.BottomRadius) > zero;
+	lanes = lanes & !earthHit;
+	if (!any8(lanes))
+	{
+		return zero;
+	}
+	const float8 distance = raySphereIntersectNearest8(P0, direction, ctx.Atmosphere.TopRadius) * length(direction);
+
+	float8 transmittance = one;
+	switch (ctx.Settings->TransmittanceMethod)
+	{
+	case CpuTransmittanceMethodDeltaTracking:
+	{
+		bool8 tracking = lanes;
+		bool8 terminated = !lanes;
+		float8 t = zero;
+		while (any8(tracking))
+		{
+			t = t + select8(tracking, rnd.nextExponential() / majorant, zero);
+			tracking = tracking & !(t > distance);	// Did not terminate in the volume
+			const float8 extinction = sampleMedium8(ctx, mask, P0 + direction * t).extinction;
+			const bool8 terminate = tracking & (rnd.next01() < extinction / majorant);
+			terminated = terminated | terminate;
+			tracking = tracking & !terminate;
+		}
+		transmittance = select8(terminated, zero, one);
+		break;
+	}
+	case CpuTransmittanceMethodRatioTracking:
+	{
+		// Ratio tracking from http://drz.disneyresearch.com/~jnovak/publications/RRTracking/index.html
+		bool8 tracking = lanes;
+		float8 t = zero;
+		while (any8(tracking))
+		{
+			t = t + select8(tracking, rnd.nextExponential() / majorant, zero);
+			tracking = tracking & !(t > distance);
+			const float8 extinction = sampleMedium8(ctx, mask, P0 + direction * t).extinction;
+			transmittance = select8(tracking, transmittance * (1.0f - max8(zero, extinction / majorant)), transmittance);
+		}
+		transmittance = saturate8(transmittance);
+		break;
+	}
+	default:
+	{
+		const float8 viewHeight = length(P0);
+		const float8 viewZenithCosAngle = dot(direction, P0 / viewHeight);
+		float8 trans[3];
+		sampleTransmittanceLut8(ctx.Atmosphere, *ctx.TransmittanceLut, viewHeight, viewZenithCosAngle, trans);
+		transmittance = mask.select(trans);
+		break;
+	}
+	}
+	return select8(lanes, transmittance, zero);
+}
+
+// phaseEvaluateSample
+static float8 phaseEvaluate8(const PathTracerContext& ctx, bool8 rayleigh, float8 cosTheta)
+{
+	return select8(rayleigh, (3.0f / (16.0f * PI)) * (1.0f + cosTheta * cosTheta), hgPhase8(ctx.Atmosphere.MiePhaseG, cosTheta));
+}
+
+// phaseGenerateSample: Henyey-Greenstein importance sampling for Mie, uniform for Rayleigh. outWeight is the phase value over the pdf.
+static float8x3 phaseGenerateSample8(const PathTracerContext& ctx, PathRandom8& rnd, const float8x3& V, float8 ScatteringType, float8& outWeight)
+{
+	const float G = ctx.Atmosphere.MiePhaseG;
+	float nx[8], ny[8], nz[8], Vx[8], Vy[8], Vz[8], types[8];
+	store8(Vx, V.x); store8(Vy, V.y); store8(Vz, V.z); store8(types, ScatteringType);
+	for (int l = 0; l < 8; ++l)
+	{
+		float zetaPhi, zetaTheta;
+		rnd.Lanes[l].get2D(zetaPhi, zetaTheta);
+		if (types[l] == D_SCATT_TYPE_RAY)
+		{
+			const float phi = 2.0f * 3.14159f * zetaPhi;
+			const float theta = 2.0f * acosf(sqrtf(1.0f - zetaTheta));
+			nx[l] = sinf(theta) * cosf(phi); ny[l] = cosf(theta); nz[l] = sinf(theta) * sinf(phi);
+			continue;
+		}
+		const float phi = 2.0f * PI * zetaPhi;
+		const float tInv = (1.0f - G * G) / (1.0f - G + 2.0f * G * zetaTheta);
+		const float cosTheta = 0.5f / G * ((1.0f + G * G) - tInv * tInv);	// Careful: undefined for g~=0
+		const float sinTheta = sqrtf((std::max)(0.0f, 1.0f - cosTheta * cosTheta));
+		const GlslVec3 mainDir = { -Vx[l], -Vy[l], -Vz[l] };
+		const GlslVec3 up = { 0.0f, 1.0f, 0.0f };
+		const GlslVec3 right = { 1.0f, 0.0f, 0.0f };
+		const GlslVec3 t0 = normalize(cross(mainDir, fabsf(dot(mainDir, up)) > 0.01f ? up : right));
+		const GlslVec3 t1 = normalize(cross(mainDir, t0));
+		const GlslVec3 newDirection = t0 * (sinTheta * sinf(phi)) + t1 * (sinTheta * cosf(phi)) + mainDir * cosTheta;
+		nx[l] = newDirection.x; ny[l] = newDirection.y; nz[l] = newDirection.z;
+	}
+	const float8x3 newDirection = { load8(nx), load8(ny), load8(nz) };
+	const bool8 rayleigh = ScatteringType == splat8(D_SCATT_TYPE_RAY);
+	const float8 phaseValue = phaseEvaluate8(ctx, rayleigh, dot(newDirection, V));
+	const float8 phasePdf = select8(rayleigh, splat8(0.25f / PI), phaseValue);
+	outWeight = phaseValue / phasePdf;
+	return newDirection;
+}
+
+// Multiple scattering LUT value at P for the wavelength of each lane.
+static float8 sampleMultiScatLut8(const PathTracerContext& ctx, const WavelengthMask8& mask, const float8x3& P, const float8x3& sunDir)
+{
+	const CpuAtmosphereParameters& Atmosphere = ctx.Atmosphere;
+	const CpuLut2D& MultiScatLut = *ctx.Settings->MultiScatLut;
+	const float MultiScatLutRes = float(MultiScatLut.Width);
+	const float8 viewHeight = length(P);
+	const float8 SunZenithCosAngle = dot(sunDir, P / viewHeight);
+	const float8 u = saturate8(SunZenithCosAngle * 0.5f + 0.5f);
+	const float8 v = saturate8((viewHeight - Atmosphere.BottomRadius) / (Atmosphere.TopRadius - Atmosphere.BottomRadius));
+	float8 ms[3];
+	MultiScatLut.sampleLinearClamp8(
+		(u + 0.5f / MultiScatLutRes) * (MultiScatLutRes / (MultiScatLutRes + 1.0f)),
+		(v + 0.5f / MultiScatLutRes) * (MultiScatLutRes / (MultiScatLutRes + 1.0f)), ms);
+	return mask.select(ms);
+}
+
+// Diffuse ground bounce direction around UpVector, as the shader does: a uniform sphere direction flipped to the upper hemisphere.
+static float8x3 groundBounceDirection8(PathRandom8& rnd, const float8x3& UpVector)
+{
+	const float8x3 newDirection = rnd.nextUniformSphere();
+	const float8 dotVec = dot(newDirection, UpVector);
+	return select8x3(dotVec < splat8(0.0f), newDirection - UpVector * (2.0f * dotVec), newDirection);
+}
+
+// LightIntegratorInner for the laneCount pixels starting at (x0, y). Lanes past laneCount or the image width are never active.
+static void lightIntegratorInner8(const PathTracerContext& ctx, uint32 x0, uint32 y, uint32 sampleIndex, uint32 laneCount, float8 outL[3], float8 outTransmittance[3],
+	PathRayCounts& counts)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const CpuAtmosphereParameters& Atmosphere = ctx.Atmosphere;
+	const float8 zero = splat8(0.0f);
+	const float8 one = splat8(1.0f);
+
+	// Per lane setup: random stream, wavelength selection and camera ray.
+	PathRandom8 rnd;
+	float maskR[8], maskG[8], maskB[8], majorant[8], activeLanes[8];
+	float ox[8], oy[8], oz[8], dx[8], dy[8], dz[8];
+	const GlslVec3 camPos = settings.Camera.WorldPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+	const float aspectRatioXOverY = float(settings.Width) / float(settings.Height);
+	for (int l = 0; l < 8; ++l)
+	{
+		const uint32 x = (std::min)(x0 + l, settings.Width - 1);
+		const uint32 pixelIndex = y * settings.Width + x;
+		rnd.Lanes[l].init(settings.Sampler, x, y, settings.Width, sampleIndex, settings.Seed);
+
+		// Wavelengths are cycled through from one sample to the next, from a different start for each pixel.
+		const uint32 channel = (sampleIndex + wangHash(pixelIndex + settings.Seed)) % 3;
+		maskR[l] = channel == 0 ? 1.0f : 0.0f;
+		maskG[l] = channel == 1 ? 1.0f : 0.0f;
+		maskB[l] = channel == 2 ? 1.0f : 0.0f;
+		majorant[l] = (&ctx.ExtinctionMajorant.x)[channel];
+
+		const float ndcX = (float(x) + 0.5f) / float(settings.Width) * 2.0f - 1.0f;
+		const float ndcY = 1.0f - (float(y) + 0.5f) / float(settings.Height) * 2.0f;
+		const GlslVec3 WorldDir = normalize(settings.Camera.ViewDir + ctx.CameraRight * (ndcX * ctx.TanHalfFov * aspectRatioXOverY) + ctx.CameraUp * (ndcY * ctx.TanHalfFov));
+
+		// Move to top atmosphere. Lanes not intersecting the atmosphere keep L = 0 and a transmittance of 1.
+		GlslVec3 rayO = camPos;
+		const bool intersectsAtmosphere = MoveToTopAtmosphere(rayO, WorldDir, Atmosphere.TopRadius);
+		activeLanes[l] = uint32(l) < laneCount && (x0 + l) < settings.Width && intersectsAtmosphere ? 1.0f : 0.0f;
+		ox[l] = rayO.x; oy[l] = rayO.y; oz[l] = rayO.z;
+		dx[l] = WorldDir.x; dy[l] = WorldDir.y; dz[l] = WorldDir.z;
+	}
+	const WavelengthMask8 mask = { load8(maskR), load8(maskG), load8(maskB) };
+	const float8 extinctionMajorant = load8(majorant);
+	const float8x3 sunDir = splat8x3(settings.SunDir);
+	const float8 lightL = mask.select(settings.SunIlluminance);	// lightGenerateSample value, pdf is 1
+
+	float8x3 rayO = { load8(ox), load8(oy), load8(oz) };
+	float8x3 rayD = { load8(dx), load8(dy), load8(dz) };
+	float8x3 P = rayO;
+	bool8 active = load8(activeLanes) > zero;
+	bool8 hasScattered = zero > one;
+	float8 lastSurfaceIntersection = splat8(D_INTERSECTION_MEDIUM);
+	float8 L = zero;
+	float8 throughput = one;
+
+	for (int step = 0; step < settings.ScatteringMaxPathDepth; ++step)
+	{
+		active = active & (throughput > zero);
+		if (!any8(active))
+		{
+			break;
+		}
+
+		if (settings.GroundGlobalIllumination)
+		{
+			// If ground is directly visible as the first intersection (has not scattered before) then we should stop tracing for the ground to not show up.
+			const bool8 onGround = active & (lastSurfaceIntersection == splat8(D_INTERSECTION_GROUND));
+			active = active & !(onGround & !hasScattered);
+
+			const bool8 bounce = onGround & hasScattered;
+			if (any8(bounce))
+			{
+				// Offset position to be always be the volume
+				const float8x3 UpVector = rayO / length(rayO);
+				rayO = select8x3(bounce, rayO + UpVector * splat8(0.025f), rayO);
+				P = select8x3(bounce, rayO, P);
+
+				const float8 SunTransmittance = transmittanceEstimation8(ctx, rnd, mask, extinctionMajorant, bounce, P, sunDir);
+				counts.Shadow += countLanes8(bounce);
+
+				// Generate a new up direction assuming a diffuse surface.
+				rayD = select8x3(bounce, groundBounceDirection8(rnd, UpVector), rayD);
+
+				const float8 NdotL = saturate8(dot(UpVector, sunDir));
+				const float8 albedo = saturate8(mask.select(Atmosphere.GroundAlbedo));
+				const float8 DiffuseEval = albedo * (1.0f / PI);
+				L = select8(bounce, L + throughput * SunTransmittance * (DiffuseEval * NdotL * lightL), L);
+				throughput = select8(bounce, throughput * DiffuseEval, throughput);
+			}
+		}
+
+		// Compute next ray from last intersection.
+		const float8x3 V = { -rayD.x, -rayD.y, -rayD.z };
+		float8x3 nextO = P + rayD * splat8(RAYDPOS);
+		float8x3 nextD = rayD;
+		active = active & insideAnyVolume8(ctx, nextO);
+		if (!any8(active))
+		{
+			break;	// Exit as we have exited the atmosphere volume
+		}
+
+		// Integrate: getNearestIntersection
+		const float8x3 P0 = nextO;
+		const float8 tBottom = raySphereIntersectNearest8(P0, nextD, Atmosphere.BottomRadius);
+		const float8 tTop = raySphereIntersectNearest8(P0, nextD, Atmosphere.TopRadius);
+		const bool8 noIntersection = (tBottom < zero) & (tTop < zero);
+		const float8 tSurface = select8(tBottom < zero, tTop, select8(tTop > zero, min8(tTop, tBottom), tBottom));
+		lastSurfaceIntersection = select8(active, select8(noIntersection, splat8(D_INTERSECTION_MEDIUM),
+			select8(tSurface == tTop, splat8(D_INTERSECTION_NULL), splat8(D_INTERSECTION_GROUND))), lastSurfaceIntersection);
+		active = active & !noIntersection;
+		const float8 tMax = length(nextD * tSurface);
+		counts.Extend += countLanes8(active);
+
+		// Delta tracking along the ray
+		bool8 tracking = active;
+		bool8 eventScatter = zero > one;
+		bool8 eventAbsorb = eventScatter;
+		float8 ScatteringType = splat8(D_SCATT_TYPE_NONE);
+		float8 extinction = zero;
+		float8 scattering = zero;
+		float8 albedo = zero;
+		float8x3 eventP = P0;
+		float8 t = zero;
+		while (any8(tracking))
+		{
+			t = t + select8(tracking, rnd.nextExponential() / extinctionMajorant, zero);	// unbounded domain proportional with PDF to the transmittance
+			tracking = tracking & (t < tMax);
+			const float8x3 P1 = P0 + nextD * t;
+			const PathMediumSample8 medium = sampleMedium8(ctx, mask, P1);
+			const float8 xi = rnd.next01();
+			const bool8 scatter = tracking & (xi <= medium.scattering / extinctionMajorant);
+			const bool8 absorb = tracking & !scatter & (xi < medium.extinction / extinctionMajorant);	// on top of scattering, as extinction = scattering + absorption
+			const float8 zeta = rnd.next01();
+			ScatteringType = select8(scatter, select8(zeta < medium.scatteringMie / medium.scattering, splat8(D_SCATT_TYPE_MIE), splat8(D_SCATT_TYPE_RAY)), ScatteringType);
+
+			const bool8 event = scatter | absorb;
+			eventP = select8x3(event, P1, eventP);
+			extinction = select8(event, medium.extinction, extinction);
+			scattering = select8(event, medium.scattering, scattering);
+			albedo = select8(event, medium.albedo, albedo);
+			eventScatter = eventScatter | scatter;
+			eventAbsorb = eventAbsorb | absorb;
+			tracking = tracking & !event;
+		}
+		const bool8 scattered = eventScatter & (extinction > zero);
+		ScatteringType = select8(eventAbsorb, splat8(D_SCATT_TYPE_ABS), ScatteringType);
+
+		// Scattering: weight = albedo * extinction / infiniteTransmittancePDF(scattering, 1). Absorption: no light and end of the path.
+		const bool8 mediumHit = scattered | eventAbsorb;
+		const float8 transmittance = select8(eventAbsorb, zero, one);
+		const float8 weight = select8(scattered, albedo * extinction / scattering, select8(eventAbsorb, zero, one));
+		P = select8x3(mediumHit, eventP, P0 + nextD * tMax);
+		lastSurfaceIntersection = select8(mediumHit, splat8(D_INTERSECTION_MEDIUM), lastSurfaceIntersection);
+		nextO = P + nextD * splat8(RAYDPOS);
+
+		if (any8(mediumHit))
+		{
+			// (1) sample light, (2) apply phase, (3) update throughput.
+			const float8 beamTransmittance = transmittanceEstimation8(ctx, rnd, mask, extinctionMajorant, scattered, P, sunDir);
+			counts.Shadow += countLanes8(scattered);
+
+			// phaseEvaluateSample
+			const float8 cosTheta = dot(sunDir, V);
+			const bool8 rayleigh = ScatteringType == splat8(D_SCATT_TYPE_RAY);
+			const float8 bsdfL = phaseEvaluate8(ctx, rayleigh, cosTheta);
+
+			if (settings.MultiScatLut)
+			{
+				// We do not apply beamTransmittance to the multiple scattering, see the shader.
+				const float8 globalL = transmittance * weight * lightL;
+
+				const float8 multiScatteredLuminance = select8(scattered, sampleMultiScatLut8(ctx, mask, P, sunDir), zero);
+
+				L = select8(mediumHit, L + throughput * globalL * (beamTransmittance * bsdfL + multiScatteredLuminance), L);
+				throughput = select8(mediumHit, throughput * transmittance, throughput);
+				hasScattered = hasScattered | mediumHit;
+				active = active & !mediumHit;
+			}
+			else
+			{
+				const float8 Lv = lightL * bsdfL * beamTransmittance;
+				L = select8(mediumHit, L + weight * throughput * Lv * transmittance, L);
+				throughput = select8(mediumHit, throughput * transmittance, throughput);
+
+				const bool8 continuePath = mediumHit & insideAnyVolume8(ctx, nextO);
+				hasScattered = hasScattered | continuePath;
+				if (settings.MiePhaseImportanceSampling)
+				{
+					float8 phaseWeight;
+					const float8x3 newDirection = phaseGenerateSample8(ctx, rnd, V, ScatteringType, phaseWeight);
+					nextD = select8x3(continuePath, newDirection, nextD);
+					throughput = select8(continuePath, throughput * phaseWeight, throughput);
+				}
+				else
+				{
+					nextD = select8x3(continuePath, rnd.nextUniformSphere(), nextD);	// Simple uniform distribution.
+				}
+			}
+		}
+
+		// No intersection within the range
+		bool8 leftVolume = lastSurfaceIntersection == splat8(D_INTERSECTION_NULL);
+		if (!settings.GroundGlobalIllumination)
+		{
+			leftVolume = leftVolume | (lastSurfaceIntersection == splat8(D_INTERSECTION_GROUND));
+		}
+		active = active & !(leftVolume & !mediumHit);
+
+		rayO = nextO;
+		rayD = nextD;
+	}
+
+	// The view ray transmittance is only known while the path has not scattered.
+	const float8 pathTransmittance = select8(hasScattered, zero, throughput);
+	const float8* channelMasks[3] = { &mask.r, &mask.g, &mask.b };
+	for (int c = 0; c < 3; ++c)
+	{
+		const float8 wavelengthWeight = *channelMasks[c] * 3.0f;	// wavelength pdf is 1/3
+		outL[c] = L * wavelengthWeight;
+		outTransmittance[c] = pathTransmittance * wavelengthWeight;
+	}
+}
+
+static void initPathTracerContext(const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings, PathTracerContext& ctx)
+{
+	ctx.Atmosphere = GetAtmosphereParameters(info);
+	ctx.Settings = &settings;
+	ctx.TransmittanceLut = &TransmittanceLut;
+	ctx.ExtinctionMajorant = ctx.Atmosphere.RayleighScattering + ctx.Atmosphere.MieExtinction + ctx.Atmosphere.AbsorptionExtinction;
+
+	// Same basis as XMMatrixLookAtLH with z up.
+	const GlslVec3 upDirection = { 0.0f, 0.0f, 1.0f };
+	ctx.CameraRight = normalize(cross(upDirection, settings.Camera.ViewDir));
+	ctx.CameraUp = cross(settings.Camera.ViewDir, ctx.CameraRight);
+	ctx.TanHalfFov = tanf(0.5f * settings.Camera.VerticalFovDegrees * 3.14159f / 180.0f);
+}
+
+void renderPathTracing(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuPathTracingStats* outStats)
+{
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	PathTracerContext ctx;
+	initPathTracerContext(info, TransmittanceLut, settings, ctx);
+
+	outLuminance.Allocate(settings.Width, settings.Height);
+	outTransmittance.Allocate(settings.Width, settings.Height);
+	const uint32 LaneCount = (std::min)(8u, (std::max)(1u, settings.PacketLaneCount));
+	const uint32 PacketsPerRow = (settings.Width + LaneCount - 1) / LaneCount;
+	const float InvSampleCount = 1.0f / float((std::max)(1u, settings.SamplesPerPixel));
+	std::atomic<uint64_t> extendRayCount(0);
+	std::atomic<uint64_t> shadowRayCount(0);
+
+	pool.parallelFor(PacketsPerRow * settings.Height, [&](uint32 packetIndex)
+	{
+		const uint32 x0 = (packetIndex % PacketsPerRow) * LaneCount;
+		const uint32 y = packetIndex / PacketsPerRow;
+		PathRayCounts counts;
+
+		float8 sumL[3] = { splat8(0.0f), splat8(0.0f), splat8(0.0f) };
+		float8 sumTransmittance[3] = { splat8(0.0f), splat8(0.0f), splat8(0.0f) };
+		for (uint32 s = settings.FirstSampleIndex; s < settings.FirstSampleIndex + settings.SamplesPerPixel; ++s)
+		{
+			float8 L[3], transmittance[3];
+			lightIntegratorInner8(ctx, x0, y, s, LaneCount, L, transmittance, counts);
+			for (int c = 0; c < 3; ++c)
+			{
+				sumL[c] = sumL[c] + L[c];
+				sumTransmittance[c] = sumTransmittance[c] + transmittance[c];
+			}
+		}
+		extendRayCount += counts.Extend;
+		shadowRayCount += counts.Shadow;
+
+		float meanL[3][8], meanTransmittance[3][8];
+		for (int c = 0; c < 3; ++c)
+		{
+			store8(meanL[c], sumL[c] * InvSampleCount);
+			store8(meanTransmittance[c], sumTransmittance[c] * InvSampleCount);
+		}
+		for (uint32 l = 0; l < LaneCount && x0 + l < settings.Width; ++l)
+		{
+			float* luminance = outLuminance.texel(x0 + l, y);
+			float* transmittance = outTransmittance.texel(x0 + l, y);
+			for (int c = 0; c < 3; ++c)
+			{
+				luminance[c] = meanL[c][l];
+				transmittance[c] = meanTransmittance[c][l];
+			}
+			luminance[3] = 1.0f;
+			transmittance[3] = 1.0f;
+		}
+	});
+
+	if (outStats)
+	{
+		outStats->Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+		outStats->PathCount = uint64_t(settings.Width) * settings.Height * settings.SamplesPerPixel;
+		outStats->ExtendRayCount = extendRayCount;
+		outStats->ShadowRayCount = shadowRayCount;
+	}
+}
+
+
+
+const char* getWavefrontStageName(CpuWavefrontStage stage)
+{
+	switch (stage)
+	{
+	case CpuWavefrontStageGenerate:		return "generate";
+	case CpuWavefrontStageExtend:		return "extend";
+	case CpuWavefrontStageLightSample:	return "light_sample";
+	case CpuWavefrontStageMediumEvent:	return "medium_event";
+	case CpuWavefrontStageGroundBounce:	return "ground_bounce";
+	case CpuWavefrontStageAccumulate:	return "accumulate";
+	case CpuWavefrontStageQueues:		return "queues";
+	default:							return "unknown";
+	}
+}
+
+// Paths of a wavefront, indexed by their index in the wavefront.
+struct WavefrontPaths
+{
+	std::vector<float> Px, Py, Pz;		// Last path vertex P, planet centered
+	std::vector<float> Dx, Dy, Dz;		// Direction of the next extend ray
+	std::vector<float> L, Throughput, SunTransmittance;
+	std::vector<float> Extinction, Scattering, Albedo, ScatteringType;	// Medium at the scattering event found by the extend stage
+	std::vector<uint32> Pixel, Channel, Depth;
+	std::vector<uint8_t> NextStage, HasScattered;
+	std::vector<CpuPathSampler> Samplers;
+
+	void resize(uint32 count)
+	{
+		for (std::vector<float>* v : { &Px, &Py, &Pz, &Dx, &Dy, &Dz, &L, &Throughput, &SunTransmittance, &Extinction, &Scattering, &Albedo, &ScatteringType })
+		{
+			v->resize(count);
+		}
+		Pixel.resize(count);
+		Channel.resize(count);
+		Depth.resize(count);
+		NextStage.resize(count);
+		HasScattered.resize(count);
+		Samplers.resize(count);
+	}
+
+	GlslVec3 position(uint32 p) const { return { Px[p], Py[p], Pz[p] }; }
+	GlslVec3 direction(uint32 p) const { return { Dx[p], Dy[p], Dz[p] }; }
+	void setPosition(uint32 p, const GlslVec3& P) { Px[p] = P.x; Py[p] = P.y; Pz[p] = P.z; }
+	void setDirection(uint32 p, const GlslVec3& D) { Dx[p] = D.x; Dy[p] = D.y; Dz[p] = D.z; }
+};
+
+// Up to 8 paths of a stage queue loaded in SIMD lanes. Lanes past Count repeat the first path and are never written back.
+struct WavefrontBatch8
+{
+	uint32 Paths[8];
+	uint32 Count;
+	bool8 Valid;
+	PathRandom8 Rnd;
+	WavelengthMask8 Mask;
+	float8 Majorant;
+
+	WavefrontBatch8(const PathTracerContext& ctx, const WavefrontPaths& paths, const uint32* queue, uint32 count)
+	{
+		float maskR[8], maskG[8], maskB[8], majorant[8], valid[8];
+		Count = count;
+		for (uint32 l = 0; l < 8; ++l)
+		{
+			const uint32 p = queue[l < count ? l : 0];
+			const uint32 channel = paths.Channel[p];
+			Paths[l] = p;
+			Rnd.Lanes[l] = paths.Samplers[p];
+			maskR[l] = channel == 0 ? 1.0f : 0.0f;
+			maskG[l] = channel == 1 ? 1.0f : 0.0f;
+			maskB[l] = channel == 2 ? 1.0f : 0.0f;
+			majorant[l] = (&ctx.ExtinctionMajorant.x)[channel];
+			valid[l] = l < count ? 1.0f : 0.0f;
+		}
+		Mask = { load8(maskR), load8(maskG), load8(maskB) };
+		Majorant = load8(majorant);
+		Valid = load8(valid) > splat8(0.0f);
+	}
+
+	float8 load(const std::vector<float>& v) const
+	{
+		float values[8];
+		for (int l = 0; l < 8; ++l)
+		{
+			values[l] = v[Paths[l]];
+		}
+		return load8(values);
+	}
+	float8x3 load(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z) const { return { load(x), load(y), load(z) }; }
+	void store(std::vector<float>& v, float8 a) const
+	{
+		float values[8];
+		store8(values, a);
+		for (uint32 l = 0; l < Count; ++l)
+		{
+			v[Paths[l]] = values[l];
+		}
+	}
+	void store(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z, const float8x3& a) const { store(x, a.x); store(y, a.y); store(z, a.z); }
+	void storeSamplers(WavefrontPaths& paths) const
+	{
+		for (uint32 l = 0; l < Count; ++l)
+		{
+			paths.Samplers[Paths[l]] = Rnd.Lanes[l];
+		}
+	}
+};
+
+// Camera ray of the paths [begin, end) of the wavefront starting at firstPixel, as in lightIntegratorInner8.
+static void wavefrontGenerate(const PathTracerContext& ctx, WavefrontPaths& paths, uint32 firstPixel, uint32 sampleIndex, uint32 begin, uint32 end)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const GlslVec3 camPos = settings.Camera.WorldPos + GlslVec3{ 0.0f, 0.0f, ctx.Atmosphere.BottomRadius };
+	const float aspectRatioXOverY = float(settings.Width) / float(settings.Height);
+	for (uint32 p = begin; p < end; ++p)
+	{
+		const uint32 pixelIndex = firstPixel + p;
+		const uint32 x = pixelIndex % settings.Width;
+		const uint32 y = pixelIndex / settings.Width;
+		paths.Samplers[p].init(settings.Sampler, x, y, settings.Width, sampleIndex, settings.Seed);
+		paths.Pixel[p] = pixelIndex;
+		paths.Channel[p] = (sampleIndex + wangHash(pixelIndex + settings.Seed)) % 3;
+
+		const float ndcX = (float(x) + 0.5f) / float(settings.Width) * 2.0f - 1.0f;
+		const float ndcY = 1.0f - (float(y) + 0.5f) / float(settings.Height) * 2.0f;
+		const GlslVec3 WorldDir = normalize(settings.Camera.ViewDir + ctx.CameraRight * (ndcX * ctx.TanHalfFov * aspectRatioXOverY) + ctx.CameraUp * (ndcY * ctx.TanHalfFov));
+		GlslVec3 rayO = camPos;
+		const bool intersectsAtmosphere = MoveToTopAtmosphere(rayO, WorldDir, ctx.Atmosphere.TopRadius);
+
+		paths.setPosition(p, rayO);
+		paths.setDirection(p, WorldDir);
+		paths.L[p] = 0.0f;
+		paths.Throughput[p] = 1.0f;
+		paths.Depth[p] = 0;
+		paths.HasScattered[p] = 0;
+		paths.NextStage[p] = uint8_t(intersectsAtmosphere ? CpuWavefrontStageExtend : CpuWavefrontStageAccumulate);
+	}
+}
+
+// Delta tracking of the queued paths to their next medium event or surface. A lane whose path found its event is refilled with the
+// next path of the queue, so that all lanes keep tracking until the queue is empty.
+static void wavefrontExtend(const PathTracerContext& ctx, WavefrontPaths& paths, const uint32* queue, uint32 count, PathRayCounts& counts)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const CpuAtmosphereParameters& Atmosphere = ctx.Atmosphere;
+	const float8 zero = splat8(0.0f);
+	PathRandom8 rnd;
+	uint32 lanePaths[8];
+	float ox[8], oy[8], oz[8], dx[8], dy[8], dz[8], t[8], tMax[8], majorant[8], maskR[8], maskG[8], maskB[8], active[8], surface[8];
+	uint32 nextQueued = 0;
+
+	// Loads the next queued path still in the atmosphere in lane l, the others being terminated.
+	auto refillLane = [&](int l)
+	{
+		active[l] = 0.0f;
+		while (nextQueued < count)
+		{
+			const uint32 p = queue[nextQueued++];
+			const GlslVec3 D = paths.direction(p);
+			const GlslVec3 P0 = paths.position(p) + D * RAYDPOS;
+			const float h = length(P0);
+			const bool insideVolume = !((h - Atmosphere.BottomRadius) < PLANET_RADIUS_OFFSET || (Atmosphere.TopRadius - h) < -PLANET_RADIUS_OFFSET);
+			const float tBottom = raySphereIntersectNearest(P0, D, GlslVec3{ 0.0f, 0.0f, 0.0f }, Atmosphere.BottomRadius);
+			const float tTop = raySphereIntersectNearest(P0, D, GlslVec3{ 0.0f, 0.0f, 0.0f }, Atmosphere.TopRadius);
+			if (!(paths.Throughput[p] > 0.0f) || !insideVolume || (tBottom < 0.0f && tTop < 0.0f))
+			{
+				paths.NextStage[p] = uint8_t(CpuWavefrontStageAccumulate);
+				continue;
+			}
+			const float tSurface = tBottom < 0.0f ? tTop : (tTop > 0.0f ? (std::min)(tTop, tBottom) : tBottom);
+			const uint32 channel = paths.Channel[p];
+			lanePaths[l] = p;
+			rnd.Lanes[l] = paths.Samplers[p];
+			ox[l] = P0.x; oy[l] = P0.y; oz[l] = P0.z;
+			dx[l] = D.x; dy[l] = D.y; dz[l] = D.z;
+			t[l] = 0.0f;
+			tMax[l] = length(D * tSurface);
+			surface[l] = tSurface == tTop ? D_INTERSECTION_NULL : D_INTERSECTION_GROUND;
+			maskR[l] = channel == 0 ? 1.0f : 0.0f;
+			maskG[l] = channel == 1 ? 1.0f : 0.0f;
+			maskB[l] = channel == 2 ? 1.0f : 0.0f;
+			majorant[l] = (&ctx.ExtinctionMajorant.x)[channel];
+			active[l] = 1.0f;
+			counts.Extend++;
+			return;
+		}
+	};
+
+	for (int l = 0; l < 8; ++l)
+	{
+		refillLane(l);
+		if (active[l] == 0.0f)
+		{
+			// Keep the inactive lanes finite.
+			ox[l] = oy[l] = oz[l] = dx[l] = dy[l] = t[l] = tMax[l] = 0.0f;
+			dz[l] = majorant[l] = maskR[l] = 1.0f;
+			maskG[l] = maskB[l] = 0.0f;
+		}
+	}
+
+	for (;;)
+	{
+		const bool8 laneActive = load8(active) > zero;
+		if (!any8(laneActive))
+		{
+			break;
+		}
+		const float8x3 P0 = { load8(ox), load8(oy), load8(oz) };
+		const float8x3 D = { load8(dx), load8(dy), load8(dz) };
+		const WavelengthMask8 mask = { load8(maskR), load8(maskG), load8(maskB) };
+		const float8 extinctionMajorant = load8(majorant);
+
+		const float8 t8 = load8(t) + select8(laneActive, rnd.nextExponential() / extinctionMajorant, zero);
+		const bool8 tracking = laneActive & (t8 < load8(tMax));
+		const float8x3 P1 = P0 + D * t8;
+		const PathMediumSample8 medium = sampleMedium8(ctx, mask, P1);
+		const float8 xi = rnd.next01();
+		const bool8 scatter = tracking & (xi <= medium.scattering / extinctionMajorant) & (medium.extinction > zero);
+		const bool8 absorb = tracking & !scatter & (xi < medium.extinction / extinctionMajorant);
+		const float8 zeta = rnd.next01();
+		store8(t, t8);
+
+		const int doneLanes = movemask8(laneActive & !(tracking & !(scatter | absorb)));
+		if (!doneLanes)
+		{
+			continue;
+		}
+		float px[8], py[8], pz[8], extinction[8], scattering[8], albedo[8], scatteringType[8];
+		store8(px, P1.x); store8(py, P1.y); store8(pz, P1.z);
+		store8(extinction, medium.extinction);
+		store8(scattering, medium.scattering);
+		store8(albedo, medium.albedo);
+		store8(scatteringType, select8(zeta < medium.scatteringMie / medium.scattering, splat8(D_SCATT_TYPE_MIE), splat8(D_SCATT_TYPE_RAY)));
+		const int scatterLanes = movemask8(scatter);
+		const int absorbLanes = movemask8(absorb);
+		for (int l = 0; l < 8; ++l)
+		{
+			if (!(doneLanes & (1 << l)))
+			{
+				continue;
+			}
+			const uint32 p = lanePaths[l];
+			paths.Samplers[p] = rnd.Lanes[l];
+			if (scatterLanes & (1 << l))
+			{
+				paths.setPosition(p, GlslVec3{ px[l], py[l], pz[l] });
+				paths.Extinction[p] = extinction[l];
+				paths.Scattering[p] = scattering[l];
+				paths.Albedo[p] = albedo[l];
+				paths.ScatteringType[p] = scatteringType[l];
+				paths.NextStage[p] = uint8_t(CpuWavefrontStageMediumEvent);
+			}
+			else if (absorbLanes & (1 << l))
+			{
+				// Absorption: no light and end of the path.
+				paths.Throughput[p] = 0.0f;
+				paths.NextStage[p] = uint8_t(CpuWavefrontStageAccumulate);
+			}
+			else
+			{
+				// Surface reached. Ground directly visible (not scattered before) ends the path for the ground to not show up.
+				const GlslVec3 D1 = { dx[l], dy[l], dz[l] };
+				const GlslVec3 rayO = GlslVec3{ ox[l], oy[l], oz[l] } + D1 * tMax[l] + D1 * RAYDPOS;
+				const bool bounce = surface[l] == D_INTERSECTION_GROUND && settings.GroundGlobalIllumination && paths.HasScattered[p]
+					&& paths.Depth[p] + 1 < uint32(settings.ScatteringMaxPathDepth);
+				if (bounce)
+				{
+					// Offset position to be always be the volume
+					paths.setPosition(p, rayO + normalize(rayO) * 0.025f);
+					paths.Depth[p]++;
+				}
+				paths.NextStage[p] = uint8_t(bounce ? CpuWavefrontStageGroundBounce : CpuWavefrontStageAccumulate);
+			}
+			refillLane(l);
+		}
+	}
+}
+
+// Sun transmittance from the scattering events and ground bounces of the queue. Delta and ratio tracking refill their lanes as the extend
+// stage does, a lane only drawing random numbers while its own path is tracking.
+static void wavefrontLightSample(const PathTracerContext& ctx, WavefrontPaths& paths, const uint32* queue, uint32 count, PathRayCounts& counts)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const CpuAtmosphereParameters& Atmosphere = ctx.Atmosphere;
+	const float8x3 sunDir = splat8x3(settings.SunDir);
+	counts.Shadow += count;
+	if (settings.TransmittanceMethod == CpuTransmittanceMethodLUT)
+	{
+		for (uint32 i = 0; i < count; i += 8)
+		{
+			WavefrontBatch8 batch(ctx, paths, queue + i, (std::min)(8u, count - i));
+			const float8x3 P = batch.load(paths.Px, paths.Py, paths.Pz);
+			batch.store(paths.SunTransmittance, transmittanceEstimation8(ctx, batch.Rnd, batch.Mask, batch.Majorant, batch.Valid, P, sunDir));
+		}
+		return;
+	}
+
+	const bool deltaTracking = settings.TransmittanceMethod == CpuTransmittanceMethodDeltaTracking;
+	const float8 zero = splat8(0.0f);
+	PathRandom8 rnd;
+	uint32 lanePaths[8];
+	float ox[8], oy[8], oz[8], t[8], distance[8], transmittance[8], majorant[8], maskR[8], maskG[8], maskB[8], active[8];
+	uint32 nextQueued = 0;
+
+	// Loads the next queued path whose sun ray does not hit the earth in lane l.
+	auto refillLane = [&](int l)
+	{
+		active[l] = 0.0f;
+		while (nextQueued < count)
+		{
+			const uint32 p = queue[nextQueued++];
+			const GlslVec3 P0 = paths.position(p) + settings.SunDir * RAYDPOS;
+			if (raySphereIntersectNearest(P0, settings.SunDir, GlslVec3{ 0.0f, 0.0f, 0.0f }, Atmosphere.BottomRadius) > 0.0f)
+			{
+				paths.SunTransmittance[p] = 0.0f;
+				continue;
+			}
+			const uint32 channel = paths.Channel[p];
+			lanePaths[l] = p;
+			rnd.Lanes[l] = paths.Samplers[p];
+			ox[l] = P0.x; oy[l] = P0.y; oz[l] = P0.z;
+			t[l] = 0.0f;
+			distance[l] = raySphereIntersectNearest(P0, settings.SunDir, GlslVec3{ 0.0f, 0.0f, 0.0f }, Atmosphere.TopRadius) * length(settings.SunDir);
+			transmittance[l] = 1.0f;
+			maskR[l] = channel == 0 ? 1.0f : 0.0f;
+			maskG[l] = channel == 1 ? 1.0f : 0.0f;
+			maskB[l] = channel == 2 ? 1.0f : 0.0f;
+			majorant[l] = (&ctx.ExtinctionMajorant.x)[channel];
+			active[l] = 1.0f;
+			return;
+		}
+	};
+
+	for (int l = 0; l < 8; ++l)
+	{
+		refillLane(l);
+		if (active[l] == 0.0f)
+		{
+			// Keep the inactive lanes finite.
+			ox[l] = oy[l] = oz[l] = t[l] = distance[l] = transmittance[l] = maskG[l] = maskB[l] = 0.0f;
+			majorant[l] = maskR[l] = 1.0f;
+		}
+	}
+
+	for (;;)
+	{
+		const bool8 laneActive = load8(active) > zero;
+		if (!any8(laneActive))
+		{
+			break;
+		}
+		const float8x3 P0 = { load8(ox), load8(oy), load8(oz) };
+		const WavelengthMask8 mask = { load8(maskR), load8(maskG), load8(maskB) };
+		const float8 extinctionMajorant = load8(majorant);
+
+		const float8 t8 = load8(t) + select8(laneActive, rnd.nextExponential() / extinctionMajorant, zero);
+		const bool8 tracking = laneActive & !(t8 > load8(distance));	// Did not terminate in the volume
+		const float8 extinction = sampleMedium8(ctx, mask, P0 + sunDir * t8).extinction;
+		float8 T = load8(transmittance);
+		bool8 done = laneActive & !tracking;
+		if (deltaTracking)
+		{
+			const bool8 terminate = tracking & (rnd.next01() < extinction / extinctionMajorant);
+			T = select8(terminate, zero, T);
+			done = done | terminate;
+		}
+		else
+		{
+			// Ratio tracking
+			T = select8(tracking, T * (1.0f - max8(zero, extinction / extinctionMajorant)), T);
+		}
+		store8(t, t8);
+		store8(transmittance, T);
+
+		const int doneLanes = movemask8(done);
+		for (int l = 0; l < 8; ++l)
+		{
+			if (doneLanes & (1 << l))
+			{
+				const uint32 p = lanePaths[l];
+				paths.SunTransmittance[p] = saturate(transmittance[l]);
+				paths.Samplers[p] = rnd.Lanes[l];
+				refillLane(l);
+			}
+		}
+	}
+}
+
+// Scattering events of the queue: lighting, then either the multiple scattering LUT ending the path or the next direction.
+static void wavefrontMediumEvent(const PathTracerContext& ctx, WavefrontPaths& paths, const uint32* queue, uint32 count)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const float8x3 sunDir = splat8x3(settings.SunDir);
+	for (uint32 i = 0; i < count; i += 8)
+	{
+		WavefrontBatch8 batch(ctx, paths, queue + i, (std::min)(8u, count - i));
+		const float8x3 P = batch.load(paths.Px, paths.Py, paths.Pz);
+		const float8x3 rayD = batch.load(paths.Dx, paths.Dy, paths.Dz);
+		const float8x3 V = { -rayD.x, -rayD.y, -rayD.z };
+		const float8 throughput = batch.load(paths.Throughput);
+		const float8 L = batch.load(paths.L);
+		const float8 ScatteringType = batch.load(paths.ScatteringType);
+		const float8 weight = batch.load(paths.Albedo) * batch.load(paths.Extinction) / batch.load(paths.Scattering);
+		const float8 beamTransmittance = batch.load(paths.SunTransmittance);
+		const float8 lightL = batch.Mask.select(settings.SunIlluminance);
+		const float8 bsdfL = phaseEvaluate8(ctx, ScatteringType == splat8(D_SCATT_TYPE_RAY), dot(sunDir, V));
+
+		int continueLanes = 0;
+		if (settings.MultiScatLut)
+		{
+			// We do not apply beamTransmittance to the multiple scattering, see the shader.
+			const float8 multiScatteredLuminance = sampleMultiScatLut8(ctx, batch.Mask, P, sunDir);
+			batch.store(paths.L, L + throughput * weight * lightL * (beamTransmittance * bsdfL + multiScatteredLuminance));
+		}
+		else
+		{
+			const float8 Lv = lightL * bsdfL * beamTransmittance;
+			batch.store(paths.L, L + weight * throughput * Lv);
+			const bool8 continuePath = batch.Valid & insideAnyVolume8(ctx, P + rayD * splat8(RAYDPOS));
+			continueLanes = movemask8(continuePath);
+			if (settings.MiePhaseImportanceSampling)
+			{
+				float8 phaseWeight;
+				const float8x3 newDirection = phaseGenerateSample8(ctx, batch.Rnd, V, ScatteringType, phaseWeight);
+				batch.store(paths.Dx, paths.Dy, paths.Dz, select8x3(continuePath, newDirection, rayD));
+				batch.store(paths.Throughput, select8(continuePath, throughput * phaseWeight, throughput));
+			}
+			else
+			{
+				batch.store(paths.Dx, paths.Dy, paths.Dz, select8x3(continuePath, batch.Rnd.nextUniformSphere(), rayD));	// Simple uniform distribution.
+			}
+			batch.storeSamplers(paths);
+		}
+
+		for (uint32 l = 0; l < batch.Count; ++l)
+		{
+			const uint32 p = batch.Paths[l];
+			const bool continuePath = (continueLanes & (1 << l)) && paths.Depth[p] + 1 < uint32(settings.ScatteringMaxPathDepth);
+			paths.HasScattered[p] |= settings.MultiScatLut || (continueLanes & (1 << l)) ? 1 : 0;
+			paths.Depth[p] += continuePath ? 1 : 0;
+			paths.NextStage[p] = uint8_t(continuePath ? CpuWavefrontStageExtend : CpuWavefrontStageAccumulate);
+		}
+	}
+}
+
+// Ground bounces of the queue: diffuse sun lighting and next direction.
+static void wavefrontGroundBounce(const PathTracerContext& ctx, WavefrontPaths& paths, const uint32* queue, uint32 count)
+{
+	const CpuPathTracingSettings& settings = *ctx.Settings;
+	const float8x3 sunDir = splat8x3(settings.SunDir);
+	for (uint32 i = 0; i < count; i += 8)
+	{
+		WavefrontBatch8 batch(ctx, paths, queue + i, (std::min)(8u, count - i));
+		const float8x3 P = batch.load(paths.Px, paths.Py, paths.Pz);
+		const float8x3 UpVector = P / length(P);
+		const float8 throughput = batch.load(paths.Throughput);
+
+		batch.store(paths.Dx, paths.Dy, paths.Dz, groundBounceDirection8(batch.Rnd, UpVector));
+		batch.storeSamplers(paths);
+
+		const float8 NdotL = saturate8(dot(UpVector, sunDir));
+		const float8 albedo = saturate8(batch.Mask.select(ctx.Atmosphere.GroundAlbedo));
+		const float8 DiffuseEval = albedo * (1.0f / PI);
+		const float8 lightL = batch.Mask.select(settings.SunIlluminance);
+		batch.store(paths.L, batch.load(paths.L) + throughput * batch.load(paths.SunTransmittance) * (DiffuseEval * NdotL * lightL));
+		batch.store(paths.Throughput, throughput * DiffuseEval);
+		for (uint32 l = 0; l < batch.Count; ++l)
+		{
+			paths.NextStage[batch.Paths[l]] = uint8_t(CpuWavefrontStageExtend);
+		}
+	}
+}
+
+void renderPathTracingWavefront(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	const CpuWavefrontSettings& wavefront, CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuPathTracingStats* outStats,
+	CpuWavefrontStats* outWavefrontStats)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const auto startTime = Clock::now();
+	PathTracerContext ctx;
+	initPathTracerContext(info, TransmittanceLut, settings, ctx);
+
+	const uint32 PixelCount = settings.Width * settings.Height;
+	const uint32 WavefrontSize = (std::min)(PixelCount, (std::max)(1u, wavefront.WavefrontSize));
+	const uint32 PathsPerTask = (std::max)(8u, wavefront.PathsPerTask);
+	WavefrontPaths paths;
+	paths.resize(WavefrontSize);
+	std::vector<float> sumL(PixelCount * 3, 0.0f);
+	std::vector<float> sumTransmittance(PixelCount * 3, 0.0f);
+	std::vector<uint32> extendQueue, nextExtendQueue, shadowQueue, mediumQueue, groundQueue, accumulateQueue;
+	std::atomic<uint64_t> extendRayCount(0);
+	std::atomic<uint64_t> shadowRayCount(0);
+	CpuWavefrontStats stats;
+
+	// Runs a stage over a queue, PathsPerTask paths per task.
+	auto runStage = [&](CpuWavefrontStage stage, const std::vector<uint32>& queue, const std::function<void(const uint32*, uint32, PathRayCounts&)>& fn)
+	{
+		const auto stageStart = Clock::now();
+		const uint32 count = uint32(queue.size());
+		pool.parallelFor((count + PathsPerTask - 1) / PathsPerTask, [&](uint32 taskIndex)
+		{
+			const uint32 begin = taskIndex * PathsPerTask;
+			PathRayCounts counts;
+			fn(queue.data() + begin, (std::min)(PathsPerTask, count - begin), counts);
+			extendRayCount += counts.Extend;
+			shadowRayCount += counts.Shadow;
+		});
+		stats.StageSeconds[stage] += std::chrono::duration<double>(Clock::now() - stageStart).count();
+	};
+	// Sorts the paths of a queue in the queues of their next stage.
+	auto sortPaths = [&](const std::vector<uint32>& queue)
+	{
+		const auto sortStart = Clock::now();
+		for (uint32 p : queue)
+		{
+			switch (CpuWavefrontStage(paths.NextStage[p]))
+			{
+			case CpuWavefrontStageExtend:		nextExtendQueue.push_back(p); break;
+			case CpuWavefrontStageMediumEvent:	mediumQueue.push_back(p); shadowQueue.push_back(p); break;
+			case CpuWavefrontStageGroundBounce:	groundQueue.push_back(p); shadowQueue.push_back(p); break;
+			default:							accumulateQueue.push_back(p); break;
+			}
+		}
+		stats.StageSeconds[CpuWavefrontStageQueues] += std::chrono::duration<double>(Clock::now() - sortStart).count();
+	};
+
+	for (uint32 firstPixel = 0; firstPixel < PixelCount; firstPixel += WavefrontSize)
+	{
+		const uint32 pathCount = (std::min)(WavefrontSize, PixelCount - firstPixel);
+		for (uint32 s = settings.FirstSampleIndex; s < settings.FirstSampleIndex + settings.SamplesPerPixel; ++s)
+		{
+			const auto generateStart = Clock::now();
+			pool.parallelFor((pathCount + PathsPerTask - 1) / PathsPerTask, [&](uint32 taskIndex)
+			{
+				const uint32 begin = taskIndex * PathsPerTask;
+				wavefrontGenerate(ctx, paths, firstPixel, s, begin, (std::min)(pathCount, begin + PathsPerTask));
+			});
+			stats.StageSeconds[CpuWavefrontStageGenerate] += std::chrono::duration<double>(Clock::now() - generateStart).count();
+
+			extendQueue.resize(pathCount);
+			for (uint32 p = 0; p < pathCount; ++p)
+			{
+				extendQueue[p] = p;
+			}
+			accumulateQueue.clear();
+			nextExtendQueue.clear();
+			sortPaths(extendQueue);
+			extendQueue.swap(nextExtendQueue);
+
+			while (!extendQueue.empty())
+			{
+				runStage(CpuWavefrontStageExtend, extendQueue, [&](const uint32* queue, uint32 count, PathRayCounts& counts) { wavefrontExtend(ctx, paths, queue, count, counts); });
+				stats.BounceCount++;
+
+				nextExtendQueue.clear();
+				shadowQueue.clear();
+				mediumQueue.clear();
+				groundQueue.clear();
+				sortPaths(extendQueue);
+
+				runStage(CpuWavefrontStageLightSample, shadowQueue, [&](const uint32* queue, uint32 count, PathRayCounts& counts) { wavefrontLightSample(ctx, paths, queue, count, counts); });
+				runStage(CpuWavefrontStageMediumEvent, mediumQueue, [&](const uint32* queue, uint32 count, PathRayCounts&) { wavefrontMediumEvent(ctx, paths, queue, count); });
+				runStage(CpuWavefrontStageGroundBounce, groundQueue, [&](const uint32* queue, uint32 count, PathRayCounts&) { wavefrontGroundBounce(ctx, paths, queue, count); });
+
+				shadowQueue.clear();
+				mediumQueue.swap(shadowQueue);
+				shadowQueue.insert(shadowQueue.end(), groundQueue.begin(), groundQueue.end());
+				mediumQueue.clear();
+				groundQueue.clear();
+				sortPaths(shadowQueue);
+				extendQueue.swap(nextExtendQueue);
+			}
+
+			// Each path of the wavefront is a different pixel, so tasks never add to the same pixel.
+			runStage(CpuWavefrontStageAccumulate, accumulateQueue, [&](const uint32* queue, uint32 count, PathRayCounts&)
+			{
+				for (uint32 i = 0; i < count; ++i)
+				{
+					const uint32 p = queue[i];
+					const uint32 texel = paths.Pixel[p] * 3 + paths.Channel[p];
+					sumL[texel] += paths.L[p] * 3.0f;	// wavelength pdf is 1/3
+					sumTransmittance[texel] += paths.HasScattered[p] ? 0.0f : paths.Throughput[p] * 3.0f;	// Only known while the path has not scattered
+				}
+			});
+			stats.WavefrontCount++;
+		}
+	}
+
+	outLuminance.Allocate(settings.Width, settings.Height);
+	outTransmittance.Allocate(settings.Width, settings.Height);
+	const float InvSampleCount = 1.0f / float((std::max)(1u, settings.SamplesPerPixel));
+	for (uint32 pixelIndex = 0; pixelIndex < PixelCount; ++pixelIndex)
+	{
+		float* luminance = outLuminance.texel(pixelIndex % settings.Width, pixelIndex / settings.Width);
+		float* transmittance = outTransmittance.texel(pixelIndex % settings.Width, pixelIndex / settings.Width);
+		for (int c = 0; c < 3; ++c)
+		{
+			luminance[c] = sumL[pixelIndex * 3 + c] * InvSampleCount;
+			transmittance[c] = sumTransmittance[pixelIndex * 3 + c] * InvSampleCount;
+		}
+		luminance[3] = 1.0f;
+		transmittance[3] = 1.0f;
+	}
+
+	if (outStats)
+	{
+		outStats->Seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+		outStats->PathCount = uint64_t(PixelCount) * settings.SamplesPerPixel;
+		outStats->ExtendRayCount = extendRayCount;
+		outStats->ShadowRayCount = shadowRayCount;
+	}
+	if (outWavefrontStats)
+	{
+		*outWavefrontStats = stats;
+	}
+}
+
+
+
+float pathTracingRelativeError(const float sum[3], const float sumSquared[3], uint32 sampleCount)
+{
+	const float cycleCount = float(sampleCount / 3);
+	float maxStandardError = 0.0f;
+	float maxMean = 0.0f;
+	for (int c = 0; c < 3; ++c)
+	{
+		const float mean = sum[c] / float(sampleCount);
+		const float variance = (std::max)(0.0f, sumSquared[c] - cycleCount * mean * mean) / (cycleCount - 1.0f);
+		maxStandardError = (std::max)(maxStandardError, sqrtf(variance / cycleCount));
+		maxMean = (std::max)(maxMean, mean);
+	}
+	return maxStandardError / (std::max)(1e-6f, maxMean);
+}
+
+void renderPathTracingAdaptive(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	const CpuAdaptivePathTracingSettings& adaptive, CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuAdaptivePathTracingStats& outStats)
+{
+	PathTracerContext ctx;
+	initPathTracerContext(info, TransmittanceLut, settings, ctx);
+
+	const uint32 TileSize = CPU_PATH_TRACING_TILE_SIZE;
+	const uint32 PacketsPerTileRow = TileSize / 8;
+	const uint32 TilesX = (settings.Width + TileSize - 1) / TileSize;
+	const uint32 TilesY = (settings.Height + TileSize - 1) / TileSize;
+	const uint32 TileCount = TilesX * TilesY;
+	const uint32 PixelCount = settings.Width * settings.Height;
+	const uint32 SamplesPerRound = (std::max)(3u, adaptive.SamplesPerRound / 3 * 3);
+	const uint32 MaxSamplesPerPixel = (std::max)(3u, settings.SamplesPerPixel / 3 * 3);	// Whole cycles, so that the last round is tested too
+
+	// Per pixel sums, as in the accumulation buffers of the application. All the pixels of a tile have the same sample count.
+	// sumLSquared accumulates unweighted squared samples, see pathTracingRelativeError.
+	std::vector<float> sumL(PixelCount * 3, 0.0f);
+	std::vector<float> sumLSquared(PixelCount * 3, 0.0f);
+	std::vector<float> sumTransmittance(PixelCount * 3, 0.0f);
+	std::vector<uint32> tileSampleCount(TileCount, 0);
+	std::vector<uint32> tileConverged(TileCount, 0);
+	std::vector<uint32> activeTiles;
+	activeTiles.reserve(TileCount);
+
+	outStats = CpuAdaptivePathTracingStats();
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	for (uint32 firstSample = 0; firstSample < MaxSamplesPerPixel; firstSample += SamplesPerRound)
+	{
+		const uint32 roundSampleCount = (std::min)(SamplesPerRound, MaxSamplesPerPixel - firstSample);
+		activeTiles.clear();
+		for (uint32 t = 0; t < TileCount; ++t)
+		{
+			if (!adaptive.SkipConvergedTiles || !tileConverged[t])
+			{
+				activeTiles.push_back(t);
+			}
+		}
+		if (activeTiles.empty())
+		{
+			break;
+		}
+
+		pool.parallelFor(uint32(activeTiles.size()) * TileSize * PacketsPerTileRow, [&](uint32 taskIndex)
+		{
+			const uint32 tile = activeTiles[taskIndex / (TileSize * PacketsPerTileRow)];
+			const uint32 packetInTile = taskIndex % (TileSize * PacketsPerTileRow);
+			const uint32 x0 = (tile % TilesX) * TileSize + (packetInTile % PacketsPerTileRow) * 8;
+			const uint32 y = (tile / TilesX) * TileSize + packetInTile / PacketsPerTileRow;
+			if (x0 >= settings.Width || y >= settings.Height)
+			{
+				return;
+			}
+
+			const float8 zero = splat8(0.0f);
+			float8 roundL[3] = { zero, zero, zero };
+			float8 roundLSquared[3] = { zero, zero, zero };
+			float8 roundTransmittance[3] = { zero, zero, zero };
+			const float8 invWavelengthWeight = splat8(1.0f / 3.0f);
+			PathRayCounts counts;
+			for (uint32 s = firstSample; s < firstSample + roundSampleCount; ++s)
+			{
+				float8 L[3], transmittance[3];
+				lightIntegratorInner8(ctx, x0, y, settings.FirstSampleIndex + s, 8, L, transmittance, counts);
+				for (int c = 0; c < 3; ++c)
+				{
+					roundL[c] = roundL[c] + L[c];
+					const float8 unweightedL = L[c] * invWavelengthWeight;
+					roundLSquared[c] = roundLSquared[c] + unweightedL * unweightedL;
+					roundTransmittance[c] = roundTransmittance[c] + transmittance[c];
+				}
+			}
+
+			float L[3][8], LSquared[3][8], transmittance[3][8];
+			for (int c = 0; c < 3; ++c)
+			{
+				store8(L[c], roundL[c]);
+				store8(LSquared[c], roundLSquared[c]);
+				store8(transmittance[c], roundTransmittance[c]);
+			}
+			for (uint32 l = 0; l < 8 && x0 + l < settings.Width; ++l)
+			{
+				const uint32 pixelIndex = y * settings.Width + x0 + l;
+				for (int c = 0; c < 3; ++c)
+				{
+					sumL[pixelIndex * 3 + c] += L[c][l];
+					sumLSquared[pixelIndex * 3 + c] += LSquared[c][l];
+					sumTransmittance[pixelIndex * 3 + c] += transmittance[c][l];
+				}
+			}
+		});
+
+		// Convergence test, same criterion as PathTracingConvergencePS.
+		for (uint32 tile : activeTiles)
+		{
+			tileSampleCount[tile] += roundSampleCount;
+			outStats.SampleCount += uint64_t(roundSampleCount) * (std::min)(TileSize, settings.Width - (tile % TilesX) * TileSize) * (std::min)(TileSize, settings.Height - (tile / TilesX) * TileSize);
+
+			const uint32 n = tileSampleCount[tile];
+			bool converged = n >= CPU_PATH_TRACING_MIN_SAMPLES && (n % 3) == 0;
+			const uint32 xEnd = (std::min)(settings.Width, (tile % TilesX + 1) * TileSize);
+			const uint32 yEnd = (std::min)(settings.Height, (tile / TilesX + 1) * TileSize);
+			for (uint32 y = (tile / TilesX) * TileSize; converged && y < yEnd; ++y)
+			{
+				for (uint32 x = (tile % TilesX) * TileSize; converged && x < xEnd; ++x)
+				{
+					const uint32 pixelIndex = y * settings.Width + x;
+					converged = pathTracingRelativeError(&sumL[pixelIndex * 3], &sumLSquared[pixelIndex * 3], n) <= adaptive.TargetRelativeError;
+				}
+			}
+			tileConverged[tile] = converged ? 1 : 0;
+		}
+		outStats.Rounds++;
+
+		uint32 convergedTileCount = 0;
+		for (uint32 t = 0; t < TileCount; ++t)
+		{
+			convergedTileCount += tileConverged[t];
+		}
+		outStats.ConvergedTileRatio = float(convergedTileCount) / float(TileCount);
+		if (convergedTileCount == TileCount)
+		{
+			outStats.TargetReached = true;
+			break;
+		}
+	}
+	outStats.Seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	outLuminance.Allocate(settings.Width, settings.Height);
+	outTransmittance.Allocate(settings.Width, settings.Height);
+	for (uint32 y = 0; y < settings.Height; ++y)
+	{
+		for (uint32 x = 0; x < settings.Width; ++x)
+		{
+			const uint32 pixelIndex = y * settings.Width + x;
+			const float invSampleCount = 1.0f / float((std::max)(1u, tileSampleCount[(y / TileSize) * TilesX + x / TileSize]));
+			float* luminance = outLuminance.texel(x, y);
+			float* transmittance = outTransmittance.texel(x, y);
+			for (int c = 0; c < 3; ++c)
+			{
+				luminance[c] = sumL[pixelIndex * 3 + c] * invSampleCount;
+				transmittance[c] = sumTransmittance[pixelIndex * 3 + c] * invSampleCount;
+			}
+			luminance[3] = 1.0f;
+			transmittance[3] = 1.0f;
+		}
+	}
+}
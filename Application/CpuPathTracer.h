@@ -0,0 +1,155 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSampler.h"
+#include "CpuSkyAtmosphere.h"
+#include "CpuThreadPool.h"
+
+// CPU port of the RenderSkyPathTracing.hlsl ground truth: LightIntegratorInner with delta tracking, the three
+// TRANSMITANCE_METHOD estimators and phaseGenerateSample. It produces reference images without a GPU.
+// Paths are traced as packets of 8 horizontally adjacent pixels, one SIMD lane per pixel. Lanes follow their own path
+// and the packet keeps going while one of them is alive. Packets are spread over the pool threads.
+// Random numbers only depend on the sampler, the pixel, the sample index and the seed, so images do not depend on the thread count.
+// Not supported: depth buffer, shadow map and sun disk (as when capturing a screenshot in the application).
+
+enum CpuTransmittanceMethod
+{
+	CpuTransmittanceMethodDeltaTracking = 0,	// Same values as Game::TransmittanceMethod and TRANSMITANCE_METHOD
+	CpuTransmittanceMethodRatioTracking,
+	CpuTransmittanceMethodLUT,
+};
+
+// Same camera model as Game::render: perspective with a vertical field of view, z up.
+struct CpuPathTracingCamera
+{
+	GlslVec3 WorldPos;		// Kilometers, ground at z = 0
+	GlslVec3 ViewDir;		// Normalized
+	float VerticalFovDegrees = 66.6f;
+};
+
+// Camera and sun direction as computed from the application UI values (view angles in degrees, sun angles in radians).
+CpuPathTracingCamera getGameCamera(float viewYaw, float viewPitch, float camHeight, float camForward);
+GlslVec3 getGameSunDirection(float sunPitch, float sunYaw);
+
+struct CpuPathTracingSettings
+{
+	uint32 Width = 640;
+	uint32 Height = 360;
+	uint32 SamplesPerPixel = 64;
+	uint32 FirstSampleIndex = 0;		// Renders samples [FirstSampleIndex, FirstSampleIndex + SamplesPerPixel), e.g. to refine an image progressively
+	uint32 Seed = 0;
+	CpuSamplerType Sampler = CpuSamplerSobolOwen;	// Game::currentSamplerPermutation default
+
+	CpuPathTracingCamera Camera;
+	GlslVec3 SunDir;
+	GlslVec3 SunIlluminance = { 1.0f, 1.0f, 1.0f };
+
+	int ScatteringMaxPathDepth = 4;											// gScatteringMaxPathDepth
+	CpuTransmittanceMethod TransmittanceMethod = CpuTransmittanceMethodLUT;	// Game::currentTransPermutation default
+	bool GroundGlobalIllumination = false;									// GROUND_GI_ENABLED
+	bool MiePhaseImportanceSampling = false;								// MIE_PHASE_IMPORTANCE_SAMPLING
+
+	// MULTISCATAPPROX_ENABLED when set: the first scattering event adds the multiple scattering LUT contribution and ends the path.
+	const CpuLut2D* MultiScatLut = nullptr;
+
+	// Pixels of a renderPathTracing packet, up to 8. 1 traces one path at a time: the per path baseline of bench-wavefront-pathtracing.
+	uint32 PacketLaneCount = 8;
+};
+
+// Path and ray counts of a render. An extend ray goes from a path vertex to the next medium event or surface, a shadow ray
+// estimates the sun transmittance from a scattering event or a ground bounce.
+struct CpuPathTracingStats
+{
+	double Seconds = 0.0;
+	uint64_t PathCount = 0;
+	uint64_t ExtendRayCount = 0;
+	uint64_t ShadowRayCount = 0;
+};
+
+// Accumulates SamplesPerPixel paths per pixel, each carrying a single wavelength as the shader does.
+// outLuminance is the mean luminance and outTransmittance the mean view ray transmittance, both with alpha set to 1.
+// TransmittanceLut is required by CpuTransmittanceMethodLUT only.
+void renderPathTracing(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuPathTracingStats* outStats = nullptr);
+
+
+
+// Wavefront path tracing: the same estimator as renderPathTracing, LightIntegratorInner being split in stages. Paths are stored as
+// structures of arrays and each stage runs on a queue holding only the paths waiting for it, 8 paths at a time, so that the SIMD lanes
+// share the same work instead of following divergent branches:
+// - Generate: camera rays of WavefrontSize paths, one sample of as many consecutive pixels.
+// - Extend: delta tracking to the next medium event or surface. A lane reaching its event is refilled with the next path of the queue.
+// - Light sample: sun transmittance from the scattering events and the ground bounces.
+// - Medium event: phase function, multiple scattering LUT and next direction.
+// - Ground bounce: diffuse ground lighting and next direction (GROUND_GI_ENABLED).
+// - Accumulate: terminated paths added to their pixel.
+// After each stage the paths are sorted in queues by their next stage. Stage queues are split in tasks of PathsPerTask paths spread over
+// the pool threads. Each path only draws random numbers for itself, so images do not depend on the thread count nor on the wavefront
+// size and match renderPathTracing with PacketLaneCount = 1. Packets of 8 lanes differ as their lanes draw together.
+enum CpuWavefrontStage
+{
+	CpuWavefrontStageGenerate = 0,
+	CpuWavefrontStageExtend,
+	CpuWavefrontStageLightSample,
+	CpuWavefrontStageMediumEvent,
+	CpuWavefrontStageGroundBounce,
+	CpuWavefrontStageAccumulate,
+	CpuWavefrontStageQueues,			// Sorting the paths in the stage queues
+	CpuWavefrontStageCount
+};
+
+const char* getWavefrontStageName(CpuWavefrontStage stage);
+
+struct CpuWavefrontSettings
+{
+	uint32 WavefrontSize = 1 << 16;		// Paths in flight
+	uint32 PathsPerTask = 256;
+};
+
+struct CpuWavefrontStats
+{
+	double StageSeconds[CpuWavefrontStageCount] = {};
+	uint32 WavefrontCount = 0;
+	uint32 BounceCount = 0;				// Extend stages run over all the wavefronts
+};
+
+void renderPathTracingWavefront(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	const CpuWavefrontSettings& wavefront, CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuPathTracingStats* outStats = nullptr,
+	CpuWavefrontStats* outWavefrontStats = nullptr);
+
+
+
+// Adaptive sampling, as done by the application when "Adaptive sampling" is enabled: pixels are grouped in tiles and a tile
+// stops receiving samples once all its pixels reach the target relative error (see PathTracingConvergencePS).
+// Samples are added in rounds, the convergence being tested after each round instead of after each frame.
+#define CPU_PATH_TRACING_TILE_SIZE 16		// Same as PATH_TRACING_TILE_SIZE, a multiple of 8
+// Minimum sample count before the variance of a pixel is trusted, also used by the application (gPathTracingMinSamples): 16 cycles of
+// the 3 wavelengths, so that pixels whose first few samples all missed a rare light path are not stopped with an error of 0.
+#define CPU_PATH_TRACING_MIN_SAMPLES 48
+
+struct CpuAdaptivePathTracingSettings
+{
+	float TargetRelativeError = 0.1f;		// gPathTracingTargetRelativeError
+	uint32 SamplesPerRound = 24;			// Rounded down to a multiple of 3 so that all wavelengths get the same sample count
+	bool SkipConvergedTiles = true;			// When false, all tiles are sampled until the last one converges: the uniform sampling baseline
+};
+
+struct CpuAdaptivePathTracingStats
+{
+	double Seconds = 0.0;
+	uint64_t SampleCount = 0;					// Paths traced over the whole image
+	uint32 Rounds = 0;
+	float ConvergedTileRatio = 0.0f;
+	bool TargetReached = false;				// False when settings.SamplesPerPixel was reached first
+};
+
+// Standard error of a pixel mean relative to its brightest channel. A sample only carries one wavelength, so the variance is that of
+// the estimates of whole cycles of 3 samples: sum is the sum of the (wavelength weighted) samples, sumSquared the sum of the squared
+// unweighted samples, i.e. of the squared cycle estimates, and sampleCount a multiple of 3.
+float pathTracingRelativeError(const float sum[3], const float sumSquared[3], uint32 sampleCount);
+
+// Renders up to settings.SamplesPerPixel (rounded down to a multiple of 3) samples per pixel, stopping when all tiles converged. Each pixel is the mean of the samples of its tile.
+void renderPathTracingAdaptive(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuPathTracingSettings& settings,
+	const CpuAdaptivePathTracingSettings& adaptive, CpuLut2D& outLuminance, CpuLut2D& outTransmittance, CpuAdaptivePathTracingStats& outStats);
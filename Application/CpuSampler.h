@@ -0,0 +1,189 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+// CPU mirror of Resources/RenderSkySampling.hlsl plus the SAMPLER_HASH random01 of RenderSkyPathTracing.hlsl,
+// so that the CPU path tracer draws the same sequences as the shader.
+
+#include <cstdint>
+#include "SkyAtmosphereCommon.h"
+
+enum CpuSamplerType
+{
+	CpuSamplerHash = 0,			// Same values as Game::SamplerHash and SAMPLER_TYPE
+	CpuSamplerSobolOwen,
+	CpuSamplerRank1Lattice,
+	CpuSamplerIndependent,		// CPU only: one PCG stream per pixel and sample, the baseline for convergence measurements
+	CpuSamplerCount
+};
+
+#define RANK1_LATTICE_GENERATOR 17939u	// Same as RenderSkySampling.hlsl
+
+
+
+inline uint32 reverseBits32(uint32 x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+inline uint32 samplerHash(uint32 x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+inline uint32 samplerHashCombine(uint32 seed, uint32 v)
+{
+	return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+inline uint32 laineKarrasPermutation(uint32 x, uint32 seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+inline uint32 nestedUniformScramble(uint32 x, uint32 seed)
+{
+	return reverseBits32(laineKarrasPermutation(reverseBits32(x), seed));
+}
+
+inline uint32 sobolDimension1(uint32 index)
+{
+	uint32 result = 0;
+	for (uint32 v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+	{
+		result ^= (index & 1) ? v : 0;
+	}
+	return result;
+}
+
+inline float samplerToFloat(uint32 x)
+{
+	return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float sampleSobolOwen1D(uint32 sampleIndex, uint32 seed)
+{
+	const uint32 index = nestedUniformScramble(sampleIndex, seed);
+	return samplerToFloat(nestedUniformScramble(reverseBits32(index), samplerHashCombine(seed, 1)));
+}
+
+inline void sampleSobolOwen2D(uint32 sampleIndex, uint32 seed, float& u, float& v)
+{
+	const uint32 index = nestedUniformScramble(sampleIndex, seed);
+	u = samplerToFloat(nestedUniformScramble(reverseBits32(index), samplerHashCombine(seed, 1)));
+	v = samplerToFloat(nestedUniformScramble(sobolDimension1(index), samplerHashCombine(seed, 2)));
+}
+
+inline float sampleRank1Lattice1D(uint32 sampleIndex, uint32 seed)
+{
+	const uint32 index = nestedUniformScramble(sampleIndex, seed);
+	return samplerToFloat(reverseBits32(index) + samplerHash(samplerHashCombine(seed, 1)));
+}
+
+inline void sampleRank1Lattice2D(uint32 sampleIndex, uint32 seed, float& u, float& v)
+{
+	const uint32 index = nestedUniformScramble(sampleIndex, seed);
+	const uint32 phi = reverseBits32(index);
+	u = samplerToFloat(phi + samplerHash(samplerHashCombine(seed, 1)));
+	v = samplerToFloat(phi * RANK1_LATTICE_GENERATOR + samplerHash(samplerHashCombine(seed, 2)));
+}
+
+// whangHashNoise from RenderSkyCommon.hlsl
+inline float whangHashNoise(uint32 u, uint32 v, uint32 s)
+{
+	uint32 seed = (u * 1664525u + v) + s;
+	seed = (seed ^ 61u) ^ (seed >> 16u);
+	seed *= 9u;
+	seed = seed ^ (seed >> 4u);
+	seed *= 0x27d4eb2du;
+	seed = seed ^ (seed >> 15u);
+	return float(seed) / 4294967296.0f;
+}
+
+
+
+// Random numbers for one path. frameIndex plays the role of gFrameId: the n-th sample accumulated in a pixel.
+struct CpuPathSampler
+{
+	CpuSamplerType Type = CpuSamplerSobolOwen;
+	uint32 PixelX = 0;
+	uint32 PixelY = 0;
+	uint32 FrameIndex = 0;
+	uint32 SampleIndex = 0;		// Low discrepancy sequence index
+	uint32 PixelSeed = 0;
+	uint32 SampleDimension = 0;
+	float RandomState = 0.0f;	// CpuSamplerHash state
+	uint64_t PcgState = 0;		// CpuSamplerIndependent state
+
+	void init(CpuSamplerType type, uint32 x, uint32 y, uint32 width, uint32 frameIndex, uint32 seed)
+	{
+		Type = type;
+		PixelX = x;
+		PixelY = y;
+		FrameIndex = frameIndex;
+		SampleIndex = frameIndex / 3;	// The wavelength cycles over 3 frames: each one sees consecutive sequence indices.
+		PixelSeed = samplerHash((x + y * width) ^ samplerHash(seed));
+		SampleDimension = 0;
+		RandomState = (float(x) + float(y) * float(width)) + float(uint32(frameIndex * 123u) % 32768u);
+		PcgState = (uint64_t(samplerHash(PixelSeed + frameIndex)) << 32) | samplerHashCombine(PixelSeed, frameIndex);
+	}
+
+	float get1D()
+	{
+		switch (Type)
+		{
+		case CpuSamplerHash:
+		{
+			const float rnd = whangHashNoise(uint32(RandomState), PixelX, PixelY);
+			RandomState += float(FrameIndex * 1280);
+			return rnd;
+		}
+		case CpuSamplerSobolOwen:
+			return sampleSobolOwen1D(SampleIndex, samplerHashCombine(PixelSeed, SampleDimension++));
+		case CpuSamplerRank1Lattice:
+			return sampleRank1Lattice1D(SampleIndex, samplerHashCombine(PixelSeed, SampleDimension++));
+		default:
+		{
+			// PCG-XSH-RR
+			const uint64_t state = PcgState;
+			PcgState = state * 6364136223846793005ull + 1442695040888963407ull;
+			const uint32 xorShifted = uint32(((state >> 18u) ^ state) >> 27u);
+			const uint32 rot = uint32(state >> 59u);
+			return samplerToFloat((xorShifted >> rot) | (xorShifted << ((32u - rot) & 31u)));
+		}
+		}
+	}
+
+	void get2D(float& u, float& v)
+	{
+		switch (Type)
+		{
+		case CpuSamplerSobolOwen:
+			sampleSobolOwen2D(SampleIndex, samplerHashCombine(PixelSeed, SampleDimension++), u, v);
+			break;
+		case CpuSamplerRank1Lattice:
+			sampleRank1Lattice2D(SampleIndex, samplerHashCombine(PixelSeed, SampleDimension++), u, v);
+			break;
+		default:
+			u = get1D();
+			v = get1D();
+			break;
+		}
+	}
+};
+
@@ -0,0 +1,178 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+// Minimal 8-wide float vector used by the CPU atmosphere code.
+// When compiling with AVX2 (/arch:AVX2 or -mavx2), a float8 maps onto a single ymm register.
+// Otherwise it falls back to plain arrays that compilers can still auto-vectorize.
+// Both paths use the same operation order and never call FMA explicitly. Compilers may still contract multiply-adds (e.g. GCC's
+// default -ffp-contract=fast with -mfma), so results for the same input can differ by a few ulps across instruction sets and
+// compilers: compare them with a tolerance (see compare-transmittance), only results of the same build are bit-identical.
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SIMD_AVX2 1
+#else
+#define CPU_SIMD_AVX2 0
+#endif
+
+#define CPU_SIMD_WIDTH 8
+
+#if CPU_SIMD_AVX2
+
+struct float8
+{
+	__m256 v;
+};
+
+struct bool8
+{
+	__m256 v;
+};
+
+inline float8 splat8(float a)							{ return { _mm256_set1_ps(a) }; }
+inline float8 load8(const float* p)					{ return { _mm256_loadu_ps(p) }; }
+inline void   store8(float* p, float8 a)				{ _mm256_storeu_ps(p, a.v); }
+
+inline float8 operator+(float8 a, float8 b)			{ return { _mm256_add_ps(a.v, b.v) }; }
+inline float8 operator-(float8 a, float8 b)			{ return { _mm256_sub_ps(a.v, b.v) }; }
+inline float8 operator*(float8 a, float8 b)			{ return { _mm256_mul_ps(a.v, b.v) }; }
+inline float8 operator/(float8 a, float8 b)			{ return { _mm256_div_ps(a.v, b.v) }; }
+inline float8 operator-(float8 a)						{ return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) }; }
+
+inline float8 min8(float8 a, float8 b)					{ return { _mm256_min_ps(a.v, b.v) }; }
+inline float8 max8(float8 a, float8 b)					{ return { _mm256_max_ps(a.v, b.v) }; }
+inline float8 sqrt8(float8 a)							{ return { _mm256_sqrt_ps(a.v) }; }
+inline float8 floor8(float8 a)							{ return { _mm256_floor_ps(a.v) }; }
+inline float8 abs8(float8 a)							{ return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+
+inline bool8 operator<(float8 a, float8 b)				{ return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline bool8 operator<=(float8 a, float8 b)			{ return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline bool8 operator>(float8 a, float8 b)				{ return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline bool8 operator>=(float8 a, float8 b)			{ return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline bool8 operator==(float8 a, float8 b)			{ return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+inline bool8 operator&(bool8 a, bool8 b)				{ return { _mm256_and_ps(a.v, b.v) }; }
+inline bool8 operator|(bool8 a, bool8 b)				{ return { _mm256_or_ps(a.v, b.v) }; }
+inline bool8 operator!(bool8 a)							{ return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+
+// Returns a where mask is set, b otherwise.
+inline float8 select8(bool8 mask, float8 a, float8 b)	{ return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+inline int    movemask8(bool8 a)						{ return _mm256_movemask_ps(a.v); }
+
+// Loads base[index] for each lane, index being integral values stored as float.
+inline float8 gather8(const float* base, float8 index)	{ return { _mm256_i32gather_ps(base, _mm256_cvttps_epi32(index.v), 4) }; }
+
+// Multiplies x by 2^n, n being integral values stored as float.
+inline float8 ldexp8(float8 x, float8 n)
+{
+	__m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127)), 23);
+	return { _mm256_mul_ps(x.v, _mm256_castsi256_ps(e)) };
+}
+
+#else // CPU_SIMD_AVX2
+
+struct float8
+{
+	float v[8];
+};
+
+struct bool8
+{
+	uint32_t v[8];
+};
+
+#define CPU_SIMD_LOOP(Expr) for (int l = 0; l < 8; ++l) { Expr; }
+
+inline float8 splat8(float a)							{ float8 r; CPU_SIMD_LOOP(r.v[l] = a); return r; }
+inline float8 load8(const float* p)					{ float8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void   store8(float* p, float8 a)				{ memcpy(p, a.v, sizeof(a.v)); }
+
+inline float8 operator+(float8 a, float8 b)			{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] + b.v[l]); return r; }
+inline float8 operator-(float8 a, float8 b)			{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] - b.v[l]); return r; }
+inline float8 operator*(float8 a, float8 b)			{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] * b.v[l]); return r; }
+inline float8 operator/(float8 a, float8 b)			{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] / b.v[l]); return r; }
+inline float8 operator-(float8 a)						{ float8 r; CPU_SIMD_LOOP(r.v[l] = -a.v[l]); return r; }
+
+// Same NaN behavior as minps/maxps: second operand is returned when the comparison fails.
+inline float8 min8(float8 a, float8 b)					{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] < b.v[l] ? a.v[l] : b.v[l]); return r; }
+inline float8 max8(float8 a, float8 b)					{ float8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] > b.v[l] ? a.v[l] : b.v[l]); return r; }
+inline float8 sqrt8(float8 a)							{ float8 r; CPU_SIMD_LOOP(r.v[l] = std::sqrt(a.v[l])); return r; }
+inline float8 floor8(float8 a)							{ float8 r; CPU_SIMD_LOOP(r.v[l] = std::floor(a.v[l])); return r; }
+inline float8 abs8(float8 a)							{ float8 r; CPU_SIMD_LOOP(r.v[l] = std::fabs(a.v[l])); return r; }
+
+inline bool8 operator<(float8 a, float8 b)				{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] <  b.v[l] ? 0xFFFFFFFFu : 0u); return r; }
+inline bool8 operator<=(float8 a, float8 b)			{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] <= b.v[l] ? 0xFFFFFFFFu : 0u); return r; }
+inline bool8 operator>(float8 a, float8 b)				{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] >  b.v[l] ? 0xFFFFFFFFu : 0u); return r; }
+inline bool8 operator>=(float8 a, float8 b)			{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] >= b.v[l] ? 0xFFFFFFFFu : 0u); return r; }
+inline bool8 operator==(float8 a, float8 b)			{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] == b.v[l] ? 0xFFFFFFFFu : 0u); return r; }
+inline bool8 operator&(bool8 a, bool8 b)				{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] & b.v[l]); return r; }
+inline bool8 operator|(bool8 a, bool8 b)				{ bool8 r; CPU_SIMD_LOOP(r.v[l] = a.v[l] | b.v[l]); return r; }
+inline bool8 operator!(bool8 a)							{ bool8 r; CPU_SIMD_LOOP(r.v[l] = ~a.v[l]); return r; }
+
+inline float8 select8(bool8 mask, float8 a, float8 b)	{ float8 r; CPU_SIMD_LOOP(r.v[l] = mask.v[l] ? a.v[l] : b.v[l]); return r; }
+inline int    movemask8(bool8 a)						{ int r = 0; CPU_SIMD_LOOP(r |= (a.v[l] >> 31) << l); return r; }
+
+inline float8 gather8(const float* base, float8 index)	{ float8 r; CPU_SIMD_LOOP(r.v[l] = base[int32_t(index.v[l])]); return r; }
+
+inline float8 ldexp8(float8 x, float8 n)
+{
+	float8 r;
+	for (int l = 0; l < 8; ++l)
+	{
+		uint32_t e = uint32_t(int32_t(n.v[l]) + 127) << 23;
+		float scale;
+		memcpy(&scale, &e, sizeof(float));
+		r.v[l] = x.v[l] * scale;
+	}
+	return r;
+}
+
+#undef CPU_SIMD_LOOP
+
+#endif // CPU_SIMD_AVX2
+
+inline bool any8(bool8 a) { return movemask8(a) != 0; }
+inline bool all8(bool8 a) { return movemask8(a) == 0xFF; }
+
+inline float8 operator+(float8 a, float b) { return a + splat8(b); }
+inline float8 operator-(float8 a, float b) { return a - splat8(b); }
+inline float8 operator*(float8 a, float b) { return a * splat8(b); }
+inline float8 operator/(float8 a, float b) { return a / splat8(b); }
+inline float8 operator+(float a, float8 b) { return splat8(a) + b; }
+inline float8 operator-(float a, float8 b) { return splat8(a) - b; }
+inline float8 operator*(float a, float8 b) { return splat8(a) * b; }
+inline float8 operator/(float a, float8 b) { return splat8(a) / b; }
+
+inline float8 saturate8(float8 a) { return min8(max8(a, splat8(0.0f)), splat8(1.0f)); }
+
+inline float lane8(float8 a, int l)
+{
+	float tmp[8];
+	store8(tmp, a);
+	return tmp[l];
+}
+
+// Cephes single precision exp. Relative error is below 2 ulp over the clamped range, and results under ~1e-38 flush to 0.
+inline float8 exp8(float8 x)
+{
+	x = min8(max8(x, splat8(-88.3762626647949f)), splat8(88.3762626647949f));
+
+	float8 fx = floor8(x * 1.44269504088896341f + 0.5f);
+	x = x - fx * 0.693359375f;
+	x = x - fx * -2.12194440e-4f;
+
+	float8 y = splat8(1.9875691500e-4f);
+	y = y * x + 1.3981999507e-3f;
+	y = y * x + 8.3334519073e-3f;
+	y = y * x + 4.1665795894e-2f;
+	y = y * x + 1.6666665459e-1f;
+	y = y * x + 5.0000001201e-1f;
+	y = y * (x * x) + x + 1.0f;
+
+	return ldexp8(y, fx);
+}
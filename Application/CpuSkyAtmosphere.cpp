@@ -0,0 +1,491 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include "CpuSkyAtmosphere.h"
+
+
+void SetupEarthAtmosphere(AtmosphereInfo& info)
+{
+	// Values shown here are the result of integration over wavelength power spectrum integrated with paricular function.
+	// Refer to https://github.com/ebruneton/precomputed_atmospheric_scattering for details.
+
+	// All units in kilometers
+	const float EarthBottomRadius = 6360.0f;
+	const float EarthTopRadius = 6460.0f;   // 100km atmosphere radius, less edge visible and it contain 99.99% of the atmosphere medium https://en.wikipedia.org/wiki/K%C3%A1rm%C3%A1n_line
+	const float EarthRayleighScaleHeight = 8.0f;
+	const float EarthMieScaleHeight = 1.2f;
+
+	// Sun - This should not be part of the sky model...
+	//info.solar_irradiance = { 1.474000f, 1.850400f, 1.911980f };
+	info.solar_irradiance = { 1.0f, 1.0f, 1.0f };	// Using a normalise sun illuminance. This is to make sure the LUTs acts as a transfert factor to apply the runtime computed sun irradiance over.
+	info.sun_angular_radius = 0.004675f;
+
+	// Earth
+	info.bottom_radius = EarthBottomRadius;
+	info.top_radius = EarthTopRadius;
+	info.ground_albedo = { 0.0f, 0.0f, 0.0f };
+
+	// Raleigh scattering
+	info.rayleigh_density.layers[0] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	info.rayleigh_density.layers[1] = { 0.0f, 1.0f, -1.0f / EarthRayleighScaleHeight, 0.0f, 0.0f };
+	info.rayleigh_scattering = { 0.005802f, 0.013558f, 0.033100f };		// 1/km
+
+	// Mie scattering
+	info.mie_density.layers[0] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	info.mie_density.layers[1] = { 0.0f, 1.0f, -1.0f / EarthMieScaleHeight, 0.0f, 0.0f };
+	info.mie_scattering = { 0.003996f, 0.003996f, 0.003996f };			// 1/km
+	info.mie_extinction = { 0.004440f, 0.004440f, 0.004440f };			// 1/km
+	info.mie_phase_function_g = 0.8f;
+
+	// Ozone absorption
+	info.absorption_density.layers[0] = { 25.0f, 0.0f, 0.0f, 1.0f / 15.0f, -2.0f / 3.0f };
+	info.absorption_density.layers[1] = { 0.0f, 0.0f, 0.0f, -1.0f / 15.0f, 8.0f / 3.0f };
+	info.absorption_extinction = { 0.000650f, 0.001881f, 0.000085f };	// 1/km
+
+	const double max_sun_zenith_angle = PI * 120.0 / 180.0; // (use_half_precision_ ? 102.0 : 120.0) / 180.0 * kPi;
+	info.mu_s_min = (float) cos(max_sun_zenith_angle);
+}
+
+
+
+CpuAtmosphereParameters GetAtmosphereParameters(const AtmosphereInfo& info)
+{
+	CpuAtmosphereParameters Parameters;
+	Parameters.AbsorptionExtinction = info.absorption_extinction;
+
+	Parameters.RayleighDensityExpScale = info.rayleigh_density.layers[1].exp_scale;
+	Parameters.MieDensityExpScale = info.mie_density.layers[1].exp_scale;
+	Parameters.AbsorptionDensity0LayerWidth = info.absorption_density.layers[0].width;
+	Parameters.AbsorptionDensity0ConstantTerm = info.absorption_density.layers[0].constant_term;
+	Parameters.AbsorptionDensity0LinearTerm = info.absorption_density.layers[0].linear_term;
+	Parameters.AbsorptionDensity1ConstantTerm = info.absorption_density.layers[1].constant_term;
+	Parameters.AbsorptionDensity1LinearTerm = info.absorption_density.layers[1].linear_term;
+
+	Parameters.MiePhaseG = info.mie_phase_function_g;
+	Parameters.RayleighScattering = info.rayleigh_scattering;
+	Parameters.MieScattering = info.mie_scattering;
+	Parameters.MieAbsorption = max3(info.mie_extinction - info.mie_scattering, splat3(0.0f));	// As uploaded by Game::render
+	Parameters.MieExtinction = info.mie_extinction;
+	Parameters.GroundAlbedo = info.ground_albedo;
+	Parameters.BottomRadius = info.bottom_radius;
+	Parameters.TopRadius = info.top_radius;
+	return Parameters;
+}
+
+
+
+float raySphereIntersectNearest(const GlslVec3& r0, const GlslVec3& rd, const GlslVec3& s0, float sR)
+{
+	float a = dot(rd, rd);
+	GlslVec3 s0_r0 = r0 - s0;
+	float b = 2.0f * dot(rd, s0_r0);
+	float c = dot(s0_r0, s0_r0) - (sR * sR);
+	float delta = b * b - 4.0f*a*c;
+	if (delta < 0.0f || a == 0.0f)
+	{
+		return -1.0f;
+	}
+	float sol0 = (-b - sqrtf(delta)) / (2.0f*a);
+	float sol1 = (-b + sqrtf(delta)) / (2.0f*a);
+	if (sol0 < 0.0f && sol1 < 0.0f)
+	{
+		return -1.0f;
+	}
+	if (sol0 < 0.0f)
+	{
+		return sol1 > 0.0f ? sol1 : 0.0f;
+	}
+	else if (sol1 < 0.0f)
+	{
+		return sol0 > 0.0f ? sol0 : 0.0f;
+	}
+	const float sol = sol0 < sol1 ? sol0 : sol1;
+	return sol > 0.0f ? sol : 0.0f;
+}
+
+void UvToLutTransmittanceParams(const CpuAtmosphereParameters& Atmosphere, float& viewHeight, float& viewZenithCosAngle, float u, float v)
+{
+	float x_mu = u;
+	float x_r = v;
+
+	float H = sqrtf(Atmosphere.TopRadius * Atmosphere.TopRadius - Atmosphere.BottomRadius * Atmosphere.BottomRadius);
+	float rho = H * x_r;
+	viewHeight = sqrtf(rho * rho + Atmosphere.BottomRadius * Atmosphere.BottomRadius);
+
+	float d_min = Atmosphere.TopRadius - viewHeight;
+	float d_max = rho + H;
+	float d = d_min + x_mu * (d_max - d_min);
+	viewZenithCosAngle = d == 0.0f ? 1.0f : (H * H - rho * rho - d * d) / (2.0f * viewHeight * d);
+	viewZenithCosAngle = clampf(viewZenithCosAngle, -1.0f, 1.0f);
+}
+
+void LutTransmittanceParamsToUv(const CpuAtmosphereParameters& Atmosphere, float viewHeight, float viewZenithCosAngle, float& u, float& v)
+{
+	float H = sqrtf((std::max)(0.0f, Atmosphere.TopRadius * Atmosphere.TopRadius - Atmosphere.BottomRadius * Atmosphere.BottomRadius));
+	float rho = sqrtf((std::max)(0.0f, viewHeight * viewHeight - Atmosphere.BottomRadius * Atmosphere.BottomRadius));
+
+	float discriminant = viewHeight * viewHeight * (viewZenithCosAngle * viewZenithCosAngle - 1.0f) + Atmosphere.TopRadius * Atmosphere.TopRadius;
+	float d = (std::max)(0.0f, (-viewHeight * viewZenithCosAngle + sqrtf(discriminant))); // Distance to atmosphere boundary
+
+	float d_min = Atmosphere.TopRadius - viewHeight;
+	float d_max = rho + H;
+	u = (d - d_min) / (d_max - d_min);
+	v = rho / H;
+}
+
+void UvToSkyViewLutParams(const CpuAtmosphereParameters& Atmosphere, float& viewZenithCosAngle, float& lightViewCosAngle, float viewHeight,
+	float u, float v, float Width, float Height)
+{
+	// Constrain uvs to valid sub texel range (avoid zenith derivative issue making LUT usage visible)
+	u = fromSubUvsToUnit(u, Width);
+	v = fromSubUvsToUnit(v, Height);
+
+	float Vhorizon = sqrtf(viewHeight * viewHeight - Atmosphere.BottomRadius * Atmosphere.BottomRadius);
+	float CosBeta = Vhorizon / viewHeight;				// GroundToHorizonCos
+	float Beta = acosf(CosBeta);
+	float ZenithHorizonAngle = PI - Beta;
+
+	if (v < 0.5f)
+	{
+		float coord = 2.0f * v;
+		coord = 1.0f - coord;
+		coord *= coord;
+		coord = 1.0f - coord;
+		viewZenithCosAngle = cosf(ZenithHorizonAngle * coord);
+	}
+	else
+	{
+		float coord = v * 2.0f - 1.0f;
+		coord *= coord;
+		viewZenithCosAngle = cosf(ZenithHorizonAngle + Beta * coord);
+	}
+
+	float coord = u;
+	coord *= coord;
+	lightViewCosAngle = -(coord * 2.0f - 1.0f);
+}
+
+void SkyViewLutParamsToUv(const CpuAtmosphereParameters& Atmosphere, bool IntersectGround, float viewZenithCosAngle, float lightViewCosAngle, float viewHeight,
+	float& u, float& v, float Width, float Height)
+{
+	float Vhorizon = sqrtf(viewHeight * viewHeight - Atmosphere.BottomRadius * Atmosphere.BottomRadius);
+	float CosBeta = Vhorizon / viewHeight;				// GroundToHorizonCos
+	float Beta = acosf(CosBeta);
+	float ZenithHorizonAngle = PI - Beta;
+
+	if (!IntersectGround)
+	{
+		float coord = acosf(viewZenithCosAngle) / ZenithHorizonAngle;
+		coord = 1.0f - coord;
+		coord = sqrtf(coord);
+		coord = 1.0f - coord;
+		v = coord * 0.5f;
+	}
+	else
+	{
+		float coord = (acosf(viewZenithCosAngle) - ZenithHorizonAngle) / Beta;
+		coord = sqrtf(coord);
+		v = coord * 0.5f + 0.5f;
+	}
+
+	{
+		float coord = -lightViewCosAngle * 0.5f + 0.5f;
+		coord = sqrtf(coord);
+		u = coord;
+	}
+
+	// Constrain uvs to valid sub texel range (avoid zenith derivative issue making LUT usage visible)
+	u = fromUnitToSubUvs(u, Width);
+	v = fromUnitToSubUvs(v, Height);
+}
+
+bool MoveToTopAtmosphere(GlslVec3& WorldPos, const GlslVec3& WorldDir, float AtmosphereTopRadius)
+{
+	float viewHeight = length(WorldPos);
+	if (viewHeight > AtmosphereTopRadius)
+	{
+		float tTop = raySphereIntersectNearest(WorldPos, WorldDir, splat3(0.0f), AtmosphereTopRadius);
+		if (tTop >= 0.0f)
+		{
+			GlslVec3 UpVector = WorldPos / viewHeight;
+			GlslVec3 UpOffset = UpVector * -PLANET_RADIUS_OFFSET;
+			WorldPos = WorldPos + WorldDir * tTop + UpOffset;
+		}
+		else
+		{
+			// Ray is not intersecting the atmosphere
+			return false;
+		}
+	}
+	return true; // ok to start tracing
+}
+
+
+
+float RayleighPhase(float cosTheta)
+{
+	float factor = 3.0f / (16.0f * PI);
+	return factor * (1.0f + cosTheta * cosTheta);
+}
+
+float hgPhase(float g, float cosTheta)
+{
+	float k = 3.0f / (8.0f * PI) * (1.0f - g * g) / (2.0f + g * g);
+	return k * (1.0f + cosTheta * cosTheta) / powf(1.0f + g * g - 2.0f * g * -cosTheta, 1.5f);
+}
+
+float getAbsorptionDensity(const CpuAtmosphereParameters& Atmosphere, float viewHeight)
+{
+	return saturate(viewHeight < Atmosphere.AbsorptionDensity0LayerWidth ?
+		Atmosphere.AbsorptionDensity0LinearTerm * viewHeight + Atmosphere.AbsorptionDensity0ConstantTerm :
+		Atmosphere.AbsorptionDensity1LinearTerm * viewHeight + Atmosphere.AbsorptionDensity1ConstantTerm);
+}
+
+MediumSampleRGB sampleMediumRGB(const GlslVec3& WorldPos, const CpuAtmosphereParameters& Atmosphere)
+{
+	const float viewHeight = length(WorldPos) - Atmosphere.BottomRadius;
+
+	const float densityMie = expf(Atmosphere.MieDensityExpScale * viewHeight);
+	const float densityRay = expf(Atmosphere.RayleighDensityExpScale * viewHeight);
+	const float densityOzo = getAbsorptionDensity(Atmosphere, viewHeight);
+
+	MediumSampleRGB s;
+	s.scatteringMie = densityMie * Atmosphere.MieScattering;
+	s.scatteringRay = densityRay * Atmosphere.RayleighScattering;
+	s.scattering = s.scatteringMie + s.scatteringRay;
+	s.extinction = densityMie * Atmosphere.MieExtinction + s.scatteringRay + densityOzo * Atmosphere.AbsorptionExtinction;
+	return s;
+}
+
+float ChapmanApprox(float x, float cosChi)
+{
+	const float a = 2.7889f;
+	const float c = sqrtf(0.5f * PI * x);
+	const float cMu = c * cosChi;
+	return c * a / ((a - 1.0f) * cMu + sqrtf(cMu * cMu + a * a));
+}
+
+float ExponentialOpticalLengthToInfinity(float r, float mu, float BottomRadius, float DensityExpScale)
+{
+	const float H = -1.0f / DensityExpScale;
+	const float density = expf(DensityExpScale * (r - BottomRadius));
+	if (mu >= 0.0f)
+	{
+		return H * density * ChapmanApprox(r / H, mu);
+	}
+	const float r0 = r * sqrtf(1.0f - mu * mu);
+	return H * (2.0f * expf(DensityExpScale * (r0 - BottomRadius)) * sqrtf(0.5f * PI * r0 / H) - density * ChapmanApprox(r / H, -mu));
+}
+
+float ExponentialOpticalLength(float r, float mu, float t, float BottomRadius, float DensityExpScale)
+{
+	const float rEnd = sqrtf(t * t + 2.0f * r * mu * t + r * r);
+	const float muEnd = (r * mu + t) / rEnd;
+	if (muEnd < 0.0f)
+	{
+		return fmaxf(0.0f, ExponentialOpticalLengthToInfinity(rEnd, -muEnd, BottomRadius, DensityExpScale)
+			- ExponentialOpticalLengthToInfinity(r, -mu, BottomRadius, DensityExpScale));
+	}
+	return fmaxf(0.0f, ExponentialOpticalLengthToInfinity(r, mu, BottomRadius, DensityExpScale)
+		- ExponentialOpticalLengthToInfinity(rEnd, muEnd, BottomRadius, DensityExpScale));
+}
+
+MediumSample8 sampleMedium8(float8 viewHeight, const CpuAtmosphereParameters& Atmosphere)
+{
+	const float8 densityMie = exp8(Atmosphere.MieDensityExpScale * viewHeight);
+	const float8 densityRay = exp8(Atmosphere.RayleighDensityExpScale * viewHeight);
+	const float8 densityOzo = saturate8(select8(viewHeight < splat8(Atmosphere.AbsorptionDensity0LayerWidth),
+		Atmosphere.AbsorptionDensity0LinearTerm * viewHeight + Atmosphere.AbsorptionDensity0ConstantTerm,
+		Atmosphere.AbsorptionDensity1LinearTerm * viewHeight + Atmosphere.AbsorptionDensity1ConstantTerm));
+
+	const float* mieSca = &Atmosphere.MieScattering.x;
+	const float* mieExt = &Atmosphere.MieExtinction.x;
+	const float* raySca = &Atmosphere.RayleighScattering.x;
+	const float* ozoExt = &Atmosphere.AbsorptionExtinction.x;
+
+	MediumSample8 s;
+	for (int c = 0; c < 3; ++c)
+	{
+		s.scatteringMie[c] = densityMie * mieSca[c];
+		s.scatteringRay[c] = densityRay * raySca[c];
+		s.scattering[c] = s.scatteringMie[c] + s.scatteringRay[c];
+		s.extinction[c] = densityMie * mieExt[c] + s.scatteringRay[c] + densityOzo * ozoExt[c];
+	}
+	return s;
+}
+
+
+
+GlslVec3 CpuLut2D::sampleLinearClamp(float u, float v) const
+{
+	// Texel centers are at (i + 0.5) / Width, as for D3D.
+	const float x = clampf(u * Width - 0.5f, 0.0f, float(Width - 1));
+	const float y = clampf(v * Height - 0.5f, 0.0f, float(Height - 1));
+	const uint32 x0 = uint32(x);
+	const uint32 y0 = uint32(y);
+	const uint32 x1 = x0 + 1 < Width ? x0 + 1 : x0;
+	const uint32 y1 = y0 + 1 < Height ? y0 + 1 : y0;
+	const float fx = x - float(x0);
+	const float fy = y - float(y0);
+
+	const float* t00 = texel(x0, y0);
+	const float* t10 = texel(x1, y0);
+	const float* t01 = texel(x0, y1);
+	const float* t11 = texel(x1, y1);
+	GlslVec3 top = lerp(GlslVec3{ t00[0], t00[1], t00[2] }, GlslVec3{ t10[0], t10[1], t10[2] }, fx);
+	GlslVec3 bottom = lerp(GlslVec3{ t01[0], t01[1], t01[2] }, GlslVec3{ t11[0], t11[1], t11[2] }, fx);
+	return lerp(top, bottom, fy);
+}
+
+void CpuLut2D::sampleLinearClamp(float u, float v, float rgba[4]) const
+{
+	const float x = clampf(u * Width - 0.5f, 0.0f, float(Width - 1));
+	const float y = clampf(v * Height - 0.5f, 0.0f, float(Height - 1));
+	const uint32 x0 = uint32(x);
+	const uint32 y0 = uint32(y);
+	const uint32 x1 = x0 + 1 < Width ? x0 + 1 : x0;
+	const uint32 y1 = y0 + 1 < Height ? y0 + 1 : y0;
+	const float fx = x - float(x0);
+	const float fy = y - float(y0);
+
+	const float* t00 = texel(x0, y0);
+	const float* t10 = texel(x1, y0);
+	const float* t01 = texel(x0, y1);
+	const float* t11 = texel(x1, y1);
+	for (uint32 c = 0; c < 4; ++c)
+	{
+		rgba[c] = lerp(lerp(t00[c], t10[c], fx), lerp(t01[c], t11[c], fx), fy);
+	}
+}
+
+void CpuLut2D::sampleLinearClamp8(float8 u, float8 v, float8 rgb[3]) const
+{
+	const float8 x = min8(max8(u * float(Width) - 0.5f, splat8(0.0f)), splat8(float(Width - 1)));
+	const float8 y = min8(max8(v * float(Height) - 0.5f, splat8(0.0f)), splat8(float(Height - 1)));
+	const float8 x0 = floor8(x);
+	const float8 y0 = floor8(y);
+	const float8 fx = x - x0;
+	const float8 fy = y - y0;
+
+	// Float offsets are exact as long as the texture has less than 2^22 texels.
+	const float8 x1Offset = (min8(x0 + 1.0f, splat8(float(Width - 1))) - x0) * 4.0f;
+	const float8 y1Offset = (min8(y0 + 1.0f, splat8(float(Height - 1))) - y0) * float(Width * 4);
+	const float8 i00 = (y0 * float(Width) + x0) * 4.0f;
+	const float8 i10 = i00 + x1Offset;
+	const float8 i01 = i00 + y1Offset;
+	const float8 i11 = i01 + x1Offset;
+
+	const float* base = Data.data();
+	for (int c = 0; c < 3; ++c)
+	{
+		const float8 a = gather8(base + c, i00);
+		const float8 b = gather8(base + c, i10);
+		const float8 top = a + (b - a) * fx;
+		const float8 d = gather8(base + c, i01);
+		const float8 e = gather8(base + c, i11);
+		const float8 bottom = d + (e - d) * fx;
+		rgb[c] = top + (bottom - top) * fy;
+	}
+}
+
+void CpuLut3D::sampleLinearClamp(float u, float v, float w, float rgba[4]) const
+{
+	const float x = clampf(u * Width - 0.5f, 0.0f, float(Width - 1));
+	const float y = clampf(v * Height - 0.5f, 0.0f, float(Height - 1));
+	const float z = clampf(w * Depth - 0.5f, 0.0f, float(Depth - 1));
+	const uint32 x0 = uint32(x);
+	const uint32 y0 = uint32(y);
+	const uint32 z0 = uint32(z);
+	const uint32 x1 = x0 + 1 < Width ? x0 + 1 : x0;
+	const uint32 y1 = y0 + 1 < Height ? y0 + 1 : y0;
+	const uint32 z1 = z0 + 1 < Depth ? z0 + 1 : z0;
+	const float fx = x - float(x0);
+	const float fy = y - float(y0);
+	const float fz = z - float(z0);
+
+	const float* t000 = texel(x0, y0, z0);
+	const float* t100 = texel(x1, y0, z0);
+	const float* t010 = texel(x0, y1, z0);
+	const float* t110 = texel(x1, y1, z0);
+	const float* t001 = texel(x0, y0, z1);
+	const float* t101 = texel(x1, y0, z1);
+	const float* t011 = texel(x0, y1, z1);
+	const float* t111 = texel(x1, y1, z1);
+	for (uint32 c = 0; c < 4; ++c)
+	{
+		const float front = lerp(lerp(t000[c], t100[c], fx), lerp(t010[c], t110[c], fx), fy);
+		const float back = lerp(lerp(t001[c], t101[c], fx), lerp(t011[c], t111[c], fx), fy);
+		rgba[c] = lerp(front, back, fz);
+	}
+}
+
+// Unsigned float with a 5 bits exponent (bias 15) and MantissaBits bits of mantissa, as the channels of DXGI_FORMAT_R11G11B10_FLOAT.
+static uint32 packUnsignedSmallFloat(float value, int MantissaBits)
+{
+	if (!(value > 0.0f))
+	{
+		return 0;
+	}
+	const uint32 MantissaOne = 1u << MantissaBits;
+	const float MaxValue = ldexpf(2.0f - ldexpf(1.0f, -MantissaBits), 15);
+	value = (std::min)(value, MaxValue);
+
+	int exponent;
+	const float mantissa = frexpf(value, &exponent);	// value = mantissa * 2^exponent, mantissa in [0.5, 1)
+	int biasedExponent = exponent - 1 + 15;
+	if (biasedExponent <= 0)
+	{
+		// Denormal, rounding up to the smallest normal value gives its encoding too
+		return uint32(lrintf(ldexpf(value, 14 + MantissaBits)));
+	}
+	uint32 bits = uint32(lrintf((mantissa * 2.0f - 1.0f) * float(MantissaOne)));
+	if (bits == MantissaOne)
+	{
+		bits = 0;
+		biasedExponent++;
+	}
+	if (biasedExponent > 30)
+	{
+		return (30u << MantissaBits) | (MantissaOne - 1);
+	}
+	return (uint32(biasedExponent) << MantissaBits) | bits;
+}
+
+static float unpackUnsignedSmallFloat(uint32 packed, int MantissaBits)
+{
+	const uint32 biasedExponent = packed >> MantissaBits;
+	const float mantissa = float(packed & ((1u << MantissaBits) - 1)) / float(1u << MantissaBits);
+	return biasedExponent == 0 ? ldexpf(mantissa, -14) : ldexpf(1.0f + mantissa, int(biasedExponent) - 15);
+}
+
+uint32 packR11G11B10Float(float r, float g, float b)
+{
+	return packUnsignedSmallFloat(r, 6) | (packUnsignedSmallFloat(g, 6) << 11) | (packUnsignedSmallFloat(b, 5) << 22);
+}
+
+void unpackR11G11B10Float(uint32 packed, float rgb[3])
+{
+	rgb[0] = unpackUnsignedSmallFloat(packed & 0x7FF, 6);
+	rgb[1] = unpackUnsignedSmallFloat((packed >> 11) & 0x7FF, 6);
+	rgb[2] = unpackUnsignedSmallFloat(packed >> 22, 5);
+}
+
+void sampleTransmittanceLut8(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut, float8 viewHeight, float8 viewZenithCosAngle, float8 rgb[3])
+{
+	// Same as LutTransmittanceParamsToUv
+	const float8 zero = splat8(0.0f);
+	const float H = sqrtf((std::max)(0.0f, Atmosphere.TopRadius * Atmosphere.TopRadius - Atmosphere.BottomRadius * Atmosphere.BottomRadius));
+	const float8 rho = sqrt8(max8(zero, viewHeight * viewHeight - Atmosphere.BottomRadius * Atmosphere.BottomRadius));
+
+	const float8 discriminant = viewHeight * viewHeight * (viewZenithCosAngle * viewZenithCosAngle - 1.0f) + Atmosphere.TopRadius * Atmosphere.TopRadius;
+	const float8 d = max8(zero, (-viewHeight * viewZenithCosAngle + sqrt8(discriminant))); // Distance to atmosphere boundary
+
+	const float8 d_min = Atmosphere.TopRadius - viewHeight;
+	const float8 d_max = rho + H;
+	const float8 x_mu = (d - d_min) / (d_max - d_min);
+	const float8 x_r = rho / H;
+
+	TransmittanceLut.sampleLinearClamp8(x_mu, x_r, rgb);
+}
+
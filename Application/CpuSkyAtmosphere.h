@@ -0,0 +1,150 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+// CPU mirror of the atmosphere functions found in SkyAtmosphereCommon.hlsl and RenderSkyCommon.hlsl.
+// Function names and parameterisations match the shader ones so that both can be compared side by side.
+// This code does not depend on D3D and can be built for headless tools.
+
+#include <vector>
+#include "CpuMath.h"
+#include "CpuSimd.h"
+
+#define PLANET_RADIUS_OFFSET 0.01f
+
+// Same layout as AtmosphereParameters in SkyAtmosphereCommon.hlsl
+struct CpuAtmosphereParameters
+{
+	float BottomRadius;
+	float TopRadius;
+
+	float RayleighDensityExpScale;
+	GlslVec3 RayleighScattering;
+
+	float MieDensityExpScale;
+	GlslVec3 MieScattering;
+	GlslVec3 MieExtinction;
+	GlslVec3 MieAbsorption;
+	float MiePhaseG;
+
+	float AbsorptionDensity0LayerWidth;
+	float AbsorptionDensity0ConstantTerm;
+	float AbsorptionDensity0LinearTerm;
+	float AbsorptionDensity1ConstantTerm;
+	float AbsorptionDensity1LinearTerm;
+	GlslVec3 AbsorptionExtinction;
+
+	GlslVec3 GroundAlbedo;
+};
+
+// Translation from Bruneton2017 parameterisation, see GetAtmosphereParameters() in SkyAtmosphereCommon.hlsl.
+CpuAtmosphereParameters GetAtmosphereParameters(const AtmosphereInfo& info);
+
+float raySphereIntersectNearest(const GlslVec3& r0, const GlslVec3& rd, const GlslVec3& s0, float sR);
+
+inline float fromUnitToSubUvs(float u, float resolution) { return (u + 0.5f / resolution) * (resolution / (resolution + 1.0f)); }
+inline float fromSubUvsToUnit(float u, float resolution) { return (u - 0.5f / resolution) * (resolution / (resolution - 1.0f)); }
+
+void UvToLutTransmittanceParams(const CpuAtmosphereParameters& Atmosphere, float& viewHeight, float& viewZenithCosAngle, float u, float v);
+void LutTransmittanceParamsToUv(const CpuAtmosphereParameters& Atmosphere, float viewHeight, float viewZenithCosAngle, float& u, float& v);
+
+// NONLINEARSKYVIEWLUT parameterisation. Width and Height are the sky view LUT resolution, gSkyViewLutResolution in the shaders.
+void UvToSkyViewLutParams(const CpuAtmosphereParameters& Atmosphere, float& viewZenithCosAngle, float& lightViewCosAngle, float viewHeight,
+	float u, float v, float Width, float Height);
+void SkyViewLutParamsToUv(const CpuAtmosphereParameters& Atmosphere, bool IntersectGround, float viewZenithCosAngle, float lightViewCosAngle, float viewHeight,
+	float& u, float& v, float Width, float Height);
+
+bool MoveToTopAtmosphere(GlslVec3& WorldPos, const GlslVec3& WorldDir, float AtmosphereTopRadius);
+
+float RayleighPhase(float cosTheta);
+float hgPhase(float g, float cosTheta);	// Cornette-Shanks, as USE_CornetteShanks is defined in RenderSkyCommon.hlsl
+inline float uniformPhase() { return 1.0f / (4.0f * PI); }
+
+struct MediumSampleRGB
+{
+	GlslVec3 scattering;
+	GlslVec3 extinction;
+
+	GlslVec3 scatteringMie;
+	GlslVec3 scatteringRay;
+};
+
+float getAbsorptionDensity(const CpuAtmosphereParameters& Atmosphere, float viewHeight);
+MediumSampleRGB sampleMediumRGB(const GlslVec3& WorldPos, const CpuAtmosphereParameters& Atmosphere);
+
+// Analytic integration of the exponential density layers, see the "Analytic optical depth" section of RenderSkyCommon.hlsl.
+float ChapmanApprox(float x, float cosChi);
+float ExponentialOpticalLengthToInfinity(float r, float mu, float BottomRadius, float DensityExpScale);
+float ExponentialOpticalLength(float r, float mu, float t, float BottomRadius, float DensityExpScale);
+
+// 8 float3 stored as SoA, one lane per ray.
+struct float8x3
+{
+	float8 x, y, z;
+};
+
+inline float8x3 operator+(const float8x3& a, const float8x3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline float8x3 operator-(const float8x3& a, const float8x3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline float8x3 operator*(const float8x3& a, float8 b) { return { a.x * b, a.y * b, a.z * b }; }
+inline float8x3 operator/(const float8x3& a, float8 b) { return { a.x / b, a.y / b, a.z / b }; }
+inline float8 dot(const float8x3& a, const float8x3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float8 length(const float8x3& a) { return sqrt8(dot(a, a)); }
+inline float8x3 splat8x3(const GlslVec3& a) { return { splat8(a.x), splat8(a.y), splat8(a.z) }; }
+
+// sampleMediumRGB for 8 heights at once, heights being relative to the ground (length(WorldPos) - BottomRadius).
+// Channels are indexed as r, g, b.
+struct MediumSample8
+{
+	float8 scattering[3];
+	float8 extinction[3];
+
+	float8 scatteringMie[3];
+	float8 scatteringRay[3];
+};
+
+MediumSample8 sampleMedium8(float8 viewHeight, const CpuAtmosphereParameters& Atmosphere);
+
+
+
+// RGBA float texture living in main memory, texel (0,0) being the top left one as with D3D.
+struct CpuLut2D
+{
+	uint32 Width = 0;
+	uint32 Height = 0;
+	std::vector<float> Data;
+
+	void Allocate(uint32 width, uint32 height) { Width = width; Height = height; Data.assign(size_t(width) * height * 4, 0.0f); }
+	float* texel(uint32 x, uint32 y) { return &Data[(size_t(y) * Width + x) * 4]; }
+	const float* texel(uint32 x, uint32 y) const { return &Data[(size_t(y) * Width + x) * 4]; }
+
+	// Same as a SampleLevel(samplerLinearClamp, uv, 0).rgb
+	GlslVec3 sampleLinearClamp(float u, float v) const;
+	void sampleLinearClamp(float u, float v, float rgba[4]) const;
+	void sampleLinearClamp8(float8 u, float8 v, float8 rgb[3]) const;
+};
+
+// RGBA float volume texture, slices being stored one after the other.
+struct CpuLut3D
+{
+	uint32 Width = 0;
+	uint32 Height = 0;
+	uint32 Depth = 0;
+	std::vector<float> Data;
+
+	void Allocate(uint32 width, uint32 height, uint32 depth) { Width = width; Height = height; Depth = depth; Data.assign(size_t(width) * height * depth * 4, 0.0f); }
+	float* texel(uint32 x, uint32 y, uint32 z) { return &Data[((size_t(z) * Height + y) * Width + x) * 4]; }
+	const float* texel(uint32 x, uint32 y, uint32 z) const { return &Data[((size_t(z) * Height + y) * Width + x) * 4]; }
+
+	// Same as a SampleLevel(samplerLinearClamp, uvw, 0)
+	void sampleLinearClamp(float u, float v, float w, float rgba[4]) const;
+};
+
+// DXGI_FORMAT_R11G11B10_FLOAT texels, as uploaded from a LUT cache entry. Values are rounded to the nearest, negative
+// values and NaNs become 0 and values above the largest one are clamped to it.
+uint32 packR11G11B10Float(float r, float g, float b);
+void unpackR11G11B10Float(uint32 packed, float rgb[3]);
+
+// TransmittanceLutTexture.SampleLevel(samplerLinearClamp, uv, 0).rgb with uv from LutTransmittanceParamsToUv, for 8 lanes.
+void sampleTransmittanceLut8(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut, float8 viewHeight, float8 viewZenithCosAngle, float8 rgb[3]);
+
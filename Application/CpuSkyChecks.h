@@ -0,0 +1,188 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "CpuSkyTools.h"
+#include "CpuSkyLuts.h"
+#include "CpuSkyRadiance.h"
+#include "CpuSkyCubemap.h"
+#include "CpuPathTracer.h"
+#include "SkyLutConfig.h"
+#include "StateRecord.h"
+
+// Shared by the commands of CpuSkyTools.cpp and the check-* commands, grouped by subsystem in CpuSkyChecks_*.cpp.
+
+
+
+struct CpuSkyToolsContext
+{
+	std::vector<const char*> Args;		// Positional arguments following the command name
+	uint32 ThreadCount = 0;				// 0 means all hardware threads
+
+	AtmosphereInfo Atmosphere;
+	LookUpTablesInfo LutInfo;
+	uint32 MultiScatteringLUTRes = 32;	// Same as Game::MultiScatteringLUTRes
+
+	const char* arg(size_t i, const char* defaultValue = nullptr) const { return i < Args.size() ? Args[i] : defaultValue; }
+};
+
+// Output of the check-* commands: one line per check, then PASSED or FAILED.
+class CheckReporter
+{
+public:
+	// Prints the result of a check and returns ok.
+	bool check(const char* name, bool ok);
+	bool check(const std::string& name, bool ok) { return check(name.c_str(), ok); }
+	// Passes when value <= bound, both being printed.
+	bool checkBound(const char* name, double value, double bound);
+
+	bool passed() const { return mFailureCount == 0; }
+	// Prints PASSED or FAILED and returns the exit code of the command.
+	int finish() const;
+
+private:
+	uint32 mFailureCount = 0;
+};
+
+struct BakeTimings
+{
+	double AvgSeconds = 0.0;
+	double BestSeconds = 1e30;
+};
+
+struct SkyLutTuningView
+{
+	const char* Name;
+	float CameraHeight;		// Kilometers
+	float SunElevation;		// Radians, as Game::uiSunPitch
+};
+
+// Luminance as seen by the application for one view: the sky through the fast sky path, and the aerial perspective
+// applied to geometry at a few depths, for depths in front of the ground only.
+struct SkyLutTuningImage
+{
+	std::vector<float> Sky;						// RGBA per pixel
+	std::vector<float> AerialPerspective;		// RGBA per valid sample
+	std::vector<uint32> SamplePixels;			// Pixel and depth index of each aerial perspective sample
+	std::vector<uint32> SampleDepths;
+};
+
+struct SkyLutTuningPoint
+{
+	SkyLutConfig Config;
+	double CostMs;
+	double SkyError;
+	double AerialPerspectiveError;
+	double Error;			// RMS of the sky and aerial perspective relative errors
+};
+
+struct CameraVolumePrefixResult
+{
+	const char* View;
+	float SamplesPerSlice;
+	BakeTimings SliceTimings;
+	BakeTimings PrefixTimings;
+	double SliceError = 0.0;
+	double PrefixError = 0.0;
+	CameraVolumeCullingStats Culling;
+};
+
+// LUTs the application uses to bake the sky view LUTs, and the options matching its sky view LUT passes.
+struct SkyViewLutAtlasInputs
+{
+	CpuLut2D TransmittanceLut;
+	CpuLut2D MultiScatLut;
+	IntegrateScatteredLuminanceOptions Options;
+};
+
+struct WavefrontPathTracingConfig
+{
+	const char* Name;
+	CpuPathTracingSettings Settings;
+};
+
+
+
+// Number of texel channels that are NaN, infinite or negative, i.e. the symptoms of a broken atmosphere setup.
+size_t countInvalidValues(const std::vector<float>& data);
+
+float meanAbsError(const CpuLut2D& test, const CpuLut2D& reference);
+
+// Transmittance LUT from a heavily sampled march.
+void bakeTransmittanceReference(CpuThreadPool& pool, const CpuSkyToolsContext& ctx, float referenceSampleCount, CpuLut2D& reference);
+
+// Random queries from the ground up to 100km, any view direction and the sun anywhere above the horizon.
+std::vector<SkyRadianceQuery> getRandomSkyRadianceQueries(uint32 queryCount);
+
+CameraVolumeView getTuningCameraView(const SkyLutTuningView& tuningView);
+
+// Marches every pixel and sample with a fixed and high sample count, up to the atmosphere top or the ground for the sky.
+void renderSkyLutTuningReference(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut,
+	const CpuLut2D& MultiScatLut, const CameraVolumeView& view, float SampleCount, SkyLutTuningImage& outImage);
+
+double getSkyLutTuningSkyError(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, const CameraVolumeView& view, const SkyLutTuningImage& reference);
+
+// Sorts the points by cost and returns the Pareto frontier: each point having a lower error than all the cheaper ones.
+std::vector<SkyLutTuningPoint> getSkyLutTuningFrontier(std::vector<SkyLutTuningPoint>& points);
+
+// Camera volume baked per slice (RenderCameraVolumePS) and front to back (CameraVolumesPrefixCS) with the same slices, against
+// the samples per slice: bake time, aerial perspective error against a reference march, and froxels culled by the front to back bake,
+// for ground views and views looking down from high up. Each result is printed as a table row.
+std::vector<CameraVolumePrefixResult> measureCameraVolumePrefix(CpuSkyToolsContext& ctx, CpuThreadPool& pool, int iterations);
+
+void bakeSkyViewLutAtlasInputs(CpuThreadPool& pool, const AtmosphereInfo& info, const SkyLutConfig& config, float multipleScatteringFactor,
+	SkyViewLutAtlasInputs& out);
+
+// Luminance error of a cubemap mip against a reference, summed over the texels relative to the summed reference. All the texels of a face
+// cover about the same solid angle.
+double getCubemapRelativeError(const CpuCubemap& cubemap, const CpuCubemap& reference, uint32 mip);
+
+// Application default view: camera, sun and path tracing settings as on startup.
+CpuPathTracingSettings getDefaultPathTracingSettings(uint32 width, uint32 height);
+
+// The default view with the application settings, with the multiple scattering LUT, and with ground bounces, Mie importance
+// sampling and delta tracking shadow rays.
+void getWavefrontPathTracingConfigs(uint32 width, uint32 height, uint32 samplesPerPixel, const CpuLut2D& multiScatLut, WavefrontPathTracingConfig configs[3]);
+
+// Presets with every field varying from one state to the next.
+std::vector<SavedState> getStateRecordPresets(uint32 count);
+
+bool isSameSavedState(const SavedState& a, const SavedState& b);
+
+
+
+// check-* commands, listed in CpuSkyToolsCommands
+
+// CpuSkyChecks_Luts.cpp
+int commandCheckAnalyticTransmittance(CpuSkyToolsContext& ctx);
+int commandCheckMultiScatteringDeterminism(CpuSkyToolsContext& ctx);
+int commandCheckLutDependencyGraph(CpuSkyToolsContext& ctx);
+int commandCheckSkyLutConfig(CpuSkyToolsContext& ctx);
+int commandCheckCameraVolumePrefix(CpuSkyToolsContext& ctx);
+int commandCheckSunInScatterLut(CpuSkyToolsContext& ctx);
+int commandCheckBruneton(CpuSkyToolsContext& ctx);
+int commandCheckLutCache(CpuSkyToolsContext& ctx);
+
+// CpuSkyChecks_SkyView.cpp
+int commandCheckSkyRadiance(CpuSkyToolsContext& ctx);
+int commandCheckSkyViewResolution(CpuSkyToolsContext& ctx);
+int commandCheckSkyViewAmortization(CpuSkyToolsContext& ctx);
+int commandCheckSkyViewAtlas(CpuSkyToolsContext& ctx);
+int commandCheckSkyIrradianceSH(CpuSkyToolsContext& ctx);
+int commandCheckSkyCubemap(CpuSkyToolsContext& ctx);
+
+// CpuSkyChecks_PathTracer.cpp
+int commandCheckPathTracing(CpuSkyToolsContext& ctx);
+int commandCheckSamplers(CpuSkyToolsContext& ctx);
+int commandCheckAdaptivePathTracing(CpuSkyToolsContext& ctx);
+int commandCheckWavefrontPathTracing(CpuSkyToolsContext& ctx);
+
+// CpuSkyChecks_Capture.cpp
+int commandCheckHdrCapture(CpuSkyToolsContext& ctx);
+int commandCheckCaptureScript(CpuSkyToolsContext& ctx);
+int commandCheckStateRecords(CpuSkyToolsContext& ctx);
+int commandCheckTimerTrace(CpuSkyToolsContext& ctx);
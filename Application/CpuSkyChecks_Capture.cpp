@@ -0,0 +1,367 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "CpuSkyChecks.h"
+#include "HdrCaptureWriter.h"
+#include "CaptureSequence.h"
+#include "DX11Base/TimerTrace.h"
+
+// check-* commands of the captures: HDR EXR files, capture scripts, state records and timer traces.
+
+
+
+// Frames written by HdrCaptureWriter must read back as submitted, RGB divided by the sample count in alpha unless it is 0, for every
+// compression and with a queue shorter than the capture. Failed writes are counted, and queued frames are written on destruction.
+int commandCheckHdrCapture(CpuSkyToolsContext&)
+{
+	const uint32 width = 37;
+	const uint32 height = 21;
+	const uint32 frameCount = 5;
+	auto getFilename = [](uint32 frame)
+	{
+		char filename[64];
+		snprintf(filename, sizeof(filename), "hdr_capture_check_%05u.exr", frame);
+		return std::string(filename);
+	};
+	auto makeFrame = [&](uint32 frame)
+	{
+		HdrCaptureFrame captureFrame;
+		captureFrame.Filename = getFilename(frame);
+		captureFrame.Width = width;
+		captureFrame.Height = height;
+		captureFrame.Rgba.resize(size_t(width) * height * 4);
+		for (size_t p = 0; p < size_t(width) * height; ++p)
+		{
+			float* rgba = &captureFrame.Rgba[p * 4];
+			rgba[0] = float(p % 97) * 0.37f + float(frame);
+			rgba[1] = float(p % 13) * 1.5e3f;
+			rgba[2] = float(p % 7) * 1e-4f;
+			rgba[3] = p % 5 == 0 ? 0.0f : float(3 * (frame + 1));
+		}
+		return captureFrame;
+	};
+	auto readsBack = [&](uint32 frame)
+	{
+		CpuLut2D image;
+		const HdrCaptureFrame expected = makeFrame(frame);
+		bool ok = loadLutExr(image, expected.Filename.c_str()) && image.Width == width && image.Height == height;
+		for (size_t p = 0; ok && p < size_t(width) * height; ++p)
+		{
+			const float* rgba = &expected.Rgba[p * 4];
+			const float invSampleCount = rgba[3] > 0.0f ? 1.0f / rgba[3] : 1.0f;
+			for (int c = 0; c < 3; ++c)
+			{
+				ok &= image.Data[p * 4 + c] == rgba[c] * invSampleCount;
+			}
+			ok &= image.Data[p * 4 + 3] == 1.0f;
+		}
+		remove(expected.Filename.c_str());
+		return ok;
+	};
+
+	CheckReporter checks;
+	for (int compression = 0; compression < HdrCaptureCompressionCount; ++compression)
+	{
+		HdrCaptureWriter writer(2);
+		writer.setCompression(HdrCaptureCompression(compression));
+		for (uint32 frame = 0; frame < frameCount; ++frame)
+		{
+			writer.submit(makeFrame(frame));
+		}
+		writer.flush();
+		const HdrCaptureWriter::Stats stats = writer.getStats();
+		bool ok = stats.FramesWritten == frameCount && stats.FramesFailed == 0 && stats.QueuedFrames == 0;
+		for (uint32 frame = 0; frame < frameCount; ++frame)
+		{
+			ok &= readsBack(frame);
+		}
+		checks.check(std::string(getHdrCaptureCompressionName(HdrCaptureCompression(compression))) + " frames read back", ok);
+	}
+
+	{
+		HdrCaptureWriter writer(2);
+		HdrCaptureFrame frame = makeFrame(0);
+		frame.Filename = "hdr_capture_check_missing_directory/frame.exr";
+		writer.submit(std::move(frame));
+		writer.flush();
+		const HdrCaptureWriter::Stats stats = writer.getStats();
+		checks.check("failed write counted", stats.FramesWritten == 0 && stats.FramesFailed == 1);
+	}
+
+	{
+		HdrCaptureWriter writer(frameCount);
+		for (uint32 frame = 0; frame < frameCount; ++frame)
+		{
+			writer.submit(makeFrame(frame));
+		}
+	}
+	bool written = true;
+	for (uint32 frame = 0; frame < frameCount; ++frame)
+	{
+		written &= readsBack(frame);
+	}
+	checks.check("queued frames written on destruction", written);
+
+	return checks.finish();
+}
+
+// A built-in script run against NullCaptureRenderer: set values carry over to the following captures and capture values only apply to
+// their capture, reset restores the startup state, and captures are taken in order once their wait, LUT and sample conditions are met,
+// skipped or timed out as requested. Invalid scripts must fail with the line of the error.
+int commandCheckCaptureScript(CpuSkyToolsContext&)
+{
+	const char* script =
+		"# Sun sweep\n"
+		"set sunPitch=0.1 method=raymarching\n"
+		"capture a.exr\n"
+		"capture b.exr sunPitch=0.3 wait=5   # this capture only\n"
+		"set method=pathtracing\n"
+		"capture c.exr samples=32\n"
+		"set groundAlbedo=0.1,0.2,0.3\n"
+		"capture d.exr skipScreenshot=1\n"
+		"reset\n"
+		"capture e.exr\n"
+		"capture f.exr method=pathtracing samples=500 maxFrames=50\n";
+	const CaptureSceneState startup;
+
+	CheckReporter checks;
+
+	std::vector<CaptureShot> shots;
+	std::string error;
+	const bool parsed = parseCaptureScript(script, shots, error) && shots.size() == 6;
+	checks.check("script parsed", parsed);
+	if (!parsed)
+	{
+		printf("  %s\nFAILED\n", error.c_str());
+		return 1;
+	}
+	checks.check("set values carry over", shots[0].State.SunPitch == 0.1f && shots[2].State.SunPitch == 0.1f && shots[0].Line == 3);
+	checks.check("capture values only apply to their capture", shots[1].State.SunPitch == 0.3f && shots[1].WaitFrameCount == 5 && shots[2].WaitFrameCount == 3);
+	checks.check("capture settings", shots[2].State.RenderingMethod == CaptureMethodPathTracing && shots[2].PathTracingSampleCount == 32
+		&& shots[3].SkipScreenshot && shots[3].State.Atmosphere.ground_albedo.y == 0.2f);
+	checks.check("reset restores the startup state", memcmp(&shots[4].State.Atmosphere, &startup.Atmosphere, sizeof(AtmosphereInfo)) == 0
+		&& shots[4].State.SunPitch == startup.SunPitch && shots[4].State.RenderingMethod == startup.RenderingMethod);
+
+	const uint32 lutFrameCount = 4;
+	NullCaptureRenderer renderer(lutFrameCount);
+	CaptureState state;
+	buildCaptureState(shots, renderer, state);
+	do
+	{
+		renderer.renderFrame();
+	} while (updateCaptureState(state, renderer));
+	const std::vector<NullCaptureRenderer::Capture>& captures = renderer.getCaptures();
+	const bool captured = captures.size() == 5 && state.capturedCount == 5 && state.timedOutCount == 1;
+	checks.check("captures taken and skipped", captured);
+	if (captured)
+	{
+		const char* expectedNames[] = { "a.exr", "b.exr", "c.exr", "e.exr", "f.exr" };
+		bool inOrder = true;
+		for (size_t c = 0; c < captures.size(); ++c)
+		{
+			inOrder &= captures[c].Filename == expectedNames[c] && (c == 0 || captures[c].Frame > captures[c - 1].Frame);
+		}
+		checks.check("captures in script order", inOrder);
+		checks.check("capture state", captures[1].State.SunPitch == 0.3f && captures[3].State.SunPitch == startup.SunPitch);
+		checks.check("first capture waits for the LUTs", captures[0].Frame >= lutFrameCount);
+		checks.check("capture waits its frames", captures[1].Frame - captures[0].Frame >= 5);
+		checks.check("capture waits its samples", captures[2].PathTracingSampleCount >= 32);
+		checks.check("capture times out", captures[4].PathTracingSampleCount < 500 && captures[4].Frame - captures[3].Frame <= 50);
+	}
+
+	struct InvalidScript
+	{
+		const char* Script;
+		const char* Error;
+	};
+	const InvalidScript invalidScripts[] = {
+		{ "capture a.exr\ncapture\n", "line 2: " },
+		{ "set sunPitch\n", "line 1: " },
+		{ "# comment\n\nset unknownKey=1\n", "line 3: " },
+		{ "set sunPitch=high\n", "line 1: " },
+		{ "set groundAlbedo=0.1,0.2\n", "line 1: " },
+		{ "set method=pathtracing\njump a.exr\n", "line 2: " },
+	};
+	bool rejected = true;
+	for (const InvalidScript& invalid : invalidScripts)
+	{
+		error.clear();
+		rejected &= !parseCaptureScript(invalid.Script, shots, error) && error.compare(0, strlen(invalid.Error), invalid.Error) == 0;
+	}
+	checks.check("invalid scripts rejected with their line", rejected);
+
+	return checks.finish();
+}
+
+// Record decoding: a raw dump from the original SaveState is migrated, unknown fields are skipped, missing fields keep their default
+// value, and truncated or foreign files are rejected.
+int commandCheckStateRecords(CpuSkyToolsContext&)
+{
+	const std::vector<SavedState> states = getStateRecordPresets(64);
+	CheckReporter checks;
+
+	std::vector<SavedState> loaded;
+	std::vector<unsigned char> file = { 0x53, 0x4B, 0x59, 0x53, STATE_FILE_VERSION, 0, 0, 0, uint8_t(states.size()), 0, 0, 0, sizeof(StateFileHeader), 0, 0, 0 };
+	for (const SavedState& state : states)
+	{
+		encodeSavedState(state, file);
+	}
+	bool roundTrip = decodeStateFile(file.data(), file.size(), loaded) && loaded.size() == states.size();
+	for (size_t s = 0; roundTrip && s < states.size(); ++s)
+	{
+		roundTrip &= isSameSavedState(loaded[s], states[s]);
+	}
+	checks.check("states round trip", roundTrip);
+	checks.check("truncated file rejected", !decodeStateFile(file.data(), file.size() - 1, loaded));
+	std::vector<unsigned char> foreignFile = file;
+	foreignFile[0] = 'X';
+	checks.check("other magic rejected", !decodeStateFile(foreignFile.data(), foreignFile.size(), loaded));
+
+	// Raw dump, in the order the original SaveState wrote the members.
+	const SavedState& reference = states[states.size() / 2];
+	std::vector<unsigned char> rawDump;
+	auto append = [&](const void* data, size_t size) { rawDump.insert(rawDump.end(), (const unsigned char*)data, (const unsigned char*)data + size); };
+	append(&reference.Atmosphere, sizeof(AtmosphereInfo));
+	append(&reference.AtmosphereSaved, sizeof(AtmosphereInfo));
+	append(reference.CamPos, 12);
+	append(reference.CamPosFinal, 12);
+	append(reference.ViewDir, 12);
+	append(reference.SunDir, 12);
+	const float floats[] = { reference.SunIlluminanceScale, reference.ViewPitch, reference.ViewYaw, reference.CamHeight, reference.CamForward, reference.SunPitch, reference.SunYaw };
+	append(floats, sizeof(floats));
+	append(&reference.NumScatteringOrder, sizeof(int));
+	uint32 version = 0xFFFFFFFF;
+	const bool migrated = decodeStateFile(rawDump.data(), rawDump.size(), loaded, &version) && version == STATE_FILE_VERSION_RAW
+		&& loaded.size() == 1 && isSameSavedState(loaded[0], reference);
+	checks.check("raw dump migrated", migrated);
+
+	// Record with a field this version does not know about, as written by a later version.
+	std::vector<unsigned char> laterFile = { 0x53, 0x4B, 0x59, 0x53, STATE_FILE_VERSION, 0, 0, 0, 1, 0, 0, 0, sizeof(StateFileHeader), 0, 0, 0 };
+	encodeSavedState(reference, laterFile);
+	const unsigned char unknownField[] = { 0xFF, 0x7F, 8, 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+	laterFile.insert(laterFile.end(), unknownField, unknownField + sizeof(unknownField));
+	const uint32 recordSize = uint32(laterFile.size() - sizeof(StateFileHeader) - 4);
+	memcpy(&laterFile[sizeof(StateFileHeader)], &recordSize, 4);	// Little endian hosts only, fine for this check
+	const bool skipped = decodeStateFile(laterFile.data(), laterFile.size(), loaded) && loaded.size() == 1 && isSameSavedState(loaded[0], reference);
+	checks.check("unknown field skipped", skipped);
+
+	// Record with the sun pitch only, as written by a version that had no other field.
+	const float sunPitch = 0.25f;
+	std::vector<unsigned char> partialFile = { 0x53, 0x4B, 0x59, 0x53, STATE_FILE_VERSION, 0, 0, 0, 1, 0, 0, 0, sizeof(StateFileHeader), 0, 0, 0,
+		8, 0, 0, 0, uint8_t(StateFieldSunPitch), 0, 4, 0 };
+	partialFile.insert(partialFile.end(), (const unsigned char*)&sunPitch, (const unsigned char*)&sunPitch + 4);
+	SavedState expected;
+	expected.SunPitch = sunPitch;
+	checks.check("missing fields keep their default", decodeStateFile(partialFile.data(), partialFile.size(), loaded) && loaded.size() == 1
+		&& isSameSavedState(loaded[0], expected));
+
+	return checks.finish();
+}
+
+// Timer statistics and Chrome trace export on synthetic frames: checks min/avg/max/p95 against known values and that the
+// written slices nest properly, children being made to overrun their parent slightly as GPU timestamp rounding does.
+int commandCheckTimerTrace(CpuSkyToolsContext& ctx)
+{
+	const uint32 frameCount = uint32((std::max)(1, atoi(ctx.arg(0, "240"))));
+	const char* filepath = ctx.arg(1, "timer_trace_check.json");
+	CheckReporter checks;
+
+	// Durations 1 to 150 ms through a window of 100: only 51 to 150 remain.
+	TimerStatistics statistics(100);
+	for (int i = 1; i <= 150; ++i)
+	{
+		statistics.addSample("Linear", double(i));
+	}
+	TimerStats stats;
+	const bool linearStats = statistics.getStats("Linear", stats);
+	printf("Statistics: min %.1f avg %.2f max %.1f p95 %.1f over %u samples (expected 51 100.50 150 145 over 100)\n",
+		stats.minMs, stats.avgMs, stats.maxMs, stats.p95Ms, stats.sampleCount);
+	checks.check("statistics over the sample window", linearStats && stats.sampleCount == 100 && stats.minMs == 51.0f && stats.maxMs == 150.0f
+		&& stats.avgMs == 100.5f && stats.p95Ms == 145.0f);
+	checks.check("no statistics for an unknown timer", !statistics.getStats("Unknown", stats));
+
+	// Frames shaped as the application ones: Frame > GameRender > SkyRender > TransLUT, SkyViewLut, then Imgui.
+	ChromeTraceWriter writer;
+	if (!writer.open(filepath, "check-timer-trace", "GPU"))
+	{
+		fprintf(stderr, "Failed to open %s\n", filepath);
+		return 1;
+	}
+	uint32 sampleCount = 0;
+	for (uint32 f = 0; f < frameCount; ++f)
+	{
+		const double jitter = 0.001 * double(f % 7);
+		TimerFrame frame(6);
+		frame[0].name = "Frame";		frame[0].parent = -1;	frame[0].beginMs = 0.0;				frame[0].durationMs = 16.0;
+		frame[1].name = "GameRender";	frame[1].parent = 0;	frame[1].beginMs = 0.5;				frame[1].durationMs = 12.0;
+		frame[2].name = "SkyRender";	frame[2].parent = 1;	frame[2].beginMs = 1.0;				frame[2].durationMs = 4.0 + jitter;
+		frame[3].name = "TransLUT";		frame[3].parent = 2;	frame[3].beginMs = 1.0 - jitter;	frame[3].durationMs = 0.5;
+		frame[4].name = "SkyViewLut";	frame[4].parent = 2;	frame[4].beginMs = 1.5;				frame[4].durationMs = 3.5 + 2.0 * jitter;
+		frame[5].name = "Imgui \"quoted\"";	frame[5].parent = 0;	frame[5].beginMs = 13.0;	frame[5].durationMs = 1.0;
+		statistics.addFrame(frame);
+		writer.writeFrame(frame, 16666.0 * f, f);
+		sampleCount += uint32(frame.size());
+	}
+	const unsigned long long eventCount = writer.getWrittenEventCount();
+	writer.close();
+	checks.check("statistics of frame timers", statistics.getStats("SkyRender", stats) && stats.sampleCount == (std::min)(frameCount, 100u));
+
+	// One event per line: check every pair of slices of a frame is either disjoint or nested.
+	struct Slice
+	{
+		double BeginUs;
+		double EndUs;
+	};
+	std::vector<std::vector<Slice>> frames(frameCount);
+	FILE* file = fopen(filepath, "rb");
+	char line[512];
+	uint32 sliceCount = 0;
+	while (file && fgets(line, sizeof(line), file))
+	{
+		const char* ts = strstr(line, "\"ts\":");
+		const char* frameArg = strstr(line, "\"frame\":");
+		Slice slice;
+		double durationUs = 0.0;
+		unsigned long long frameId = 0;
+		if (!ts || !frameArg || sscanf(ts, "\"ts\":%lf,\"dur\":%lf", &slice.BeginUs, &durationUs) != 2 || sscanf(frameArg, "\"frame\":%llu", &frameId) != 1
+			|| frameId >= frameCount)
+		{
+			continue;
+		}
+		slice.EndUs = slice.BeginUs + durationUs;
+		frames[size_t(frameId)].push_back(slice);
+		sliceCount++;
+	}
+	if (file)
+	{
+		fclose(file);
+	}
+	remove(filepath);
+	uint32 badNestingCount = 0;
+	for (const std::vector<Slice>& slices : frames)
+	{
+		for (size_t a = 0; a < slices.size(); ++a)
+		{
+			for (size_t b = a + 1; b < slices.size(); ++b)
+			{
+				const Slice& sa = slices[a];
+				const Slice& sb = slices[b];
+				const bool disjoint = sa.EndUs <= sb.BeginUs || sb.EndUs <= sa.BeginUs;
+				const bool nested = (sa.BeginUs <= sb.BeginUs && sb.EndUs <= sa.EndUs) || (sb.BeginUs <= sa.BeginUs && sa.EndUs <= sb.EndUs);
+				badNestingCount += disjoint || nested ? 0 : 1;
+			}
+		}
+	}
+	printf("Trace: %llu events written, %u slices read back for %u samples, %u badly nested pair(s)\n", eventCount, sliceCount, sampleCount, badNestingCount);
+	checks.check("one slice per sample", sliceCount == sampleCount);
+	checks.check("slices disjoint or nested", badNestingCount == 0);
+	return checks.finish();
+}
@@ -0,0 +1,519 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CpuSkyChecks.h"
+#include "CpuBruneton.h"
+#include "LutDependencyGraph.h"
+#include "LutDiskCache.h"
+
+// check-* commands of the LUTs: transmittance, multiple scattering, sun in-scattering, camera volume and Bruneton 2017,
+// with their configuration, dependencies and disk cache.
+
+
+
+// The analytic transmittance LUT must be closer to a heavily sampled march than the ray marched LUT it replaces, everywhere within maxAbsError.
+int commandCheckAnalyticTransmittance(CpuSkyToolsContext& ctx)
+{
+	const float maxAbsError = float(atof(ctx.arg(0, "0.02")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D reference;
+	bakeTransmittanceReference(pool, ctx, 4096.0f, reference);
+	CpuLut2D marched, analytic;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, marched, false);
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, analytic, true);
+	const LutComparison marchedCmp = compareLuts(marched, reference, 0, 0.0f);
+	const LutComparison analyticCmp = compareLuts(analytic, reference, 0, 0.0f);
+	const float marchedMeanError = meanAbsError(marched, reference);
+	const float analyticMeanError = meanAbsError(analytic, reference);
+
+	CheckReporter checks;
+	checks.checkBound("no invalid texels", double(countInvalidValues(analytic.Data)), 0.0);
+	checks.checkBound("max abs error", analyticCmp.MaxAbsError, maxAbsError);
+	checks.checkBound("max abs error against the march", analyticCmp.MaxAbsError, marchedCmp.MaxAbsError);
+	checks.checkBound("mean abs error against the march", analyticMeanError, marchedMeanError);
+	return checks.finish();
+}
+
+// Bakes the multiple scattering LUT with 1 to maxThreads threads and checks that all results are bit-identical.
+int commandCheckMultiScatteringDeterminism(CpuSkyToolsContext& ctx)
+{
+	const uint32 maxThreads = uint32((std::max)(2, atoi(ctx.arg(0, "8"))));
+
+	CpuThreadPool singleThreadPool(1);
+	CpuLut2D transmittanceLut;
+	CpuLut2D reference;
+	bakeTransmittanceLut(singleThreadPool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	bakeMultiScatteringLut(singleThreadPool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, reference);
+
+	CheckReporter checks;
+	for (uint32 threadCount = 2; threadCount <= maxThreads; ++threadCount)
+	{
+		CpuThreadPool pool(threadCount);
+		CpuLut2D lut;
+		bakeMultiScatteringLut(pool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, lut);
+		checks.check(std::to_string(threadCount) + " threads identical to 1 thread",
+			memcmp(lut.Data.data(), reference.Data.data(), reference.Data.size() * sizeof(float)) == 0);
+	}
+	return checks.finish();
+}
+
+// Invalidated LUTs for single field edits of the atmosphere and for each render setting, against the expected masks.
+// The camera volumes depend on the Bruneton 2017 tables, so any field only read by those also invalidates them.
+int commandCheckLutDependencyGraph(CpuSkyToolsContext& ctx)
+{
+	const uint32 T = lutNodeBit(LutNodeTransmittance);
+	const uint32 M = lutNodeBit(LutNodeMultiScattering);
+	const uint32 S = lutNodeBit(LutNodeSunInScatter);
+	const uint32 V = lutNodeBit(LutNodeSkyView);
+	const uint32 A = lutNodeBit(LutNodeAerialPerspective);
+	const uint32 B = lutNodeBit(LutNodeBruneton2017);
+	const uint32 All = T | M | S | V | A | B;
+
+	struct FieldEdit
+	{
+		const char* Name;
+		LutInput Input;
+		void (*Edit)(AtmosphereInfo& info);
+		uint32 Expected;
+	};
+	const FieldEdit fieldEdits[] =
+	{
+		{ "solar_irradiance",		LutInputSolarIrradiance,		[](AtmosphereInfo& info) { info.solar_irradiance.x *= 2.0f; },				B | A },
+		{ "sun_angular_radius",		LutInputSunAngularRadius,		[](AtmosphereInfo& info) { info.sun_angular_radius *= 2.0f; },				B | A },
+		{ "bottom_radius",			LutInputBottomRadius,			[](AtmosphereInfo& info) { info.bottom_radius += 1.0f; },					All },
+		{ "top_radius",				LutInputTopRadius,				[](AtmosphereInfo& info) { info.top_radius += 1.0f; },						All },
+		{ "rayleigh_density",		LutInputRayleighDensity,		[](AtmosphereInfo& info) { info.rayleigh_density.layers[1].exp_scale *= 2.0f; },	All },
+		{ "rayleigh_scattering",	LutInputRayleighScattering,		[](AtmosphereInfo& info) { info.rayleigh_scattering.y *= 2.0f; },			All },
+		{ "mie_density",			LutInputMieDensity,				[](AtmosphereInfo& info) { info.mie_density.layers[1].exp_scale *= 2.0f; },	All },
+		{ "mie_scattering",			LutInputMieScattering,			[](AtmosphereInfo& info) { info.mie_scattering.z *= 0.5f; },				M | S | V | A | B },
+		{ "mie_extinction",			LutInputMieExtinction,			[](AtmosphereInfo& info) { info.mie_extinction.z *= 2.0f; },				All },
+		{ "mie_phase_function_g",	LutInputMiePhaseG,				[](AtmosphereInfo& info) { info.mie_phase_function_g = 0.5f; },			V | A | B },
+		{ "absorption_density",		LutInputAbsorptionDensity,		[](AtmosphereInfo& info) { info.absorption_density.layers[0].width += 1.0f; },	All },
+		{ "absorption_extinction",	LutInputAbsorptionExtinction,	[](AtmosphereInfo& info) { info.absorption_extinction.x *= 2.0f; },			All },
+		{ "ground_albedo",			LutInputGroundAlbedo,			[](AtmosphereInfo& info) { info.ground_albedo.x = 0.9f; },					M | S | V | A | B },
+		{ "mu_s_min",				LutInputMuSMin,					[](AtmosphereInfo& info) { info.mu_s_min = 0.0f; },						B | A },
+	};
+	struct SettingEdit
+	{
+		const char* Name;
+		LutInput Input;
+		uint32 Expected;
+	};
+	const SettingEdit settingEdits[] =
+	{
+		{ "multiple_scattering_factor",	LutInputMultipleScatteringFactor,	M | S | V | A },
+		{ "scattering_order",			LutInputScatteringOrder,			B | A },
+		{ "view (camera, sun)",			LutInputView,						V | A },
+		{ "rendering_method",			LutInputRenderingMethod,			A },
+		{ "optical_depth_method",		LutInputOpticalDepthMethod,			T | M | S | V | A },
+	};
+
+	// Stale LUTs after the change of a graph where every LUT has been generated, checked against the expected mask.
+	CheckReporter checks;
+	auto checkEdit = [&](const char* name, uint32 changedInputs, uint32 expectedInputs, uint32 expected, const std::function<uint32(LutDependencyGraph&)>& invalidate)
+	{
+		LutDependencyGraph graph;
+		for (uint32 n = 0; n < LutNodeCount; ++n)
+		{
+			graph.markRebuilt(LutNode(n));
+		}
+		const uint32 invalidated = invalidate(graph);
+		bool ok = changedInputs == expectedInputs && invalidated == expected && graph.getStaleNodes() == expected;
+		for (uint32 n = 0; n < LutNodeCount; ++n)
+		{
+			// Generated once, then stale again only if invalidated.
+			ok &= graph.getDirtyCount(LutNode(n)) == ((expected & lutNodeBit(LutNode(n))) ? 2u : 1u);
+		}
+
+		std::string result = std::string(name) + ":";
+		for (uint32 n = 0; n < LutNodeCount; ++n)
+		{
+			if (invalidated & lutNodeBit(LutNode(n)))
+			{
+				result += std::string(" ") + LutDependencyGraph::getNodeName(LutNode(n));
+			}
+		}
+		if (!ok)
+		{
+			char mismatch[128];
+			snprintf(mismatch, sizeof(mismatch), " (expected inputs 0x%x nodes 0x%x, got inputs 0x%x nodes 0x%x)", expectedInputs, expected, changedInputs, invalidated);
+			result += mismatch;
+		}
+		checks.check(result, ok);
+	};
+
+	for (const FieldEdit& edit : fieldEdits)
+	{
+		AtmosphereInfo current = ctx.Atmosphere;
+		edit.Edit(current);
+		const uint32 changedInputs = LutDependencyGraph::getChangedInputs(ctx.Atmosphere, current);
+		checkEdit(edit.Name, changedInputs, 1u << edit.Input, edit.Expected,
+			[&](LutDependencyGraph& graph) { return graph.invalidateAtmosphere(ctx.Atmosphere, current); });
+	}
+	for (const SettingEdit& edit : settingEdits)
+	{
+		checkEdit(edit.Name, 1u << edit.Input, 1u << edit.Input, edit.Expected, [&](LutDependencyGraph& graph) { return graph.invalidate(edit.Input); });
+	}
+	checkEdit("(no change)", LutDependencyGraph::getChangedInputs(ctx.Atmosphere, ctx.Atmosphere), 0, 0,
+		[&](LutDependencyGraph& graph) { return graph.invalidateAtmosphere(ctx.Atmosphere, ctx.Atmosphere); });
+
+	return checks.finish();
+}
+
+// LUT configuration files as written by tune-sky-luts and read by -lutconfig: defaults, round trip and invalid lines, then the
+// Pareto frontier on synthetic points.
+int commandCheckSkyLutConfig(CpuSkyToolsContext&)
+{
+	const char* filepath = "sky_lut_config_check.txt";
+	CheckReporter checks;
+	auto writeFile = [&](const char* content)
+	{
+		FILE* file = fopen(filepath, "wb");
+		const bool written = file && fputs(content, file) >= 0;
+		return (file ? fclose(file) == 0 : false) && written;
+	};
+
+	const SkyLutConfig defaultConfig;
+	const LookUpTablesInfo lutInfo;
+	checks.check("defaults match LookUpTablesInfo", defaultConfig.TransmittanceWidth == lutInfo.TRANSMITTANCE_TEXTURE_WIDTH
+		&& defaultConfig.TransmittanceHeight == lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT);
+
+	SkyLutConfig config;
+	config.TransmittanceWidth = 64;
+	config.MultiScatteringSampleCount = 12.5f;
+	config.SkyViewWidth = 128;
+	config.SkyViewHeight = 72;
+	config.RayMarchMinMaxSPP[1] = 24.0f;
+	config.CameraVolumeKmPerSlice = 8.0f;
+	SkyLutConfig loaded;
+	std::string error;
+	checks.check("non default configuration round trip", config.save(filepath) && loaded.load(filepath, error) && loaded.toString() == config.toString());
+
+	loaded = SkyLutConfig();
+	checks.check("comments and missing keys", writeFile("# Tuned\nskyViewWidth=96 skyViewHeight=54 # Low tier\n\n") && loaded.load(filepath, error)
+		&& loaded.SkyViewWidth == 96 && loaded.SkyViewHeight == 54 && loaded.TransmittanceWidth == defaultConfig.TransmittanceWidth);
+
+	const char* invalidFiles[][2] = {
+		{ "unknown key rejected",			"skyViewWidth=96\nskyViewDepth=4\n" },
+		{ "fractional resolution rejected",	"skyViewWidth=96.5\n" },
+		{ "out of range value rejected",	"multiScatteringRes=1\n" },
+		{ "missing value rejected",			"skyViewWidth=\n" },
+		{ "setting without = rejected",		"skyViewWidth\n" },
+		{ "max SPP below min SPP rejected",	"rayMarchMinSPP=16 rayMarchMaxSPP=8\n" },
+	};
+	for (const auto& invalidFile : invalidFiles)
+	{
+		error.clear();
+		checks.check(invalidFile[0], writeFile(invalidFile[1]) && !loaded.load(filepath, error) && !error.empty());
+	}
+	writeFile("skyViewWidth=96\nskyViewDepth=4\n");
+	loaded.load(filepath, error);
+	checks.check("error reports the line", error.compare(0, 7, "line 2:") == 0);
+	remove(filepath);
+	checks.check("missing file rejected", !loaded.load(filepath, error));
+
+	// (cost, error) points, ties and dominated points included: the frontier keeps the costs 1, 2, 3, 4 and 6.
+	const double costErrors[][2] = { { 4.0, 0.5 }, { 1.0, 0.9 }, { 3.0, 0.6 }, { 2.0, 0.7 }, { 2.0, 0.8 }, { 5.0, 0.6 }, { 6.0, 0.1 }, { 3.0, 0.7 } };
+	std::vector<SkyLutTuningPoint> points;
+	for (const auto& costError : costErrors)
+	{
+		SkyLutTuningPoint point = {};
+		point.CostMs = costError[0];
+		point.Error = costError[1];
+		points.push_back(point);
+	}
+	const std::vector<SkyLutTuningPoint> frontier = getSkyLutTuningFrontier(points);
+	const double expectedCosts[] = { 1.0, 2.0, 3.0, 4.0, 6.0 };
+	bool frontierOk = frontier.size() == sizeof(expectedCosts) / sizeof(expectedCosts[0]);
+	for (size_t f = 0; frontierOk && f < frontier.size(); ++f)
+	{
+		frontierOk &= frontier[f].CostMs == expectedCosts[f] && (f == 0 || frontier[f].Error < frontier[f - 1].Error);
+	}
+	checks.check("Pareto frontier", frontierOk);
+
+	return checks.finish();
+}
+
+// The front to back camera volume must be at least as accurate as the per slice one where it is used: from high altitude at every
+// sample count, and within a quarter of the per slice error for every view at the default samples per slice.
+int commandCheckCameraVolumePrefix(CpuSkyToolsContext& ctx)
+{
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+	const std::vector<CameraVolumePrefixResult> results = measureCameraVolumePrefix(ctx, pool, 1);
+
+	CheckReporter checks;
+	for (const CameraVolumePrefixResult& result : results)
+	{
+		const bool altitude = strcmp(result.View, "altitude") == 0;
+		const bool defaultSamples = result.SamplesPerSlice == defaultConfig.CameraVolumeSamplesPerSlice;
+		if (!altitude && !defaultSamples)
+			continue;
+		const double tolerance = altitude ? 1.0 : 1.25;
+		char name[128];
+		snprintf(name, sizeof(name), "%-9s %g samples: prefix error %.5f, per slice error %.5f x %.2f", result.View, result.SamplesPerSlice,
+			result.PrefixError, result.SliceError, tolerance);
+		checks.check(name, result.PrefixError <= result.SliceError * tolerance);
+	}
+	return checks.finish();
+}
+
+// Sun visible in-scatter LUT: the parameterization round trip at texel centers, texels in the earth shadow, and the sky view LUT error
+// of views using the default LUT size staying close to the error of the separate transmittance and multiple scattering lookups.
+int commandCheckSunInScatterLut(CpuSkyToolsContext& ctx)
+{
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const SkyLutConfig defaultConfig;
+	const uint32 Width = defaultConfig.SunInScatterWidth;
+	const uint32 Height = defaultConfig.SunInScatterHeight;
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+
+	float maxTexelError = 0.0f;
+	for (uint32 y = 0; y < Height; ++y)
+	{
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			const float u = (float(x) + 0.5f) / float(Width);
+			const float v = (float(y) + 0.5f) / float(Height);
+			float viewHeight, SunZenithCosAngle, u2, v2;
+			UvToSunInScatterLutParams(Atmosphere, u, v, Width, Height, viewHeight, SunZenithCosAngle);
+			SunInScatterLutParamsToUv(Atmosphere, viewHeight, SunZenithCosAngle, Width, Height, u2, v2);
+			maxTexelError = (std::max)(maxTexelError, (std::max)(fabsf(u2 - u) * float(Width), fabsf(v2 - v) * float(Height)));
+		}
+	}
+	printf("  parameterization round trip: %.2e texel\n", maxTexelError);
+	checks.check("parameterization round trip", maxTexelError < 0.05f);
+
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = defaultConfig.TransmittanceWidth;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = defaultConfig.TransmittanceHeight;
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, lutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, defaultConfig.MultiScatteringRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	CpuSunInScatterLut sunInScatterLut;
+	bakeSunInScatterLut(pool, info, transmittanceLut, &multiScatLut, Width, Height, sunInScatterLut);
+
+	// The sun is below the horizon of every height of the atmosphere when its zenith cosine is below -sqrt(1 - (bottom / top)^2), and above
+	// it when positive, except close enough to the ground for the earth shadow test to start inside the offset planet.
+	const float nightCos = -sqrtf(1.0f - (Atmosphere.BottomRadius / Atmosphere.TopRadius) * (Atmosphere.BottomRadius / Atmosphere.TopRadius));
+	bool shadowOk = true;
+	for (uint32 y = 0; y < Height; ++y)
+	{
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			float viewHeight, SunZenithCosAngle;
+			UvToSunInScatterLutParams(Atmosphere, (float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height), Width, Height, viewHeight, SunZenithCosAngle);
+			const float* texel = sunInScatterLut.texel(x, y);
+			shadowOk &= SunZenithCosAngle >= nightCos || (texel[0] == 0.0f && texel[1] == 0.0f && texel[2] == 0.0f);
+			shadowOk &= SunZenithCosAngle <= 0.0f || viewHeight - Atmosphere.BottomRadius <= PLANET_RADIUS_OFFSET || texel[0] > 0.0f;
+		}
+	}
+	checks.check("earth shadow in the transmittance", shadowOk);
+
+	LookUpTablesInfo referenceLutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+	bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+	options.VariableSampleCount = true;
+	options.RayMarchMinMaxSPP[0] = defaultConfig.RayMarchMinMaxSPP[0];
+	options.RayMarchMinMaxSPP[1] = defaultConfig.RayMarchMinMaxSPP[1];
+	IntegrateScatteredLuminanceOptions lutOptions = options;
+	lutOptions.SunInScatterLut = &sunInScatterLut;
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+		{ "altitude",	40.0f,	0.45f },
+	};
+	for (const SkyLutTuningView& tuningView : views)
+	{
+		const CameraVolumeView view = getTuningCameraView(tuningView);
+		SkyLutTuningImage referenceImage;
+		renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, view, 256.0f, referenceImage);
+		CpuLut2D skyViewLut;
+		bakeSkyViewLut(pool, info, transmittanceLut, view.CamPos.z, sinf(tuningView.SunElevation), defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight, 30.0f, options, skyViewLut);
+		const double error = getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImage);
+		bakeSkyViewLut(pool, info, transmittanceLut, view.CamPos.z, sinf(tuningView.SunElevation), defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight, 30.0f, lutOptions, skyViewLut);
+		const double lutError = getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImage);
+		printf("  %s error: %.4f without the LUT, %.4f with\n", tuningView.Name, error, lutError);
+		char name[64];
+		snprintf(name, sizeof(name), "%s error with the LUT", tuningView.Name);
+		checks.check(name, lutError <= error * 1.1 + 0.002);
+	}
+
+	return checks.finish();
+}
+
+// Bruneton 2017 tables at the low resolution of LookUpTablesInfo: identical for 1 and 4 threads, free of NaN and negative values, without
+// indirect irradiance for a single scattering order, and gaining energy with the orders.
+int commandCheckBruneton(CpuSkyToolsContext& ctx)
+{
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 64;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 16;
+	lutInfo.SCATTERING_TEXTURE_R_SIZE = 16;
+	lutInfo.SCATTERING_TEXTURE_MU_SIZE = 16;
+	lutInfo.SCATTERING_TEXTURE_MU_S_SIZE = 16;
+	lutInfo.SCATTERING_TEXTURE_NU_SIZE = 4;
+	lutInfo.IRRADIANCE_TEXTURE_WIDTH = 32;
+	lutInfo.IRRADIANCE_TEXTURE_HEIGHT = 8;
+	lutInfo.updateDerivedData();
+	CheckReporter checks;
+	auto isSame = [](const std::vector<float>& a, const std::vector<float>& b)
+	{
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+	};
+	auto sum = [](const std::vector<float>& data, uint32 channel)
+	{
+		double total = 0.0;
+		for (size_t i = channel; i < data.size(); i += 4)
+		{
+			total += data[i];
+		}
+		return total;
+	};
+
+	CpuThreadPool singleThreadPool(1);
+	CpuThreadPool pool(4);
+	CpuBrunetonLuts reference, luts, singleOrderLuts;
+	bakeBrunetonLuts(singleThreadPool, ctx.Atmosphere, lutInfo, 4, reference);
+	bakeBrunetonLuts(pool, ctx.Atmosphere, lutInfo, 4, luts);
+	checks.check("identical for any thread count", isSame(luts.TransmittanceTex.Data, reference.TransmittanceTex.Data)
+		&& isSame(luts.IrradianceTex.Data, reference.IrradianceTex.Data) && isSame(luts.ScatteringTex.Data, reference.ScatteringTex.Data));
+	checks.check("no NaN, infinite or negative values", countInvalidValues(luts.TransmittanceTex.Data) + countInvalidValues(luts.IrradianceTex.Data)
+		+ countInvalidValues(luts.ScatteringTex.Data) == 0);
+
+	bakeBrunetonLuts(pool, ctx.Atmosphere, lutInfo, 1, singleOrderLuts);
+	checks.check("no indirect irradiance for a single order", sum(singleOrderLuts.IrradianceTex.Data, 0) == 0.0 && sum(luts.IrradianceTex.Data, 0) > 0.0);
+	bool gainsEnergy = isSame(singleOrderLuts.TransmittanceTex.Data, luts.TransmittanceTex.Data);
+	for (uint32 c = 0; c < 3; ++c)
+	{
+		gainsEnergy &= sum(luts.ScatteringTex.Data, c) > sum(singleOrderLuts.ScatteringTex.Data, c);
+	}
+	gainsEnergy &= sum(luts.ScatteringTex.Data, 3) == sum(singleOrderLuts.ScatteringTex.Data, 3);	// Single Mie scattering
+	checks.check("multiple scattering orders add energy", gainsEnergy);
+
+	return checks.finish();
+}
+
+// Cache entries must map back the texels they were written with, and must be rejected when they are for another key, another version,
+// other textures or truncated. Keys must change with everything the tables depend on.
+int commandCheckLutCache(CpuSkyToolsContext& ctx)
+{
+	LutCacheTextureDesc descs[2];
+	memset(descs, 0, sizeof(descs));
+	descs[0].Width = 7;
+	descs[0].Height = 5;
+	descs[0].Depth = 1;
+	descs[0].Format = 2;
+	descs[0].BytesPerTexel = 4 * sizeof(float);
+	descs[1].Width = 3;
+	descs[1].Height = 4;
+	descs[1].Depth = 6;
+	descs[1].Format = 26;	// DXGI_FORMAT_R11G11B10_FLOAT
+	descs[1].BytesPerTexel = sizeof(uint32);
+	std::vector<unsigned char> texels[2];
+	for (uint32 t = 0; t < 2; ++t)
+	{
+		texels[t].resize(size_t(descs[t].getDepthPitch()) * descs[t].Depth);
+		for (size_t i = 0; i < texels[t].size(); ++i)
+		{
+			texels[t][i] = (unsigned char)(i * 31 + t * 7 + 1);
+		}
+	}
+	const void* textureData[2] = { texels[0].data(), texels[1].data() };
+
+	CheckReporter checks;
+	auto opens = [&](const char* filepath, uint64 key, const LutCacheTextureDesc* expectedDescs)
+	{
+		MappedLutCacheEntry entry;
+		return entry.open(filepath, key, 2, expectedDescs);
+	};
+
+	const uint64 key = fnv1aHash64("check-lut-cache", 15);
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	checks.check("write", writeLutCacheEntry(filepath, key, 2, descs, textureData));
+	{
+		MappedLutCacheEntry entry;
+		bool ok = entry.open(filepath, key, 2, descs);
+		for (uint32 t = 0; t < 2 && ok; ++t)
+		{
+			ok &= entry.getHeader().Textures[t].Offset % LUT_CACHE_DATA_ALIGNMENT == 0
+				&& memcmp(entry.getTextureData(t), texels[t].data(), texels[t].size()) == 0;
+		}
+		checks.check("texels mapped back", ok);
+	}
+	checks.check("other key rejected", !opens(filepath, key + 1, descs));
+	LutCacheTextureDesc otherDescs[2] = { descs[0], descs[1] };
+	otherDescs[1].Depth = 5;
+	checks.check("other textures rejected", !opens(filepath, key, otherDescs));
+
+	std::vector<unsigned char> file;
+	if (FILE* f = fopen(filepath, "rb"))
+	{
+		unsigned char buffer[4096];
+		for (size_t n; (n = fread(buffer, 1, sizeof(buffer), f)) > 0;)
+		{
+			file.insert(file.end(), buffer, buffer + n);
+		}
+		fclose(f);
+	}
+	auto rewrite = [&](const std::vector<unsigned char>& bytes)
+	{
+		FILE* f = fopen(filepath, "wb");
+		const bool ok = f && fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+		if (f)
+		{
+			fclose(f);
+		}
+		return ok;
+	};
+	std::vector<unsigned char> otherVersion = file;
+	if (otherVersion.size() >= sizeof(LutCacheHeader))
+	{
+		reinterpret_cast<LutCacheHeader*>(otherVersion.data())->Version = LUT_CACHE_VERSION + 1;
+	}
+	checks.check("other version rejected", rewrite(otherVersion) && !opens(filepath, key, descs));
+	checks.check("truncated file rejected", rewrite(std::vector<unsigned char>(file.begin(), file.end() - 1)) && !opens(filepath, key, descs));
+	checks.check("header only file rejected", rewrite(std::vector<unsigned char>(file.begin(), file.begin() + (std::min)(file.size(), sizeof(LutCacheHeader) - 1)))
+		&& !opens(filepath, key, descs));
+	remove(filepath);
+	checks.check("missing file rejected", !opens(filepath, key, descs));
+
+	const uint64 atmosphereKey = computeLutCacheKey(ctx.Atmosphere, ctx.LutInfo, 4);
+	AtmosphereInfo otherAtmosphere = ctx.Atmosphere;
+	otherAtmosphere.ground_albedo.y += 0.01f;
+	LookUpTablesInfo otherLutInfo = ctx.LutInfo;
+	otherLutInfo.SCATTERING_TEXTURE_DEPTH *= 2;
+	checks.check("key stable", atmosphereKey == computeLutCacheKey(ctx.Atmosphere, ctx.LutInfo, 4));
+	checks.check("key depends on the atmosphere", atmosphereKey != computeLutCacheKey(otherAtmosphere, ctx.LutInfo, 4));
+	checks.check("key depends on the resolutions", atmosphereKey != computeLutCacheKey(ctx.Atmosphere, otherLutInfo, 4));
+	checks.check("key depends on the scattering orders", atmosphereKey != computeLutCacheKey(ctx.Atmosphere, ctx.LutInfo, 3));
+	const SkyLutConfig config;
+	SkyLutConfig otherConfig;
+	otherConfig.SkyViewWidth *= 2;
+	const uint64 atlasKey = computeSkyViewLutAtlasKey(ctx.Atmosphere, config, 1.0f);
+	checks.check("atlas key differs from the tables key", atlasKey != atmosphereKey);
+	checks.check("atlas key depends on the LUT config", atlasKey != computeSkyViewLutAtlasKey(ctx.Atmosphere, otherConfig, 1.0f));
+	checks.check("atlas key depends on the multiple scattering", atlasKey != computeSkyViewLutAtlasKey(ctx.Atmosphere, config, 0.0f));
+
+	return checks.finish();
+}
@@ -0,0 +1,318 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "CpuSkyChecks.h"
+
+// check-* commands of the path tracer: reference images, samplers, adaptive and wavefront path tracing.
+
+
+
+// Images must not depend on the thread count, an image refined progressively must match one rendered at once, and packets must agree
+// with the per path loop on the image mean. The view ray transmittance of single pixel images, whose ray is the view direction, must
+// match the marched optical depth within the noise of the estimate.
+int commandCheckPathTracing(CpuSkyToolsContext& ctx)
+{
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuThreadPool multiThreadPool((std::max)(4u, ctx.ThreadCount));
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+
+	CheckReporter checks;
+	auto meanLuminance = [](const CpuLut2D& image)
+	{
+		double sum = 0.0;
+		for (size_t t = 0; t < image.Data.size() / 4; ++t)
+		{
+			sum += (double(image.Data[t * 4 + 0]) + image.Data[t * 4 + 1] + image.Data[t * 4 + 2]) / 3.0;
+		}
+		return sum / double(image.Data.size() / 4);
+	};
+
+	CpuPathTracingSettings settings = getDefaultPathTracingSettings(48, 24);
+	settings.SamplesPerPixel = 12;
+	settings.GroundGlobalIllumination = true;
+	CpuLut2D luminance, transmittance, multiThreadLuminance, multiThreadTransmittance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, luminance, transmittance);
+	renderPathTracing(multiThreadPool, ctx.Atmosphere, transmittanceLut, settings, multiThreadLuminance, multiThreadTransmittance);
+	checks.check("no invalid values", countInvalidValues(luminance.Data) == 0 && countInvalidValues(transmittance.Data) == 0);
+	checks.check("same image on 4 threads", luminance.Data == multiThreadLuminance.Data && transmittance.Data == multiThreadTransmittance.Data);
+
+	CpuPathTracingSettings halfSettings = settings;
+	halfSettings.SamplesPerPixel = settings.SamplesPerPixel / 2;
+	CpuLut2D firstHalf, secondHalf, halfTransmittance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, halfSettings, firstHalf, halfTransmittance);
+	halfSettings.FirstSampleIndex = halfSettings.SamplesPerPixel;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, halfSettings, secondHalf, halfTransmittance);
+	double maxProgressiveDifference = 0.0;
+	const double imageMean = meanLuminance(luminance);
+	for (size_t i = 0; i < luminance.Data.size(); ++i)
+	{
+		const double refined = (double(firstHalf.Data[i]) + double(secondHalf.Data[i])) * 0.5;
+		maxProgressiveDifference = (std::max)(maxProgressiveDifference, fabs(refined - luminance.Data[i]) / imageMean);
+	}
+	printf("  max difference of the progressive image %.2e of the image mean\n", maxProgressiveDifference);
+	checks.check("same image refined progressively", maxProgressiveDifference <= 1e-5);
+
+	CpuPathTracingSettings perPathSettings = settings;
+	perPathSettings.SamplesPerPixel = 48;
+	perPathSettings.PacketLaneCount = 1;
+	CpuPathTracingSettings packetSettings = perPathSettings;
+	packetSettings.PacketLaneCount = 8;
+	CpuLut2D perPathLuminance, packetLuminance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, perPathSettings, perPathLuminance, transmittance);
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, packetSettings, packetLuminance, transmittance);
+	const double packetDifference = fabs(meanLuminance(packetLuminance) / meanLuminance(perPathLuminance) - 1.0);
+	printf("  packet image mean differs by %.2e\n", packetDifference);
+	checks.check("packets agree with the per path loop", packetDifference <= 0.02);
+
+	struct View
+	{
+		const char* Name;
+		float Pitch;
+		float Height;
+	};
+	const View views[] = { { "horizon", 0.0f, 0.5f }, { "up", 30.0f, 0.5f }, { "ground", -20.0f, 2.0f }, { "high", 5.0f, 20.0f } };
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(ctx.Atmosphere);
+	for (const View& view : views)
+	{
+		CpuPathTracingSettings pixelSettings = getDefaultPathTracingSettings(1, 1);
+		pixelSettings.Camera = getGameCamera(0.0f, view.Pitch, view.Height, 0.0f);
+		pixelSettings.SamplesPerPixel = 3 * 40000;	// Each wavelength gets the same number of samples
+		CpuLut2D pixelLuminance, pixelTransmittance;
+		renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, pixelSettings, pixelLuminance, pixelTransmittance);
+
+		const GlslVec3 WorldPos = pixelSettings.Camera.WorldPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+		const GlslVec3 expected = exp3(-IntegrateOpticalDepth(Atmosphere, WorldPos, normalize(pixelSettings.Camera.ViewDir), 4096.0f));
+		bool ok = true;
+		for (int c = 0; c < 3; ++c)
+		{
+			// Four standard deviations of the mean of samples that are either 0 or 3 (wavelength pdf of 1/3) one time out of three.
+			const double T = (&expected.x)[c];
+			const double sigma = sqrt((std::max)(T * (3.0 - T), 1e-3) / double(pixelSettings.SamplesPerPixel));
+			ok &= fabs(double(pixelTransmittance.Data[c]) - T) <= 4.0 * sigma + 1e-3;
+		}
+		char name[128];
+		snprintf(name, sizeof(name), "%-8s transmittance %.4f %.4f %.4f, marched %.4f %.4f %.4f", view.Name, pixelTransmittance.Data[0],
+			pixelTransmittance.Data[1], pixelTransmittance.Data[2], expected.x, expected.y, expected.z);
+		checks.check(name, ok);
+	}
+
+	return checks.finish();
+}
+
+// Sequence properties of the low discrepancy samplers, for several pixel seeds and dimensions: each aligned block of 2^m samples of
+// Sobol Owen is a (0, m, 2)-net (one point in each elementary interval of area 2^-m), and the rank-1 lattice and all 1D sequences have
+// one point in each stratum of width 2^-m.
+int commandCheckSamplers(CpuSkyToolsContext&)
+{
+	const uint32 MaxLog2 = 10;
+	CheckReporter checks;
+
+	// Number of points of each cell of a 2^log2X by 2^log2Y grid must be 1.
+	std::vector<uint32> cells;
+	auto isNet = [&](const std::vector<float>& u, const std::vector<float>& v, uint32 log2X, uint32 log2Y)
+	{
+		cells.assign(size_t(1) << (log2X + log2Y), 0);
+		for (size_t i = 0; i < u.size(); ++i)
+		{
+			if (!(u[i] >= 0.0f && u[i] < 1.0f && v[i] >= 0.0f && v[i] < 1.0f))
+			{
+				return false;
+			}
+			const uint32 x = uint32(u[i] * float(1u << log2X));
+			const uint32 y = uint32(v[i] * float(1u << log2Y));
+			cells[(size_t(y) << log2X) + x]++;
+		}
+		for (uint32 count : cells)
+		{
+			if (count != 1)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool sobolNets = true, sobolStrata = true, latticeStrata = true, latticeStrata1D = true;
+	std::vector<float> u, v, w, zeros;
+	for (uint32 pixel = 0; pixel < 16; ++pixel)
+	{
+		for (uint32 dimension = 0; dimension < 4; ++dimension)
+		{
+			const uint32 seed = samplerHashCombine(samplerHash(pixel), dimension);
+			for (uint32 log2 = 1; log2 <= MaxLog2; ++log2)
+			{
+				const uint32 count = 1u << log2;
+				const uint32 first = count * (pixel % 3);
+				u.resize(count);
+				v.resize(count);
+				w.resize(count);
+				zeros.assign(count, 0.0f);
+				for (uint32 i = 0; i < count; ++i)
+				{
+					sampleSobolOwen2D(first + i, seed, u[i], v[i]);
+					w[i] = sampleSobolOwen1D(first + i, seed);
+				}
+				for (uint32 log2X = 0; log2X <= log2; ++log2X)
+				{
+					sobolNets &= isNet(u, v, log2X, log2 - log2X);
+				}
+				sobolStrata &= isNet(w, zeros, log2, 0);
+
+				for (uint32 i = 0; i < count; ++i)
+				{
+					sampleRank1Lattice2D(first + i, seed, u[i], v[i]);
+					w[i] = sampleRank1Lattice1D(first + i, seed);
+				}
+				latticeStrata &= isNet(u, zeros, log2, 0) && isNet(v, zeros, log2, 0);
+				latticeStrata1D &= isNet(w, zeros, log2, 0);
+			}
+		}
+	}
+	checks.check("Sobol Owen 2D blocks are (0, m, 2)-nets", sobolNets);
+	checks.check("Sobol Owen 1D blocks are stratified", sobolStrata);
+	checks.check("rank-1 lattice 2D blocks are stratified", latticeStrata);
+	checks.check("rank-1 lattice 1D blocks are stratified", latticeStrata1D);
+
+	// Path samplers: the wavelength cycles over 3 frames, which must see consecutive sequence indices, and pixels and dimensions must
+	// not repeat each other.
+	bool consecutive = true, decorrelated = true;
+	for (int type = CpuSamplerSobolOwen; type <= CpuSamplerRank1Lattice; ++type)
+	{
+		std::vector<float> pixelValues[2][2];
+		for (uint32 frame = 0; frame < 3 * 64; ++frame)
+		{
+			for (uint32 pixel = 0; pixel < 2; ++pixel)
+			{
+				CpuPathSampler sampler;
+				sampler.init(CpuSamplerType(type), pixel, 0, 64, frame, 0);
+				consecutive &= sampler.SampleIndex == frame / 3;
+				pixelValues[pixel][0].push_back(sampler.get1D());
+				pixelValues[pixel][1].push_back(sampler.get1D());
+			}
+		}
+		decorrelated &= pixelValues[0][0] != pixelValues[1][0] && pixelValues[0][0] != pixelValues[0][1];
+	}
+	checks.check("frames of a wavelength cycle share an index", consecutive);
+	checks.check("pixels and dimensions are decorrelated", decorrelated);
+
+	return checks.finish();
+}
+
+// Adaptive sampling on an image whose size is not a multiple of the tile size: the relative error estimate on known samples, the sample
+// counts at the two extremes (an unreachable target renders the whole budget and matches renderPathTracing, a target always met stops
+// after CPU_PATH_TRACING_MIN_SAMPLES) and fewer samples than uniform sampling for the same target.
+int commandCheckAdaptivePathTracing(CpuSkyToolsContext& ctx)
+{
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+
+	CheckReporter checks;
+
+	// 300 samples, 100 wavelength cycles whose estimates alternate 0 and 2 in the brightest channel: mean 1, unbiased variance 100 / 99.
+	// Samples are weighted by 3 in the sums, not in the sums of squares.
+	const float sum[3] = { 300.0f, 30.0f, 0.0f };
+	const float sumSquared[3] = { 200.0f, 1.0f, 0.0f };
+	checks.check("relative error of known samples", fabs(pathTracingRelativeError(sum, sumSquared, 300) - sqrtf(1.0f / 99.0f)) <= 1e-5f);
+	const float constantSum[3] = { 150.0f, 150.0f, 150.0f };
+	const float constantSumSquared[3] = { 25.0f, 25.0f, 25.0f };
+	checks.check("no relative error of constant samples", pathTracingRelativeError(constantSum, constantSumSquared, 300) == 0.0f);
+
+	CpuPathTracingSettings settings = getDefaultPathTracingSettings(40, 20);
+	const uint64_t pixelCount = uint64_t(settings.Width) * settings.Height;
+	CpuAdaptivePathTracingSettings adaptive;
+	CpuAdaptivePathTracingStats stats;
+	CpuLut2D luminance, transmittance;
+
+	settings.SamplesPerPixel = 60;
+	adaptive.TargetRelativeError = 0.0f;
+	renderPathTracingAdaptive(pool, ctx.Atmosphere, transmittanceLut, settings, adaptive, luminance, transmittance, stats);
+	CpuLut2D uniformLuminance, uniformTransmittance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, uniformLuminance, uniformTransmittance);
+	double maxDifference = 0.0, meanLuminance = 0.0;
+	for (size_t i = 0; i < luminance.Data.size(); ++i)
+	{
+		maxDifference = (std::max)(maxDifference, fabs(double(luminance.Data[i]) - uniformLuminance.Data[i]));
+		meanLuminance += uniformLuminance.Data[i] / double(luminance.Data.size());
+	}
+	checks.check("unreachable target renders the whole budget", !stats.TargetReached && stats.SampleCount == pixelCount * settings.SamplesPerPixel
+		&& stats.Rounds == (settings.SamplesPerPixel + adaptive.SamplesPerRound - 1) / adaptive.SamplesPerRound);
+	checks.check("unreachable target matches renderPathTracing", maxDifference <= 1e-5 * meanLuminance);
+
+	settings.SamplesPerPixel = 8192;
+	adaptive.TargetRelativeError = 1e9f;
+	renderPathTracingAdaptive(pool, ctx.Atmosphere, transmittanceLut, settings, adaptive, luminance, transmittance, stats);
+	checks.check("met target stops after the minimum samples", stats.TargetReached && stats.SampleCount == pixelCount * CPU_PATH_TRACING_MIN_SAMPLES);
+
+	adaptive.TargetRelativeError = 0.25f;
+	adaptive.SkipConvergedTiles = false;
+	CpuAdaptivePathTracingStats uniformStats;
+	renderPathTracingAdaptive(pool, ctx.Atmosphere, transmittanceLut, settings, adaptive, uniformLuminance, uniformTransmittance, uniformStats);
+	adaptive.SkipConvergedTiles = true;
+	renderPathTracingAdaptive(pool, ctx.Atmosphere, transmittanceLut, settings, adaptive, luminance, transmittance, stats);
+	printf("  %.1f spp adaptive, %.1f spp uniform for a %g target\n", double(stats.SampleCount) / double(pixelCount),
+		double(uniformStats.SampleCount) / double(pixelCount), adaptive.TargetRelativeError);
+	checks.check("target reached with adaptive sampling", stats.TargetReached && countInvalidValues(luminance.Data) == 0);
+	checks.check("fewer samples than uniform sampling", stats.SampleCount <= uniformStats.SampleCount);
+
+	return checks.finish();
+}
+
+// The wavefront path tracer must trace the same paths as the per path loop (packets of a single lane) for every configuration, with
+// wavefronts smaller than the image and shadow rays ratio tracked too. Images are bit-identical unless the compiler contracts
+// multiply-adds differently in the two loops, so values may differ by a few ulps.
+int commandCheckWavefrontPathTracing(CpuSkyToolsContext& ctx)
+{
+	const uint32 width = 64;
+	const uint32 height = 36;
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	CpuLut2D multiScatLut;
+	bakeMultiScatteringLut(pool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, multiScatLut);
+
+	WavefrontPathTracingConfig configs[4];
+	getWavefrontPathTracingConfigs(width, height, 2, multiScatLut, configs);
+	configs[3] = { "ratio", configs[2].Settings };
+	configs[3].Settings.TransmittanceMethod = CpuTransmittanceMethodRatioTracking;
+	const uint32 wavefrontSizes[] = { 1 << 16, 1000, 37 };
+
+	CheckReporter checks;
+	for (const WavefrontPathTracingConfig& config : configs)
+	{
+		CpuPathTracingSettings settings = config.Settings;
+		settings.PacketLaneCount = 1;
+		CpuLut2D perPathLuminance, perPathTransmittance;
+		renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, perPathLuminance, perPathTransmittance);
+		for (uint32 wavefrontSize : wavefrontSizes)
+		{
+			CpuWavefrontSettings wavefront;
+			wavefront.WavefrontSize = wavefrontSize;
+			wavefront.PathsPerTask = 16;
+			CpuLut2D luminance, transmittance;
+			renderPathTracingWavefront(pool, ctx.Atmosphere, transmittanceLut, settings, wavefront, luminance, transmittance);
+			size_t mismatches = 0;
+			double maxRelativeDifference = 0.0;
+			for (size_t i = 0; i < luminance.Data.size(); ++i)
+			{
+				const float values[2][2] = { { luminance.Data[i], perPathLuminance.Data[i] }, { transmittance.Data[i], perPathTransmittance.Data[i] } };
+				for (const float* v : values)
+				{
+					mismatches += v[0] != v[1] ? 1 : 0;
+					maxRelativeDifference = (std::max)(maxRelativeDifference, fabs(double(v[0]) - v[1]) / (std::max)(fabs(double(v[1])), 1e-30));
+				}
+			}
+			char name[128];
+			snprintf(name, sizeof(name), "%-10s wavefront of %6u paths: %zu differing value(s), max relative difference %.2e", config.Name, wavefrontSize,
+				mismatches, maxRelativeDifference);
+			checks.check(name, luminance.Data.size() == perPathLuminance.Data.size() && maxRelativeDifference <= 1e-6);
+		}
+	}
+	return checks.finish();
+}
@@ -0,0 +1,633 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CpuSkyChecks.h"
+#include "LutDiskCache.h"
+
+// check-* commands of the sky: radiance queries, sky view LUT, time of day atlas, irradiance and cubemap.
+
+
+
+// Each query result must only depend on its own query: the same whatever its batch, its lane and the thread count. Rays missing the
+// atmosphere get no luminance and a transmittance of 1, luminance scales with the sun illuminance, and queries rotated around the
+// vertical axis with their sun get the same result.
+int commandCheckSkyRadiance(CpuSkyToolsContext& ctx)
+{
+	const uint32 queryCount = 1003;	// Not a multiple of 8
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuThreadPool multiThreadPool((std::max)(4u, ctx.ThreadCount));
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	const std::vector<SkyRadianceQuery> queries = getRandomSkyRadianceQueries(queryCount);
+	SkyRadianceSettings settings;
+
+	CheckReporter checks;
+	auto sameResults = [](const std::vector<SkyRadianceResult>& a, const std::vector<SkyRadianceResult>& b)
+	{
+		return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(SkyRadianceResult)) == 0;
+	};
+
+	std::vector<SkyRadianceResult> results(queryCount);
+	querySkyRadiance(pool, luts, settings, queries.data(), queryCount, results.data());
+	bool valid = true;
+	for (const SkyRadianceResult& result : results)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			const float L = (&result.L.x)[c];
+			const float T = (&result.Transmittance.x)[c];
+			valid &= std::isfinite(L) && L >= 0.0f && T >= 0.0f && T <= 1.0f;
+		}
+	}
+	checks.check("finite luminance and transmittance in [0, 1]", valid);
+
+	std::vector<SkyRadianceResult> multiThreadResults(queryCount);
+	querySkyRadiance(multiThreadPool, luts, settings, queries.data(), queryCount, multiThreadResults.data());
+	checks.check("same results on 4 threads", sameResults(results, multiThreadResults));
+
+	std::vector<SkyRadianceResult> singleResults(queryCount);
+	for (uint32 q = 0; q < queryCount; ++q)
+	{
+		querySkyRadiance8(luts, settings, &queries[q], 1, &singleResults[q]);
+	}
+	checks.check("same results queried one at a time", sameResults(results, singleResults));
+
+	std::vector<SkyRadianceQuery> shiftedQueries(queries.begin() + 3, queries.end());
+	std::vector<SkyRadianceResult> shiftedResults(shiftedQueries.size());
+	querySkyRadiance(pool, luts, settings, shiftedQueries.data(), uint32(shiftedQueries.size()), shiftedResults.data());
+	checks.check("same results in other lanes", sameResults(std::vector<SkyRadianceResult>(results.begin() + 3, results.end()), shiftedResults));
+
+	SkyRadianceSettings doubledSettings = settings;
+	doubledSettings.SunIlluminance = settings.SunIlluminance * 2.0f;
+	std::vector<SkyRadianceResult> doubledResults(queryCount);
+	querySkyRadiance(pool, luts, doubledSettings, queries.data(), queryCount, doubledResults.data());
+	bool scaled = true;
+	for (uint32 q = 0; q < queryCount; ++q)
+	{
+		scaled &= doubledResults[q].L.x == 2.0f * results[q].L.x && doubledResults[q].L.y == 2.0f * results[q].L.y && doubledResults[q].L.z == 2.0f * results[q].L.z
+			&& memcmp(&doubledResults[q].Transmittance, &results[q].Transmittance, sizeof(GlslVec3)) == 0;
+	}
+	checks.check("luminance proportional to the sun illuminance", scaled);
+
+	SkyRadianceQuery space = { GlslVec3{ 0.0f, 0.0f, 200.0f }, GlslVec3{ 0.0f, 0.0f, 1.0f }, GlslVec3{ 0.0f, 0.0f, 1.0f } };
+	SkyRadianceResult spaceResult;
+	querySkyRadiance8(luts, settings, &space, 1, &spaceResult);
+	checks.check("no luminance from space looking away", spaceResult.L.x == 0.0f && spaceResult.L.y == 0.0f && spaceResult.L.z == 0.0f
+		&& spaceResult.Transmittance.x == 1.0f && spaceResult.Transmittance.y == 1.0f && spaceResult.Transmittance.z == 1.0f);
+
+	// Positions stay on the vertical axis so that the rotation is exact up to rounding of the directions.
+	double maxRelativeDifference = 0.0;
+	for (uint32 q = 0; q < queryCount; q += 10)
+	{
+		const float angle = 2.0f * PI * float(q) / float(queryCount);
+		const float c = cosf(angle), s = sinf(angle);
+		auto rotate = [&](const GlslVec3& v) { return GlslVec3{ c * v.x - s * v.y, s * v.x + c * v.y, v.z }; };
+		const SkyRadianceQuery rotated = { queries[q].WorldPos, rotate(queries[q].WorldDir), rotate(queries[q].SunDir) };
+		SkyRadianceResult rotatedResult;
+		querySkyRadiance8(luts, settings, &rotated, 1, &rotatedResult);
+		for (int ch = 0; ch < 3; ++ch)
+		{
+			const double a = (&rotatedResult.L.x)[ch];
+			const double b = (&results[q].L.x)[ch];
+			maxRelativeDifference = (std::max)(maxRelativeDifference, fabs(a - b) / (std::max)(fabs(b), 1e-6));
+		}
+	}
+	printf("  max relative difference of rotated queries %.2e\n", maxRelativeDifference);
+	checks.check("same luminance rotated around the vertical", maxRelativeDifference <= 1e-3);
+
+	return checks.finish();
+}
+
+// Runtime sky view LUT resolution: the tiers, the parameterization round trip at texel centers for any resolution, and the error
+// left by the resolution alone (LUTs marched with 256 samples from the reference LUTs) decreasing with it.
+int commandCheckSkyViewResolution(CpuSkyToolsContext& ctx)
+{
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+
+	std::vector<uint32> widths;
+	bool tiersOk = true;
+	for (uint32 t = 0; t < SkyViewLutTierCount; ++t)
+	{
+		uint32 width, height;
+		getSkyViewLutTierResolution(SkyViewLutTier(t), width, height);
+		tiersOk &= height == width * 9 / 16 && (widths.empty() || width > widths.back());
+		widths.push_back(width);
+	}
+	uint32 highWidth, highHeight;
+	getSkyViewLutTierResolution(SkyViewLutTierHigh, highWidth, highHeight);
+	checks.check("tiers are 16:9 and increasing", tiersOk);
+	checks.check("high tier is the default resolution", highWidth == defaultConfig.SkyViewWidth && highHeight == defaultConfig.SkyViewHeight);
+
+	// Texel centers to view and light angles and back, in texels
+	float maxTexelError = 0.0f;
+	for (uint32 width : { widths[0], widths[SkyViewLutTierCount - 1], 100u })
+	{
+		const uint32 height = width * 9 / 16;
+		for (float cameraHeight : { 0.5f, 40.0f })
+		{
+			const float viewHeight = Atmosphere.BottomRadius + cameraHeight;
+			for (uint32 y = 0; y < height; ++y)
+			{
+				for (uint32 x = 0; x < width; ++x)
+				{
+					const float u = (float(x) + 0.5f) / float(width);
+					const float v = (float(y) + 0.5f) / float(height);
+					float viewZenithCosAngle, lightViewCosAngle, u2, v2;
+					UvToSkyViewLutParams(Atmosphere, viewZenithCosAngle, lightViewCosAngle, viewHeight, u, v, float(width), float(height));
+					SkyViewLutParamsToUv(Atmosphere, v >= 0.5f, viewZenithCosAngle, lightViewCosAngle, viewHeight, u2, v2, float(width), float(height));
+					maxTexelError = (std::max)(maxTexelError, (std::max)(fabsf(u2 - u) * float(width), fabsf(v2 - v) * float(height)));
+				}
+			}
+		}
+	}
+	printf("  parameterization round trip: %.2e texel\n", maxTexelError);
+	checks.check("parameterization round trip", maxTexelError < 0.05f);
+
+	LookUpTablesInfo referenceLutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+	bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+	IntegrateScatteredLuminanceOptions referenceOptions;
+	referenceOptions.MultiScatLut = &referenceMultiScatLut;
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+	};
+	for (const SkyLutTuningView& tuningView : views)
+	{
+		const CameraVolumeView view = getTuningCameraView(tuningView);
+		SkyLutTuningImage referenceImage;
+		renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, view, 256.0f, referenceImage);
+		bool decreasing = true;
+		double previousError = 0.0;
+		printf("  %s resolution error:", tuningView.Name);
+		for (size_t w = 0; w < widths.size(); ++w)
+		{
+			CpuLut2D skyViewLut;
+			bakeSkyViewLut(pool, info, referenceTransmittanceLut, view.CamPos.z, sinf(tuningView.SunElevation), widths[w], widths[w] * 9 / 16, 256.0f, referenceOptions, skyViewLut);
+			const double error = getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImage);
+			printf(" %.4f", error);
+			decreasing &= w == 0 || error < previousError;
+			previousError = error;
+		}
+		printf("\n");
+		char name[64];
+		snprintf(name, sizeof(name), "%s error decreases with the resolution", tuningView.Name);
+		checks.check(name, decreasing);
+	}
+
+	return checks.finish();
+}
+
+// Amortized sky view LUT updates: the interleave meets the texel budget, the phases split every 4x4 tile evenly, a phase only writes
+// its own texels, and the phases of a static view add up to the full update exactly.
+int commandCheckSkyViewAmortization(CpuSkyToolsContext& ctx)
+{
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+
+	const uint32 TexelCount = defaultConfig.SkyViewWidth * defaultConfig.SkyViewHeight;
+	bool interleaveOk = getSkyViewLutInterleave(TexelCount, 0) == 1 && getSkyViewLutInterleave(TexelCount, TexelCount) == 1
+		&& getSkyViewLutInterleave(TexelCount, 1) == SKY_VIEW_LUT_MAX_INTERLEAVE;
+	for (uint32 budget = TexelCount / SKY_VIEW_LUT_MAX_INTERLEAVE; budget < TexelCount; budget += 997)
+	{
+		const uint32 interleave = getSkyViewLutInterleave(TexelCount, budget);
+		interleaveOk &= (interleave & (interleave - 1)) == 0 && TexelCount <= budget * interleave && (interleave == 1 || TexelCount > budget * interleave / 2);
+	}
+	checks.check("interleave meets the texel budget", interleaveOk);
+
+	bool phasesOk = true;
+	for (uint32 interleave = 1; interleave <= SKY_VIEW_LUT_MAX_INTERLEAVE; interleave *= 2)
+	{
+		uint32 phaseTexelCounts[SKY_VIEW_LUT_MAX_INTERLEAVE] = {};
+		for (uint32 y = 0; y < 4; ++y)
+		{
+			for (uint32 x = 0; x < 4; ++x)
+			{
+				const uint32 phase = getSkyViewLutInterleavePhase(x, y, interleave);
+				phasesOk &= phase < interleave && phase == getSkyViewLutInterleavePhase(x + 4, y + 8, interleave);
+				phaseTexelCounts[phase < interleave ? phase : 0]++;
+			}
+		}
+		for (uint32 phase = 0; phase < interleave; ++phase)
+		{
+			phasesOk &= phaseTexelCounts[phase] == 16 / interleave;
+		}
+	}
+	checks.check("phases split the tiles evenly", phasesOk);
+
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, ctx.LutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+	options.VariableSampleCount = true;
+	options.RayMarchMinMaxSPP[0] = defaultConfig.RayMarchMinMaxSPP[0];
+	options.RayMarchMinMaxSPP[1] = defaultConfig.RayMarchMinMaxSPP[1];
+	const uint32 Width = 96;
+	const uint32 Height = 54;
+	const float cameraHeight = 0.5f;
+	const float sunZenithCosAngle = sinf(0.45f);
+
+	CpuLut2D fullLut;
+	bakeSkyViewLut(pool, info, transmittanceLut, cameraHeight, sunZenithCosAngle, Width, Height, 30.0f, options, fullLut);
+	bool phaseOnlyOk = true;
+	bool phasesAddUp = true;
+	for (uint32 interleave = 2; interleave <= SKY_VIEW_LUT_MAX_INTERLEAVE; interleave *= 2)
+	{
+		// Starts from the LUT of another sun, as after a sun move below the refresh threshold
+		CpuLut2D amortizedLut;
+		bakeSkyViewLut(pool, info, transmittanceLut, cameraHeight, sinf(0.02f), Width, Height, 30.0f, options, amortizedLut);
+		for (uint32 phase = 0; phase < interleave; ++phase)
+		{
+			const std::vector<float> previous = amortizedLut.Data;
+			bakeSkyViewLut(pool, info, transmittanceLut, cameraHeight, sunZenithCosAngle, Width, Height, 30.0f, options, amortizedLut, interleave, phase);
+			for (uint32 y = 0; y < Height; ++y)
+			{
+				for (uint32 x = 0; x < Width; ++x)
+				{
+					const std::vector<float>& expected = getSkyViewLutInterleavePhase(x, y, interleave) == phase ? fullLut.Data : previous;
+					phaseOnlyOk &= memcmp(&amortizedLut.Data[(size_t(y) * Width + x) * 4], &expected[(size_t(y) * Width + x) * 4], 4 * sizeof(float)) == 0;
+				}
+			}
+		}
+		phasesAddUp &= amortizedLut.Data == fullLut.Data;
+	}
+	checks.check("phase only writes its texels", phaseOnlyOk);
+	checks.check("phases add up to the full update", phasesAddUp);
+
+	return checks.finish();
+}
+
+// Time of day sky view LUT atlas on a small layout: atlas coordinates at the keyframes and out of range, the blend being the baked LUT at
+// the keyframes and staying between its two nearest LUTs in between, and the cache key following the inputs.
+int commandCheckSkyViewAtlas(CpuSkyToolsContext& ctx)
+{
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	SkyLutConfig config;
+	config.SkyViewWidth = 48;
+	config.SkyViewHeight = 27;
+	config.SkyViewAtlasSunAngleCount = 8;
+	config.SkyViewAtlasHeightBandCount = 4;
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+
+	bool keyframesOk = true;
+	for (uint32 band = 0; band < config.SkyViewAtlasHeightBandCount; ++band)
+	{
+		for (uint32 angle = 0; angle < config.SkyViewAtlasSunAngleCount; ++angle)
+		{
+			SkyViewLutAtlasCoord coord;
+			getSkyViewLutAtlasCoord(config, getSkyViewLutAtlasCameraHeight(config, band), getSkyViewLutAtlasSunElevation(config, angle), coord);
+			const uint32 nearestBand = coord.BandBlend < 0.5f ? coord.Bands[0] : coord.Bands[1];
+			keyframesOk &= nearestBand == band && (std::min)(coord.BandBlend, 1.0f - coord.BandBlend) < 1e-3f && fabsf(coord.SunAngle - float(angle)) < 1e-3f;
+		}
+	}
+	checks.check("keyframe coordinates", keyframesOk);
+
+	SkyViewLutAtlasCoord low, high;
+	getSkyViewLutAtlasCoord(config, 0.0f, -1.0f, low);
+	getSkyViewLutAtlasCoord(config, 100.0f, 2.0f, high);
+	const uint32 LastBand = config.SkyViewAtlasHeightBandCount - 1;
+	checks.check("out of range coordinates clamped", low.Bands[0] == 0 && low.Bands[1] == 1 && low.BandBlend == 0.0f && low.SunAngle == 0.0f
+		&& high.Bands[0] == LastBand && high.Bands[1] == LastBand && high.BandBlend == 0.0f && high.SunAngle == float(config.SkyViewAtlasSunAngleCount - 1));
+
+	SkyViewLutAtlasInputs inputs;
+	bakeSkyViewLutAtlasInputs(pool, info, config, 1.0f, inputs);
+	CpuLut3D atlas;
+	bakeSkyViewLutAtlas(pool, info, inputs.TransmittanceLut, config, 30.0f, inputs.Options, atlas);
+	const size_t LutFloatCount = size_t(config.SkyViewWidth) * config.SkyViewHeight * 4;
+	auto getAtlasLut = [&](uint32 band, uint32 angle) { return &atlas.Data[LutFloatCount * (band * config.SkyViewAtlasSunAngleCount + angle)]; };
+
+	// Keyframes, the blend weights being exact up to rounding
+	double maxKeyframeError = 0.0;
+	for (uint32 band : { 0u, 2u, LastBand })
+	{
+		for (uint32 angle : { 0u, 3u, config.SkyViewAtlasSunAngleCount - 1 })
+		{
+			CpuLut2D blended;
+			blendSkyViewLutAtlas(atlas, config, getSkyViewLutAtlasCameraHeight(config, band), getSkyViewLutAtlasSunElevation(config, angle), blended);
+			const float* baked = getAtlasLut(band, angle);
+			for (size_t i = 0; i < LutFloatCount; ++i)
+			{
+				maxKeyframeError = (std::max)(maxKeyframeError, fabs(double(blended.Data[i]) - baked[i]) / (std::max)(fabs(double(baked[i])), 1e-6));
+			}
+		}
+	}
+	printf("  keyframe blend: %.2e max relative difference\n", maxKeyframeError);
+	checks.check("blend is the baked LUT at keyframes", maxKeyframeError < 1e-4);
+
+	// Halfway between two sun angles of a band
+	bool betweenOk = true;
+	for (uint32 angle = 0; angle + 1 < config.SkyViewAtlasSunAngleCount; ++angle)
+	{
+		const float sunElevation = 0.5f * (getSkyViewLutAtlasSunElevation(config, angle) + getSkyViewLutAtlasSunElevation(config, angle + 1));
+		CpuLut2D blended;
+		blendSkyViewLutAtlas(atlas, config, getSkyViewLutAtlasCameraHeight(config, 1), sunElevation, blended);
+		const float* a = getAtlasLut(1, angle);
+		const float* b = getAtlasLut(1, angle + 1);
+		for (size_t i = 0; i < LutFloatCount; ++i)
+		{
+			const float margin = 1e-4f * (std::max)(fabsf(a[i]), fabsf(b[i]));
+			betweenOk &= blended.Data[i] >= (std::min)(a[i], b[i]) - margin && blended.Data[i] <= (std::max)(a[i], b[i]) + margin;
+		}
+	}
+	checks.check("blend between the nearest sun angles", betweenOk);
+
+	const uint64 key = computeSkyViewLutAtlasKey(info, config, 1.0f);
+	SkyLutConfig otherConfig = config;
+	otherConfig.SkyViewAtlasSunAngleCount = 16;
+	checks.check("cache key follows the inputs", key == computeSkyViewLutAtlasKey(info, config, 1.0f) && key != computeSkyViewLutAtlasKey(info, otherConfig, 1.0f)
+		&& key != computeSkyViewLutAtlasKey(info, config, 0.0f));
+
+	return checks.finish();
+}
+
+// Sky luminance SH: basis orthonormality, irradiance of a constant sky, rotation around z, cache lookups at the bins and for any sun
+// azimuth, and the sky view LUT projection against the ray marched one. The cache uses a small layout.
+int commandCheckSkyIrradianceSH(CpuSkyToolsContext& ctx)
+{
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+	auto evaluateSH = [](const SkyLuminanceSH& sh, const GlslVec3& dir)
+	{
+		float basis[SKY_SH_COEFFICIENT_COUNT];
+		evaluateSHBasis(dir, basis);
+		GlslVec3 L = splat3(0.0f);
+		for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+		{
+			L += sh.C[i] * basis[i];
+		}
+		return L;
+	};
+	auto getMaxRelativeDifference = [](const SkyLuminanceSH& a, const SkyLuminanceSH& b)
+	{
+		float scale = 0.0f, difference = 0.0f;
+		for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+		{
+			scale = (std::max)(scale, (std::max)(fabsf(a.C[i].x), (std::max)(fabsf(a.C[i].y), fabsf(a.C[i].z))));
+			const GlslVec3 d = a.C[i] - b.C[i];
+			difference = (std::max)(difference, (std::max)(fabsf(d.x), (std::max)(fabsf(d.y), fabsf(d.z))));
+		}
+		return scale > 0.0f ? difference / scale : difference;
+	};
+
+	// Spherical Fibonacci directions, all covering the same solid angle
+	const uint32 DirectionCount = 4096;
+	std::vector<GlslVec3> dirs(DirectionCount);
+	for (uint32 i = 0; i < DirectionCount; ++i)
+	{
+		const float cosTheta = 1.0f - 2.0f * (float(i) + 0.5f) / float(DirectionCount);
+		const float sinTheta = sqrtf(saturate(1.0f - cosTheta * cosTheta));
+		dirs[i] = GlslVec3{ sinTheta * cosf(2.39996323f * float(i)), sinTheta * sinf(2.39996323f * float(i)), cosTheta };
+	}
+	double gram[SKY_SH_COEFFICIENT_COUNT][SKY_SH_COEFFICIENT_COUNT] = {};
+	for (const GlslVec3& dir : dirs)
+	{
+		float basis[SKY_SH_COEFFICIENT_COUNT];
+		evaluateSHBasis(dir, basis);
+		for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+		{
+			for (uint32 j = 0; j < SKY_SH_COEFFICIENT_COUNT; ++j)
+			{
+				gram[i][j] += double(basis[i]) * basis[j] * 4.0 * PI / DirectionCount;
+			}
+		}
+	}
+	double maxGramError = 0.0;
+	for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+	{
+		for (uint32 j = 0; j < SKY_SH_COEFFICIENT_COUNT; ++j)
+		{
+			maxGramError = (std::max)(maxGramError, fabs(gram[i][j] - (i == j ? 1.0 : 0.0)));
+		}
+	}
+	checks.check("basis is orthonormal", maxGramError < 1e-3);
+
+	// Constant luminance of 1: E = PI for any normal
+	SkyLuminanceSH constant = {};
+	constant.C[0] = splat3(0.282095f * 4.0f * PI);
+	bool constantOk = true;
+	for (const GlslVec3& normal : { GlslVec3{ 0.0f, 0.0f, 1.0f }, GlslVec3{ 0.0f, 0.0f, -1.0f }, normalize(GlslVec3{ 1.0f, -2.0f, 0.5f }) })
+	{
+		for (uint32 order = 1; order <= 3; ++order)
+		{
+			constantOk &= fabsf(evaluateSHIrradiance(constant, normal, order).x - PI) < 1e-3f * PI;
+		}
+	}
+	checks.check("constant sky irradiance", constantOk);
+
+	// Rotating by angle moves the luminance of direction d to d rotated by angle.
+	SkyLuminanceSH sh;
+	for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+	{
+		sh.C[i] = GlslVec3{ 1.0f / float(i + 1), float(i % 3) - 1.0f, 0.5f * float(i) };
+	}
+	float maxRotationError = 0.0f;
+	for (float angle : { 0.3f, 1.7f, -2.5f })
+	{
+		SkyLuminanceSH rotated;
+		rotateSHAroundZ(sh, angle, rotated);
+		for (uint32 i = 0; i < DirectionCount; i += 37)
+		{
+			const GlslVec3& d = dirs[i];
+			const GlslVec3 rotatedDir = { d.x * cosf(angle) - d.y * sinf(angle), d.x * sinf(angle) + d.y * cosf(angle), d.z };
+			const GlslVec3 difference = evaluateSH(rotated, rotatedDir) - evaluateSH(sh, d);
+			maxRotationError = (std::max)(maxRotationError, (std::max)(fabsf(difference.x), (std::max)(fabsf(difference.y), fabsf(difference.z))));
+		}
+	}
+	checks.check("rotation around z", maxRotationError < 1e-4f);
+
+	SkyLutConfig config;
+	config.SkyViewWidth = 96;
+	config.SkyViewHeight = 54;
+	config.SkyViewAtlasSunAngleCount = 6;
+	config.SkyViewAtlasHeightBandCount = 3;
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	SkyRadianceSettings settings;
+	SkyIrradianceCache cache;
+	cache.bake(pool, luts, settings, config, 256);
+
+	float maxBinError = 0.0f;
+	float maxAzimuthError = 0.0f;
+	for (uint32 band = 0; band < config.SkyViewAtlasHeightBandCount; ++band)
+	{
+		for (uint32 angle = 0; angle < config.SkyViewAtlasSunAngleCount; ++angle)
+		{
+			const float sunElevation = getSkyViewLutAtlasSunElevation(config, angle);
+			const GlslVec3 position = { 0.0f, 0.0f, getSkyViewLutAtlasCameraHeight(config, band) };
+			SkyLuminanceSH looked;
+			cache.lookup(position, GlslVec3{ cosf(sunElevation), 0.0f, sinf(sunElevation) }, looked);
+			maxBinError = (std::max)(maxBinError, getMaxRelativeDifference(cache.getBin(band, angle), looked));
+			const float azimuth = 2.0f;
+			SkyLuminanceSH expected;
+			rotateSHAroundZ(cache.getBin(band, angle), azimuth, expected);
+			cache.lookup(position, GlslVec3{ cosf(sunElevation) * cosf(azimuth), cosf(sunElevation) * sinf(azimuth), sinf(sunElevation) }, looked);
+			maxAzimuthError = (std::max)(maxAzimuthError, getMaxRelativeDifference(expected, looked));
+		}
+	}
+	printf("  cache lookups: %.2e at the bins, %.2e with a sun azimuth\n", maxBinError, maxAzimuthError);
+	checks.check("cache lookup at the bins", maxBinError < 5e-3f);
+	checks.check("cache lookup with a sun azimuth", maxAzimuthError < 5e-3f);
+
+	// Sky view LUT of the exact height and sun angle against the ray marcher, both without the ground bounce
+	const float cameraHeight = 0.5f;
+	const float sunZenithCosAngle = sinf(0.45f);
+	SkyViewLutAtlasInputs inputs;
+	bakeSkyViewLutAtlasInputs(pool, ctx.Atmosphere, config, 1.0f, inputs);
+	CpuLut2D skyViewLut;
+	bakeSkyViewLut(pool, ctx.Atmosphere, inputs.TransmittanceLut, cameraHeight, sunZenithCosAngle, config.SkyViewWidth, config.SkyViewHeight, 30.0f, inputs.Options, skyViewLut);
+	SkyLuminanceSH lutSH, rayMarchedSH;
+	projectSkyViewLutSH(luts.Atmosphere, skyViewLut, cameraHeight, sunZenithCosAngle, 1.0f, 1024, lutSH);
+	projectSkyRadianceSH(luts, settings, cameraHeight, sunZenithCosAngle, 1024, false, rayMarchedSH);
+	const GlslVec3 up = { 0.0f, 0.0f, 1.0f };
+	const float lutIrradiance = evaluateSHIrradiance(lutSH, up).y;
+	const float rayMarchedIrradiance = evaluateSHIrradiance(rayMarchedSH, up).y;
+	printf("  sky irradiance from above: %.4f from the sky view LUT, %.4f ray marched\n", lutIrradiance, rayMarchedIrradiance);
+	checks.check("sky view LUT projection", fabsf(lutIrradiance - rayMarchedIrradiance) < 0.05f * rayMarchedIrradiance);
+
+	return checks.finish();
+}
+
+// Sky cubemap on a small size: face directions, GGX prefiltering of a constant sky, the DDS layout, the sky view LUT source against ray
+// marching, and the SkyCubemapCapture update thresholds.
+int commandCheckSkyCubemap(CpuSkyToolsContext& ctx)
+{
+	const char* filepath = "sky_cubemap_check.dds";
+	CpuThreadPool pool(ctx.ThreadCount);
+	CheckReporter checks;
+
+	// Face centers along the D3D face axes, and texel centers back to their face and uv
+	const GlslVec3 axes[SKY_CUBEMAP_FACE_COUNT] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const uint32 FaceSize = 16;
+	bool facesOk = true;
+	float maxUvError = 0.0f;
+	for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+	{
+		facesOk &= dot(getCubemapDirection(f, 0.5f, 0.5f), axes[f]) > 0.9999f;
+		for (uint32 y = 0; y < FaceSize; ++y)
+		{
+			for (uint32 x = 0; x < FaceSize; ++x)
+			{
+				const float u = (float(x) + 0.5f) / float(FaceSize);
+				const float v = (float(y) + 0.5f) / float(FaceSize);
+				uint32 face;
+				float u2, v2;
+				getCubemapFaceUv(getCubemapDirection(f, u, v), face, u2, v2);
+				facesOk &= face == f;
+				maxUvError = (std::max)(maxUvError, (std::max)(fabsf(u2 - u), fabsf(v2 - v)));
+			}
+		}
+	}
+	checks.check("face centers along the face axes", facesOk);
+	checks.check("direction to face and uv round trip", maxUvError < 1e-5f);
+
+	SkyCubemapSettings cubemapSettings;
+	cubemapSettings.Size = 32;
+	cubemapSettings.MipCount = 4;
+	cubemapSettings.SampleCount = 16;
+	CpuCubemap cubemap;
+	cubemap.Allocate(cubemapSettings.Size, cubemapSettings.MipCount);
+	for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+	{
+		CpuLut2D& face = cubemap.face(0, f);
+		for (size_t i = 0; i < face.Data.size(); i += 4)
+		{
+			face.Data[i + 0] = 1.0f;
+			face.Data[i + 1] = 2.0f;
+			face.Data[i + 2] = 3.0f;
+			face.Data[i + 3] = 1.0f;
+		}
+	}
+	prefilterSkyCubemapGGX(pool, cubemapSettings.SampleCount, cubemap);
+	float maxConstantError = 0.0f;
+	for (uint32 m = 1; m < cubemap.MipCount; ++m)
+	{
+		for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+		{
+			const CpuLut2D& face = cubemap.face(m, f);
+			for (size_t i = 0; i < face.Data.size(); ++i)
+			{
+				const float expected = (i & 3) == 3 ? face.Data[i] : float((i & 3) + 1);
+				maxConstantError = (std::max)(maxConstantError, fabsf(face.Data[i] - expected) / expected);
+			}
+		}
+	}
+	checks.check("constant sky prefiltered to itself", maxConstantError < 1e-4f);
+
+	// Header of 148 bytes then the faces, each with its mip chain
+	size_t expectedSize = 4 + 124 + 20;
+	for (uint32 m = 0; m < cubemap.MipCount; ++m)
+	{
+		expectedSize += SKY_CUBEMAP_FACE_COUNT * size_t(cubemap.face(m, 0).Width) * cubemap.face(m, 0).Height * 16;
+	}
+	std::vector<unsigned char> dds;
+	if (saveCubemapDds(cubemap, filepath))
+	{
+		FILE* file = fopen(filepath, "rb");
+		unsigned char buffer[65536];
+		size_t readSize;
+		while (file && (readSize = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			dds.insert(dds.end(), buffer, buffer + readSize);
+		}
+		if (file)
+		{
+			fclose(file);
+		}
+	}
+	remove(filepath);
+	uint32 ddsHeader[37] = {};
+	memcpy(ddsHeader, dds.data(), (std::min)(dds.size(), sizeof(ddsHeader)));
+	checks.check("DDS cubemap layout", dds.size() == expectedSize && ddsHeader[0] == 0x20534444 && ddsHeader[3] == cubemap.Size && ddsHeader[7] == cubemap.MipCount
+		&& (ddsHeader[28] & 0xFE00) == 0xFE00 && ddsHeader[32] == 2);
+
+	// Sky view LUT source against ray marching, at noon
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	const SkyRadianceSettings settings;
+	const GlslVec3 noonSunDir = { cosf(0.45f), 0.0f, sinf(0.45f) };
+	SkyCubemapCapture lutCapture, rayMarchedCapture;
+	SkyCubemapSettings rayMarchedSettings = cubemapSettings;
+	rayMarchedSettings.Source = SkyCubemapSourceRayMarching;
+	lutCapture.update(pool, ctx.Atmosphere, luts, settings, cubemapSettings, GlslVec3{ 0.0f, 0.0f, 0.5f }, noonSunDir);
+	rayMarchedCapture.update(pool, ctx.Atmosphere, luts, settings, rayMarchedSettings, GlslVec3{ 0.0f, 0.0f, 0.5f }, noonSunDir);
+	const double lutError = getCubemapRelativeError(lutCapture.getCubemap(), rayMarchedCapture.getCubemap(), 0);
+	printf("  sky view LUT source: %.4f relative error against ray marching\n", lutError);
+	checks.check("sky view LUT source", lutError < 0.01);
+
+	// Capture updates: sun moves below and above the thresholds, away from and at the horizon, then the height and invalidate
+	SkyCubemapCapture capture;
+	auto update = [&](float sunElevation, float cameraHeight)
+	{
+		return capture.update(pool, ctx.Atmosphere, luts, settings, cubemapSettings, GlslVec3{ 0.0f, 0.0f, cameraHeight },
+			GlslVec3{ cosf(sunElevation), 0.0f, sinf(sunElevation) });
+	};
+	bool updatesOk = update(0.45f, 0.5f);
+	updatesOk &= !update(0.455f, 0.5f) && update(0.465f, 0.5f);
+	updatesOk &= update(0.0f, 0.5f) && !update(0.001f, 0.5f) && update(0.003f, 0.5f);
+	updatesOk &= !update(0.003f, 0.54f) && update(0.003f, 0.56f);
+	capture.invalidate();
+	updatesOk &= update(0.003f, 0.56f) && capture.getRenderCount() == 6;
+	checks.check("capture update thresholds", updatesOk);
+
+	return checks.finish();
+}
@@ -0,0 +1,361 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "CpuSkyCubemap.h"
+#include "CpuSampler.h"
+
+
+
+GlslVec3 getCubemapDirection(uint32 face, float u, float v)
+{
+	// D3D face orientations, (s, t) being the face coordinates in [-1, 1]
+	const float s = 2.0f * u - 1.0f;
+	const float t = 2.0f * v - 1.0f;
+	GlslVec3 dir;
+	switch (face)
+	{
+	case 0:		dir = { 1.0f, -t, -s }; break;
+	case 1:		dir = { -1.0f, -t, s }; break;
+	case 2:		dir = { s, 1.0f, t }; break;
+	case 3:		dir = { s, -1.0f, -t }; break;
+	case 4:		dir = { s, -t, 1.0f }; break;
+	default:	dir = { -s, -t, -1.0f }; break;
+	}
+	return normalize(dir);
+}
+
+void getCubemapFaceUv(const GlslVec3& dir, uint32& outFace, float& outU, float& outV)
+{
+	const float ax = fabsf(dir.x), ay = fabsf(dir.y), az = fabsf(dir.z);
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az)
+	{
+		outFace = dir.x >= 0.0f ? 0 : 1;
+		sc = dir.x >= 0.0f ? -dir.z : dir.z;
+		tc = -dir.y;
+		ma = ax;
+	}
+	else if (ay >= az)
+	{
+		outFace = dir.y >= 0.0f ? 2 : 3;
+		sc = dir.x;
+		tc = dir.y >= 0.0f ? dir.z : -dir.z;
+		ma = ay;
+	}
+	else
+	{
+		outFace = dir.z >= 0.0f ? 4 : 5;
+		sc = dir.z >= 0.0f ? dir.x : -dir.x;
+		tc = -dir.y;
+		ma = az;
+	}
+	outU = 0.5f * (sc / ma + 1.0f);
+	outV = 0.5f * (tc / ma + 1.0f);
+}
+
+void CpuCubemap::Allocate(uint32 size, uint32 mipCount)
+{
+	Size = size;
+	MipCount = mipCount;
+	Faces.resize(size_t(mipCount) * SKY_CUBEMAP_FACE_COUNT);
+	for (uint32 m = 0; m < mipCount; ++m)
+	{
+		const uint32 mipSize = (std::max)(1u, size >> m);
+		for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+		{
+			face(m, f).Allocate(mipSize, mipSize);
+		}
+	}
+}
+
+GlslVec3 CpuCubemap::sampleLinear(const GlslVec3& dir, float mip) const
+{
+	uint32 f;
+	float u, v;
+	getCubemapFaceUv(dir, f, u, v);
+	mip = clampf(mip, 0.0f, float(MipCount - 1));
+	const uint32 mip0 = uint32(mip);
+	const uint32 mip1 = (std::min)(mip0 + 1, MipCount - 1);
+	const GlslVec3 L0 = face(mip0, f).sampleLinearClamp(u, v);
+	return mip1 == mip0 ? L0 : lerp(L0, face(mip1, f).sampleLinearClamp(u, v), mip - float(mip0));
+}
+
+
+
+void renderSkyCubemapFromSkyViewLut(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, float CameraHeight,
+	const GlslVec3& SunDir, const GlslVec3& SunIlluminance, CpuCubemap& inoutCubemap)
+{
+	const uint32 Size = inoutCubemap.Size;
+	const GlslVec3 WorldPos = { 0.0f, 0.0f, Atmosphere.BottomRadius + CameraHeight };
+	pool.parallelFor(SKY_CUBEMAP_FACE_COUNT * Size, [&](uint32 row)
+	{
+		CpuLut2D& face = inoutCubemap.face(0, row / Size);
+		const uint32 y = row % Size;
+		for (uint32 x = 0; x < Size; ++x)
+		{
+			GlslVec3 dir = getCubemapDirection(row / Size, (float(x) + 0.5f) / float(Size), (float(y) + 0.5f) / float(Size));
+			if (fabsf(dir.z) > 0.9999f)
+			{
+				dir = normalize(GlslVec3{ 0.01f, 0.0f, dir.z });	// sampleSkyViewLut needs a direction not parallel to up
+			}
+			const GlslVec3 L = sampleSkyViewLut(Atmosphere, SkyViewLut, WorldPos, dir, SunDir) * SunIlluminance;
+			float* texel = face.texel(x, y);
+			texel[0] = L.x;
+			texel[1] = L.y;
+			texel[2] = L.z;
+			texel[3] = 1.0f;
+		}
+	});
+}
+
+void renderSkyCubemapRayMarched(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, float CameraHeight,
+	const GlslVec3& SunDir, CpuCubemap& inoutCubemap)
+{
+	const uint32 Size = inoutCubemap.Size;
+	pool.parallelFor(SKY_CUBEMAP_FACE_COUNT * Size, [&](uint32 row)
+	{
+		CpuLut2D& face = inoutCubemap.face(0, row / Size);
+		const uint32 y = row % Size;
+		for (uint32 x = 0; x < Size; x += 8)
+		{
+			const uint32 count = (std::min)(8u, Size - x);
+			SkyRadianceQuery queries[8];
+			SkyRadianceResult results[8];
+			for (uint32 l = 0; l < count; ++l)
+			{
+				queries[l].WorldPos = { 0.0f, 0.0f, CameraHeight };
+				queries[l].WorldDir = getCubemapDirection(row / Size, (float(x + l) + 0.5f) / float(Size), (float(y) + 0.5f) / float(Size));
+				queries[l].SunDir = SunDir;
+			}
+			querySkyRadiance8(luts, settings, queries, count, results);
+			for (uint32 l = 0; l < count; ++l)
+			{
+				float* texel = face.texel(x + l, y);
+				texel[0] = results[l].L.x;
+				texel[1] = results[l].L.y;
+				texel[2] = results[l].L.z;
+				texel[3] = 1.0f;
+			}
+		}
+	});
+}
+
+
+
+// Reflected direction of a GGX sample around N = V = +z, with the source mip to read it from.
+struct SkyCubemapGGXSample
+{
+	GlslVec3 L;
+	float NoL;
+	float SourceMip;
+};
+
+static void getSkyCubemapGGXSamples(float Roughness, uint32 SampleCount, uint32 SourceSize, uint32 SourceMipCount, std::vector<SkyCubemapGGXSample>& out)
+{
+	const float a2 = (std::max)(Roughness * Roughness * Roughness * Roughness, 1e-8f);
+	const float TexelSolidAngle = 4.0f * PI / (float(SKY_CUBEMAP_FACE_COUNT) * float(SourceSize) * float(SourceSize));
+	out.clear();
+	for (uint32 i = 0; i < SampleCount; ++i)
+	{
+		// Hammersley point and GGX half vector (Karis 2013)
+		const float e0 = (float(i) + 0.5f) / float(SampleCount);
+		const float e1 = float(reverseBits32(i)) * (1.0f / 4294967296.0f);
+		const float phi = 2.0f * PI * e0;
+		const float NoH = sqrtf((1.0f - e1) / (1.0f + (a2 - 1.0f) * e1));
+		const float sinTheta = sqrtf(saturate(1.0f - NoH * NoH));
+		const GlslVec3 H = { sinTheta * cosf(phi), sinTheta * sinf(phi), NoH };
+
+		SkyCubemapGGXSample sample;
+		sample.L = H * (2.0f * NoH) - GlslVec3{ 0.0f, 0.0f, 1.0f };
+		sample.NoL = sample.L.z;
+		if (sample.NoL <= 0.0f)
+		{
+			continue;
+		}
+		// With V = N, pdf(L) = D(NoH) * NoH / (4 * VoH) = D(NoH) / 4
+		const float d = NoH * NoH * (a2 - 1.0f) + 1.0f;
+		const float pdf = a2 / (PI * d * d) * 0.25f;
+		const float SampleSolidAngle = 1.0f / (float(SampleCount) * pdf);
+		sample.SourceMip = clampf(0.5f * log2f(SampleSolidAngle / TexelSolidAngle), 0.0f, float(SourceMipCount - 1));
+		out.push_back(sample);
+	}
+}
+
+void prefilterSkyCubemapGGX(CpuThreadPool& pool, uint32 SampleCount, CpuCubemap& inoutCubemap)
+{
+	const uint32 Size = inoutCubemap.Size;
+	if (inoutCubemap.MipCount < 2)
+	{
+		return;
+	}
+
+	// Full box filtered chain of mip 0
+	uint32 SourceMipCount = 1;
+	while ((Size >> SourceMipCount) > 0)
+	{
+		SourceMipCount++;
+	}
+	CpuCubemap source;
+	source.Allocate(Size, SourceMipCount);
+	for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+	{
+		source.face(0, f).Data = inoutCubemap.face(0, f).Data;
+	}
+	for (uint32 m = 1; m < SourceMipCount; ++m)
+	{
+		pool.parallelFor(SKY_CUBEMAP_FACE_COUNT, [&](uint32 f)
+		{
+			const CpuLut2D& src = source.face(m - 1, f);
+			CpuLut2D& dst = source.face(m, f);
+			for (uint32 y = 0; y < dst.Height; ++y)
+			{
+				for (uint32 x = 0; x < dst.Width; ++x)
+				{
+					const uint32 x0 = 2 * x, x1 = (std::min)(2 * x + 1, src.Width - 1);
+					const uint32 y0 = 2 * y, y1 = (std::min)(2 * y + 1, src.Height - 1);
+					float* texel = dst.texel(x, y);
+					for (uint32 c = 0; c < 4; ++c)
+					{
+						texel[c] = 0.25f * (src.texel(x0, y0)[c] + src.texel(x1, y0)[c] + src.texel(x0, y1)[c] + src.texel(x1, y1)[c]);
+					}
+				}
+			}
+		});
+	}
+
+	std::vector<SkyCubemapGGXSample> samples;
+	for (uint32 m = 1; m < inoutCubemap.MipCount; ++m)
+	{
+		const uint32 MipSampleCount = (std::max)(1u, SampleCount) << (std::min)(m - 1, 8u);
+		getSkyCubemapGGXSamples(getSkyCubemapMipRoughness(m, inoutCubemap.MipCount), MipSampleCount, Size, SourceMipCount, samples);
+		const uint32 MipSize = inoutCubemap.face(m, 0).Width;
+		pool.parallelFor(SKY_CUBEMAP_FACE_COUNT * MipSize, [&](uint32 row)
+		{
+			CpuLut2D& face = inoutCubemap.face(m, row / MipSize);
+			const uint32 y = row % MipSize;
+			for (uint32 x = 0; x < MipSize; ++x)
+			{
+				const GlslVec3 N = getCubemapDirection(row / MipSize, (float(x) + 0.5f) / float(MipSize), (float(y) + 0.5f) / float(MipSize));
+				const GlslVec3 Up = fabsf(N.z) < 0.999f ? GlslVec3{ 0.0f, 0.0f, 1.0f } : GlslVec3{ 1.0f, 0.0f, 0.0f };
+				const GlslVec3 TangentX = normalize(cross(Up, N));
+				const GlslVec3 TangentY = cross(N, TangentX);
+
+				GlslVec3 L = splat3(0.0f);
+				float weight = 0.0f;
+				for (const SkyCubemapGGXSample& sample : samples)
+				{
+					const GlslVec3 dir = TangentX * sample.L.x + TangentY * sample.L.y + N * sample.L.z;
+					L += source.sampleLinear(dir, sample.SourceMip) * sample.NoL;
+					weight += sample.NoL;
+				}
+				L = weight > 0.0f ? L * (1.0f / weight) : L;
+				float* texel = face.texel(x, y);
+				texel[0] = L.x;
+				texel[1] = L.y;
+				texel[2] = L.z;
+				texel[3] = 1.0f;
+			}
+		});
+	}
+}
+
+bool saveCubemapDds(const CpuCubemap& cubemap, const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return false;
+	}
+
+	// "DDS ", DDS_HEADER and DDS_HEADER_DXT10
+	uint32 header[1 + 31 + 5] = {};
+	header[0] = 0x20534444;								// "DDS "
+	header[1] = 124;									// dwSize
+	header[2] = 0x1 | 0x2 | 0x4 | 0x8 | 0x1000 | 0x20000;	// CAPS, HEIGHT, WIDTH, PITCH, PIXELFORMAT, MIPMAPCOUNT
+	header[3] = cubemap.Size;							// dwHeight
+	header[4] = cubemap.Size;							// dwWidth
+	header[5] = cubemap.Size * 16;						// dwPitchOrLinearSize
+	header[7] = cubemap.MipCount;						// dwMipMapCount
+	header[19] = 32;									// ddspf.dwSize
+	header[20] = 0x4;									// ddspf.dwFlags: DDPF_FOURCC
+	header[21] = 0x30315844;							// ddspf.dwFourCC: "DX10"
+	header[27] = 0x8 | 0x1000 | 0x400000;				// dwCaps: COMPLEX, TEXTURE, MIPMAP
+	header[28] = 0x200 | 0xFC00;						// dwCaps2: CUBEMAP and all the faces
+	header[32] = 2;										// DXGI_FORMAT_R32G32B32A32_FLOAT
+	header[33] = 3;										// D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	header[34] = 0x4;									// D3D11_RESOURCE_MISC_TEXTURECUBE
+	header[35] = 1;										// arraySize
+	bool success = fwrite(header, sizeof(header), 1, file) == 1;
+
+	// Face major, each face with its mip chain
+	for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT && success; ++f)
+	{
+		for (uint32 m = 0; m < cubemap.MipCount && success; ++m)
+		{
+			const std::vector<float>& data = cubemap.face(m, f).Data;
+			success = fwrite(data.data(), sizeof(float), data.size(), file) == data.size();
+		}
+	}
+	fclose(file);
+	if (!success)
+	{
+		fprintf(stderr, "Failed to write %s\n", filename);
+	}
+	return success;
+}
+
+
+
+const char* getSkyCubemapSourceName(SkyCubemapSource source)
+{
+	static const char* names[SkyCubemapSourceCount] = { "sky view LUT", "ray marching" };
+	return source < SkyCubemapSourceCount ? names[source] : "unknown";
+}
+
+bool SkyCubemapCapture::update(CpuThreadPool& pool, const AtmosphereInfo& info, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings,
+	const SkyCubemapSettings& cubemapSettings, const GlslVec3& WorldPos, const GlslVec3& SunDir)
+{
+	const float CameraHeight = WorldPos.z;
+	const bool settingsChanged = cubemapSettings.Size != mSettings.Size || cubemapSettings.MipCount != mSettings.MipCount
+		|| cubemapSettings.SampleCount != mSettings.SampleCount || cubemapSettings.Source != mSettings.Source
+		|| cubemapSettings.SkyViewWidth != mSettings.SkyViewWidth || cubemapSettings.SkyViewHeight != mSettings.SkyViewHeight;
+	const float horizonDistance = saturate((std::min)(fabsf(asinf(clampf(SunDir.z, -1.0f, 1.0f))), fabsf(asinf(clampf(mSunDir.z, -1.0f, 1.0f))))
+		/ (std::max)(cubemapSettings.HorizonElevation, 1e-6f));
+	const float sunAngleThreshold = lerp(cubemapSettings.HorizonSunAngleThreshold, cubemapSettings.SunAngleThreshold, horizonDistance);
+	if (mValid && !settingsChanged && dot(SunDir, mSunDir) >= cosf(sunAngleThreshold)
+		&& fabsf(CameraHeight - mCameraHeight) <= cubemapSettings.HeightThreshold)
+	{
+		return false;
+	}
+
+	mSettings = cubemapSettings;
+	mSunDir = SunDir;
+	mCameraHeight = CameraHeight;
+	mValid = true;
+	mRenderCount++;
+	if (mCubemap.Size != mSettings.Size || mCubemap.MipCount != mSettings.MipCount)
+	{
+		mCubemap.Allocate(mSettings.Size, mSettings.MipCount);
+	}
+
+	if (mSettings.Source == SkyCubemapSourceSkyViewLut)
+	{
+		IntegrateScatteredLuminanceOptions Options;
+		Options.MultiScatLut = settings.MultipleScattering ? &luts.MultiScatLut : nullptr;
+		Options.VariableSampleCount = true;
+		Options.RayMarchMinMaxSPP[0] = settings.RayMarchMinMaxSPP[0];
+		Options.RayMarchMinMaxSPP[1] = settings.RayMarchMinMaxSPP[1];
+		bakeSkyViewLut(pool, info, luts.TransmittanceLut, CameraHeight, SunDir.z, mSettings.SkyViewWidth, mSettings.SkyViewHeight, 0.0f, Options, mSkyViewLut);
+		renderSkyCubemapFromSkyViewLut(pool, luts.Atmosphere, mSkyViewLut, CameraHeight, SunDir, settings.SunIlluminance, mCubemap);
+	}
+	else
+	{
+		renderSkyCubemapRayMarched(pool, luts, settings, CameraHeight, SunDir, mCubemap);
+	}
+	prefilterSkyCubemapGGX(pool, mSettings.SampleCount, mCubemap);
+	return true;
+}
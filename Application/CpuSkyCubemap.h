@@ -0,0 +1,101 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSkyRadiance.h"
+
+// Sky cubemap for reflections: mip 0 holds the sky luminance and the other mips the GGX prefiltered luminance for increasing
+// roughness, assuming N = V = R as split sum reflection probes do. Faces are in the D3D order +X, -X, +Y, -Y, +Z, -Z and use the
+// D3D face orientations in world space (z up), so that a TextureCube sampled with a world direction returns the luminance from it.
+// The sun disk is not included: it is the directional light of the scene.
+#define SKY_CUBEMAP_FACE_COUNT 6
+
+// Direction through (u, v) of a face, uv in [0, 1] with v going down.
+GlslVec3 getCubemapDirection(uint32 face, float u, float v);
+// Face and uv a direction goes through, the inverse of getCubemapDirection.
+void getCubemapFaceUv(const GlslVec3& dir, uint32& outFace, float& outU, float& outV);
+
+// Linear roughness of a mip: 0 for mip 0 up to 1 for the last mip. A shader selects the mip as roughness * (MipCount - 1).
+inline float getSkyCubemapMipRoughness(uint32 mip, uint32 mipCount) { return mipCount > 1 ? float(mip) / float(mipCount - 1) : 0.0f; }
+
+struct CpuCubemap
+{
+	uint32 Size = 0;				// Face size of mip 0
+	uint32 MipCount = 0;
+	std::vector<CpuLut2D> Faces;	// Faces[mip * SKY_CUBEMAP_FACE_COUNT + face]
+
+	void Allocate(uint32 size, uint32 mipCount);
+	CpuLut2D& face(uint32 mip, uint32 f) { return Faces[mip * SKY_CUBEMAP_FACE_COUNT + f]; }
+	const CpuLut2D& face(uint32 mip, uint32 f) const { return Faces[mip * SKY_CUBEMAP_FACE_COUNT + f]; }
+
+	// Bilinear within the face a direction goes through, clamped at the face edges, and linear between the two nearest mips.
+	GlslVec3 sampleLinear(const GlslVec3& dir, float mip) const;
+};
+
+// Mip 0 from a sky view LUT baked for the capture height and the sun zenith angle SunDir.z (see sampleSkyViewLut), rows being spread
+// over the pool threads. Rays hitting the ground only get the atmosphere in front of it, as in the sky view LUT.
+void renderSkyCubemapFromSkyViewLut(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, float CameraHeight,
+	const GlslVec3& SunDir, const GlslVec3& SunIlluminance, CpuCubemap& inoutCubemap);
+// Mip 0 ray marched 8 texels at a time as querySkyRadiance8 does, rows being spread over the pool threads.
+void renderSkyCubemapRayMarched(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, float CameraHeight,
+	const GlslVec3& SunDir, CpuCubemap& inoutCubemap);
+
+// Mips 1 and up from mip 0, with SampleCount GGX importance samples per texel of mip 1, doubled for each next mip: the rougher mips need
+// more samples and have 4 times fewer texels. Each sample reads a box filtered copy of mip 0 at the mip matching its solid angle
+// (Krivanek and Colbert 2008), which keeps the result smooth with few samples. Rows are spread over the pool threads.
+void prefilterSkyCubemapGGX(CpuThreadPool& pool, uint32 SampleCount, CpuCubemap& inoutCubemap);
+
+// DDS cubemap with all its mips as DXGI_FORMAT_R32G32B32A32_FLOAT, readable by CreateDDSTextureFromFile and texconv.
+bool saveCubemapDds(const CpuCubemap& cubemap, const char* filename);
+
+
+
+enum SkyCubemapSource
+{
+	SkyCubemapSourceSkyViewLut = 0,
+	SkyCubemapSourceRayMarching,
+	SkyCubemapSourceCount
+};
+
+const char* getSkyCubemapSourceName(SkyCubemapSource source);
+
+struct SkyCubemapSettings
+{
+	uint32 Size = 128;
+	uint32 MipCount = 6;					// 128 down to 4 texels, the last mip being for a roughness of 1
+	uint32 SampleCount = 64;				// GGX samples per texel of mip 1, see prefilterSkyCubemapGGX
+	SkyCubemapSource Source = SkyCubemapSourceSkyViewLut;
+	uint32 SkyViewWidth = 192;				// Sky view LUT baked by SkyCubemapCapture for the sky view LUT source
+	uint32 SkyViewHeight = 108;
+	float SunAngleThreshold = 0.01f;		// Radians the sun moves before the cubemap is rendered again
+	float HorizonSunAngleThreshold = 0.002f;	// Same with the sun at the horizon, the threshold going up to SunAngleThreshold at HorizonElevation
+	float HorizonElevation = 0.2f;			// Radians, above or below the horizon
+	float HeightThreshold = 0.05f;			// Kilometers the capture position moves up or down before the cubemap is rendered again
+};
+
+// Sky cubemap following the sun: update only renders mip 0 and prefilters the other mips again when the sun moved past the angle threshold
+// or the capture height past HeightThreshold since the last render, so a time of day transition costs a full update every few frames.
+// The sky changes the fastest around sunrise and sunset, hence the lower threshold there. The local up is taken as +z, as for SkyIrradianceCache.
+class SkyCubemapCapture
+{
+public:
+	// Returns true when the cubemap was rendered. luts hold the atmosphere of info. settings are the sun illuminance and ray marching
+	// settings of both sources, the sky view LUT source baking its LUT with them.
+	bool update(CpuThreadPool& pool, const AtmosphereInfo& info, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings,
+		const SkyCubemapSettings& cubemapSettings, const GlslVec3& WorldPos, const GlslVec3& SunDir);
+	// To call when the atmosphere or the LUTs change.
+	void invalidate() { mValid = false; }
+
+	const CpuCubemap& getCubemap() const { return mCubemap; }
+	uint32 getRenderCount() const { return mRenderCount; }
+
+private:
+	CpuCubemap mCubemap;
+	CpuLut2D mSkyViewLut;
+	SkyCubemapSettings mSettings;
+	GlslVec3 mSunDir = { 0.0f, 0.0f, 1.0f };
+	float mCameraHeight = 0.0f;
+	bool mValid = false;
+	uint32 mRenderCount = 0;
+};
@@ -0,0 +1,1058 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cstring>
+#include "CpuSkyLuts.h"
+
+
+// Integrates the optical depth along 8 rays starting at (0, 0, viewHeight) with direction (0, sinTheta, cosTheta).
+// This is the part of IntegrateScatteredLuminance used by RenderTransmittanceLutPS (no variable sample count, no depth buffer).
+static void integrateOpticalDepth8(const CpuAtmosphereParameters& Atmosphere, float8 viewHeight, float8 sinTheta, float8 cosTheta,
+	float8 tMax, float SampleCount, float8 OpticalDepth[3])
+{
+	const float SampleSegmentT = 0.3f;
+	const float8 zero = splat8(0.0f);
+	OpticalDepth[0] = zero;
+	OpticalDepth[1] = zero;
+	OpticalDepth[2] = zero;
+
+	float8 t = zero;
+	for (float s = 0.0f; s < SampleCount; s += 1.0f)
+	{
+		// Exact difference, important for accuracy of multiple scattering
+		const float8 NewT = tMax * (s + SampleSegmentT) / SampleCount;
+		const float8 dt = NewT - t;
+		t = NewT;
+
+		const float8 Py = t * sinTheta;
+		const float8 Pz = viewHeight + t * cosTheta;
+		const float8 sampleHeight = sqrt8(Py * Py + Pz * Pz) - Atmosphere.BottomRadius;
+
+		const MediumSample8 medium = sampleMedium8(sampleHeight, Atmosphere);
+		OpticalDepth[0] = OpticalDepth[0] + medium.extinction[0] * dt;
+		OpticalDepth[1] = OpticalDepth[1] + medium.extinction[1] * dt;
+		OpticalDepth[2] = OpticalDepth[2] + medium.extinction[2] * dt;
+	}
+}
+
+// Distance to the atmosphere top or the ground, 0 when the ray misses the atmosphere.
+static float getOpticalDepthRayLength(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& WorldPos, const GlslVec3& WorldDir)
+{
+	const GlslVec3 earthO = splat3(0.0f);
+	const float tBottom = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.BottomRadius);
+	const float tTop = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.TopRadius);
+	if (tBottom < 0.0f)
+	{
+		return tTop < 0.0f ? 0.0f : tTop;
+	}
+	return tTop > 0.0f ? (tTop < tBottom ? tTop : tBottom) : 0.0f;
+}
+
+GlslVec3 IntegrateOpticalDepth(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& WorldPos, const GlslVec3& WorldDir, float SampleCount)
+{
+	const float tMax = getOpticalDepthRayLength(Atmosphere, WorldPos, WorldDir);
+	GlslVec3 OpticalDepth = splat3(0.0f);
+	float t = 0.0f;
+	const float SampleSegmentT = 0.3f;
+	for (float s = 0.0f; s < SampleCount; s += 1.0f)
+	{
+		const float NewT = tMax * (s + SampleSegmentT) / SampleCount;
+		const float dt = NewT - t;
+		t = NewT;
+		OpticalDepth += sampleMediumRGB(WorldPos + WorldDir * t, Atmosphere).extinction * dt;
+	}
+	return OpticalDepth;
+}
+
+GlslVec3 IntegrateOpticalDepthAnalytic(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& WorldPos, const GlslVec3& WorldDir, float SampleCount)
+{
+	const float tMax = getOpticalDepthRayLength(Atmosphere, WorldPos, WorldDir);
+	if (tMax <= 0.0f)
+	{
+		return splat3(0.0f);
+	}
+
+	const float r = length(WorldPos);
+	const float mu = dot(WorldPos, WorldDir) / r;
+	GlslVec3 OpticalDepth = Atmosphere.RayleighScattering * ExponentialOpticalLength(r, mu, tMax, Atmosphere.BottomRadius, Atmosphere.RayleighDensityExpScale)
+		+ Atmosphere.MieExtinction * ExponentialOpticalLength(r, mu, tMax, Atmosphere.BottomRadius, Atmosphere.MieDensityExpScale);
+
+	float t = 0.0f;
+	const float SampleSegmentT = 0.3f;
+	for (float s = 0.0f; s < SampleCount; s += 1.0f)
+	{
+		const float NewT = tMax * (s + SampleSegmentT) / SampleCount;
+		const float dt = NewT - t;
+		t = NewT;
+		OpticalDepth += Atmosphere.AbsorptionExtinction * (getAbsorptionDensity(Atmosphere, length(WorldPos + WorldDir * t) - Atmosphere.BottomRadius) * dt);
+	}
+	return OpticalDepth;
+}
+
+void bakeTransmittanceLut(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo, CpuLut2D& outLut, bool analyticOpticalDepth,
+	float SampleCountIni)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const uint32 Width = lutInfo.TRANSMITTANCE_TEXTURE_WIDTH;
+	const uint32 Height = lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT;
+	outLut.Allocate(Width, Height);
+
+	const GlslVec3 earthO = splat3(0.0f);
+
+	if (analyticOpticalDepth)
+	{
+		pool.parallelFor(Height, [&](uint32 y)
+		{
+			for (uint32 x = 0; x < Width; ++x)
+			{
+				const float u = (float(x) + 0.5f) / float(Width);
+				const float v = (float(y) + 0.5f) / float(Height);
+				float viewHeight, viewZenithCosAngle;
+				UvToLutTransmittanceParams(Atmosphere, viewHeight, viewZenithCosAngle, u, v);
+
+				const GlslVec3 WorldPos = { 0.0f, 0.0f, viewHeight };
+				const GlslVec3 WorldDir = { 0.0f, sqrtf(1.0f - viewZenithCosAngle * viewZenithCosAngle), viewZenithCosAngle };
+				const GlslVec3 transmittance = exp3(-IntegrateOpticalDepthAnalytic(Atmosphere, WorldPos, WorldDir, SampleCountIni));
+				float* texel = outLut.texel(x, y);
+				texel[0] = transmittance.x;
+				texel[1] = transmittance.y;
+				texel[2] = transmittance.z;
+				texel[3] = 1.0f;
+			}
+		});
+		return;
+	}
+
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		for (uint32 x0 = 0; x0 < Width; x0 += CPU_SIMD_WIDTH)
+		{
+			// Per lane setup, cheap compared to the march itself.
+			float viewHeight[CPU_SIMD_WIDTH];
+			float sinTheta[CPU_SIMD_WIDTH];
+			float cosTheta[CPU_SIMD_WIDTH];
+			float tMax[CPU_SIMD_WIDTH];
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+			{
+				// Lanes past the end of the row replicate the last texel and are not written back.
+				const uint32 x = (x0 + l) < Width ? (x0 + l) : (Width - 1);
+				const float u = (float(x) + 0.5f) / float(Width);
+				const float v = (float(y) + 0.5f) / float(Height);
+				float viewZenithCosAngle;
+				UvToLutTransmittanceParams(Atmosphere, viewHeight[l], viewZenithCosAngle, u, v);
+
+				const GlslVec3 WorldPos = { 0.0f, 0.0f, viewHeight[l] };
+				const GlslVec3 WorldDir = { 0.0f, sqrtf(1.0f - viewZenithCosAngle * viewZenithCosAngle), viewZenithCosAngle };
+				sinTheta[l] = WorldDir.y;
+				cosTheta[l] = WorldDir.z;
+
+				// Compute next intersection with atmosphere or ground
+				const float tBottom = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.BottomRadius);
+				const float tTop = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.TopRadius);
+				tMax[l] = 0.0f;
+				if (tBottom < 0.0f)
+				{
+					tMax[l] = tTop < 0.0f ? 0.0f : tTop;
+				}
+				else if (tTop > 0.0f)
+				{
+					tMax[l] = tTop < tBottom ? tTop : tBottom;
+				}
+			}
+
+			float8 OpticalDepth[3];
+			integrateOpticalDepth8(Atmosphere, load8(viewHeight), load8(sinTheta), load8(cosTheta), load8(tMax), SampleCountIni, OpticalDepth);
+
+			float transmittance[3][CPU_SIMD_WIDTH];
+			store8(transmittance[0], exp8(-OpticalDepth[0]));
+			store8(transmittance[1], exp8(-OpticalDepth[1]));
+			store8(transmittance[2], exp8(-OpticalDepth[2]));
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH && (x0 + l) < Width; ++l)
+			{
+				float* texel = outLut.texel(x0 + l, y);
+				texel[0] = transmittance[0][l];
+				texel[1] = transmittance[1][l];
+				texel[2] = transmittance[2][l];
+				texel[3] = 1.0f;
+			}
+		}
+	});
+}
+
+
+
+
+void SunInScatterLutParamsToUv(const CpuAtmosphereParameters& Atmosphere, float viewHeight, float SunZenithCosAngle, uint32 Width, uint32 Height, float& u, float& v)
+{
+	const float x = sqrtf(fabsf(SunZenithCosAngle));
+	u = fromUnitToSubUvs(saturate(0.5f + 0.5f * (SunZenithCosAngle < 0.0f ? -x : x)), float(Width));
+	v = fromUnitToSubUvs(sqrtf(saturate((viewHeight - Atmosphere.BottomRadius) / (Atmosphere.TopRadius - Atmosphere.BottomRadius))), float(Height));
+}
+
+void UvToSunInScatterLutParams(const CpuAtmosphereParameters& Atmosphere, float u, float v, uint32 Width, uint32 Height, float& viewHeight, float& SunZenithCosAngle)
+{
+	const float x = fromSubUvsToUnit(u, float(Width)) * 2.0f - 1.0f;
+	const float y = fromSubUvsToUnit(v, float(Height));
+	SunZenithCosAngle = x < 0.0f ? -x * x : x * x;
+	viewHeight = Atmosphere.BottomRadius + y * y * (Atmosphere.TopRadius - Atmosphere.BottomRadius);
+}
+
+// Same as SampleSunInScatterLut, the 6 channels sharing the bilinear weights and the texel addresses.
+static void sampleSunInScatterLut8(const CpuAtmosphereParameters& Atmosphere, const CpuSunInScatterLut& Lut, float8 viewHeight, float8 SunZenithCosAngle,
+	bool multiScattering, float8 SunTransmittance[3], float8 MultiScatteredLuminance[3])
+{
+	// SunInScatterLutParamsToUv
+	const float8 zero = splat8(0.0f);
+	const float8 sqrtCos = sqrt8(abs8(SunZenithCosAngle));
+	const float8 uUnit = saturate8(0.5f + 0.5f * select8(SunZenithCosAngle < zero, -sqrtCos, sqrtCos));
+	const float8 vUnit = sqrt8(saturate8((viewHeight - Atmosphere.BottomRadius) * (1.0f / (Atmosphere.TopRadius - Atmosphere.BottomRadius))));
+	const float W = float(Lut.Width);
+	const float H = float(Lut.Height);
+	const float8 u = (uUnit + 0.5f / W) * (W / (W + 1.0f));
+	const float8 v = (vUnit + 0.5f / H) * (H / (H + 1.0f));
+
+	// Same as CpuLut2D::sampleLinearClamp8 with 8 floats per texel
+	const float8 x = min8(max8(u * W - 0.5f, zero), splat8(W - 1.0f));
+	const float8 y = min8(max8(v * H - 0.5f, zero), splat8(H - 1.0f));
+	const float8 x0 = floor8(x);
+	const float8 y0 = floor8(y);
+	const float8 fx = x - x0;
+	const float8 fy = y - y0;
+	const float8 x1Offset = (min8(x0 + 1.0f, splat8(W - 1.0f)) - x0) * 8.0f;
+	const float8 y1Offset = (min8(y0 + 1.0f, splat8(H - 1.0f)) - y0) * (W * 8.0f);
+	const float8 i00 = (y0 * W + x0) * 8.0f;
+	const float8 i10 = i00 + x1Offset;
+	const float8 i01 = i00 + y1Offset;
+	const float8 i11 = i01 + x1Offset;
+
+	// Transmittance in texel floats 0 to 2, multiple scattering in 4 to 6
+	const int channelCount = multiScattering ? 6 : 3;
+	for (int c = 0; c < channelCount; ++c)
+	{
+		const float* base = Lut.Data.data() + (c < 3 ? c : c + 1);
+		const float8 a = gather8(base, i00);
+		const float8 b = gather8(base, i10);
+		const float8 top = a + (b - a) * fx;
+		const float8 d = gather8(base, i01);
+		const float8 e = gather8(base, i11);
+		const float8 bottom = d + (e - d) * fx;
+		float8& out = c < 3 ? SunTransmittance[c] : MultiScatteredLuminance[c - 3];
+		out = top + (bottom - top) * fy;
+	}
+}
+
+SingleScatteringResult8 IntegrateScatteredLuminance8(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut,
+	const float8x3& WorldPos, const float8x3& WorldDir, const float8x3& SunDir, bool ground, float SampleCountIni, bool MieRayPhase,
+	const IntegrateScatteredLuminanceOptions& Options)
+{
+	const float8 zero = splat8(0.0f);
+	const float8 one = splat8(1.0f);
+	SingleScatteringResult8 result;
+	for (int c = 0; c < 3; ++c)
+	{
+		result.L[c] = zero;
+		result.OpticalDepth[c] = zero;
+		result.MultiScatAs1[c] = zero;
+	}
+
+	// Compute next intersection with atmosphere or ground, and the Mie phase (pow is not vectorized)
+	float tMaxLanes[8], tBottomLanes[8], MiePhaseLanes[8];
+	{
+		float px[8], py[8], pz[8], dx[8], dy[8], dz[8], cosThetaLanes[8];
+		store8(px, WorldPos.x); store8(py, WorldPos.y); store8(pz, WorldPos.z);
+		store8(dx, WorldDir.x); store8(dy, WorldDir.y); store8(dz, WorldDir.z);
+		store8(cosThetaLanes, dot(SunDir, WorldDir));
+		const GlslVec3 earthO = splat3(0.0f);
+		for (int l = 0; l < 8; ++l)
+		{
+			const GlslVec3 P = { px[l], py[l], pz[l] };
+			const GlslVec3 D = { dx[l], dy[l], dz[l] };
+			const float tBottom = raySphereIntersectNearest(P, D, earthO, Atmosphere.BottomRadius);
+			const float tTop = raySphereIntersectNearest(P, D, earthO, Atmosphere.TopRadius);
+			float tMax = 0.0f;
+			if (tBottom < 0.0f)
+			{
+				tMax = tTop < 0.0f ? 0.0f : tTop;	// No intersection with earth nor atmosphere gives an empty integration
+			}
+			else if (tTop > 0.0f)
+			{
+				tMax = tTop < tBottom ? tTop : tBottom;
+			}
+			tMaxLanes[l] = tMax;
+			tBottomLanes[l] = tBottom;
+			MiePhaseLanes[l] = MieRayPhase ? hgPhase(Atmosphere.MiePhaseG, -cosThetaLanes[l]) : 0.0f;	// negate cosTheta because WorldDir is an "in" direction
+		}
+	}
+	const float8 tMax = min8(load8(tMaxLanes), Options.tMaxMax);
+	const float8 tBottom = load8(tBottomLanes);
+
+	// Sample count
+	float SampleCount = SampleCountIni;
+	float8 SampleCount8 = splat8(SampleCountIni);
+	float8 SampleCountFloor = SampleCount8;
+	float8 tMaxFloor = tMax;
+	if (Options.VariableSampleCount)
+	{
+		SampleCount8 = Options.RayMarchMinMaxSPP[0] + (Options.RayMarchMinMaxSPP[1] - Options.RayMarchMinMaxSPP[0]) * saturate8(tMax * 0.01f);
+		SampleCountFloor = floor8(SampleCount8);
+		tMaxFloor = tMax * SampleCountFloor / SampleCount8;	// rescale tMax to map to the last entire step segment.
+
+		// Lanes past their own sample count get empty segments.
+		SampleCount = 0.0f;
+		for (int l = 0; l < 8; ++l)
+		{
+			SampleCount = (std::max)(SampleCount, lane8(SampleCount8, l));
+		}
+	}
+
+	// Phase functions
+	const float uniformPhaseValue = uniformPhase();
+	const float8 cosTheta = dot(SunDir, WorldDir);
+	const float8 MiePhaseValue = load8(MiePhaseLanes);
+	const float8 RayleighPhaseValue = (3.0f / (16.0f * PI)) * (1.0f + cosTheta * cosTheta);
+
+	// Ray march the atmosphere to integrate optical depth
+	float8 throughput[3] = { one, one, one };
+	float8 t = zero;
+	const float SampleSegmentT = 0.3f;
+	const float8 SunDirSqrLength = dot(SunDir, SunDir);
+	const float8 InvTwoA = 1.0f / (2.0f * SunDirSqrLength);
+	const float BottomRadiusSqr = Atmosphere.BottomRadius * Atmosphere.BottomRadius;
+	const float MultiScatLutRes = Options.MultiScatLut ? float(Options.MultiScatLut->Width) : 0.0f;
+	for (float s = 0.0f; s < SampleCount; s += 1.0f)
+	{
+		float8 dt;
+		if (Options.VariableSampleCount)
+		{
+			// Non linear distribution of sample within the range.
+			float8 t0 = s / SampleCountFloor;
+			float8 t1 = (s + 1.0f) / SampleCountFloor;
+			t0 = t0 * t0;
+			t1 = t1 * t1;
+			// Make t0 and t1 world space distances.
+			t0 = tMaxFloor * t0;
+			t1 = select8(t1 > splat8(1.0f), tMax, tMaxFloor * t1);
+			const bool8 active = splat8(s) < SampleCount8;
+			t = min8(t0 + (t1 - t0) * SampleSegmentT, tMax);
+			dt = select8(active, t1 - t0, zero);
+		}
+		else if (Options.FullSegments)
+		{
+			t = tMax * (s + 0.5f) / SampleCount;
+			dt = tMax / SampleCount;
+		}
+		else
+		{
+			// Exact difference, important for accuracy of multiple scattering
+			const float8 NewT = tMax * (s + SampleSegmentT) / SampleCount;
+			dt = NewT - t;
+			t = NewT;
+		}
+		const float8x3 P = WorldPos + WorldDir * t;
+
+		const float8 pHeight = length(P);
+		const MediumSample8 medium = sampleMedium8(pHeight - Atmosphere.BottomRadius, Atmosphere);
+
+		const float8x3 UpVector = P * (1.0f / pHeight);
+		const float8 SunZenithCosAngle = dot(SunDir, UpVector);
+		float8 TransmittanceToSun[3];
+		float8 earthShadow = one;
+		float8 multiScatteredLuminance[3] = { zero, zero, zero };
+		if (Options.SunInScatterLut)
+		{
+			// Earth shadow already applied to the transmittance
+			sampleSunInScatterLut8(Atmosphere, *Options.SunInScatterLut, pHeight, SunZenithCosAngle, Options.MultiScatLut != nullptr, TransmittanceToSun, multiScatteredLuminance);
+		}
+		else
+		{
+			sampleTransmittanceLut8(Atmosphere, TransmittanceLut, pHeight, SunZenithCosAngle, TransmittanceToSun);
+
+			// Earth shadow: raySphereIntersectNearest(P, SunDir, earthO + PLANET_RADIUS_OFFSET * UpVector, Atmosphere.BottomRadius) >= 0.0f
+			const float8x3 s0_r0 = P - UpVector * splat8(PLANET_RADIUS_OFFSET);
+			const float8 a = SunDirSqrLength;
+			const float8 b = 2.0f * dot(SunDir, s0_r0);
+			const float8 c = dot(s0_r0, s0_r0) - BottomRadiusSqr;
+			const float8 delta = b * b - 4.0f * a * c;
+			const float8 sqrtDelta = sqrt8(max8(delta, zero));
+			const float8 sol0 = (-b - sqrtDelta) * InvTwoA;
+			const float8 sol1 = (-b + sqrtDelta) * InvTwoA;
+			const bool8 earthHit = (!(delta < zero)) & (!(a == zero)) & (!((sol0 < zero) & (sol1 < zero)));
+			earthShadow = select8(earthHit, zero, one);
+		}
+
+		// Dual scattering for multi scattering, see GetMultipleScattering
+		if (Options.MultiScatLut && !Options.SunInScatterLut)
+		{
+			const float8 u = saturate8(SunZenithCosAngle * 0.5f + 0.5f);
+			const float8 v = saturate8((pHeight - Atmosphere.BottomRadius) / (Atmosphere.TopRadius - Atmosphere.BottomRadius));
+			Options.MultiScatLut->sampleLinearClamp8(
+				(u + 0.5f / MultiScatLutRes) * (MultiScatLutRes / (MultiScatLutRes + 1.0f)),
+				(v + 0.5f / MultiScatLutRes) * (MultiScatLutRes / (MultiScatLutRes + 1.0f)), multiScatteredLuminance);
+		}
+
+		for (int ch = 0; ch < 3; ++ch)
+		{
+			const float8 extinction = medium.extinction[ch];
+			const float8 SampleOpticalDepth = extinction * dt;
+			const float8 SampleTransmittance = exp8(-SampleOpticalDepth);
+			result.OpticalDepth[ch] = result.OpticalDepth[ch] + SampleOpticalDepth;
+
+			const float8 PhaseTimesScattering = MieRayPhase ?
+				medium.scatteringMie[ch] * MiePhaseValue + medium.scatteringRay[ch] * RayleighPhaseValue :
+				medium.scattering[ch] * uniformPhaseValue;
+
+			const float8 S = earthShadow * TransmittanceToSun[ch] * PhaseTimesScattering + multiScatteredLuminance[ch] * medium.scattering[ch];
+
+			// (X - X * SampleTransmittance) / extinction, with the division shared by both integrals below.
+			const float8 SegmentIntegral = (1.0f - SampleTransmittance) / extinction;
+
+			// MULTI_SCATTERING_POWER_SERIE==1 path
+			const float8 MS = medium.scattering[ch];
+			const float8 MSint = MS * SegmentIntegral;
+			result.MultiScatAs1[ch] = result.MultiScatAs1[ch] + throughput[ch] * MSint;
+
+			// See slide 28 at http://www.frostbite.com/2015/08/physically-based-unified-volumetric-rendering-in-frostbite/
+			const float8 Sint = S * SegmentIntegral;							// integrate along the current step segment
+			result.L[ch] = result.L[ch] + throughput[ch] * Sint;				// accumulate and also take into account the transmittance from previous steps
+			throughput[ch] = throughput[ch] * SampleTransmittance;
+		}
+	}
+
+	const bool8 groundHit = (tMax == tBottom) & (tBottom > zero);
+	if (ground && any8(groundHit))
+	{
+		// Account for bounced light off the earth
+		const float8x3 P = WorldPos + WorldDir * tBottom;
+		const float8 pHeight = length(P);
+
+		const float8x3 UpVector = P / pHeight;
+		const float8 SunZenithCosAngle = dot(SunDir, UpVector);
+		float8 TransmittanceToSun[3];
+		sampleTransmittanceLut8(Atmosphere, TransmittanceLut, pHeight, SunZenithCosAngle, TransmittanceToSun);
+
+		const float8 NdotL = saturate8(dot(UpVector / length(UpVector), SunDir / length(SunDir)));
+		const float* GroundAlbedo = &Atmosphere.GroundAlbedo.x;
+		for (int ch = 0; ch < 3; ++ch)
+		{
+			const float8 GroundL = TransmittanceToSun[ch] * throughput[ch] * NdotL * GroundAlbedo[ch] / PI;
+			result.L[ch] = result.L[ch] + select8(groundHit, GroundL, zero);
+		}
+	}
+
+	for (int c = 0; c < 3; ++c)
+	{
+		result.Transmittance[c] = throughput[c];
+	}
+	return result;
+}
+
+
+
+void bakeMultiScatteringLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut,
+	uint32 MultiScatteringLUTRes, float MultipleScatteringFactor, CpuLut2D& outLut, float SampleCountIni)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	outLut.Allocate(MultiScatteringLUTRes, MultiScatteringLUTRes);
+	const float LutRes = float(MultiScatteringLUTRes);
+
+	const bool ground = true;
+	const bool MieRayPhase = false;
+
+	const float SphereSolidAngle = 4.0f * PI;
+	const float IsotropicPhase = 1.0f / SphereSolidAngle;
+
+	// Sample directions are the same for every texel: 8x8 uniform distribution over the sphere.
+	// Batch i holds the 8 directions of ThreadId.z in [8*i, 8*i+7], i.e. constant theta and varying phi.
+	const uint32 SqrtSampleCount = 8;
+	const float sqrtSample = float(SqrtSampleCount);
+	float8x3 SampleDirs[SqrtSampleCount];
+	for (uint32 i = 0; i < SqrtSampleCount; ++i)
+	{
+		float dx[8], dy[8], dz[8];
+		for (uint32 j = 0; j < SqrtSampleCount; ++j)
+		{
+			float randA = (0.5f + float(i)) / sqrtSample;
+			float randB = (0.5f + float(j)) / sqrtSample;
+			float theta = 2.0f * PI * randA;
+			float phi = acosf(1.0f - 2.0f * randB);	// uniform distribution https://mathworld.wolfram.com/SpherePointPicking.html
+			float cosPhi = cosf(phi);
+			float sinPhi = sinf(phi);
+			float cosTheta = cosf(theta);
+			float sinTheta = sinf(theta);
+			dx[j] = cosTheta * sinPhi;
+			dy[j] = sinTheta * sinPhi;
+			dz[j] = cosPhi;
+		}
+		SampleDirs[i] = { load8(dx), load8(dy), load8(dz) };
+	}
+
+	pool.parallelFor(MultiScatteringLUTRes * MultiScatteringLUTRes, [&](uint32 texelIndex)
+	{
+		const uint32 x = texelIndex % MultiScatteringLUTRes;
+		const uint32 y = texelIndex / MultiScatteringLUTRes;
+		float u = (float(x) + 0.5f) / LutRes;
+		float v = (float(y) + 0.5f) / LutRes;
+		u = fromSubUvsToUnit(u, LutRes);
+		v = fromSubUvsToUnit(v, LutRes);
+
+		float cosSunZenithAngle = u * 2.0f - 1.0f;
+		GlslVec3 sunDir = { 0.0f, sqrtf(saturate(1.0f - cosSunZenithAngle * cosSunZenithAngle)), cosSunZenithAngle };
+		// We adjust again viewHeight according to PLANET_RADIUS_OFFSET to be in a valid range.
+		float viewHeight = Atmosphere.BottomRadius + saturate(v + PLANET_RADIUS_OFFSET) * (Atmosphere.TopRadius - Atmosphere.BottomRadius - PLANET_RADIUS_OFFSET);
+
+		const float8x3 WorldPos = splat8x3(GlslVec3{ 0.0f, 0.0f, viewHeight });
+		const float8x3 SunDir = splat8x3(sunDir);
+
+		// Same storage as MultiScatAs1SharedMem and LSharedMem
+		float MultiScatAs1SharedMem[3][64];
+		float LSharedMem[3][64];
+		for (uint32 i = 0; i < SqrtSampleCount; ++i)
+		{
+			SingleScatteringResult8 result = IntegrateScatteredLuminance8(Atmosphere, TransmittanceLut, WorldPos, SampleDirs[i], SunDir, ground, SampleCountIni, MieRayPhase);
+			for (int c = 0; c < 3; ++c)
+			{
+				store8(&MultiScatAs1SharedMem[c][i * 8], result.MultiScatAs1[c] * SphereSolidAngle / (sqrtSample * sqrtSample));
+				store8(&LSharedMem[c][i * 8], result.L[c] * SphereSolidAngle / (sqrtSample * sqrtSample));
+			}
+		}
+
+		// 64 to 32, 32 to 16, ..., 2 to 1: same summation order as the shader.
+		for (uint32 stride = 32; stride > 0; stride /= 2)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				for (uint32 z = 0; z < stride; ++z)
+				{
+					MultiScatAs1SharedMem[c][z] += MultiScatAs1SharedMem[c][z + stride];
+					LSharedMem[c][z] += LSharedMem[c][z + stride];
+				}
+			}
+		}
+
+		float* texel = outLut.texel(x, y);
+		for (int c = 0; c < 3; ++c)
+		{
+			float MultiScatAs1 = MultiScatAs1SharedMem[c][0] * IsotropicPhase;	// Equation 7 f_ms
+			float InScatteredLuminance = LSharedMem[c][0] * IsotropicPhase;		// Equation 5 L_2ndOrder
+
+			// For a serie, sum_{n=0}^{n=+inf} = 1 + r + r^2 + r^3 + ... + r^n = 1 / (1.0 - r), see https://en.wikipedia.org/wiki/Geometric_series
+			const float r = MultiScatAs1;
+			const float SumOfAllMultiScatteringEventsContribution = 1.0f / (1.0f - r);
+			float L = InScatteredLuminance * SumOfAllMultiScatteringEventsContribution;	// Equation 10 Psi_ms
+
+			texel[c] = MultipleScatteringFactor * L;
+		}
+		texel[3] = 1.0f;
+	});
+}
+
+
+
+
+void bakeSunInScatterLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuLut2D* MultiScatLut,
+	uint32 Width, uint32 Height, CpuSunInScatterLut& outLut)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	outLut.Allocate(Width, Height);
+
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			float viewHeight, SunZenithCosAngle;
+			UvToSunInScatterLutParams(Atmosphere, (float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height), Width, Height, viewHeight, SunZenithCosAngle);
+			const GlslVec3 P = { 0.0f, 0.0f, viewHeight };
+			const GlslVec3 UpVector = { 0.0f, 0.0f, 1.0f };
+			const GlslVec3 SunDir = { sqrtf(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle };
+
+			float u, v;
+			LutTransmittanceParamsToUv(Atmosphere, viewHeight, SunZenithCosAngle, u, v);
+			const GlslVec3 TransmittanceToSun = TransmittanceLut.sampleLinearClamp(u, v);
+
+			// Earth shadow
+			const float tEarth = raySphereIntersectNearest(P, SunDir, UpVector * PLANET_RADIUS_OFFSET, Atmosphere.BottomRadius);
+			const float earthShadow = tEarth >= 0.0f ? 0.0f : 1.0f;
+
+			// Dual scattering for multi scattering, see GetMultipleScattering
+			GlslVec3 multiScatteredLuminance = splat3(0.0f);
+			if (MultiScatLut)
+			{
+				const float MultiScatLutRes = float(MultiScatLut->Width);
+				multiScatteredLuminance = MultiScatLut->sampleLinearClamp(
+					fromUnitToSubUvs(saturate(SunZenithCosAngle * 0.5f + 0.5f), MultiScatLutRes),
+					fromUnitToSubUvs(saturate((viewHeight - Atmosphere.BottomRadius) / (Atmosphere.TopRadius - Atmosphere.BottomRadius)), MultiScatLutRes));
+			}
+
+			float* texel = outLut.texel(x, y);
+			texel[0] = earthShadow * TransmittanceToSun.x;
+			texel[1] = earthShadow * TransmittanceToSun.y;
+			texel[2] = earthShadow * TransmittanceToSun.z;
+			texel[3] = 1.0f;
+			texel[4] = multiScatteredLuminance.x;
+			texel[5] = multiScatteredLuminance.y;
+			texel[6] = multiScatteredLuminance.z;
+			texel[7] = 1.0f;
+		}
+	});
+}
+
+GlslVec3 sampleSkyViewLut(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, const GlslVec3& WorldPos, const GlslVec3& WorldDir, const GlslVec3& SunDir)
+{
+	const float viewHeight = length(WorldPos);
+	const GlslVec3 UpVector = normalize(WorldPos);
+	const float viewZenithCosAngle = clampf(dot(WorldDir, UpVector), -1.0f, 1.0f);	// acos is not forgiving on the CPU
+
+	const GlslVec3 sideVector = normalize(cross(UpVector, WorldDir));		// assumes non parallel vectors
+	const GlslVec3 forwardVector = normalize(cross(sideVector, UpVector));	// aligns toward the sun light but perpendicular to up vector
+	const float lightOnPlaneX = dot(SunDir, forwardVector);
+	const float lightOnPlaneY = dot(SunDir, sideVector);
+	const float lightViewCosAngle = lightOnPlaneX / sqrtf(lightOnPlaneX * lightOnPlaneX + lightOnPlaneY * lightOnPlaneY);
+
+	const bool IntersectGround = raySphereIntersectNearest(WorldPos, WorldDir, splat3(0.0f), Atmosphere.BottomRadius) >= 0.0f;
+
+	float u, v;
+	SkyViewLutParamsToUv(Atmosphere, IntersectGround, viewZenithCosAngle, lightViewCosAngle, viewHeight, u, v, float(SkyViewLut.Width), float(SkyViewLut.Height));
+	return SkyViewLut.sampleLinearClamp(u, v);
+}
+
+void bakeSkyViewLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, float CameraHeight, float SunZenithCosAngle,
+	uint32 Width, uint32 Height, float SampleCountIni, const IntegrateScatteredLuminanceOptions& Options, CpuLut2D& outLut,
+	uint32 Interleave, uint32 Phase)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	if (Interleave <= 1 || outLut.Width != Width || outLut.Height != Height)
+	{
+		outLut.Allocate(Width, Height);
+		Interleave = 1;		// Nothing to keep
+	}
+
+	const float viewHeight = Atmosphere.BottomRadius + CameraHeight;
+	const GlslVec3 sunDir = normalize(GlslVec3{ sqrtf(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle });
+	const float8x3 SunDir = splat8x3(sunDir);
+	const bool ground = false;
+	const bool MieRayPhase = true;
+
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		// Texels of the row to update, packed so that the lanes only march those
+		std::vector<uint32> rowTexels;
+		rowTexels.reserve(Width);
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			if (Interleave <= 1 || getSkyViewLutInterleavePhase(x, y, Interleave) == Phase)
+			{
+				rowTexels.push_back(x);
+			}
+		}
+		const uint32 TexelCount = uint32(rowTexels.size());
+
+		for (uint32 x0 = 0; x0 < TexelCount; x0 += CPU_SIMD_WIDTH)
+		{
+			float px[CPU_SIMD_WIDTH], py[CPU_SIMD_WIDTH], pz[CPU_SIMD_WIDTH];
+			float dx[CPU_SIMD_WIDTH], dy[CPU_SIMD_WIDTH], dz[CPU_SIMD_WIDTH];
+			bool inAtmosphere[CPU_SIMD_WIDTH];
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+			{
+				// Lanes past the end of the row replicate the last texel and are not written back.
+				const uint32 x = rowTexels[(x0 + l) < TexelCount ? (x0 + l) : (TexelCount - 1)];
+				float viewZenithCosAngle, lightViewCosAngle;
+				UvToSkyViewLutParams(Atmosphere, viewZenithCosAngle, lightViewCosAngle, viewHeight,
+					(float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height), float(Width), float(Height));
+
+				GlslVec3 WorldPos = { 0.0f, 0.0f, viewHeight };
+				const float viewZenithSinAngle = sqrtf(saturate(1.0f - viewZenithCosAngle * viewZenithCosAngle));
+				const GlslVec3 WorldDir = {
+					viewZenithSinAngle * lightViewCosAngle,
+					viewZenithSinAngle * sqrtf(saturate(1.0f - lightViewCosAngle * lightViewCosAngle)),
+					viewZenithCosAngle };
+
+				// Move to top atmosphere
+				inAtmosphere[l] = MoveToTopAtmosphere(WorldPos, WorldDir, Atmosphere.TopRadius);
+				px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+				dx[l] = WorldDir.x; dy[l] = WorldDir.y; dz[l] = WorldDir.z;
+			}
+
+			const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+			const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+			const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, TransmittanceLut, WorldPos, WorldDir, SunDir, ground, SampleCountIni, MieRayPhase, Options);
+
+			float L[3][CPU_SIMD_WIDTH];
+			for (int c = 0; c < 3; ++c)
+			{
+				store8(L[c], ss.L[c]);
+			}
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH && (x0 + l) < TexelCount; ++l)
+			{
+				// Rays not intersecting the atmosphere are black
+				float* texel = outLut.texel(rowTexels[x0 + l], y);
+				texel[0] = inAtmosphere[l] ? L[0][l] : 0.0f;
+				texel[1] = inAtmosphere[l] ? L[1][l] : 0.0f;
+				texel[2] = inAtmosphere[l] ? L[2][l] : 0.0f;
+				texel[3] = 1.0f;
+			}
+		}
+	});
+}
+
+
+
+void bakeSkyViewLutAtlas(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const SkyLutConfig& config,
+	float SampleCountIni, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outAtlas)
+{
+	const uint32 Width = config.SkyViewWidth;
+	const uint32 Height = config.SkyViewHeight;
+	const uint32 AngleCount = config.SkyViewAtlasSunAngleCount;
+	const uint32 BandCount = config.SkyViewAtlasHeightBandCount;
+	outAtlas.Allocate(Width, Height, AngleCount * BandCount);
+
+	CpuLut2D lut;
+	for (uint32 band = 0; band < BandCount; ++band)
+	{
+		const float CameraHeight = getSkyViewLutAtlasCameraHeight(config, band);
+		for (uint32 angle = 0; angle < AngleCount; ++angle)
+		{
+			const float SunZenithCosAngle = sinf(getSkyViewLutAtlasSunElevation(config, angle));
+			bakeSkyViewLut(pool, info, TransmittanceLut, CameraHeight, SunZenithCosAngle, Width, Height, SampleCountIni, Options, lut);
+			memcpy(outAtlas.texel(0, 0, band * AngleCount + angle), lut.Data.data(), lut.Data.size() * sizeof(float));
+		}
+	}
+}
+
+void blendSkyViewLutAtlas(const CpuLut3D& atlas, const SkyLutConfig& config, float CameraHeight, float SunElevation, CpuLut2D& outLut)
+{
+	SkyViewLutAtlasCoord coord;
+	getSkyViewLutAtlasCoord(config, CameraHeight, SunElevation, coord);
+
+	outLut.Allocate(atlas.Width, atlas.Height);
+	for (uint32 y = 0; y < atlas.Height; ++y)
+	{
+		for (uint32 x = 0; x < atlas.Width; ++x)
+		{
+			const float u = (float(x) + 0.5f) / float(atlas.Width);
+			const float v = (float(y) + 0.5f) / float(atlas.Height);
+			float band0[4], band1[4];
+			atlas.sampleLinearClamp(u, v, coord.W[0], band0);
+			atlas.sampleLinearClamp(u, v, coord.W[1], band1);
+			float* texel = outLut.texel(x, y);
+			for (uint32 c = 0; c < 4; ++c)
+			{
+				texel[c] = lerp(band0[c], band1[c], coord.BandBlend);
+			}
+		}
+	}
+}
+
+
+
+GlslVec3 getCameraVolumeViewDir(const CameraVolumeView& view, float u, float v)
+{
+	const float ClipX = u * 2.0f - 1.0f;
+	const float ClipY = 1.0f - v * 2.0f;
+	return normalize(view.Forward + view.Right * (ClipX * view.TanHalfFovX) + view.Up * (ClipY * view.TanHalfFovY));
+}
+
+void bakeCameraVolume(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CameraVolumeView& view,
+	uint32 Width, uint32 Height, uint32 SliceCount, float KmPerSlice, float SampleCountPerSlice, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outVolume)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const float AP_SLICE_COUNT = float(SliceCount);
+	outVolume.Allocate(Width, Height, SliceCount);
+
+	const GlslVec3 camPos = view.CamPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+	const float8x3 SunDir = splat8x3(view.SunDir);
+	const bool ground = false;
+	const bool MieRayPhase = true;
+
+	pool.parallelFor(SliceCount * Height, [&](uint32 rowIndex)
+	{
+		const uint32 sliceId = rowIndex / Height;
+		const uint32 y = rowIndex % Height;
+
+		float Slice = ((float(sliceId) + 0.5f) / AP_SLICE_COUNT);
+		Slice *= Slice;	// squared distribution
+		Slice *= AP_SLICE_COUNT;
+		const float SampleCountIni = (std::max)(1.0f, float(sliceId + 1) * SampleCountPerSlice);
+
+		for (uint32 x0 = 0; x0 < Width; x0 += CPU_SIMD_WIDTH)
+		{
+			float px[CPU_SIMD_WIDTH], py[CPU_SIMD_WIDTH], pz[CPU_SIMD_WIDTH];
+			float dx[CPU_SIMD_WIDTH], dy[CPU_SIMD_WIDTH], dz[CPU_SIMD_WIDTH];
+			float tMaxMaxLanes[CPU_SIMD_WIDTH];
+			bool inAtmosphere[CPU_SIMD_WIDTH];
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+			{
+				// Lanes past the end of the row replicate the last froxel and are not written back.
+				const uint32 x = (x0 + l) < Width ? (x0 + l) : (Width - 1);
+				GlslVec3 WorldDir = getCameraVolumeViewDir(view, (float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height));
+				GlslVec3 WorldPos = camPos;
+
+				// Compute position from froxel information
+				float tMax = Slice * KmPerSlice;
+				GlslVec3 newWorldPos = WorldPos + WorldDir * tMax;
+
+				// If the voxel is under the ground, make sure to offset it out on the ground.
+				float viewHeight = length(newWorldPos);
+				if (viewHeight <= (Atmosphere.BottomRadius + PLANET_RADIUS_OFFSET))
+				{
+					// Apply a position offset to make sure no artefact are visible close to the earth boundaries for large voxel.
+					newWorldPos = normalize(newWorldPos) * (Atmosphere.BottomRadius + PLANET_RADIUS_OFFSET + 0.001f);
+					WorldDir = normalize(newWorldPos - camPos);
+					tMax = length(newWorldPos - camPos);
+				}
+				float tMaxMax = tMax;
+
+				// Move ray marching start up to top atmosphere.
+				inAtmosphere[l] = true;
+				viewHeight = length(WorldPos);
+				if (viewHeight >= Atmosphere.TopRadius)
+				{
+					const GlslVec3 prevWorlPos = WorldPos;
+					inAtmosphere[l] = MoveToTopAtmosphere(WorldPos, WorldDir, Atmosphere.TopRadius);
+					const float LengthToAtmosphere = length(prevWorlPos - WorldPos);
+					// tMaxMax for this voxel may not be within earth atmosphere
+					inAtmosphere[l] = inAtmosphere[l] && tMaxMax >= LengthToAtmosphere;
+					// Now world position has been moved to the atmosphere boundary: we need to reduce tMaxMax accordingly.
+					tMaxMax = (std::max)(0.0f, tMaxMax - LengthToAtmosphere);
+				}
+
+				px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+				dx[l] = WorldDir.x; dy[l] = WorldDir.y; dz[l] = WorldDir.z;
+				tMaxMaxLanes[l] = tMaxMax;
+			}
+
+			IntegrateScatteredLuminanceOptions FroxelOptions = Options;
+			FroxelOptions.tMaxMax = load8(tMaxMaxLanes);
+			const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+			const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+			const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, TransmittanceLut, WorldPos, WorldDir, SunDir, ground, SampleCountIni, MieRayPhase, FroxelOptions);
+
+			float L[3][CPU_SIMD_WIDTH], T[3][CPU_SIMD_WIDTH];
+			for (int c = 0; c < 3; ++c)
+			{
+				store8(L[c], ss.L[c]);
+				store8(T[c], ss.Transmittance[c]);
+			}
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH && (x0 + l) < Width; ++l)
+			{
+				// Froxels out of the atmosphere get no luminance and a transmittance of 1
+				float* texel = outVolume.texel(x0 + l, y, sliceId);
+				const float Transmittance = (T[0][l] + T[1][l] + T[2][l]) * (1.0f / 3.0f);
+				texel[0] = inAtmosphere[l] ? L[0][l] : 0.0f;
+				texel[1] = inAtmosphere[l] ? L[1][l] : 0.0f;
+				texel[2] = inAtmosphere[l] ? L[2][l] : 0.0f;
+				texel[3] = inAtmosphere[l] ? 1.0f - Transmittance : 0.0f;
+			}
+		}
+	});
+}
+
+// Part of the view ray within the atmosphere, tExit stopping at the ground. Same as CameraVolumeColumnInterval in RenderSkyRayMarching.hlsl.
+// Sphere terms are factored as (r - R) * (r + R) to keep the precision of grazing rays at planet scale.
+static bool getCameraVolumeColumnInterval(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& camPos, const GlslVec3& WorldDir,
+	float& tEnter, float& tExit, bool& hitsGround)
+{
+	const float viewHeight = length(camPos);
+	const float b = dot(camPos, WorldDir);
+	const float topDelta = b * b - (viewHeight - Atmosphere.TopRadius) * (viewHeight + Atmosphere.TopRadius);
+	tEnter = 0.0f;
+	tExit = 0.0f;
+	hitsGround = false;
+	if (topDelta < 0.0f)
+	{
+		return false;
+	}
+	tEnter = (std::max)(0.0f, -b - sqrtf(topDelta));
+	tExit = -b + sqrtf(topDelta);
+	if (tExit <= 0.0f)
+	{
+		tEnter = 0.0f;
+		tExit = 0.0f;
+		return false;
+	}
+	const float bottomDelta = b * b - (viewHeight - Atmosphere.BottomRadius) * (viewHeight + Atmosphere.BottomRadius);
+	const float tGround = bottomDelta >= 0.0f ? -b - sqrtf(bottomDelta) : -1.0f;
+	if (tGround >= 0.0f && tGround < tExit)
+	{
+		tExit = tGround;
+		hitsGround = true;
+	}
+	return true;
+}
+
+CameraVolumeCullingStats bakeCameraVolumePrefix(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CameraVolumeView& view,
+	uint32 Width, uint32 Height, uint32 SliceCount, float KmPerSlice, float SampleCountPerSlice, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outVolume)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const float AP_SLICE_COUNT = float(SliceCount);
+	outVolume.Allocate(Width, Height, SliceCount);
+
+	const GlslVec3 camPos = view.CamPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+	const float8x3 SunDir = splat8x3(view.SunDir);
+	const bool ground = false;
+	const bool MieRayPhase = true;
+	const float SampleCountIni = (std::max)(1.0f, SampleCountPerSlice);
+
+	std::vector<CameraVolumeCullingStats> rowStats(Height);
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		CameraVolumeCullingStats& stats = rowStats[y];
+		for (uint32 x0 = 0; x0 < Width; x0 += CPU_SIMD_WIDTH)
+		{
+			GlslVec3 WorldDirs[CPU_SIMD_WIDTH];
+			float tEnter[CPU_SIMD_WIDTH], tExit[CPU_SIMD_WIDTH];
+			bool hitsGround[CPU_SIMD_WIDTH];
+			float dx[CPU_SIMD_WIDTH], dy[CPU_SIMD_WIDTH], dz[CPU_SIMD_WIDTH];
+			for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+			{
+				// Lanes past the end of the row replicate the last column and are not written back.
+				const uint32 x = (x0 + l) < Width ? (x0 + l) : (Width - 1);
+				WorldDirs[l] = getCameraVolumeViewDir(view, (float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height));
+				getCameraVolumeColumnInterval(Atmosphere, camPos, WorldDirs[l], tEnter[l], tExit[l], hitsGround[l]);
+				dx[l] = WorldDirs[l].x; dy[l] = WorldDirs[l].y; dz[l] = WorldDirs[l].z;
+			}
+			const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+
+			// Luminance and transmittance from the camera to the last slice
+			float L[3][CPU_SIMD_WIDTH], T[3][CPU_SIMD_WIDTH];
+			for (int c = 0; c < 3; ++c)
+			{
+				for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+				{
+					L[c][l] = 0.0f;
+					T[c][l] = 1.0f;
+				}
+			}
+
+			// Previous slice output, starting from the camera
+			float PrevOutput[4][CPU_SIMD_WIDTH];
+			for (int c = 0; c < 4; ++c)
+			{
+				for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+				{
+					PrevOutput[c][l] = 0.0f;
+				}
+			}
+
+			float tPrev = 0.0f;
+			for (uint32 sliceId = 0; sliceId < SliceCount; ++sliceId)
+			{
+				const float tSliceStart = tPrev;
+				float Slice = ((float(sliceId) + 0.5f) / AP_SLICE_COUNT);
+				Slice *= Slice;	// squared distribution
+				Slice *= AP_SLICE_COUNT;
+				const float tSlice = Slice * KmPerSlice;
+
+				float px[CPU_SIMD_WIDTH], py[CPU_SIMD_WIDTH], pz[CPU_SIMD_WIDTH];
+				float tMaxMaxLanes[CPU_SIMD_WIDTH];
+				bool marched[CPU_SIMD_WIDTH];
+				bool anyMarched = false;
+				for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+				{
+					const float t0 = (std::max)(tPrev, tEnter[l]);
+					const float t1 = (std::min)(tSlice, tExit[l]);
+					marched[l] = t1 > t0;
+					anyMarched |= marched[l];
+
+					GlslVec3 WorldPos = camPos + WorldDirs[l] * t0;
+					if (t0 == tEnter[l] && tEnter[l] > 0.0f)
+					{
+						// Entering from space: start just below the atmosphere top as MoveToTopAtmosphere does.
+						WorldPos = WorldPos - camPos * (PLANET_RADIUS_OFFSET / length(camPos));
+					}
+					px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+					tMaxMaxLanes[l] = marched[l] ? t1 - t0 : 0.0f;
+
+					if ((x0 + l) < Width)
+					{
+						stats.MarchedFroxels += marched[l] ? 1 : 0;
+						stats.GroundCulledFroxels += !marched[l] && hitsGround[l] && tPrev >= tExit[l] ? 1 : 0;
+						stats.SpaceCulledFroxels += !marched[l] && !(hitsGround[l] && tPrev >= tExit[l]) ? 1 : 0;
+					}
+				}
+				tPrev = tSlice;
+
+				if (anyMarched)
+				{
+					IntegrateScatteredLuminanceOptions SegmentOptions = Options;
+					SegmentOptions.tMaxMax = load8(tMaxMaxLanes);
+					SegmentOptions.FullSegments = true;
+					const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+					const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, TransmittanceLut, WorldPos, WorldDir, SunDir, ground, SampleCountIni, MieRayPhase, SegmentOptions);
+
+					float SegmentL[3][CPU_SIMD_WIDTH], SegmentT[3][CPU_SIMD_WIDTH];
+					for (int c = 0; c < 3; ++c)
+					{
+						store8(SegmentL[c], ss.L[c]);
+						store8(SegmentT[c], ss.Transmittance[c]);
+					}
+					for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+					{
+						for (int c = 0; c < 3 && marched[l]; ++c)
+						{
+							L[c][l] += T[c][l] * SegmentL[c][l];
+							T[c][l] *= SegmentT[c][l];
+						}
+					}
+				}
+
+				for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+				{
+					float Output[4] = { L[0][l], L[1][l], L[2][l], 1.0f - (T[0][l] + T[1][l] + T[2][l]) * (1.0f / 3.0f) };
+					if (hitsGround[l] && tSliceStart >= tExit[l])
+					{
+						for (int c = 0; c < 4; ++c)
+						{
+							Output[c] = PrevOutput[c][l];
+						}
+					}
+					else if (hitsGround[l] && tSliceStart >= tEnter[l] && tSlice > tExit[l])
+					{
+						// First slice past the ground: extrapolated from the previous slice through the ground hit.
+						const float Scale = (tSlice - tSliceStart) / (tExit[l] - tSliceStart);
+						for (int c = 0; c < 4; ++c)
+						{
+							Output[c] = PrevOutput[c][l] + (Output[c] - PrevOutput[c][l]) * Scale;
+						}
+						Output[3] = saturate(Output[3]);
+					}
+					for (int c = 0; c < 4; ++c)
+					{
+						PrevOutput[c][l] = Output[c];
+					}
+					if ((x0 + l) < Width)
+					{
+						memcpy(outVolume.texel(x0 + l, y, sliceId), Output, sizeof(Output));
+					}
+				}
+			}
+		}
+	});
+
+	CameraVolumeCullingStats stats;
+	for (const CameraVolumeCullingStats& row : rowStats)
+	{
+		stats.MarchedFroxels += row.MarchedFroxels;
+		stats.GroundCulledFroxels += row.GroundCulledFroxels;
+		stats.SpaceCulledFroxels += row.SpaceCulledFroxels;
+	}
+	return stats;
+}
+
+void sampleCameraVolume(const CpuLut3D& volume, float KmPerSlice, float u, float v, float depth, float rgba[4])
+{
+	float Slice = depth * (1.0f / KmPerSlice);
+	float Weight = 1.0f;
+	if (Slice < 0.5f)
+	{
+		// We multiply by weight to fade to 0 at depth 0. That works for luminance and opacity.
+		Weight = saturate(Slice * 2.0f);
+		Slice = 0.5f;
+	}
+	const float w = sqrtf(Slice / float(volume.Depth));	// squared distribution
+	volume.sampleLinearClamp(u, v, w, rgba);
+	for (int c = 0; c < 4; ++c)
+	{
+		rgba[c] *= Weight;
+	}
+}
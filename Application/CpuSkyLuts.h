@@ -0,0 +1,155 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSkyAtmosphere.h"
+#include "CpuThreadPool.h"
+#include "SkyLutConfig.h"
+
+// CPU versions of the LUT generation passes from RenderSkyRayMarching.hlsl.
+// They do not need a GPU and are meant to be used by offline tools and build machines.
+
+// Optical depth along a ray up to the atmosphere top or the ground, for transmittance only queries.
+// IntegrateOpticalDepth ray marches everything as IntegrateScatteredLuminance does. IntegrateOpticalDepthAnalytic
+// is the ANALYTIC_OPTICAL_DEPTH_ENABLED path: Rayleigh and Mie use the Chapman approximation and only ozone is marched.
+GlslVec3 IntegrateOpticalDepth(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& WorldPos, const GlslVec3& WorldDir, float SampleCount);
+GlslVec3 IntegrateOpticalDepthAnalytic(const CpuAtmosphereParameters& Atmosphere, const GlslVec3& WorldPos, const GlslVec3& WorldDir, float SampleCount);
+
+// Same as RenderTransmittanceLutPS: 40 samples optical depth integration using the UvToLutTransmittanceParams parameterisation.
+// Texels are processed 8 at a time along a row, and rows are spread over the pool threads.
+// With analyticOpticalDepth, texels use IntegrateOpticalDepthAnalytic one at a time instead.
+// SampleCountIni can go as low as 10 but the energy lost starts to be visible.
+void bakeTransmittanceLut(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo, CpuLut2D& outLut, bool analyticOpticalDepth = false,
+	float SampleCountIni = 40.0f);
+
+struct SingleScatteringResult8
+{
+	float8 L[3];					// Scattered light (luminance)
+	float8 OpticalDepth[3];			// Optical depth (1/m)
+	float8 Transmittance[3];		// Transmittance in [0,1] (unitless)
+	float8 MultiScatAs1[3];
+};
+
+// Sun visible in-scatter LUT, see bakeSunInScatterLut. Texels hold 8 floats: the transmittance to the sun with the earth shadow
+// applied in rgb, then the multiple scattering luminance in rgb, so a ray marching step reads both with one set of bilinear weights.
+struct CpuSunInScatterLut
+{
+	uint32 Width = 0;		// Sun zenith cosines
+	uint32 Height = 0;		// Heights
+	std::vector<float> Data;
+
+	void Allocate(uint32 width, uint32 height) { Width = width; Height = height; Data.assign(size_t(width) * height * 8, 0.0f); }
+	float* texel(uint32 x, uint32 y) { return &Data[(size_t(y) * Width + x) * 8]; }
+};
+
+// Same as SunInScatterLutParamsToUv: u is the sun zenith cosine with a square root mapping, dense around the horizon where the earth
+// shadow and the transmittance change quickly, v is the square root of the normalized height. Both go through fromUnitToSubUvs.
+void SunInScatterLutParamsToUv(const CpuAtmosphereParameters& Atmosphere, float viewHeight, float SunZenithCosAngle, uint32 Width, uint32 Height, float& u, float& v);
+void UvToSunInScatterLutParams(const CpuAtmosphereParameters& Atmosphere, float u, float v, uint32 Width, uint32 Height, float& viewHeight, float& SunZenithCosAngle);
+
+// Optional parts of IntegrateScatteredLuminance8, matching the shader permutations and constants.
+struct IntegrateScatteredLuminanceOptions
+{
+	const CpuLut2D* MultiScatLut = nullptr;				// MultiScatTexture, MULTISCATAPPROX_ENABLED when set
+	const CpuSunInScatterLut* SunInScatterLut = nullptr;	// SUN_INSCATTER_LUT_ENABLED when set: replaces the transmittance and multiple scattering
+														// fetches and the earth shadow test of each step. MultiScatLut still enables the multiple scattering.
+	bool VariableSampleCount = false;					// Sample count from the ray length instead of SampleCountIni
+	float RayMarchMinMaxSPP[2] = { 4.0f, 14.0f };		// Same defaults as Game::uiViewRayMarchMinSPP and uiViewRayMarchMaxSPP
+	float8 tMaxMax = splat8(9000000.0f);				// Per lane tMaxMax argument, used by the camera volume to stop at the froxel depth
+	bool FullSegments = false;							// FullSegments argument: with a fixed sample count, step s covers [s, s + 1] * tMax / SampleCount and
+														// is sampled at its middle, so the march ends on tMax instead of 0.7 step before it.
+};
+
+// IntegrateScatteredLuminance for 8 rays, each lane having its own position, direction and sun direction.
+// Does not cover the depth buffer and the shadow map, and assumes ILLUMINANCE_IS_ONE (luminance is for a sun illuminance of 1).
+// With a variable sample count, lanes run their own number of steps and the loop lasts as long as the longest one.
+SingleScatteringResult8 IntegrateScatteredLuminance8(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut,
+	const float8x3& WorldPos, const float8x3& WorldDir, const float8x3& SunDir, bool ground, float SampleCountIni, bool MieRayPhase,
+	const IntegrateScatteredLuminanceOptions& Options = IntegrateScatteredLuminanceOptions());
+
+// Same as NewMultiScattCS: 64 directions per texel integrated as 8 SIMD batches, then reduced with the same
+// 64 to 1 tree as the group shared memory version. Each texel is a task of the pool and the reduction never
+// crosses tasks, so the output is bit-identical whatever the number of threads. A minimum of 20 samples is required for accuracy.
+void bakeMultiScatteringLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut,
+	uint32 MultiScatteringLUTRes, float MultipleScatteringFactor, CpuLut2D& outLut, float SampleCountIni = 20.0f);
+
+// Same as SunInScatterLutPS: per (sun zenith cosine, height) texel, the transmittance LUT value and the earth shadow test of
+// IntegrateScatteredLuminance, and the multiple scattering LUT value when MultiScatLut is set. Only depends on the atmosphere and
+// the two LUTs, so it is rebuilt along with them. Width and Height are SkyLutConfig::SunInScatterWidth and SunInScatterHeight.
+void bakeSunInScatterLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CpuLut2D* MultiScatLut,
+	uint32 Width, uint32 Height, CpuSunInScatterLut& outLut);
+
+// FASTSKY_ENABLED lookup of RenderRayMarchingPS without the sun disk. WorldPos is relative to the planet center and below the atmosphere top.
+GlslVec3 sampleSkyViewLut(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, const GlslVec3& WorldPos, const GlslVec3& WorldDir, const GlslVec3& SunDir);
+
+// Amortized sky view LUT updates: a frame only updates the texels of one of Interleave phases, Interleave being a power of two up to 16.
+// Texels are ranked in 4x4 tiles with a Bayer matrix and phase p gets the ranks [p * 16 / Interleave, (p + 1) * 16 / Interleave),
+// each phase being spread over the whole LUT. Same as SkyViewLutInterleavePhase in RenderSkyRayMarching.hlsl.
+inline uint32 getSkyViewLutInterleavePhase(uint32 x, uint32 y, uint32 Interleave)
+{
+	static const uint32 BayerRanks[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+	return BayerRanks[y & 3][x & 3] * Interleave / SKY_VIEW_LUT_MAX_INTERLEAVE;
+}
+
+// Same as SkyViewLutPS, the MULTISCATAPPROX_ENABLED permutation being used when Options.MultiScatLut is set.
+// The LUT only depends on the camera height and the sun zenith angle. Width and Height are SkyLutConfig::SkyViewWidth and SkyViewHeight.
+// The shader uses a variable sample count, SampleCountIni only matters when Options.VariableSampleCount is false.
+// With Interleave > 1, only the texels of Phase are written and outLut keeps the others, see getSkyViewLutInterleavePhase.
+void bakeSkyViewLut(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, float CameraHeight, float SunZenithCosAngle,
+	uint32 Width, uint32 Height, float SampleCountIni, const IntegrateScatteredLuminanceOptions& Options, CpuLut2D& outLut,
+	uint32 Interleave = 1, uint32 Phase = 0);
+
+// Time of day atlas of sky view LUTs, see getSkyViewLutAtlasCoord: one bakeSkyViewLut per height band and sun elevation, slice
+// Band * SkyViewAtlasSunAngleCount + Angle of outAtlas holding it. SkyViewWidth * SkyViewHeight * SkyViewAtlasSunAngleCount * SkyViewAtlasHeightBandCount texels.
+void bakeSkyViewLutAtlas(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const SkyLutConfig& config,
+	float SampleCountIni, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outAtlas);
+
+// Same as SkyViewLutAtlasBlendPS: the sky view LUT of a camera height (kilometers) and sun elevation (radians) from the four
+// nearest atlas slices, blending the two nearest sun elevations of the two nearest height bands.
+void blendSkyViewLutAtlas(const CpuLut3D& atlas, const SkyLutConfig& config, float CameraHeight, float SunElevation, CpuLut2D& outLut);
+
+// Perspective camera of the camera volume, as set up by Game::update. Kilometers, ground at z = 0.
+struct CameraVolumeView
+{
+	GlslVec3 CamPos = { 0.0f, -1.0f, 0.5f };
+	GlslVec3 Forward = { 0.0f, 1.0f, 0.0f };
+	GlslVec3 Right = { 1.0f, 0.0f, 0.0f };
+	GlslVec3 Up = { 0.0f, 0.0f, 1.0f };
+	float TanHalfFovX = 1.1578f;				// 66.6 degrees vertical field of view with a 16:9 aspect ratio
+	float TanHalfFovY = 0.6568f;
+	GlslVec3 SunDir = { 0.0f, 0.9004f, 0.4350f };	// Game::uiSunPitch = 0.45
+};
+
+// Normalized direction through the screen position uv, v going down as pixPos.y does.
+GlslVec3 getCameraVolumeViewDir(const CameraVolumeView& view, float u, float v);
+
+// Same as RenderCameraVolumePS: SliceCount (AP_SLICE_COUNT) slices with a squared depth distribution, slice s being at s * KmPerSlice
+// (AP_KM_PER_SLICE) kilometers. Luminance in rgb and 1 - transmittance in alpha. Slice i is marched with (i + 1) * SampleCountPerSlice samples.
+// Froxels are processed 8 at a time along a row. The defaults of SkyLutConfig are the values the shader used to have compiled in.
+void bakeCameraVolume(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CameraVolumeView& view,
+	uint32 Width, uint32 Height, uint32 SliceCount, float KmPerSlice, float SampleCountPerSlice, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outVolume);
+
+// Froxel counts of bakeCameraVolumePrefix. Culled froxels are not marched and copy the previous slice.
+struct CameraVolumeCullingStats
+{
+	uint32 MarchedFroxels = 0;
+	uint32 GroundCulledFroxels = 0;		// Past the ground hit of their column: the integral up to the ground is kept
+	uint32 SpaceCulledFroxels = 0;		// Before the atmosphere entry or past the atmosphere exit of their column
+
+	uint32 getCulledFroxels() const { return GroundCulledFroxels + SpaceCulledFroxels; }
+};
+
+// Same as CameraVolumesPrefixCS: same slices as bakeCameraVolume, but each froxel column is integrated once front to back,
+// slice i only marching from slice i - 1 with SampleCountPerSlice samples and compositing the result behind it.
+// The column is clipped to the atmosphere and to the ground once, so froxels outside of it are never marched. Segments are marched
+// with FullSegments for the column to have no gap between slices. The first slice past the ground hit is extrapolated from the previous
+// slice and the ground hit, for the lookup between them to be linear up to the ground, and the next slices copy it. RenderCameraVolumePS
+// instead moves below ground froxels up to the ground. Rows of froxel columns are processed 8 at a time.
+CameraVolumeCullingStats bakeCameraVolumePrefix(CpuThreadPool& pool, const AtmosphereInfo& info, const CpuLut2D& TransmittanceLut, const CameraVolumeView& view,
+	uint32 Width, uint32 Height, uint32 SliceCount, float KmPerSlice, float SampleCountPerSlice, const IntegrateScatteredLuminanceOptions& Options, CpuLut3D& outVolume);
+
+// Camera volume lookup of ApplySkyAtmosphere with FASTAERIALPERSPECTIVE_ENABLED: luminance and opacity at depth kilometers along the
+// direction of screen uv, faded to 0 over the first half slice.
+void sampleCameraVolume(const CpuLut3D& volume, float KmPerSlice, float u, float v, float depth, float rgba[4]);
+
@@ -0,0 +1,277 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cstring>
+#include "CpuSkyRadiance.h"
+
+
+// Batches handed to a pool task at once, to amortize the task overhead.
+#define SKY_RADIANCE_BATCHES_PER_TASK 8
+
+
+
+void bakeSkyRadianceLuts(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo,
+	uint32 MultiScatteringLUTRes, float MultipleScatteringFactor, SkyRadianceLuts& outLuts)
+{
+	outLuts.Atmosphere = GetAtmosphereParameters(info);
+	bakeTransmittanceLut(pool, info, lutInfo, outLuts.TransmittanceLut);
+	bakeMultiScatteringLut(pool, info, outLuts.TransmittanceLut, MultiScatteringLUTRes, MultipleScatteringFactor, outLuts.MultiScatLut);
+}
+
+void querySkyRadiance8(const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, const SkyRadianceQuery* queries, uint32 count, SkyRadianceResult* results)
+{
+	const CpuAtmosphereParameters& Atmosphere = luts.Atmosphere;
+
+	// AoS to SoA. Lanes past count replicate the last query and are not written back.
+	float px[8], py[8], pz[8], dx[8], dy[8], dz[8], sx[8], sy[8], sz[8];
+	for (uint32 l = 0; l < 8; ++l)
+	{
+		const SkyRadianceQuery& query = queries[l < count ? l : count - 1];
+		GlslVec3 WorldPos = query.WorldPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+
+		// Move to top atmosphere as the starting point for ray marching. A ray missing the atmosphere
+		// stays outside of it and gets an empty integration: no luminance and a transmittance of 1.
+		MoveToTopAtmosphere(WorldPos, query.WorldDir, Atmosphere.TopRadius);
+
+		px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+		dx[l] = query.WorldDir.x; dy[l] = query.WorldDir.y; dz[l] = query.WorldDir.z;
+		sx[l] = query.SunDir.x; sy[l] = query.SunDir.y; sz[l] = query.SunDir.z;
+	}
+	const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+	const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+	const float8x3 SunDir = { load8(sx), load8(sy), load8(sz) };
+
+	IntegrateScatteredLuminanceOptions Options;
+	Options.MultiScatLut = settings.MultipleScattering ? &luts.MultiScatLut : nullptr;
+	Options.VariableSampleCount = true;
+	Options.RayMarchMinMaxSPP[0] = settings.RayMarchMinMaxSPP[0];
+	Options.RayMarchMinMaxSPP[1] = settings.RayMarchMinMaxSPP[1];
+
+	const bool ground = false;
+	const float SampleCountIni = 0.0f;
+	const bool MieRayPhase = true;
+	const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, luts.TransmittanceLut, WorldPos, WorldDir, SunDir, ground, SampleCountIni, MieRayPhase, Options);
+
+	// Luminance is for a sun illuminance of 1.
+	float L[3][8], T[3][8];
+	for (int c = 0; c < 3; ++c)
+	{
+		store8(L[c], ss.L[c] * (&settings.SunIlluminance.x)[c]);
+		store8(T[c], ss.Transmittance[c]);
+	}
+	for (uint32 l = 0; l < 8 && l < count; ++l)
+	{
+		results[l].L = { L[0][l], L[1][l], L[2][l] };
+		results[l].Transmittance = { T[0][l], T[1][l], T[2][l] };
+	}
+}
+
+void querySkyRadiance(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings,
+	const SkyRadianceQuery* queries, uint32 count, SkyRadianceResult* results)
+{
+	const uint32 QueriesPerTask = 8 * SKY_RADIANCE_BATCHES_PER_TASK;
+	const uint32 TaskCount = (count + QueriesPerTask - 1) / QueriesPerTask;
+	pool.parallelFor(TaskCount, [&](uint32 taskIndex)
+	{
+		const uint32 end = (std::min)(count, (taskIndex + 1) * QueriesPerTask);
+		for (uint32 q = taskIndex * QueriesPerTask; q < end; q += 8)
+		{
+			querySkyRadiance8(luts, settings, queries + q, (std::min)(8u, end - q), results + q);
+		}
+	});
+}
+
+
+
+
+void evaluateSHBasis(const GlslVec3& dir, float basis[SKY_SH_COEFFICIENT_COUNT])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * dir.y;
+	basis[2] = 0.488603f * dir.z;
+	basis[3] = 0.488603f * dir.x;
+	basis[4] = 1.092548f * dir.x * dir.y;
+	basis[5] = 1.092548f * dir.y * dir.z;
+	basis[6] = 0.315392f * (3.0f * dir.z * dir.z - 1.0f);
+	basis[7] = 1.092548f * dir.x * dir.z;
+	basis[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+}
+
+GlslVec3 evaluateSHIrradiance(const SkyLuminanceSH& sh, const GlslVec3& normal, uint32 order)
+{
+	// Clamped cosine lobe coefficients per band
+	const float BandFactors[3] = { PI, 2.0f * PI / 3.0f, PI / 4.0f };
+	float basis[SKY_SH_COEFFICIENT_COUNT];
+	evaluateSHBasis(normal, basis);
+	GlslVec3 irradiance = splat3(0.0f);
+	const uint32 CoefficientCount = order >= 3 ? 9 : (order == 2 ? 4 : 1);
+	for (uint32 i = 0; i < CoefficientCount; ++i)
+	{
+		irradiance += sh.C[i] * (BandFactors[i == 0 ? 0 : (i < 4 ? 1 : 2)] * basis[i]);
+	}
+	return max3(irradiance, splat3(0.0f));
+}
+
+void rotateSHAroundZ(const SkyLuminanceSH& sh, float angle, SkyLuminanceSH& out)
+{
+	// Y(l, m) goes with cos(m phi) and Y(l, -m) with sin(m phi), so each (m, -m) pair is a 2D rotation of angle m * angle.
+	const float c1 = cosf(angle), s1 = sinf(angle);
+	const float c2 = c1 * c1 - s1 * s1, s2 = 2.0f * s1 * c1;
+	const SkyLuminanceSH in = sh;	// out can be sh
+	out.C[0] = in.C[0];
+	out.C[2] = in.C[2];
+	out.C[6] = in.C[6];
+	out.C[3] = in.C[3] * c1 - in.C[1] * s1;
+	out.C[1] = in.C[1] * c1 + in.C[3] * s1;
+	out.C[7] = in.C[7] * c1 - in.C[5] * s1;
+	out.C[5] = in.C[5] * c1 + in.C[7] * s1;
+	out.C[8] = in.C[8] * c2 - in.C[4] * s2;
+	out.C[4] = in.C[4] * c2 + in.C[8] * s2;
+}
+
+// Spherical Fibonacci direction i of count, all of them covering the same solid angle.
+static GlslVec3 getSkySHDirection(uint32 i, uint32 count)
+{
+	const float cosTheta = 1.0f - 2.0f * (float(i) + 0.5f) / float(count);
+	const float sinTheta = sqrtf(saturate(1.0f - cosTheta * cosTheta));
+	const float phi = 2.39996323f * float(i);	// Golden angle
+	return GlslVec3{ sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta };
+}
+
+static void accumulateSkySH(const GlslVec3& dir, const GlslVec3& L, float weight, SkyLuminanceSH& out)
+{
+	float basis[SKY_SH_COEFFICIENT_COUNT];
+	evaluateSHBasis(dir, basis);
+	for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+	{
+		out.C[i] += L * (basis[i] * weight);
+	}
+}
+
+void projectSkyRadianceSH(const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, float CameraHeight, float SunZenithCosAngle,
+	uint32 DirectionCount, bool Ground, SkyLuminanceSH& out)
+{
+	const CpuAtmosphereParameters& Atmosphere = luts.Atmosphere;
+	const uint32 BatchCount = (std::max)(1u, (DirectionCount + 7) / 8);
+	const float weight = 4.0f * PI / float(BatchCount * 8);
+	memset(&out, 0, sizeof(SkyLuminanceSH));
+
+	const GlslVec3 sunDir = { sqrtf(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle };
+	const float8x3 SunDir = splat8x3(sunDir);
+	IntegrateScatteredLuminanceOptions Options;
+	Options.MultiScatLut = settings.MultipleScattering ? &luts.MultiScatLut : nullptr;
+	Options.VariableSampleCount = true;
+	Options.RayMarchMinMaxSPP[0] = settings.RayMarchMinMaxSPP[0];
+	Options.RayMarchMinMaxSPP[1] = settings.RayMarchMinMaxSPP[1];
+	const float SampleCountIni = 0.0f;
+	const bool MieRayPhase = true;
+
+	for (uint32 b = 0; b < BatchCount; ++b)
+	{
+		GlslVec3 dirs[8];
+		float px[8], py[8], pz[8], dx[8], dy[8], dz[8];
+		for (uint32 l = 0; l < 8; ++l)
+		{
+			dirs[l] = getSkySHDirection(b * 8 + l, BatchCount * 8);
+			GlslVec3 WorldPos = { 0.0f, 0.0f, Atmosphere.BottomRadius + CameraHeight };
+			MoveToTopAtmosphere(WorldPos, dirs[l], Atmosphere.TopRadius);
+			px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+			dx[l] = dirs[l].x; dy[l] = dirs[l].y; dz[l] = dirs[l].z;
+		}
+		const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+		const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+		const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, luts.TransmittanceLut, WorldPos, WorldDir, SunDir, Ground, SampleCountIni, MieRayPhase, Options);
+
+		float L[3][8];
+		for (int c = 0; c < 3; ++c)
+		{
+			store8(L[c], ss.L[c] * (&settings.SunIlluminance.x)[c]);
+		}
+		for (uint32 l = 0; l < 8; ++l)
+		{
+			accumulateSkySH(dirs[l], GlslVec3{ L[0][l], L[1][l], L[2][l] }, weight, out);
+		}
+	}
+}
+
+void projectSkyViewLutSH(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, float CameraHeight, float SunZenithCosAngle,
+	float SunIlluminance, uint32 DirectionCount, SkyLuminanceSH& out)
+{
+	const uint32 Count = (std::max)(8u, (DirectionCount + 7) / 8 * 8);
+	const float weight = 4.0f * PI / float(Count);
+	memset(&out, 0, sizeof(SkyLuminanceSH));
+
+	const GlslVec3 WorldPos = { 0.0f, 0.0f, Atmosphere.BottomRadius + CameraHeight };
+	const GlslVec3 SunDir = { sqrtf(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle };
+	for (uint32 i = 0; i < Count; ++i)
+	{
+		GlslVec3 dir = getSkySHDirection(i, Count);
+		if (fabsf(dir.z) > 0.9999f)
+		{
+			dir = normalize(GlslVec3{ 0.01f, 0.0f, dir.z });	// sampleSkyViewLut needs a direction not parallel to up
+		}
+		accumulateSkySH(dir, sampleSkyViewLut(Atmosphere, SkyViewLut, WorldPos, dir, SunDir) * SunIlluminance, weight, out);
+	}
+}
+
+void SkyIrradianceCache::bake(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, const SkyLutConfig& config,
+	uint32 DirectionCount, bool Ground)
+{
+	mConfig = config;
+	mBottomRadius = luts.Atmosphere.BottomRadius;
+	const uint32 AngleCount = config.SkyViewAtlasSunAngleCount;
+	mBins.resize(size_t(config.SkyViewAtlasHeightBandCount) * AngleCount);
+	pool.parallelFor(uint32(mBins.size()), [&](uint32 bin)
+	{
+		projectSkyRadianceSH(luts, settings, getSkyViewLutAtlasCameraHeight(config, bin / AngleCount), sinf(getSkyViewLutAtlasSunElevation(config, bin % AngleCount)),
+			DirectionCount, Ground, mBins[bin]);
+	});
+}
+
+void SkyIrradianceCache::bakeFromSkyViewLutAtlas(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut3D& atlas, const SkyLutConfig& config,
+	float SunIlluminance, uint32 DirectionCount)
+{
+	mConfig = config;
+	mBottomRadius = Atmosphere.BottomRadius;
+	const uint32 AngleCount = config.SkyViewAtlasSunAngleCount;
+	mBins.resize(size_t(config.SkyViewAtlasHeightBandCount) * AngleCount);
+	pool.parallelFor(uint32(mBins.size()), [&](uint32 bin)
+	{
+		// Slice bin of the atlas as a 2D LUT
+		CpuLut2D lut;
+		lut.Width = atlas.Width;
+		lut.Height = atlas.Height;
+		const float* slice = atlas.texel(0, 0, bin);
+		lut.Data.assign(slice, slice + size_t(atlas.Width) * atlas.Height * 4);
+		projectSkyViewLutSH(Atmosphere, lut, getSkyViewLutAtlasCameraHeight(config, bin / AngleCount), sinf(getSkyViewLutAtlasSunElevation(config, bin % AngleCount)),
+			SunIlluminance, DirectionCount, mBins[bin]);
+	});
+}
+
+void SkyIrradianceCache::lookup(const GlslVec3& WorldPos, const GlslVec3& SunDir, SkyLuminanceSH& out) const
+{
+	const GlslVec3 PlanetPos = WorldPos + GlslVec3{ 0.0f, 0.0f, mBottomRadius };
+	const float viewHeight = length(PlanetPos);
+	const float SunZenithCosAngle = clampf(dot(PlanetPos, SunDir) / viewHeight, -1.0f, 1.0f);
+	SkyViewLutAtlasCoord coord;
+	getSkyViewLutAtlasCoord(mConfig, viewHeight - mBottomRadius, asinf(SunZenithCosAngle), coord);
+
+	const uint32 AngleCount = mConfig.SkyViewAtlasSunAngleCount;
+	const uint32 angle0 = (std::min)(uint32(coord.SunAngle), AngleCount - 1);
+	const uint32 angle1 = (std::min)(angle0 + 1, AngleCount - 1);
+	const float angleBlend = coord.SunAngle - float(angle0);
+	const float weights[4] = {
+		(1.0f - coord.BandBlend) * (1.0f - angleBlend), (1.0f - coord.BandBlend) * angleBlend,
+		coord.BandBlend * (1.0f - angleBlend), coord.BandBlend * angleBlend };
+	const SkyLuminanceSH* bins[4] = {
+		&getBin(coord.Bands[0], angle0), &getBin(coord.Bands[0], angle1),
+		&getBin(coord.Bands[1], angle0), &getBin(coord.Bands[1], angle1) };
+	for (uint32 i = 0; i < SKY_SH_COEFFICIENT_COUNT; ++i)
+	{
+		out.C[i] = bins[0]->C[i] * weights[0] + bins[1]->C[i] * weights[1] + bins[2]->C[i] * weights[2] + bins[3]->C[i] * weights[3];
+	}
+
+	// Bins have the sun toward +x
+	rotateSHAroundZ(out, atan2f(SunDir.y, SunDir.x), out);
+}
@@ -0,0 +1,106 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSkyLuts.h"
+
+// Answers "what is the sky luminance in direction d from position p" without rendering a frame, e.g. for gameplay code or light probes.
+// This is the RenderRayMarchingPS path without fast sky, fast aerial perspective, depth buffer, shadow map and sun disk:
+// IntegrateScatteredLuminance with variable sample count, Rayleigh and Mie phases and the multiple scattering LUT.
+
+struct SkyRadianceQuery
+{
+	GlslVec3 WorldPos;		// Same space as the camera: kilometers, ground at z = 0
+	GlslVec3 WorldDir;		// Normalized view direction
+	GlslVec3 SunDir;		// Normalized direction toward the sun
+};
+
+struct SkyRadianceResult
+{
+	GlslVec3 L;				// Luminance reaching WorldPos from WorldDir
+	GlslVec3 Transmittance;	// Transmittance along the view ray, up to the ground or the atmosphere top
+};
+
+struct SkyRadianceSettings
+{
+	GlslVec3 SunIlluminance = { 1.0f, 1.0f, 1.0f };
+	float RayMarchMinMaxSPP[2] = { 4.0f, 14.0f };	// Same defaults as Game::uiViewRayMarchMinSPP and uiViewRayMarchMaxSPP
+	bool MultipleScattering = true;					// MULTISCATAPPROX_ENABLED
+};
+
+// Atmosphere and LUTs shared by all the queries. They can be baked with bakeSkyRadianceLuts or filled from LUTs baked elsewhere.
+struct SkyRadianceLuts
+{
+	CpuAtmosphereParameters Atmosphere;
+	CpuLut2D TransmittanceLut;
+	CpuLut2D MultiScatLut;
+};
+
+void bakeSkyRadianceLuts(CpuThreadPool& pool, const AtmosphereInfo& info, const LookUpTablesInfo& lutInfo,
+	uint32 MultiScatteringLUTRes, float MultipleScatteringFactor, SkyRadianceLuts& outLuts);
+
+// Evaluates up to 8 queries as a single SIMD batch on the calling thread.
+void querySkyRadiance8(const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, const SkyRadianceQuery* queries, uint32 count, SkyRadianceResult* results);
+
+// Evaluates count queries. Records are transposed to SoA 8 at a time and batches are spread over the pool threads.
+// Each result only depends on its own query, whatever the thread count.
+void querySkyRadiance(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings,
+	const SkyRadianceQuery* queries, uint32 count, SkyRadianceResult* results);
+
+
+
+
+// Order 3 real spherical harmonics (bands 0 to 2, 9 coefficients) of the sky luminance around a position, for ambient lighting
+// of scene objects. Coefficient l * l + l + m is for Y(l, m), with the usual graphics basis: Y(1, -1) ~ y, Y(1, 0) ~ z, Y(1, 1) ~ x,
+// Y(2, -2) ~ xy, Y(2, -1) ~ yz, Y(2, 0) ~ 3z^2 - 1, Y(2, 1) ~ xz and Y(2, 2) ~ x^2 - y^2. Order 2 users only read the first 4.
+#define SKY_SH_COEFFICIENT_COUNT 9
+
+struct SkyLuminanceSH
+{
+	GlslVec3 C[SKY_SH_COEFFICIENT_COUNT];
+};
+
+void evaluateSHBasis(const GlslVec3& dir, float basis[SKY_SH_COEFFICIENT_COUNT]);
+
+// Irradiance on a surface of normal n lit by the SH luminance (clamped cosine convolution, Ramamoorthi and Hanrahan 2001), using the
+// first order bands. Divide by PI to get the outgoing luminance of a white lambertian surface.
+GlslVec3 evaluateSHIrradiance(const SkyLuminanceSH& sh, const GlslVec3& normal, uint32 order = 3);
+
+// Rotation of angle radians around +z, from x toward y.
+void rotateSHAroundZ(const SkyLuminanceSH& sh, float angle, SkyLuminanceSH& out);
+
+// Projection of the sky luminance from a camera height (kilometers) with the sun in the xz plane toward +x, so that one projection
+// covers all the sun azimuths. DirectionCount directions on a spherical Fibonacci set, rounded up to a multiple of 8.
+// projectSkyRadianceSH ray marches them 8 at a time as querySkyRadiance8 does, and with Ground the rays hitting the ground get the
+// GroundAlbedo / PI bounce of IntegrateScatteredLuminance. projectSkyViewLutSH reads them from a sky view LUT baked for that height and
+// sun angle instead, so ground hits only get the atmosphere in front of the ground.
+void projectSkyRadianceSH(const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, float CameraHeight, float SunZenithCosAngle,
+	uint32 DirectionCount, bool Ground, SkyLuminanceSH& out);
+void projectSkyViewLutSH(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, float CameraHeight, float SunZenithCosAngle,
+	float SunIlluminance, uint32 DirectionCount, SkyLuminanceSH& out);
+
+// Sky luminance SH cached per (camera height, sun elevation) bin, using the bins of the time of day sky view LUT atlas (SkyLutConfig
+// SkyViewAtlasSunAngleCount, SkyViewAtlasHeightBandCount and the distributions of getSkyViewLutAtlasCoord). A probe update is a bilinear
+// blend of the four nearest bins rotated toward the sun azimuth: it never ray marches, so time of day transitions only cost the lookups.
+class SkyIrradianceCache
+{
+public:
+	// Ray marches every bin, bins being spread over the pool threads.
+	void bake(CpuThreadPool& pool, const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, const SkyLutConfig& config,
+		uint32 DirectionCount = 256, bool Ground = true);
+	// Projects each slice of an atlas baked by bakeSkyViewLutAtlas for the same config. The atlas is for a sun illuminance of 1.
+	void bakeFromSkyViewLutAtlas(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut3D& atlas, const SkyLutConfig& config,
+		float SunIlluminance = 1.0f, uint32 DirectionCount = 256);
+
+	// WorldPos in kilometers with the ground at z = 0, SunDir normalized. The local up is taken as +z, as for the terrain of the application.
+	void lookup(const GlslVec3& WorldPos, const GlslVec3& SunDir, SkyLuminanceSH& out) const;
+
+	const SkyLuminanceSH& getBin(uint32 band, uint32 angle) const { return mBins[band * mConfig.SkyViewAtlasSunAngleCount + angle]; }
+	bool isBaked() const { return !mBins.empty(); }
+
+private:
+	SkyLutConfig mConfig;
+	float mBottomRadius = 0.0f;
+	std::vector<SkyLuminanceSH> mBins;		// Band major, as the atlas slices
+};
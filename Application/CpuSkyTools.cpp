@@ -0,0 +1,3371 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tinyexr/tinyexr.h>
+
+#include "CpuSkyTools.h"
+#include "CpuSkyChecks.h"
+#include "CpuSkyLuts.h"
+#include "CpuSkyRadiance.h"
+#include "CpuSkyCubemap.h"
+#include "CpuPathTracer.h"
+#include "CpuBruneton.h"
+#include "LutDiskCache.h"
+#include "HdrCaptureWriter.h"
+#include "CaptureSequence.h"
+#include "StateRecord.h"
+#include "SkyLutConfig.h"
+#include "DX11Base/CpuTimer.h"
+
+
+
+bool saveLutExr(const CpuLut2D& lut, const char* filename)
+{
+	const char* err = nullptr;
+	int exrError = SaveEXR(lut.Data.data(), int(lut.Width), int(lut.Height), 4, 0, filename, &err);
+	if (exrError != TINYEXR_SUCCESS)
+	{
+		fprintf(stderr, "Failed to save %s: %s\n", filename, err ? err : "unknown error");
+		return false;
+	}
+	return true;
+}
+
+bool loadLutExr(CpuLut2D& lut, const char* filename)
+{
+	float* rgba = nullptr;
+	int width = -1;
+	int height = -1;
+	const char* err = nullptr;
+	int exrError = LoadEXR(&rgba, &width, &height, filename, &err);
+	if (exrError != TINYEXR_SUCCESS)
+	{
+		fprintf(stderr, "Failed to load %s: %s\n", filename, err ? err : "unknown error");
+		return false;
+	}
+	lut.Allocate(uint32(width), uint32(height));
+	memcpy(lut.Data.data(), rgba, lut.Data.size() * sizeof(float));
+	free(rgba);
+	return true;
+}
+
+
+
+uint32 floatUlpDistance(float a, float b)
+{
+	if (std::isnan(a) || std::isnan(b))
+	{
+		return 0xFFFFFFFF;
+	}
+	// Map float bits to integers ordered as the float values are, +0 and -0 being the same.
+	auto toOrdered = [](float f)
+	{
+		int32_t i;
+		memcpy(&i, &f, sizeof(float));
+		return i < 0 ? int64_t(int32_t(0x80000000) - i) : int64_t(i);
+	};
+	const int64_t d = toOrdered(a) - toOrdered(b);
+	return uint32(d < 0 ? -d : d);
+}
+
+LutComparison compareLuts(const CpuLut2D& test, const CpuLut2D& reference, uint32 maxUlp, float maxAbsError)
+{
+	LutComparison result;
+	if (test.Width != reference.Width || test.Height != reference.Height)
+	{
+		return result;
+	}
+
+	result.TexelCount = test.Width * test.Height;
+	for (uint32 t = 0; t < result.TexelCount; ++t)
+	{
+		bool texelFailed = false;
+		for (uint32 c = 0; c < 3; ++c)
+		{
+			const float a = test.Data[t * 4 + c];
+			const float b = reference.Data[t * 4 + c];
+			const uint32 ulp = floatUlpDistance(a, b);
+			const float absError = fabsf(a - b);
+			const float relError = b != 0.0f ? absError / fabsf(b) : (a != 0.0f ? 1.0f : 0.0f);
+
+			result.MaxUlpDistance = ulp > result.MaxUlpDistance ? ulp : result.MaxUlpDistance;
+			result.MaxAbsError = absError > result.MaxAbsError ? absError : result.MaxAbsError;
+			result.MaxRelError = relError > result.MaxRelError ? relError : result.MaxRelError;
+			texelFailed |= ulp > maxUlp && !(absError <= maxAbsError);
+		}
+		result.FailingTexelCount += texelFailed ? 1 : 0;
+	}
+	return result;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////////
+// Command line
+//////////////////////////////////////////////////////////////////////////
+
+
+
+bool CheckReporter::check(const char* name, bool ok)
+{
+	printf("  %-45s %s\n", name, ok ? "ok" : "FAILED");
+	mFailureCount += ok ? 0 : 1;
+	return ok;
+}
+
+bool CheckReporter::checkBound(const char* name, double value, double bound)
+{
+	const bool ok = value <= bound;
+	printf("  %-45s %s (%g <= %g)\n", name, ok ? "ok" : "FAILED", value, bound);
+	mFailureCount += ok ? 0 : 1;
+	return ok;
+}
+
+int CheckReporter::finish() const
+{
+	printf("%s\n", passed() ? "PASSED" : "FAILED");
+	return passed() ? 0 : 1;
+}
+
+static int commandBakeTransmittance(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0);
+	if (!outFile)
+	{
+		fprintf(stderr, "bake-transmittance: missing output file\n");
+		return 1;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D lut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, lut);
+	if (!saveLutExr(lut, outFile))
+	{
+		return 1;
+	}
+	printf("Transmittance LUT %ux%u written to %s\n", lut.Width, lut.Height, outFile);
+	return 0;
+}
+
+static int commandCompareTransmittance(CpuSkyToolsContext& ctx)
+{
+	const char* goldenFile = ctx.arg(0);
+	if (!goldenFile)
+	{
+		fprintf(stderr, "compare-transmittance: missing golden file\n");
+		return 1;
+	}
+	const uint32 maxUlp = uint32(atoi(ctx.arg(1, "16")));
+	const float maxAbsError = float(atof(ctx.arg(2, "0")));
+
+	CpuLut2D golden;
+	if (!loadLutExr(golden, goldenFile))
+	{
+		return 1;
+	}
+	if (golden.Width != ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH || golden.Height != ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT)
+	{
+		fprintf(stderr, "Golden resolution %ux%u does not match the transmittance LUT resolution %ux%u\n",
+			golden.Width, golden.Height, ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH, ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT);
+		return 1;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D lut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, lut);
+
+	const LutComparison cmp = compareLuts(lut, golden, maxUlp, maxAbsError);
+	printf("Texels %u, failing %u (allowed: %u ulp or %g abs error)\n", cmp.TexelCount, cmp.FailingTexelCount, maxUlp, maxAbsError);
+	printf("Max ulp distance %u, max abs error %g, max rel error %g\n", cmp.MaxUlpDistance, cmp.MaxAbsError, cmp.MaxRelError);
+	printf("%s\n", cmp.passed() ? "PASSED" : "FAILED");
+	return cmp.passed() ? 0 : 1;
+}
+
+// Runs bake once to warm up, then iterations times.
+static BakeTimings timeBake(int iterations, const std::function<void()>& bake)
+{
+	bake();
+
+	BakeTimings timings;
+	double totalSeconds = 0.0;
+	for (int i = 0; i < iterations; ++i)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		bake();
+		auto end = std::chrono::high_resolution_clock::now();
+		const double seconds = std::chrono::duration<double>(end - start).count();
+		totalSeconds += seconds;
+		timings.BestSeconds = seconds < timings.BestSeconds ? seconds : timings.BestSeconds;
+	}
+	timings.AvgSeconds = totalSeconds / iterations;
+	return timings;
+}
+
+// Same as timeBake, printing timings and throughput.
+static void benchmarkBake(const char* name, uint32 threadCount, int iterations, double texelCount, const std::function<void()>& bake, const char* unit = "texels")
+{
+	const BakeTimings timings = timeBake(iterations, bake);
+	const double avgSeconds = timings.AvgSeconds;
+	const double bestSeconds = timings.BestSeconds;
+	printf("%s, %u thread(s), %s, %d iterations\n", name, threadCount, CPU_SIMD_AVX2 ? "AVX2" : "scalar", iterations);
+	printf("  avg %.3f ms  best %.3f ms\n", avgSeconds * 1000.0, bestSeconds * 1000.0);
+	printf("  avg %.2f M%s/s  best %.2f M%s/s\n", texelCount / avgSeconds * 1e-6, unit, texelCount / bestSeconds * 1e-6, unit);
+}
+
+static int commandBenchTransmittance(CpuSkyToolsContext& ctx)
+{
+	const int iterations = (std::max)(1, atoi(ctx.arg(0, "100")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D lut;
+	const double texelCount = double(ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH) * double(ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT);
+	benchmarkBake("Transmittance LUT", pool.getThreadCount(), iterations, texelCount, [&]()
+	{
+		bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, lut);
+	});
+	return 0;
+}
+
+size_t countInvalidValues(const std::vector<float>& data)
+{
+	size_t count = 0;
+	for (float value : data)
+	{
+		count += (std::isfinite(value) && value >= 0.0f) ? 0 : 1;
+	}
+	return count;
+}
+
+float meanAbsError(const CpuLut2D& test, const CpuLut2D& reference)
+{
+	double sum = 0.0;
+	for (uint32 t = 0; t < test.Width * test.Height; ++t)
+	{
+		for (uint32 c = 0; c < 3; ++c)
+		{
+			sum += fabs(double(test.Data[t * 4 + c]) - double(reference.Data[t * 4 + c]));
+		}
+	}
+	return float(sum / (3.0 * test.Width * test.Height));
+}
+
+void bakeTransmittanceReference(CpuThreadPool& pool, const CpuSkyToolsContext& ctx, float referenceSampleCount, CpuLut2D& reference)
+{
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(ctx.Atmosphere);
+	const uint32 Width = ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH;
+	const uint32 Height = ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT;
+	reference.Allocate(Width, Height);
+	pool.parallelFor(Height, [&](uint32 y)
+	{
+		for (uint32 x = 0; x < Width; ++x)
+		{
+			float viewHeight, viewZenithCosAngle;
+			UvToLutTransmittanceParams(Atmosphere, viewHeight, viewZenithCosAngle, (float(x) + 0.5f) / float(Width), (float(y) + 0.5f) / float(Height));
+			const GlslVec3 WorldPos = { 0.0f, 0.0f, viewHeight };
+			const GlslVec3 WorldDir = { 0.0f, sqrtf(1.0f - viewZenithCosAngle * viewZenithCosAngle), viewZenithCosAngle };
+			const GlslVec3 transmittance = exp3(-IntegrateOpticalDepth(Atmosphere, WorldPos, WorldDir, referenceSampleCount));
+			float* texel = reference.texel(x, y);
+			texel[0] = transmittance.x;
+			texel[1] = transmittance.y;
+			texel[2] = transmittance.z;
+			texel[3] = 1.0f;
+		}
+	});
+}
+
+// Compares the ray marched and the analytic (ANALYTIC_OPTICAL_DEPTH_ENABLED) transmittance LUTs against a heavily sampled march.
+static int commandReportAnalyticTransmittance(CpuSkyToolsContext& ctx)
+{
+	const float referenceSampleCount = float((std::max)(1, atoi(ctx.arg(0, "4096"))));
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "20")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	const uint32 Width = ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH;
+	const uint32 Height = ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT;
+	CpuLut2D reference;
+	bakeTransmittanceReference(pool, ctx, referenceSampleCount, reference);
+
+	const double texelCount = double(Width) * double(Height);
+	printf("Reference: %ux%u texels, %.0f samples per texel\n\n", Width, Height, referenceSampleCount);
+	for (int analytic = 0; analytic < 2; ++analytic)
+	{
+		CpuLut2D lut;
+		benchmarkBake(analytic ? "Analytic transmittance LUT" : "Ray marched transmittance LUT", pool.getThreadCount(), iterations, texelCount, [&]()
+		{
+			bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, lut, analytic != 0);
+		});
+		const LutComparison cmp = compareLuts(lut, reference, 0, 0.0f);
+		printf("  max abs error %g, mean abs error %g, max rel error %g\n\n", cmp.MaxAbsError, meanAbsError(lut, reference), cmp.MaxRelError);
+	}
+	return 0;
+}
+
+static int commandBakeMultiScattering(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0);
+	if (!outFile)
+	{
+		fprintf(stderr, "bake-multiscattering: missing output file\n");
+		return 1;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	CpuLut2D lut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	bakeMultiScatteringLut(pool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, lut);
+	if (!saveLutExr(lut, outFile))
+	{
+		return 1;
+	}
+	printf("Multiple scattering LUT %ux%u written to %s\n", lut.Width, lut.Height, outFile);
+	return 0;
+}
+
+static int commandBenchMultiScattering(CpuSkyToolsContext& ctx)
+{
+	const int iterations = (std::max)(1, atoi(ctx.arg(0, "20")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	CpuLut2D lut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	const double texelCount = double(ctx.MultiScatteringLUTRes) * double(ctx.MultiScatteringLUTRes);
+	benchmarkBake("Multiple scattering LUT", pool.getThreadCount(), iterations, texelCount, [&]()
+	{
+		bakeMultiScatteringLut(pool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, lut);
+	});
+	printf("  %llu task range(s) stolen\n", pool.getStealCount());
+	return 0;
+}
+
+
+std::vector<SkyRadianceQuery> getRandomSkyRadianceQueries(uint32 queryCount)
+{
+	uint32 seed = 1;
+	auto random01 = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) * (1.0f / 16777216.0f);
+	};
+	auto randomDirection = [&](float minCosZenith)
+	{
+		const float cosZenith = minCosZenith + (1.0f - minCosZenith) * random01();
+		const float sinZenith = sqrtf((std::max)(0.0f, 1.0f - cosZenith * cosZenith));
+		const float phi = 2.0f * PI * random01();
+		return GlslVec3{ sinZenith * cosf(phi), sinZenith * sinf(phi), cosZenith };
+	};
+	std::vector<SkyRadianceQuery> queries(queryCount);
+	for (SkyRadianceQuery& query : queries)
+	{
+		query.WorldPos = { 0.0f, 0.0f, 100.0f * random01() * random01() };
+		query.WorldDir = randomDirection(-1.0f);
+		query.SunDir = randomDirection(0.0f);
+	}
+	return queries;
+}
+
+static int commandBenchSkyRadiance(CpuSkyToolsContext& ctx)
+{
+	const uint32 queryCount = uint32((std::max)(1, atoi(ctx.arg(0, "1000000"))));
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	const std::vector<SkyRadianceQuery> queries = getRandomSkyRadianceQueries(queryCount);
+
+	std::vector<SkyRadianceResult> results(queryCount);
+	SkyRadianceSettings settings;
+	benchmarkBake("Sky radiance queries", pool.getThreadCount(), iterations, double(queryCount), [&]()
+	{
+		querySkyRadiance(pool, luts, settings, queries.data(), queryCount, results.data());
+	}, "queries");
+
+	size_t invalidCount = 0;
+	for (const SkyRadianceResult& result : results)
+	{
+		const float* values = &result.L.x;
+		const float* transmittance = &result.Transmittance.x;
+		for (int c = 0; c < 3; ++c)
+		{
+			invalidCount += !(values[c] >= 0.0f) || !(transmittance[c] >= 0.0f && transmittance[c] <= 1.0f) ? 1 : 0;
+		}
+	}
+	SkyRadianceQuery zenith = { GlslVec3{ 0.0f, 0.0f, 0.5f }, GlslVec3{ 0.0f, 0.0f, 1.0f }, normalize(GlslVec3{ 0.0f, 1.0f, 1.0f }) };
+	SkyRadianceResult zenithResult;
+	querySkyRadiance8(luts, settings, &zenith, 1, &zenithResult);
+	printf("  %zu invalid values, zenith luminance at 500m with the sun at 45 degrees: %g %g %g\n", invalidCount,
+		zenithResult.L.x, zenithResult.L.y, zenithResult.L.z);
+	return invalidCount == 0 ? 0 : 1;
+}
+
+// Error of a LUT resampled on the texels of the reference, over the rgb channels.
+struct SkyPipelineError
+{
+	double Rmse = 0.0;
+	double RelativeRmse = 0.0;		// Rmse divided by the mean reference value
+	double MaxAbsError = 0.0;
+};
+
+static SkyPipelineError computeSkyPipelineError(const std::vector<float>& resampled, const std::vector<float>& reference)
+{
+	SkyPipelineError error;
+	double sumSqr = 0.0;
+	double sumReference = 0.0;
+	const size_t texelCount = reference.size() / 4;
+	for (size_t t = 0; t < texelCount; ++t)
+	{
+		for (size_t c = 0; c < 3; ++c)
+		{
+			const double diff = double(resampled[t * 4 + c]) - double(reference[t * 4 + c]);
+			sumSqr += diff * diff;
+			sumReference += fabs(double(reference[t * 4 + c]));
+			error.MaxAbsError = (std::max)(error.MaxAbsError, fabs(diff));
+		}
+	}
+	error.Rmse = sqrt(sumSqr / double(texelCount * 3));
+	error.RelativeRmse = sumReference > 0.0 ? error.Rmse / (sumReference / double(texelCount * 3)) : 0.0;
+	return error;
+}
+
+// Samples lut at the texel centers of a referenceWidth x referenceHeight LUT covering the same parameter range.
+// With subUvs, texel centers are mapped with fromSubUvsToUnit and fromUnitToSubUvs as done by the multiple scattering and sky view LUTs.
+static std::vector<float> resampleLut(const CpuLut2D& lut, uint32 referenceWidth, uint32 referenceHeight, bool subUvs)
+{
+	std::vector<float> resampled(size_t(referenceWidth) * referenceHeight * 4);
+	for (uint32 y = 0; y < referenceHeight; ++y)
+	{
+		for (uint32 x = 0; x < referenceWidth; ++x)
+		{
+			float u = (float(x) + 0.5f) / float(referenceWidth);
+			float v = (float(y) + 0.5f) / float(referenceHeight);
+			if (subUvs)
+			{
+				u = fromUnitToSubUvs(fromSubUvsToUnit(u, float(referenceWidth)), float(lut.Width));
+				v = fromUnitToSubUvs(fromSubUvsToUnit(v, float(referenceHeight)), float(lut.Height));
+			}
+			lut.sampleLinearClamp(u, v, &resampled[(size_t(y) * referenceWidth + x) * 4]);
+		}
+	}
+	return resampled;
+}
+
+// Slices match one to one, so only the froxel rows and columns are interpolated.
+static std::vector<float> resampleCameraVolume(const CpuLut3D& volume, const CpuLut3D& reference)
+{
+	std::vector<float> resampled(reference.Data.size());
+	for (uint32 z = 0; z < reference.Depth; ++z)
+	{
+		for (uint32 y = 0; y < reference.Height; ++y)
+		{
+			for (uint32 x = 0; x < reference.Width; ++x)
+			{
+				const float u = (float(x) + 0.5f) / float(reference.Width);
+				const float v = (float(y) + 0.5f) / float(reference.Height);
+				const float w = (float(z) + 0.5f) / float(reference.Depth);
+				volume.sampleLinearClamp(u, v, w, &resampled[((size_t(z) * reference.Height + y) * reference.Width + x) * 4]);
+			}
+		}
+	}
+	return resampled;
+}
+
+struct SkyPipelineScenario
+{
+	const char* Name;
+	float CameraHeight;		// Kilometers
+	float SunElevation;		// Radians, as Game::uiSunPitch
+};
+
+struct SkyPipelineResult
+{
+	const char* Kernel;
+	const char* Scenario;		// Empty for the view independent LUTs
+	uint32 Width;
+	uint32 Height;
+	uint32 Depth;
+	float SampleCount;			// SampleCountIni, samples per slice for the camera volume, 0 with a variable sample count
+	float RayMarchMinMaxSPP[2];	// Variable sample count only
+	bool IsDefault;				// Settings used by the application
+	BakeTimings Timings;
+	SkyPipelineError Error;
+	bool MeetsQualityBar;
+	bool Cheapest;				// Fastest of the results meeting the quality bar for this kernel and scenario
+};
+
+static std::string getSkyPipelineSettingsName(const SkyPipelineResult& result)
+{
+	char size[32];
+	char samples[32];
+	if (result.Depth > 1)
+	{
+		snprintf(size, sizeof(size), "%ux%ux%u", result.Width, result.Height, result.Depth);
+	}
+	else
+	{
+		snprintf(size, sizeof(size), "%ux%u", result.Width, result.Height);
+	}
+	if (result.SampleCount > 0.0f)
+	{
+		snprintf(samples, sizeof(samples), "%g samples", result.SampleCount);
+	}
+	else
+	{
+		snprintf(samples, sizeof(samples), "%g-%g spp", result.RayMarchMinMaxSPP[0], result.RayMarchMinMaxSPP[1]);
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "%-10s %-12s", size, samples);
+	return name;
+}
+
+// Bakes the transmittance, multiple scattering, sky view and camera volume LUTs over a matrix of resolutions and sample counts.
+// Each kernel is timed on its own, with reference inputs, and compared against a high resolution and high sample count bake
+// of the same kernel. The view dependent LUTs are baked for a few camera heights and sun elevations.
+static int commandBenchSkyPipeline(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_pipeline_bench.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+	const double maxRelativeRmse = atof(ctx.arg(2, "0.05"));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	const SkyLutConfig defaultConfig;
+	std::vector<SkyPipelineResult> results;
+	auto addResult = [&](const char* kernel, const char* scenario, uint32 width, uint32 height, uint32 depth, float sampleCount,
+		float minSPP, float maxSPP, bool isDefault, const BakeTimings& timings, const SkyPipelineError& error)
+	{
+		SkyPipelineResult result = { kernel, scenario, width, height, depth, sampleCount, { minSPP, maxSPP }, isDefault, timings, error,
+			error.RelativeRmse <= maxRelativeRmse, false };
+		results.push_back(result);
+		printf("%-15s %-9s %s %9.3f ms  rel. RMSE %.2e%s\n", kernel, scenario, getSkyPipelineSettingsName(result).c_str(),
+			timings.AvgSeconds * 1000.0, error.RelativeRmse, isDefault ? "  (default)" : "");
+	};
+
+	// References
+	LookUpTablesInfo referenceLutInfo = ctx.LutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	const float ReferenceTransmittanceSamples = 1024.0f;
+	const uint32 ReferenceMultiScatteringRes = 128;
+	const float ReferenceMultiScatteringSamples = 128.0f;
+	const uint32 ReferenceSkyViewSize[2] = { 768, 432 };
+	const float ReferenceSkyViewSamples = 256.0f;
+	const uint32 ReferenceCameraVolumeRes = 64;
+	const float ReferenceCameraVolumeSamplesPerSlice = 16.0f;
+
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, referenceLutInfo, referenceTransmittanceLut, false, ReferenceTransmittanceSamples);
+	bakeMultiScatteringLut(pool, ctx.Atmosphere, referenceTransmittanceLut, ReferenceMultiScatteringRes, 1.0f, referenceMultiScatLut, ReferenceMultiScatteringSamples);
+	printf("%u thread(s), %s, %d iterations, quality bar: relative RMSE <= %g\n\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar", iterations, maxRelativeRmse);
+
+	// Transmittance
+	{
+		const uint32 sizes[][2] = { { 64, 16 }, { 128, 32 }, { 256, 64 }, { 512, 128 } };
+		const float sampleCounts[] = { 10.0f, 20.0f, 40.0f, 80.0f };
+		for (const uint32* size : sizes)
+		{
+			for (float sampleCount : sampleCounts)
+			{
+				LookUpTablesInfo lutInfo = ctx.LutInfo;
+				lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = size[0];
+				lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = size[1];
+				CpuLut2D lut;
+				const BakeTimings timings = timeBake(iterations, [&]()
+				{
+					bakeTransmittanceLut(pool, ctx.Atmosphere, lutInfo, lut, false, sampleCount);
+				});
+				const SkyPipelineError error = computeSkyPipelineError(
+					resampleLut(lut, referenceTransmittanceLut.Width, referenceTransmittanceLut.Height, false), referenceTransmittanceLut.Data);
+				const bool isDefault = size[0] == ctx.LutInfo.TRANSMITTANCE_TEXTURE_WIDTH && size[1] == ctx.LutInfo.TRANSMITTANCE_TEXTURE_HEIGHT
+					&& sampleCount == defaultConfig.TransmittanceSampleCount;
+				addResult("transmittance", "", size[0], size[1], 1, sampleCount, 0.0f, 0.0f, isDefault, timings, error);
+			}
+		}
+	}
+
+	// Multiple scattering
+	{
+		const uint32 sizes[] = { 16, 32, 64 };
+		const float sampleCounts[] = { 10.0f, 20.0f, 40.0f };
+		for (uint32 size : sizes)
+		{
+			for (float sampleCount : sampleCounts)
+			{
+				CpuLut2D lut;
+				const BakeTimings timings = timeBake(iterations, [&]()
+				{
+					bakeMultiScatteringLut(pool, ctx.Atmosphere, referenceTransmittanceLut, size, 1.0f, lut, sampleCount);
+				});
+				const SkyPipelineError error = computeSkyPipelineError(
+					resampleLut(lut, referenceMultiScatLut.Width, referenceMultiScatLut.Height, true), referenceMultiScatLut.Data);
+				const bool isDefault = size == ctx.MultiScatteringLUTRes && sampleCount == defaultConfig.MultiScatteringSampleCount;
+				addResult("multiscattering", "", size, size, 1, sampleCount, 0.0f, 0.0f, isDefault, timings, error);
+			}
+		}
+	}
+
+	// View dependent LUTs
+	const SkyPipelineScenario scenarios[] = {
+		{ "ground",		0.5f,	0.45f },	// Application startup view
+		{ "sunset",		0.5f,	0.02f },
+		{ "altitude",	40.0f,	0.45f },
+	};
+	for (const SkyPipelineScenario& scenario : scenarios)
+	{
+		const float SunZenithCosAngle = sinf(scenario.SunElevation);
+
+		IntegrateScatteredLuminanceOptions referenceOptions;
+		referenceOptions.MultiScatLut = &referenceMultiScatLut;
+		CpuLut2D referenceSkyViewLut;
+		bakeSkyViewLut(pool, ctx.Atmosphere, referenceTransmittanceLut, scenario.CameraHeight, SunZenithCosAngle,
+			ReferenceSkyViewSize[0], ReferenceSkyViewSize[1], ReferenceSkyViewSamples, referenceOptions, referenceSkyViewLut);
+
+		const uint32 sizes[][2] = { { 96, 54 }, { 192, 108 }, { 384, 216 } };
+		const float minMaxSPPs[][2] = { { 2.0f, 8.0f }, { 4.0f, 14.0f }, { 8.0f, 24.0f }, { 16.0f, 31.0f } };
+		for (const uint32* size : sizes)
+		{
+			for (const float* minMaxSPP : minMaxSPPs)
+			{
+				IntegrateScatteredLuminanceOptions options;
+				options.MultiScatLut = &referenceMultiScatLut;
+				options.VariableSampleCount = true;
+				options.RayMarchMinMaxSPP[0] = minMaxSPP[0];
+				options.RayMarchMinMaxSPP[1] = minMaxSPP[1];
+				CpuLut2D lut;
+				const BakeTimings timings = timeBake(iterations, [&]()
+				{
+					bakeSkyViewLut(pool, ctx.Atmosphere, referenceTransmittanceLut, scenario.CameraHeight, SunZenithCosAngle, size[0], size[1], 30.0f, options, lut);
+				});
+				const SkyPipelineError error = computeSkyPipelineError(
+					resampleLut(lut, referenceSkyViewLut.Width, referenceSkyViewLut.Height, true), referenceSkyViewLut.Data);
+				const bool isDefault = size[0] == defaultConfig.SkyViewWidth && size[1] == defaultConfig.SkyViewHeight
+					&& minMaxSPP[0] == defaultConfig.RayMarchMinMaxSPP[0] && minMaxSPP[1] == defaultConfig.RayMarchMinMaxSPP[1];
+				addResult("skyview", scenario.Name, size[0], size[1], 1, 0.0f, minMaxSPP[0], minMaxSPP[1], isDefault, timings, error);
+			}
+		}
+
+		CameraVolumeView view;
+		view.CamPos = { 0.0f, 0.0f, scenario.CameraHeight };
+		view.SunDir = { 0.0f, cosf(scenario.SunElevation), sinf(scenario.SunElevation) };
+		CpuLut3D referenceVolume;
+		bakeCameraVolume(pool, ctx.Atmosphere, referenceTransmittanceLut, view, ReferenceCameraVolumeRes, ReferenceCameraVolumeRes,
+			defaultConfig.CameraVolumeSliceCount, defaultConfig.CameraVolumeKmPerSlice, ReferenceCameraVolumeSamplesPerSlice, referenceOptions, referenceVolume);
+
+		const uint32 volumeSizes[] = { 16, 32, 64 };
+		const float samplesPerSlice[] = { 1.0f, 2.0f, 4.0f };
+		for (uint32 size : volumeSizes)
+		{
+			for (float sampleCount : samplesPerSlice)
+			{
+				CpuLut3D volume;
+				const BakeTimings timings = timeBake(iterations, [&]()
+				{
+					bakeCameraVolume(pool, ctx.Atmosphere, referenceTransmittanceLut, view, size, size,
+						defaultConfig.CameraVolumeSliceCount, defaultConfig.CameraVolumeKmPerSlice, sampleCount, referenceOptions, volume);
+				});
+				const SkyPipelineError error = computeSkyPipelineError(resampleCameraVolume(volume, referenceVolume), referenceVolume.Data);
+				const bool isDefault = size == defaultConfig.CameraVolumeWidth && sampleCount == defaultConfig.CameraVolumeSamplesPerSlice;
+				addResult("cameravolume", scenario.Name, size, size, volume.Depth, sampleCount, 0.0f, 0.0f, isDefault, timings, error);
+			}
+		}
+	}
+
+	// Cheapest settings meeting the quality bar, per kernel and scenario
+	printf("\nCheapest settings meeting the quality bar:\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		bool firstOfGroup = true;
+		size_t cheapest = results.size();
+		for (size_t j = 0; j < results.size(); ++j)
+		{
+			if (strcmp(results[j].Kernel, results[i].Kernel) != 0 || strcmp(results[j].Scenario, results[i].Scenario) != 0)
+			{
+				continue;
+			}
+			firstOfGroup &= j >= i;
+			if (results[j].MeetsQualityBar && (cheapest == results.size() || results[j].Timings.AvgSeconds < results[cheapest].Timings.AvgSeconds))
+			{
+				cheapest = j;
+			}
+		}
+		if (!firstOfGroup)
+		{
+			continue;
+		}
+		if (cheapest == results.size())
+		{
+			printf("  %-15s %-9s none\n", results[i].Kernel, results[i].Scenario);
+			continue;
+		}
+		SkyPipelineResult& result = results[cheapest];
+		result.Cheapest = true;
+		printf("  %-15s %-9s %s %9.3f ms\n", result.Kernel, result.Scenario, getSkyPipelineSettingsName(result).c_str(), result.Timings.AvgSeconds * 1000.0);
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"maxRelativeRmse\": %g,\n", maxRelativeRmse);
+	fprintf(file, "\t\"reference\": {\n");
+	fprintf(file, "\t\t\"transmittance\": { \"width\": %u, \"height\": %u, \"sampleCount\": %g },\n",
+		referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH, referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT, ReferenceTransmittanceSamples);
+	fprintf(file, "\t\t\"multiscattering\": { \"width\": %u, \"height\": %u, \"sampleCount\": %g },\n",
+		ReferenceMultiScatteringRes, ReferenceMultiScatteringRes, ReferenceMultiScatteringSamples);
+	fprintf(file, "\t\t\"skyview\": { \"width\": %u, \"height\": %u, \"sampleCount\": %g },\n",
+		ReferenceSkyViewSize[0], ReferenceSkyViewSize[1], ReferenceSkyViewSamples);
+	fprintf(file, "\t\t\"cameravolume\": { \"width\": %u, \"height\": %u, \"depth\": %u, \"sampleCount\": %g }\n",
+		ReferenceCameraVolumeRes, ReferenceCameraVolumeRes, defaultConfig.CameraVolumeSliceCount, ReferenceCameraVolumeSamplesPerSlice);
+	fprintf(file, "\t},\n");
+	fprintf(file, "\t\"scenarios\": [\n");
+	for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); ++s)
+	{
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"cameraHeight\": %g, \"sunElevation\": %g }%s\n", scenarios[s].Name, scenarios[s].CameraHeight,
+			scenarios[s].SunElevation, s + 1 < sizeof(scenarios) / sizeof(scenarios[0]) ? "," : "");
+	}
+	fprintf(file, "\t],\n");
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const SkyPipelineResult& r = results[i];
+		fprintf(file, "\t\t{ \"kernel\": \"%s\", \"scenario\": \"%s\", \"width\": %u, \"height\": %u, \"depth\": %u, \"sampleCount\": %g, "
+			"\"rayMarchMinSPP\": %g, \"rayMarchMaxSPP\": %g, \"default\": %s, \"avgMs\": %.6f, \"bestMs\": %.6f, "
+			"\"rmse\": %.6e, \"relativeRmse\": %.6e, \"maxAbsError\": %.6e, \"meetsQualityBar\": %s, \"cheapest\": %s }%s\n",
+			r.Kernel, r.Scenario, r.Width, r.Height, r.Depth, r.SampleCount, r.RayMarchMinMaxSPP[0], r.RayMarchMinMaxSPP[1], r.IsDefault ? "true" : "false",
+			r.Timings.AvgSeconds * 1000.0, r.Timings.BestSeconds * 1000.0, r.Error.Rmse, r.Error.RelativeRmse, r.Error.MaxAbsError,
+			r.MeetsQualityBar ? "true" : "false", r.Cheapest ? "true" : "false", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("\nResults written to %s\n", outFile);
+	return 0;
+}
+
+CameraVolumeView getTuningCameraView(const SkyLutTuningView& tuningView)
+{
+	CameraVolumeView view;
+	view.CamPos = { 0.0f, 0.0f, tuningView.CameraHeight };
+	view.SunDir = { 0.0f, cosf(tuningView.SunElevation), sinf(tuningView.SunElevation) };
+	return view;
+}
+
+#define SKY_LUT_TUNING_WIDTH 64
+#define SKY_LUT_TUNING_HEIGHT 36
+static const float SkyLutTuningDepths[] = { 1.0f, 5.0f, 20.0f, 60.0f };	// Kilometers
+
+void renderSkyLutTuningReference(CpuThreadPool& pool, const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& TransmittanceLut,
+	const CpuLut2D& MultiScatLut, const CameraVolumeView& view, float SampleCount, SkyLutTuningImage& outImage)
+{
+	const uint32 PixelCount = SKY_LUT_TUNING_WIDTH * SKY_LUT_TUNING_HEIGHT;
+	const uint32 DepthCount = uint32(sizeof(SkyLutTuningDepths) / sizeof(SkyLutTuningDepths[0]));
+	const GlslVec3 camPos = view.CamPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+
+	outImage.SamplePixels.clear();
+	outImage.SampleDepths.clear();
+	for (uint32 p = 0; p < PixelCount; ++p)
+	{
+		const GlslVec3 WorldDir = getCameraVolumeViewDir(view, (float(p % SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_WIDTH, (float(p / SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_HEIGHT);
+		const float tBottom = raySphereIntersectNearest(camPos, WorldDir, splat3(0.0f), Atmosphere.BottomRadius);
+		for (uint32 d = 0; d < DepthCount; ++d)
+		{
+			if (tBottom < 0.0f || SkyLutTuningDepths[d] < tBottom)
+			{
+				outImage.SamplePixels.push_back(p);
+				outImage.SampleDepths.push_back(d);
+			}
+		}
+	}
+
+	// Sky rays first, then one ray per aerial perspective sample
+	const uint32 RayCount = PixelCount + uint32(outImage.SamplePixels.size());
+	std::vector<float> rays(size_t(RayCount) * 4);
+	pool.parallelFor((RayCount + 7) / 8, [&](uint32 batch)
+	{
+		float dx[8], dy[8], dz[8], tMaxMax[8];
+		for (uint32 l = 0; l < 8; ++l)
+		{
+			const uint32 r = (std::min)(batch * 8 + l, RayCount - 1);
+			const uint32 p = r < PixelCount ? r : outImage.SamplePixels[r - PixelCount];
+			const GlslVec3 WorldDir = getCameraVolumeViewDir(view, (float(p % SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_WIDTH, (float(p / SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_HEIGHT);
+			dx[l] = WorldDir.x; dy[l] = WorldDir.y; dz[l] = WorldDir.z;
+			tMaxMax[l] = r < PixelCount ? 9000000.0f : SkyLutTuningDepths[outImage.SampleDepths[r - PixelCount]];
+		}
+		IntegrateScatteredLuminanceOptions Options;
+		Options.MultiScatLut = &MultiScatLut;
+		Options.tMaxMax = load8(tMaxMax);
+		const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, TransmittanceLut, splat8x3(camPos),
+			float8x3{ load8(dx), load8(dy), load8(dz) }, splat8x3(view.SunDir), false, SampleCount, true, Options);
+		float L[3][8];
+		for (int c = 0; c < 3; ++c)
+		{
+			store8(L[c], ss.L[c]);
+		}
+		for (uint32 l = 0; l < 8 && batch * 8 + l < RayCount; ++l)
+		{
+			float* ray = &rays[(size_t(batch) * 8 + l) * 4];
+			ray[0] = L[0][l];
+			ray[1] = L[1][l];
+			ray[2] = L[2][l];
+			ray[3] = 1.0f;
+		}
+	});
+	outImage.Sky.assign(rays.begin(), rays.begin() + size_t(PixelCount) * 4);
+	outImage.AerialPerspective.assign(rays.begin() + size_t(PixelCount) * 4, rays.end());
+}
+
+double getSkyLutTuningSkyError(const CpuAtmosphereParameters& Atmosphere, const CpuLut2D& SkyViewLut, const CameraVolumeView& view, const SkyLutTuningImage& reference)
+{
+	const GlslVec3 camPos = view.CamPos + GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius };
+	std::vector<float> sky(reference.Sky.size());
+	for (uint32 p = 0; p < SKY_LUT_TUNING_WIDTH * SKY_LUT_TUNING_HEIGHT; ++p)
+	{
+		const GlslVec3 WorldDir = getCameraVolumeViewDir(view, (float(p % SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_WIDTH, (float(p / SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_HEIGHT);
+		const GlslVec3 L = sampleSkyViewLut(Atmosphere, SkyViewLut, camPos, WorldDir, view.SunDir);
+		sky[p * 4 + 0] = L.x;
+		sky[p * 4 + 1] = L.y;
+		sky[p * 4 + 2] = L.z;
+	}
+	return computeSkyPipelineError(sky, reference.Sky).RelativeRmse;
+}
+
+static double getSkyLutTuningAerialPerspectiveError(const CpuLut3D& volume, float KmPerSlice, const SkyLutTuningImage& reference)
+{
+	std::vector<float> ap(reference.AerialPerspective.size());
+	for (size_t s = 0; s < reference.SamplePixels.size(); ++s)
+	{
+		const uint32 p = reference.SamplePixels[s];
+		sampleCameraVolume(volume, KmPerSlice, (float(p % SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_WIDTH, (float(p / SKY_LUT_TUNING_WIDTH) + 0.5f) / SKY_LUT_TUNING_HEIGHT,
+			SkyLutTuningDepths[reference.SampleDepths[s]], &ap[s * 4]);
+	}
+	return computeSkyPipelineError(ap, reference.AerialPerspective).RelativeRmse;
+}
+
+static std::string getSkyLutConfigJson(const SkyLutConfig& config)
+{
+	// key=value lines to "key": value
+	std::string json = "{ ";
+	std::istringstream lines(config.toString());
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		const size_t equal = line.find('=');
+		json += (json.size() > 2 ? ", \"" : "\"") + line.substr(0, equal) + "\": " + line.substr(equal + 1);
+	}
+	return json + " }";
+}
+
+std::vector<SkyLutTuningPoint> getSkyLutTuningFrontier(std::vector<SkyLutTuningPoint>& points)
+{
+	std::sort(points.begin(), points.end(), [](const SkyLutTuningPoint& a, const SkyLutTuningPoint& b)
+	{
+		return a.CostMs < b.CostMs || (a.CostMs == b.CostMs && a.Error < b.Error);
+	});
+	std::vector<SkyLutTuningPoint> frontier;
+	for (const SkyLutTuningPoint& point : points)
+	{
+		if (frontier.empty() || point.Error < frontier.back().Error)
+		{
+			frontier.push_back(point);
+		}
+	}
+	return frontier;
+}
+
+// Searches the SkyLutConfig space for each atmosphere preset. Every configuration is rendered through the sky view LUT and the camera
+// volume, as the application does with fast sky and fast aerial perspective, and compared against ray marching with a high sample count.
+// The cost is the CPU bake time of the four LUTs, which are all rebuilt every frame. The Pareto frontier of (cost, error) is written
+// as JSON, and the cheapest configuration of the frontier meeting maxError as SkyLutConfig_<preset>.txt for -lutconfig.
+// maxError defaults to the error of the default configuration: the cheapest configuration at least as good as the current one.
+static int commandTuneSkyLuts(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_lut_tuning.json");
+	const char* maxErrorArg = ctx.arg(1, "default");
+	const bool maxErrorIsDefault = strcmp(maxErrorArg, "default") == 0;
+	const char* presetFile = ctx.arg(2);
+	const int iterations = 2;
+
+	// Presets, as capture script settings (see CaptureSequence.h), then the atmospheres of a state file
+	struct Preset
+	{
+		std::string Name;
+		AtmosphereInfo Atmosphere;
+	};
+	std::vector<Preset> presets;
+	const char* builtinPresets[][2] = {
+		{ "earth",	"" },
+		{ "hazy",	"mieScattering=0.016,0.016,0.016 mieAbsorption=0.0018,0.0018,0.0018 mieScaleHeight=2.4" },
+	};
+	for (const auto& builtinPreset : builtinPresets)
+	{
+		CaptureSceneState state;
+		std::istringstream settings(builtinPreset[1]);
+		std::string setting;
+		std::string error;
+		while (settings >> setting)
+		{
+			const size_t equal = setting.find('=');
+			if (!applyCaptureSetting(state, setting.substr(0, equal), setting.substr(equal + 1), error))
+			{
+				fprintf(stderr, "Preset %s: %s\n", builtinPreset[0], error.c_str());
+				return 1;
+			}
+		}
+		presets.push_back({ builtinPreset[0], state.Atmosphere });
+	}
+	if (presetFile)
+	{
+		std::vector<SavedState> states;
+		if (!loadStateFile(presetFile, states))
+		{
+			fprintf(stderr, "Cannot load the states of %s\n", presetFile);
+			return 1;
+		}
+		for (size_t s = 0; s < states.size(); ++s)
+		{
+			presets.push_back({ "state" + std::to_string(s), states[s].Atmosphere });
+		}
+	}
+
+	const SkyLutTuningView views[] = {
+		{ "noon",	0.5f,	0.45f },	// Application startup view
+		{ "sunset",	0.5f,	0.02f },
+	};
+	const uint32 ViewCount = uint32(sizeof(views) / sizeof(views[0]));
+
+	// Search space, each axis including the SkyLutConfig default
+	struct TransmittanceOption { uint32 Width, Height; float SampleCount; };
+	struct MultiScatteringOption { uint32 Res; float SampleCount; };
+	struct SkyViewOption { uint32 Width, Height; float MinSPP, MaxSPP; };
+	struct CameraVolumeOption { uint32 Res, SliceCount; float KmPerSlice, SamplesPerSlice; };
+	std::vector<TransmittanceOption> transmittanceOptions;
+	std::vector<MultiScatteringOption> multiScatteringOptions;
+	std::vector<SkyViewOption> skyViewOptions;
+	std::vector<CameraVolumeOption> cameraVolumeOptions;
+	for (uint32 width : { 64u, 128u, 256u })
+	{
+		for (float sampleCount : { 20.0f, 40.0f, 80.0f })
+		{
+			transmittanceOptions.push_back({ width, width / 4, sampleCount });
+		}
+	}
+	for (uint32 res : { 16u, 32u })
+	{
+		for (float sampleCount : { 10.0f, 20.0f, 40.0f })
+		{
+			multiScatteringOptions.push_back({ res, sampleCount });
+		}
+	}
+	for (uint32 width : { 96u, 128u, 192u, 256u })
+	{
+		skyViewOptions.push_back({ width, width * 9 / 16, 4.0f, 14.0f });
+		skyViewOptions.push_back({ width, width * 9 / 16, 8.0f, 24.0f });
+		skyViewOptions.push_back({ width, width * 9 / 16, 16.0f, 48.0f });
+	}
+	for (uint32 res : { 16u, 32u })
+	{
+		for (uint32 sliceCount : { 16u, 32u })
+		{
+			for (float kmPerSlice : { 4.0f, 8.0f })
+			{
+				for (float samplesPerSlice : { 1.0f, 2.0f })
+				{
+					cameraVolumeOptions.push_back({ res, sliceCount, kmPerSlice, samplesPerSlice });
+				}
+			}
+		}
+	}
+	const size_t T = transmittanceOptions.size();
+	const size_t M = multiScatteringOptions.size();
+	const size_t S = skyViewOptions.size();
+	const size_t C = cameraVolumeOptions.size();
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	printf("%u thread(s), %s, %zu configurations per preset, %u views\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar", T * M * S * C, ViewCount);
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"maxError\": \"%s\",\n", maxErrorArg);
+	fprintf(file, "\t\"presets\": [\n");
+
+	const SkyLutConfig defaultConfig;
+	for (size_t presetIndex = 0; presetIndex < presets.size(); ++presetIndex)
+	{
+		const Preset& preset = presets[presetIndex];
+		const AtmosphereInfo& info = preset.Atmosphere;
+		const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// Reference
+		LookUpTablesInfo referenceLutInfo;
+		referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+		referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+		CpuLut2D referenceTransmittanceLut;
+		CpuLut2D referenceMultiScatLut;
+		bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+		bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+		std::vector<SkyLutTuningImage> referenceImages(ViewCount);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, getTuningCameraView(views[v]), 256.0f, referenceImages[v]);
+		}
+
+		// Costs, each kernel timed on its own with reference inputs
+		IntegrateScatteredLuminanceOptions referenceOptions;
+		referenceOptions.MultiScatLut = &referenceMultiScatLut;
+		const CameraVolumeView firstView = getTuningCameraView(views[0]);
+		const float firstSunZenithCosAngle = sinf(views[0].SunElevation);
+		std::vector<double> transmittanceCosts(T), multiScatteringCosts(M), skyViewCosts(S), cameraVolumeCosts(C);
+		for (size_t t = 0; t < T; ++t)
+		{
+			LookUpTablesInfo lutInfo;
+			lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = transmittanceOptions[t].Width;
+			lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = transmittanceOptions[t].Height;
+			CpuLut2D lut;
+			transmittanceCosts[t] = timeBake(iterations, [&]() { bakeTransmittanceLut(pool, info, lutInfo, lut, false, transmittanceOptions[t].SampleCount); }).BestSeconds * 1000.0;
+		}
+		for (size_t m = 0; m < M; ++m)
+		{
+			CpuLut2D lut;
+			multiScatteringCosts[m] = timeBake(iterations, [&]()
+			{
+				bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, multiScatteringOptions[m].Res, 1.0f, lut, multiScatteringOptions[m].SampleCount);
+			}).BestSeconds * 1000.0;
+		}
+		for (size_t s = 0; s < S; ++s)
+		{
+			const SkyViewOption& option = skyViewOptions[s];
+			IntegrateScatteredLuminanceOptions options = referenceOptions;
+			options.VariableSampleCount = true;
+			options.RayMarchMinMaxSPP[0] = option.MinSPP;
+			options.RayMarchMinMaxSPP[1] = option.MaxSPP;
+			CpuLut2D lut;
+			skyViewCosts[s] = timeBake(iterations, [&]()
+			{
+				bakeSkyViewLut(pool, info, referenceTransmittanceLut, firstView.CamPos.z, firstSunZenithCosAngle, option.Width, option.Height, 30.0f, options, lut);
+			}).BestSeconds * 1000.0;
+		}
+		for (size_t c = 0; c < C; ++c)
+		{
+			const CameraVolumeOption& option = cameraVolumeOptions[c];
+			CpuLut3D volume;
+			cameraVolumeCosts[c] = timeBake(iterations, [&]()
+			{
+				bakeCameraVolume(pool, info, referenceTransmittanceLut, firstView, option.Res, option.Res, option.SliceCount, option.KmPerSlice, option.SamplesPerSlice, referenceOptions, volume);
+			}).BestSeconds * 1000.0;
+		}
+
+		// Squared errors averaged over the views, for each transmittance and multiple scattering pair
+		std::vector<double> skyErrors(T * M * S, 0.0);
+		std::vector<double> aerialPerspectiveErrors(T * M * C, 0.0);
+		for (size_t t = 0; t < T; ++t)
+		{
+			LookUpTablesInfo lutInfo;
+			lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = transmittanceOptions[t].Width;
+			lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = transmittanceOptions[t].Height;
+			CpuLut2D transmittanceLut;
+			bakeTransmittanceLut(pool, info, lutInfo, transmittanceLut, false, transmittanceOptions[t].SampleCount);
+			for (size_t m = 0; m < M; ++m)
+			{
+				CpuLut2D multiScatLut;
+				bakeMultiScatteringLut(pool, info, transmittanceLut, multiScatteringOptions[m].Res, 1.0f, multiScatLut, multiScatteringOptions[m].SampleCount);
+				IntegrateScatteredLuminanceOptions options;
+				options.MultiScatLut = &multiScatLut;
+				for (uint32 v = 0; v < ViewCount; ++v)
+				{
+					const CameraVolumeView view = getTuningCameraView(views[v]);
+					for (size_t s = 0; s < S; ++s)
+					{
+						const SkyViewOption& option = skyViewOptions[s];
+						IntegrateScatteredLuminanceOptions skyViewOptionsValue = options;
+						skyViewOptionsValue.VariableSampleCount = true;
+						skyViewOptionsValue.RayMarchMinMaxSPP[0] = option.MinSPP;
+						skyViewOptionsValue.RayMarchMinMaxSPP[1] = option.MaxSPP;
+						CpuLut2D skyViewLut;
+						bakeSkyViewLut(pool, info, transmittanceLut, view.CamPos.z, sinf(views[v].SunElevation), option.Width, option.Height, 30.0f, skyViewOptionsValue, skyViewLut);
+						const double error = getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImages[v]);
+						skyErrors[(t * M + m) * S + s] += error * error / ViewCount;
+					}
+					for (size_t c = 0; c < C; ++c)
+					{
+						const CameraVolumeOption& option = cameraVolumeOptions[c];
+						CpuLut3D volume;
+						bakeCameraVolume(pool, info, transmittanceLut, view, option.Res, option.Res, option.SliceCount, option.KmPerSlice, option.SamplesPerSlice, options, volume);
+						const double error = getSkyLutTuningAerialPerspectiveError(volume, option.KmPerSlice, referenceImages[v]);
+						aerialPerspectiveErrors[(t * M + m) * C + c] += error * error / ViewCount;
+					}
+				}
+			}
+		}
+
+		// All configurations, then the Pareto frontier
+		std::vector<SkyLutTuningPoint> points;
+		points.reserve(T * M * S * C);
+		SkyLutTuningPoint defaultPoint = {};
+		for (size_t t = 0; t < T; ++t)
+		{
+			for (size_t m = 0; m < M; ++m)
+			{
+				for (size_t s = 0; s < S; ++s)
+				{
+					for (size_t c = 0; c < C; ++c)
+					{
+						SkyLutTuningPoint point;
+						point.Config.TransmittanceWidth = transmittanceOptions[t].Width;
+						point.Config.TransmittanceHeight = transmittanceOptions[t].Height;
+						point.Config.TransmittanceSampleCount = transmittanceOptions[t].SampleCount;
+						point.Config.MultiScatteringRes = multiScatteringOptions[m].Res;
+						point.Config.MultiScatteringSampleCount = multiScatteringOptions[m].SampleCount;
+						point.Config.SkyViewWidth = skyViewOptions[s].Width;
+						point.Config.SkyViewHeight = skyViewOptions[s].Height;
+						point.Config.RayMarchMinMaxSPP[0] = skyViewOptions[s].MinSPP;
+						point.Config.RayMarchMinMaxSPP[1] = skyViewOptions[s].MaxSPP;
+						point.Config.CameraVolumeWidth = cameraVolumeOptions[c].Res;
+						point.Config.CameraVolumeHeight = cameraVolumeOptions[c].Res;
+						point.Config.CameraVolumeSliceCount = cameraVolumeOptions[c].SliceCount;
+						point.Config.CameraVolumeKmPerSlice = cameraVolumeOptions[c].KmPerSlice;
+						point.Config.CameraVolumeSamplesPerSlice = cameraVolumeOptions[c].SamplesPerSlice;
+						point.CostMs = transmittanceCosts[t] + multiScatteringCosts[m] + skyViewCosts[s] + cameraVolumeCosts[c];
+						point.SkyError = sqrt(skyErrors[(t * M + m) * S + s]);
+						point.AerialPerspectiveError = sqrt(aerialPerspectiveErrors[(t * M + m) * C + c]);
+						point.Error = sqrt(0.5 * (point.SkyError * point.SkyError + point.AerialPerspectiveError * point.AerialPerspectiveError));
+						points.push_back(point);
+						if (point.Config.toString() == defaultConfig.toString())
+						{
+							defaultPoint = point;
+						}
+					}
+				}
+			}
+		}
+		const std::vector<SkyLutTuningPoint> frontier = getSkyLutTuningFrontier(points);
+
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("\n%s: %zu configurations on the frontier (%.1f s)\n", preset.Name.c_str(), frontier.size(), seconds);
+		printf("  default    %8.3f ms  error %.4f (sky %.4f, aerial perspective %.4f)\n", defaultPoint.CostMs, defaultPoint.Error, defaultPoint.SkyError, defaultPoint.AerialPerspectiveError);
+		const double maxError = maxErrorIsDefault ? defaultPoint.Error : atof(maxErrorArg);
+		const SkyLutTuningPoint* chosen = nullptr;
+		for (const SkyLutTuningPoint& point : frontier)
+		{
+			printf("  frontier   %8.3f ms  error %.4f (sky %.4f, aerial perspective %.4f)\n", point.CostMs, point.Error, point.SkyError, point.AerialPerspectiveError);
+			chosen = !chosen && point.Error <= maxError ? &point : chosen;
+		}
+		if (chosen)
+		{
+			const std::string configFile = "SkyLutConfig_" + preset.Name + ".txt";
+			if (!chosen->Config.save(configFile.c_str()))
+			{
+				fprintf(stderr, "Cannot write %s\n", configFile.c_str());
+				fclose(file);
+				return 1;
+			}
+			printf("  cheapest configuration with an error below %g written to %s (%.3f ms, %.1fx the default)\n", maxError, configFile.c_str(),
+				chosen->CostMs, defaultPoint.CostMs / chosen->CostMs);
+		}
+		else
+		{
+			printf("  no configuration with an error below %g\n", maxError);
+		}
+
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", preset.Name.c_str());
+		fprintf(file, "\t\t\t\"configurationCount\": %zu,\n", points.size());
+		fprintf(file, "\t\t\t\"maxError\": %.6e,\n", maxError);
+		fprintf(file, "\t\t\t\"default\": { \"costMs\": %.6f, \"error\": %.6e, \"skyError\": %.6e, \"aerialPerspectiveError\": %.6e },\n",
+			defaultPoint.CostMs, defaultPoint.Error, defaultPoint.SkyError, defaultPoint.AerialPerspectiveError);
+		fprintf(file, "\t\t\t\"frontier\": [\n");
+		for (size_t f = 0; f < frontier.size(); ++f)
+		{
+			const SkyLutTuningPoint& point = frontier[f];
+			fprintf(file, "\t\t\t\t{ \"costMs\": %.6f, \"error\": %.6e, \"skyError\": %.6e, \"aerialPerspectiveError\": %.6e, \"chosen\": %s, \"config\": %s }%s\n",
+				point.CostMs, point.Error, point.SkyError, point.AerialPerspectiveError, &point == chosen ? "true" : "false",
+				getSkyLutConfigJson(point.Config).c_str(), f + 1 < frontier.size() ? "," : "");
+		}
+		fprintf(file, "\t\t\t]\n");
+		fprintf(file, "\t\t}%s\n", presetIndex + 1 < presets.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("\nResults written to %s\n", outFile);
+	return 0;
+}
+
+// Sky view LUT resolution against fast sky error, for the tiers of SkyViewLutTier and a few more. The LUT is looked up as
+// RenderRayMarchingPS does with FASTSKY_ENABLED and compared against the reference of tune-sky-luts. Bake time and error are measured
+// with the default LUT configuration and ray march SPP. The resolution error is that of a LUT marched with 256 samples from the
+// reference LUTs, leaving only the error due to the resolution.
+static int commandBenchSkyViewResolution(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_view_resolution.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+		{ "altitude",	40.0f,	0.45f },
+	};
+	const uint32 ViewCount = uint32(sizeof(views) / sizeof(views[0]));
+	std::vector<uint32> widths = { 48, 64, 96, 128, 160, 192, 256, 384, 512 };
+
+	// Reference and floor
+	LookUpTablesInfo referenceLutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+	bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+	IntegrateScatteredLuminanceOptions referenceOptions;
+	referenceOptions.MultiScatLut = &referenceMultiScatLut;
+	std::vector<SkyLutTuningImage> referenceImages(ViewCount);
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, getTuningCameraView(views[v]), 256.0f, referenceImages[v]);
+	}
+
+	// LUTs sampled by the sky view LUT, as in the application
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = defaultConfig.TransmittanceWidth;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = defaultConfig.TransmittanceHeight;
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, lutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, defaultConfig.MultiScatteringRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+	options.VariableSampleCount = true;
+	options.RayMarchMinMaxSPP[0] = defaultConfig.RayMarchMinMaxSPP[0];
+	options.RayMarchMinMaxSPP[1] = defaultConfig.RayMarchMinMaxSPP[1];
+
+	struct Result
+	{
+		uint32 Width, Height;
+		BakeTimings Timings;				// Averaged over the views
+		std::vector<double> Errors;			// Per view
+		std::vector<double> ResolutionErrors;
+	};
+	std::vector<Result> results;
+	double defaultBakeSeconds = 0.0;
+	printf("%u thread(s), %s, %d iteration(s)\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar", iterations);
+	printf("  resolution      bake  vs %ux%u", defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight);
+	for (const SkyLutTuningView& view : views)
+	{
+		printf("  %8s (resolution)", view.Name);
+	}
+	printf("\n");
+	for (uint32 width : widths)
+	{
+		Result result;
+		result.Width = width;
+		result.Height = width * 9 / 16;
+		result.Timings.BestSeconds = 0.0;
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			const CameraVolumeView view = getTuningCameraView(views[v]);
+			CpuLut2D skyViewLut;
+			const BakeTimings timings = timeBake(iterations, [&]()
+			{
+				bakeSkyViewLut(pool, info, transmittanceLut, view.CamPos.z, sinf(views[v].SunElevation), result.Width, result.Height, 30.0f, options, skyViewLut);
+			});
+			result.Timings.AvgSeconds += timings.AvgSeconds / ViewCount;
+			result.Timings.BestSeconds += timings.BestSeconds / ViewCount;
+			result.Errors.push_back(getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImages[v]));
+			bakeSkyViewLut(pool, info, referenceTransmittanceLut, view.CamPos.z, sinf(views[v].SunElevation), result.Width, result.Height, 256.0f, referenceOptions, skyViewLut);
+			result.ResolutionErrors.push_back(getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImages[v]));
+		}
+		defaultBakeSeconds = result.Width == defaultConfig.SkyViewWidth && result.Height == defaultConfig.SkyViewHeight ? result.Timings.BestSeconds : defaultBakeSeconds;
+		results.push_back(result);
+	}
+	for (const Result& result : results)
+	{
+		printf("  %4ux%-4u  %8.3f ms  %9.2fx", result.Width, result.Height, result.Timings.BestSeconds * 1000.0,
+			defaultBakeSeconds > 0.0 ? result.Timings.BestSeconds / defaultBakeSeconds : 0.0);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			printf("  %8.4f   (%8.4f)", result.Errors[v], result.ResolutionErrors[v]);
+		}
+		printf("\n");
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"rayMarchMinMaxSPP\": [%g, %g],\n", defaultConfig.RayMarchMinMaxSPP[0], defaultConfig.RayMarchMinMaxSPP[1]);
+	fprintf(file, "\t\"views\": [");
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		fprintf(file, "%s{ \"name\": \"%s\", \"cameraHeight\": %g, \"sunElevation\": %g }", v > 0 ? ", " : "",
+			views[v].Name, views[v].CameraHeight, views[v].SunElevation);
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const Result& result = results[r];
+		fprintf(file, "\t\t{ \"width\": %u, \"height\": %u, \"avgMs\": %.6f, \"bestMs\": %.6f, \"relativeRmse\": [", result.Width, result.Height,
+			result.Timings.AvgSeconds * 1000.0, result.Timings.BestSeconds * 1000.0);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			fprintf(file, "%s%.6e", v > 0 ? ", " : "", result.Errors[v]);
+		}
+		fprintf(file, "], \"resolutionRelativeRmse\": [");
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			fprintf(file, "%s%.6e", v > 0 ? ", " : "", result.ResolutionErrors[v]);
+		}
+		fprintf(file, "] }%s\n", r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return 0;
+}
+
+// Amortized sky view LUT updates as done by Game::renderSkyViewLut: a phase is updated each frame, unless the camera height or the
+// sun elevation moved past the thresholds (SkyLutConfig::SkyViewRefreshHeight and SkyViewRefreshSunAngle) since the last full update. Reports the per frame bake time, and the error of
+// the amortized LUT against a LUT fully updated with the same settings, for a few camera and sun motions at 60 frames per second.
+static int commandBenchSkyViewAmortization(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_view_amortization.json");
+	const uint32 frameCount = uint32((std::max)(1, atoi(ctx.arg(1, "120"))));
+	const SkyLutConfig defaultConfig;
+	const float heightThreshold = ctx.arg(2) ? float(atof(ctx.arg(2))) : defaultConfig.SkyViewRefreshHeight;
+	const float sunAngleThreshold = ctx.arg(3) ? float(atof(ctx.arg(3))) : defaultConfig.SkyViewRefreshSunAngle;
+
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	CpuThreadPool pool(ctx.ThreadCount);
+
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, ctx.LutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+	options.VariableSampleCount = true;
+	options.RayMarchMinMaxSPP[0] = defaultConfig.RayMarchMinMaxSPP[0];
+	options.RayMarchMinMaxSPP[1] = defaultConfig.RayMarchMinMaxSPP[1];
+	const uint32 Width = defaultConfig.SkyViewWidth;
+	const uint32 Height = defaultConfig.SkyViewHeight;
+
+	// Camera height and sun elevation at the start and end of the motion
+	struct Motion
+	{
+		const char* Name;
+		float CameraHeight[2];
+		float SunElevation[2];
+	};
+	const float framesPerSecond = 60.0f;
+	const float duration = float(frameCount) / framesPerSecond;
+	const Motion motions[] = {
+		{ "static",		{ 0.5f, 0.5f },							{ 0.45f, 0.45f } },
+		{ "timeOfDay",	{ 0.5f, 0.5f },							{ 0.1f, 0.1f - 0.005f * duration } },	// 0.3 degree per second
+		{ "sunDrag",	{ 0.5f, 0.5f },							{ 0.45f, (std::max)(0.05f, 0.45f - 0.2f * duration) } },	// Stops above the horizon
+		{ "takeOff",	{ 0.5f, 0.5f + 0.25f * duration },		{ 0.45f, 0.45f } },						// 900 km/h climb
+	};
+	const uint32 interleaves[] = { 1, 2, 4, 8, SKY_VIEW_LUT_MAX_INTERLEAVE };
+
+	struct Result
+	{
+		const char* Motion;
+		uint32 Interleave;
+		double AvgMs = 0.0;
+		double MaxMs = 0.0;
+		double AvgError = 0.0;
+		double MaxError = 0.0;
+		uint32 FullUpdateCount = 0;
+	};
+	std::vector<Result> results;
+
+	printf("%u thread(s), %s, %ux%u sky view LUT, %u frames, thresholds %g km and %g rad\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar",
+		Width, Height, frameCount, heightThreshold, sunAngleThreshold);
+	printf("  %-10s  texels/frame   avg ms   max ms   avg error   max error   full updates\n", "motion");
+	for (const Motion& motion : motions)
+	{
+		for (uint32 interleave : interleaves)
+		{
+			Result result;
+			result.Motion = motion.Name;
+			result.Interleave = interleave;
+			CpuLut2D amortizedLut;
+			CpuLut2D referenceLut;
+			float fullUpdateHeight = 0.0f;
+			float fullUpdateSunElevation = 0.0f;
+			for (uint32 frame = 0; frame < frameCount; ++frame)
+			{
+				const float alpha = frameCount > 1 ? float(frame) / float(frameCount - 1) : 0.0f;
+				const float cameraHeight = motion.CameraHeight[0] + (motion.CameraHeight[1] - motion.CameraHeight[0]) * alpha;
+				const float sunElevation = motion.SunElevation[0] + (motion.SunElevation[1] - motion.SunElevation[0]) * alpha;
+
+				const bool fullUpdate = interleave <= 1 || frame == 0 || fabsf(cameraHeight - fullUpdateHeight) > heightThreshold
+					|| fabsf(sunElevation - fullUpdateSunElevation) > sunAngleThreshold;
+				if (fullUpdate)
+				{
+					fullUpdateHeight = cameraHeight;
+					fullUpdateSunElevation = sunElevation;
+					result.FullUpdateCount++;
+				}
+				const BakeTimings timings = timeBake(1, [&]()
+				{
+					bakeSkyViewLut(pool, info, transmittanceLut, cameraHeight, sinf(sunElevation), Width, Height, 30.0f, options, amortizedLut,
+						fullUpdate ? 1 : interleave, frame % interleave);
+				});
+
+				bakeSkyViewLut(pool, info, transmittanceLut, cameraHeight, sinf(sunElevation), Width, Height, 30.0f, options, referenceLut);
+				const double error = computeSkyPipelineError(amortizedLut.Data, referenceLut.Data).RelativeRmse;
+				result.AvgMs += timings.BestSeconds * 1000.0 / frameCount;
+				result.MaxMs = (std::max)(result.MaxMs, timings.BestSeconds * 1000.0);
+				result.AvgError += error / frameCount;
+				result.MaxError = (std::max)(result.MaxError, error);
+			}
+			printf("  %-10s  %12u  %7.3f  %7.3f  %10.5f  %10.5f  %13u\n", result.Motion, Width * Height / interleave, result.AvgMs, result.MaxMs,
+				result.AvgError, result.MaxError, result.FullUpdateCount);
+			results.push_back(result);
+		}
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"width\": %u,\n", Width);
+	fprintf(file, "\t\"height\": %u,\n", Height);
+	fprintf(file, "\t\"frames\": %u,\n", frameCount);
+	fprintf(file, "\t\"heightThreshold\": %g,\n", heightThreshold);
+	fprintf(file, "\t\"sunAngleThreshold\": %g,\n", sunAngleThreshold);
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const Result& result = results[r];
+		fprintf(file, "\t\t{ \"motion\": \"%s\", \"interleave\": %u, \"texelsPerFrame\": %u, \"avgMs\": %.6f, \"maxMs\": %.6f, \"avgRelativeRmse\": %.6e, \"maxRelativeRmse\": %.6e, \"fullUpdates\": %u }%s\n",
+			result.Motion, result.Interleave, Width * Height / result.Interleave, result.AvgMs, result.MaxMs, result.AvgError, result.MaxError,
+			result.FullUpdateCount, r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return 0;
+}
+
+std::vector<CameraVolumePrefixResult> measureCameraVolumePrefix(CpuSkyToolsContext& ctx, CpuThreadPool& pool, int iterations)
+{
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const SkyLutConfig defaultConfig;
+
+	struct View
+	{
+		const char* Name;
+		float CameraHeight;		// Kilometers
+		float Pitch;			// Radians, negative looking down
+		float SunElevation;		// Radians
+	};
+	const View views[] = {
+		{ "noon",		0.5f,	0.0f,	0.45f },
+		{ "sunset",		0.5f,	0.0f,	0.02f },
+		{ "lookDown",	2.0f,	-0.35f,	0.45f },
+		{ "altitude",	40.0f,	-0.2f,	0.45f },
+		{ "orbit",		120.0f,	-0.5f,	0.45f },
+	};
+	const float samplesPerSlice[] = { 1.0f, 2.0f, 4.0f };
+	const uint32 Width = defaultConfig.CameraVolumeWidth;
+	const uint32 Height = defaultConfig.CameraVolumeHeight;
+	const uint32 SliceCount = defaultConfig.CameraVolumeSliceCount;
+	const float KmPerSlice = defaultConfig.CameraVolumeKmPerSlice;
+
+	LookUpTablesInfo referenceLutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+	bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+
+	// LUTs sampled by the camera volume, as in the application
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = defaultConfig.TransmittanceWidth;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = defaultConfig.TransmittanceHeight;
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, lutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, defaultConfig.MultiScatteringRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+
+	std::vector<CameraVolumePrefixResult> results;
+
+	const uint32 FroxelCount = Width * Height * SliceCount;
+	printf("%u thread(s), %s, %ux%ux%u camera volume, %g km per slice, %d iteration(s)\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar",
+		Width, Height, SliceCount, KmPerSlice, iterations);
+	printf("  %-9s  samples   per slice ms   prefix ms   speedup   per slice error   prefix error   marched   ground culled   space culled\n", "view");
+	for (const View& v : views)
+	{
+		CameraVolumeView view;
+		view.CamPos = { 0.0f, 0.0f, v.CameraHeight };
+		view.Forward = { 0.0f, cosf(v.Pitch), sinf(v.Pitch) };
+		view.Up = { 0.0f, -sinf(v.Pitch), cosf(v.Pitch) };
+		view.SunDir = { 0.0f, cosf(v.SunElevation), sinf(v.SunElevation) };
+		SkyLutTuningImage referenceImage;
+		renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, view, 256.0f, referenceImage);
+
+		for (float sampleCount : samplesPerSlice)
+		{
+			CameraVolumePrefixResult result;
+			result.View = v.Name;
+			result.SamplesPerSlice = sampleCount;
+			CpuLut3D volume;
+			result.SliceTimings = timeBake(iterations, [&]()
+			{
+				bakeCameraVolume(pool, info, transmittanceLut, view, Width, Height, SliceCount, KmPerSlice, sampleCount, options, volume);
+			});
+			result.SliceError = getSkyLutTuningAerialPerspectiveError(volume, KmPerSlice, referenceImage);
+			result.PrefixTimings = timeBake(iterations, [&]()
+			{
+				result.Culling = bakeCameraVolumePrefix(pool, info, transmittanceLut, view, Width, Height, SliceCount, KmPerSlice, sampleCount, options, volume);
+			});
+			result.PrefixError = getSkyLutTuningAerialPerspectiveError(volume, KmPerSlice, referenceImage);
+
+			printf("  %-9s  %7g  %13.3f  %10.3f  %7.2fx  %16.5f  %13.5f  %7.1f%%  %13.1f%%  %12.1f%%\n", result.View, sampleCount,
+				result.SliceTimings.BestSeconds * 1000.0, result.PrefixTimings.BestSeconds * 1000.0,
+				result.PrefixTimings.BestSeconds > 0.0 ? result.SliceTimings.BestSeconds / result.PrefixTimings.BestSeconds : 0.0,
+				result.SliceError, result.PrefixError, 100.0 * result.Culling.MarchedFroxels / FroxelCount,
+				100.0 * result.Culling.GroundCulledFroxels / FroxelCount, 100.0 * result.Culling.SpaceCulledFroxels / FroxelCount);
+			results.push_back(result);
+		}
+	}
+	return results;
+}
+
+static int commandBenchCameraVolumePrefix(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "camera_volume_prefix.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+	const std::vector<CameraVolumePrefixResult> results = measureCameraVolumePrefix(ctx, pool, iterations);
+	const uint32 Width = defaultConfig.CameraVolumeWidth;
+	const uint32 Height = defaultConfig.CameraVolumeHeight;
+	const uint32 SliceCount = defaultConfig.CameraVolumeSliceCount;
+	const float KmPerSlice = defaultConfig.CameraVolumeKmPerSlice;
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"volume\": [%u, %u, %u],\n", Width, Height, SliceCount);
+	fprintf(file, "\t\"kmPerSlice\": %g,\n", KmPerSlice);
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const CameraVolumePrefixResult& result = results[r];
+		fprintf(file, "\t\t{ \"view\": \"%s\", \"samplesPerSlice\": %g, \"sliceBestMs\": %.6f, \"prefixBestMs\": %.6f, \"sliceRelativeRmse\": %.6e, \"prefixRelativeRmse\": %.6e, "
+			"\"marchedFroxels\": %u, \"groundCulledFroxels\": %u, \"spaceCulledFroxels\": %u }%s\n",
+			result.View, result.SamplesPerSlice, result.SliceTimings.BestSeconds * 1000.0, result.PrefixTimings.BestSeconds * 1000.0, result.SliceError, result.PrefixError,
+			result.Culling.MarchedFroxels, result.Culling.GroundCulledFroxels, result.Culling.SpaceCulledFroxels, r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return 0;
+}
+
+
+// Sun visible in-scatter LUT of IntegrateScatteredLuminanceOptions::SunInScatterLut: per step cost of IntegrateScatteredLuminance8
+// with and without the LUT, then the sky view LUT bake time and error against the reference images for a few LUT resolutions.
+static int commandBenchSunInScatterLut(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sun_inscatter_lut.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const CpuAtmosphereParameters Atmosphere = GetAtmosphereParameters(info);
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+		{ "altitude",	40.0f,	0.45f },
+	};
+	const uint32 ViewCount = uint32(sizeof(views) / sizeof(views[0]));
+	const uint32 lutSizes[][2] = { { 64, 16 }, { 128, 32 }, { 256, 64 }, { 512, 128 } };
+
+	// Reference
+	LookUpTablesInfo referenceLutInfo;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_WIDTH = 1024;
+	referenceLutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = 256;
+	CpuLut2D referenceTransmittanceLut;
+	CpuLut2D referenceMultiScatLut;
+	bakeTransmittanceLut(pool, info, referenceLutInfo, referenceTransmittanceLut, false, 1024.0f);
+	bakeMultiScatteringLut(pool, info, referenceTransmittanceLut, 128, 1.0f, referenceMultiScatLut, 128.0f);
+	std::vector<SkyLutTuningImage> referenceImages(ViewCount);
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		renderSkyLutTuningReference(pool, Atmosphere, referenceTransmittanceLut, referenceMultiScatLut, getTuningCameraView(views[v]), 256.0f, referenceImages[v]);
+	}
+
+	// LUTs of the application
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = defaultConfig.TransmittanceWidth;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = defaultConfig.TransmittanceHeight;
+	CpuLut2D transmittanceLut;
+	CpuLut2D multiScatLut;
+	bakeTransmittanceLut(pool, info, lutInfo, transmittanceLut, false, defaultConfig.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, transmittanceLut, defaultConfig.MultiScatteringRes, 1.0f, multiScatLut, defaultConfig.MultiScatteringSampleCount);
+	IntegrateScatteredLuminanceOptions options;
+	options.MultiScatLut = &multiScatLut;
+	options.VariableSampleCount = true;
+	options.RayMarchMinMaxSPP[0] = defaultConfig.RayMarchMinMaxSPP[0];
+	options.RayMarchMinMaxSPP[1] = defaultConfig.RayMarchMinMaxSPP[1];
+
+	// Kernel: rays from the ground over the hemisphere, with a fixed sample count so that every lane runs all the steps
+	const uint32 RayBatchCount = 4096;
+	const float KernelSampleCount = 32.0f;
+	std::vector<float> rayDirs[3];		// Plain floats, std::vector does not align float8
+	for (uint32 i = 0; i < RayBatchCount * CPU_SIMD_WIDTH; ++i)
+	{
+		const float cosTheta = 1.0f - 2.0f * (float(i) + 0.5f) / float(RayBatchCount * CPU_SIMD_WIDTH);
+		const float sinTheta = sqrtf(saturate(1.0f - cosTheta * cosTheta));
+		const float phi = 2.39996323f * float(i);	// Golden angle
+		rayDirs[0].push_back(sinTheta * cosf(phi));
+		rayDirs[1].push_back(sinTheta * sinf(phi));
+		rayDirs[2].push_back(cosTheta);
+	}
+	const float8x3 rayPos = splat8x3(GlslVec3{ 0.0f, 0.0f, Atmosphere.BottomRadius + 0.5f });
+	const float8x3 kernelSunDir = splat8x3(normalize(GlslVec3{ 0.0f, cosf(0.45f), sinf(0.45f) }));
+	IntegrateScatteredLuminanceOptions kernelOptions;
+	kernelOptions.MultiScatLut = &multiScatLut;
+	float8 kernelSink = splat8(0.0f);
+	auto timeKernel = [&](const IntegrateScatteredLuminanceOptions& kernelOpt)
+	{
+		const BakeTimings timings = timeBake(iterations, [&]()
+		{
+			for (uint32 b = 0; b < RayBatchCount; ++b)
+			{
+				const size_t i = size_t(b) * CPU_SIMD_WIDTH;
+				const float8x3 rayDir = { load8(&rayDirs[0][i]), load8(&rayDirs[1][i]), load8(&rayDirs[2][i]) };
+				const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, transmittanceLut, rayPos, rayDir, kernelSunDir, true, KernelSampleCount, true, kernelOpt);
+				kernelSink = kernelSink + ss.L[0];
+			}
+		});
+		return timings.BestSeconds * 1e9 / (double(RayBatchCount) * CPU_SIMD_WIDTH * KernelSampleCount);
+	};
+
+	struct Result
+	{
+		uint32 Width = 0, Height = 0;		// 0 for the transmittance and multiple scattering LUTs
+		double LutBakeSeconds = 0.0;
+		double KernelStepNs = 0.0;			// Per lane step, single thread
+		double SkyViewBakeSeconds = 0.0;	// Averaged over the views
+		std::vector<double> Errors;			// Per view
+	};
+	std::vector<Result> results;
+	auto runSkyViews = [&](Result& result, const IntegrateScatteredLuminanceOptions& skyViewOptions)
+	{
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			const CameraVolumeView view = getTuningCameraView(views[v]);
+			CpuLut2D skyViewLut;
+			const BakeTimings timings = timeBake(iterations, [&]()
+			{
+				bakeSkyViewLut(pool, info, transmittanceLut, view.CamPos.z, sinf(views[v].SunElevation), defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight,
+					30.0f, skyViewOptions, skyViewLut);
+			});
+			result.SkyViewBakeSeconds += timings.BestSeconds / ViewCount;
+			result.Errors.push_back(getSkyLutTuningSkyError(Atmosphere, skyViewLut, view, referenceImages[v]));
+		}
+	};
+
+	Result baseline;
+	baseline.KernelStepNs = timeKernel(kernelOptions);
+	runSkyViews(baseline, options);
+	results.push_back(baseline);
+	for (const uint32* size : lutSizes)
+	{
+		Result result;
+		result.Width = size[0];
+		result.Height = size[1];
+		CpuSunInScatterLut sunInScatterLut;
+		result.LutBakeSeconds = timeBake(iterations, [&]()
+		{
+			bakeSunInScatterLut(pool, info, transmittanceLut, &multiScatLut, result.Width, result.Height, sunInScatterLut);
+		}).BestSeconds;
+		kernelOptions.SunInScatterLut = &sunInScatterLut;
+		result.KernelStepNs = timeKernel(kernelOptions);
+		IntegrateScatteredLuminanceOptions lutOptions = options;
+		lutOptions.SunInScatterLut = &sunInScatterLut;
+		runSkyViews(result, lutOptions);
+		results.push_back(result);
+	}
+
+	printf("%u thread(s), %s, %d iteration(s), kernel on 1 thread with %g samples, sky view LUT %ux%u\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar",
+		iterations, KernelSampleCount, defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight);
+	printf("  sun LUT     bake   ns/step  sky view");
+	for (const SkyLutTuningView& view : views)
+	{
+		printf("  %8s", view.Name);
+	}
+	printf("\n");
+	for (const Result& result : results)
+	{
+		if (result.Width == 0)
+		{
+			printf("  %-9s  %8s", "none", "");
+		}
+		else
+		{
+			printf("  %4ux%-4u  %5.3f ms", result.Width, result.Height, result.LutBakeSeconds * 1000.0);
+		}
+		printf("  %7.2f  %5.3f ms", result.KernelStepNs, result.SkyViewBakeSeconds * 1000.0);
+		for (double error : result.Errors)
+		{
+			printf("  %8.4f", error);
+		}
+		printf("\n");
+	}
+	float kernelSinkValues[CPU_SIMD_WIDTH];
+	store8(kernelSinkValues, kernelSink);
+	if (!std::isfinite(kernelSinkValues[0]))
+	{
+		fprintf(stderr, "Kernel produced invalid values\n");
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"kernelSampleCount\": %g,\n", KernelSampleCount);
+	fprintf(file, "\t\"skyView\": [%u, %u],\n", defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight);
+	fprintf(file, "\t\"views\": [");
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		fprintf(file, "%s{ \"name\": \"%s\", \"cameraHeight\": %g, \"sunElevation\": %g }", v > 0 ? ", " : "",
+			views[v].Name, views[v].CameraHeight, views[v].SunElevation);
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const Result& result = results[r];
+		fprintf(file, "\t\t{ \"width\": %u, \"height\": %u, \"lutBestMs\": %.6f, \"kernelStepNs\": %.4f, \"skyViewBestMs\": %.6f, \"relativeRmse\": [",
+			result.Width, result.Height, result.LutBakeSeconds * 1000.0, result.KernelStepNs, result.SkyViewBakeSeconds * 1000.0);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			fprintf(file, "%s%.6e", v > 0 ? ", " : "", result.Errors[v]);
+		}
+		fprintf(file, "] }%s\n", r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return 0;
+}
+
+void bakeSkyViewLutAtlasInputs(CpuThreadPool& pool, const AtmosphereInfo& info, const SkyLutConfig& config, float multipleScatteringFactor,
+	SkyViewLutAtlasInputs& out)
+{
+	LookUpTablesInfo lutInfo;
+	lutInfo.TRANSMITTANCE_TEXTURE_WIDTH = config.TransmittanceWidth;
+	lutInfo.TRANSMITTANCE_TEXTURE_HEIGHT = config.TransmittanceHeight;
+	bakeTransmittanceLut(pool, info, lutInfo, out.TransmittanceLut, false, config.TransmittanceSampleCount);
+	bakeMultiScatteringLut(pool, info, out.TransmittanceLut, config.MultiScatteringRes, multipleScatteringFactor, out.MultiScatLut, config.MultiScatteringSampleCount);
+	out.Options = IntegrateScatteredLuminanceOptions();
+	out.Options.MultiScatLut = &out.MultiScatLut;
+	out.Options.VariableSampleCount = true;
+	out.Options.RayMarchMinMaxSPP[0] = config.RayMarchMinMaxSPP[0];
+	out.Options.RayMarchMinMaxSPP[1] = config.RayMarchMinMaxSPP[1];
+}
+
+// Rounds the atlas to R11G11B10, returning the packed texels and replacing the atlas values by the ones the GPU reads.
+static std::vector<uint32> quantizeSkyViewLutAtlas(CpuLut3D& atlas)
+{
+	std::vector<uint32> packed(atlas.Data.size() / 4);
+	for (size_t t = 0; t < packed.size(); ++t)
+	{
+		float* texel = &atlas.Data[t * 4];
+		packed[t] = packR11G11B10Float(texel[0], texel[1], texel[2]);
+		unpackR11G11B10Float(packed[t], texel);
+	}
+	return packed;
+}
+
+// Bakes the time of day sky view LUT atlas (see getSkyViewLutAtlasCoord) of a SkyLutConfig file, or of the defaults, to the LUT cache entry
+// Game::updateSkyViewLutAtlas looks for. The multiple scattering factor must be the one of the application, 0 for the multiple
+// scattering approximation being disabled.
+static int commandBakeSkyViewAtlas(CpuSkyToolsContext& ctx)
+{
+	const char* configFile = ctx.arg(0);
+	const float multipleScatteringFactor = float(atof(ctx.arg(1, "1")));
+
+	SkyLutConfig config;
+	std::string error;
+	if (configFile && strcmp(configFile, "-") != 0 && !config.load(configFile, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	SkyViewLutAtlasInputs inputs;
+	CpuLut3D atlas;
+	auto start = std::chrono::high_resolution_clock::now();
+	bakeSkyViewLutAtlasInputs(pool, ctx.Atmosphere, config, multipleScatteringFactor, inputs);
+	bakeSkyViewLutAtlas(pool, ctx.Atmosphere, inputs.TransmittanceLut, config, 30.0f, inputs.Options, atlas);
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("Sky view LUT atlas of %u sun angles x %u height bands baked in %.1f ms, %u thread(s)\n", config.SkyViewAtlasSunAngleCount,
+		config.SkyViewAtlasHeightBandCount, std::chrono::duration<double>(end - start).count() * 1000.0, pool.getThreadCount());
+
+	if (countInvalidValues(atlas.Data) > 0)
+	{
+		fprintf(stderr, "NaN, infinite or negative values found, the atlas is not written\n");
+		return 1;
+	}
+	const std::vector<uint32> packed = quantizeSkyViewLutAtlas(atlas);
+
+	LutCacheTextureDesc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.Width = atlas.Width;
+	desc.Height = atlas.Height;
+	desc.Depth = atlas.Depth;
+	desc.Format = 26;	// DXGI_FORMAT_R11G11B10_FLOAT
+	desc.BytesPerTexel = sizeof(uint32);
+	const void* textureData[1] = { packed.data() };
+	const uint64 key = computeSkyViewLutAtlasKey(ctx.Atmosphere, config, multipleScatteringFactor);
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	if (!writeLutCacheEntry(filepath, key, 1, &desc, textureData))
+	{
+		fprintf(stderr, "Failed to write %s\n", filepath);
+		return 1;
+	}
+	printf("LUT cache entry written to %s (%.1f MB)\n", filepath, double(desc.getDepthPitch()) * desc.Depth / (1024.0 * 1024.0));
+	return 0;
+}
+
+// Relative RMSE of a sky view LUT against another one.
+static double getSkyViewLutRelativeRmse(const CpuLut2D& lut, const CpuLut2D& reference)
+{
+	double errorSum = 0.0;
+	double referenceSum = 0.0;
+	for (size_t i = 0; i < reference.Data.size(); ++i)
+	{
+		if ((i & 3) != 3)
+		{
+			const double diff = double(lut.Data[i]) - double(reference.Data[i]);
+			errorSum += diff * diff;
+			referenceSum += double(reference.Data[i]) * double(reference.Data[i]);
+		}
+	}
+	return referenceSum > 0.0 ? sqrt(errorSum / referenceSum) : 0.0;
+}
+
+// Memory, bake time and error of time of day sky view LUT atlas layouts. The error is the relative RMSE of the blended LUT, R11G11B10 rounding
+// included, against the sky view LUT baked for the exact camera height and sun elevation, over twilight, daylight and altitude sweeps.
+// The blend cost is compared to the ray marched LUT the atlas replaces.
+static int commandBenchSkyViewAtlas(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_view_atlas.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+
+	const AtmosphereInfo& info = ctx.Atmosphere;
+	const SkyLutConfig defaultConfig;
+	CpuThreadPool pool(ctx.ThreadCount);
+	SkyViewLutAtlasInputs inputs;
+	bakeSkyViewLutAtlasInputs(pool, info, defaultConfig, 1.0f, inputs);
+
+	struct Sweep
+	{
+		const char* Name;
+		std::vector<float> CameraHeights;		// Kilometers
+		std::vector<float> SunElevations;		// Degrees
+	};
+	const Sweep sweeps[] = {
+		{ "twilight",	{ 0.5f, 5.0f },					{ -6.0f, -4.5f, -3.0f, -1.5f, -0.5f, 0.5f, 1.5f, 3.0f, 4.5f, 6.0f } },
+		{ "day",		{ 0.5f, 5.0f },					{ 10.0f, 25.0f, 45.0f, 70.0f } },
+		{ "altitude",	{ 1.7f, 12.0f, 30.0f, 55.0f },	{ 2.0f, 20.0f } },
+	};
+	const uint32 SweepCount = uint32(sizeof(sweeps) / sizeof(sweeps[0]));
+	const uint32 sunAngleCounts[] = { 8, 16, 32, 64 };
+	const uint32 heightBandCounts[] = { 4, 8, 16 };
+
+	// Exact LUTs
+	struct Sample
+	{
+		float CameraHeight;
+		float SunElevation;		// Radians
+		CpuLut2D Lut;
+	};
+	std::vector<Sample> samples[SweepCount];
+	double exactBakeSeconds = 0.0;
+	for (uint32 s = 0; s < SweepCount; ++s)
+	{
+		for (float height : sweeps[s].CameraHeights)
+		{
+			for (float elevation : sweeps[s].SunElevations)
+			{
+				Sample sample;
+				sample.CameraHeight = height;
+				sample.SunElevation = elevation * PI / 180.0f;
+				bakeSkyViewLut(pool, info, inputs.TransmittanceLut, sample.CameraHeight, sinf(sample.SunElevation), defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight,
+					30.0f, inputs.Options, sample.Lut);
+				samples[s].push_back(sample);
+			}
+		}
+	}
+	exactBakeSeconds = timeBake(iterations, [&]()
+	{
+		CpuLut2D lut;
+		bakeSkyViewLut(pool, info, inputs.TransmittanceLut, 0.5f, sinf(0.02f), defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight, 30.0f, inputs.Options, lut);
+	}).BestSeconds;
+
+	struct Result
+	{
+		uint32 SunAngleCount = 0;
+		uint32 HeightBandCount = 0;
+		double MegaBytes = 0.0;
+		double BakeSeconds = 0.0;
+		double BlendSeconds = 0.0;		// Single thread
+		double MeanErrors[SweepCount] = {};
+		double MaxErrors[SweepCount] = {};
+	};
+	std::vector<Result> results;
+	for (uint32 heightBandCount : heightBandCounts)
+	{
+		for (uint32 sunAngleCount : sunAngleCounts)
+		{
+			SkyLutConfig config = defaultConfig;
+			config.SkyViewAtlasSunAngleCount = sunAngleCount;
+			config.SkyViewAtlasHeightBandCount = heightBandCount;
+
+			Result result;
+			result.SunAngleCount = sunAngleCount;
+			result.HeightBandCount = heightBandCount;
+			result.MegaBytes = double(config.SkyViewWidth) * config.SkyViewHeight * sunAngleCount * heightBandCount * sizeof(uint32) / (1024.0 * 1024.0);
+			CpuLut3D atlas;
+			auto start = std::chrono::high_resolution_clock::now();
+			bakeSkyViewLutAtlas(pool, info, inputs.TransmittanceLut, config, 30.0f, inputs.Options, atlas);
+			auto end = std::chrono::high_resolution_clock::now();
+			result.BakeSeconds = std::chrono::duration<double>(end - start).count();
+			quantizeSkyViewLutAtlas(atlas);
+
+			CpuLut2D blended;
+			result.BlendSeconds = timeBake(iterations, [&]()
+			{
+				blendSkyViewLutAtlas(atlas, config, 0.5f, 0.02f, blended);
+			}).BestSeconds;
+			for (uint32 s = 0; s < SweepCount; ++s)
+			{
+				for (const Sample& sample : samples[s])
+				{
+					blendSkyViewLutAtlas(atlas, config, sample.CameraHeight, sample.SunElevation, blended);
+					const double error = getSkyViewLutRelativeRmse(blended, sample.Lut);
+					result.MeanErrors[s] += error / double(samples[s].size());
+					result.MaxErrors[s] = (std::max)(result.MaxErrors[s], error);
+				}
+			}
+			results.push_back(result);
+		}
+	}
+
+	printf("%u thread(s), %s, sky view LUT %ux%u baked in %.3f ms, sun elevations from %.3f rad, heights from %g to %g km\n", pool.getThreadCount(),
+		CPU_SIMD_AVX2 ? "AVX2" : "scalar", defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight, exactBakeSeconds * 1000.0,
+		defaultConfig.SkyViewAtlasMinSunElevation, defaultConfig.SkyViewAtlasMinCameraHeight, defaultConfig.SkyViewAtlasMaxCameraHeight);
+	printf("  angles  bands  memory MB  bake s  blend ms");
+	for (const Sweep& sweep : sweeps)
+	{
+		printf("  %8s mean/max", sweep.Name);
+	}
+	printf("\n");
+	for (const Result& result : results)
+	{
+		printf("  %6u  %5u  %9.1f  %6.2f  %8.3f", result.SunAngleCount, result.HeightBandCount, result.MegaBytes, result.BakeSeconds, result.BlendSeconds * 1000.0);
+		for (uint32 s = 0; s < SweepCount; ++s)
+		{
+			printf("  %8.4f/%-8.4f", result.MeanErrors[s], result.MaxErrors[s]);
+		}
+		printf("\n");
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"skyView\": [%u, %u],\n", defaultConfig.SkyViewWidth, defaultConfig.SkyViewHeight);
+	fprintf(file, "\t\"skyViewBestMs\": %.6f,\n", exactBakeSeconds * 1000.0);
+	fprintf(file, "\t\"minSunElevation\": %g,\n", defaultConfig.SkyViewAtlasMinSunElevation);
+	fprintf(file, "\t\"minCameraHeight\": %g,\n", defaultConfig.SkyViewAtlasMinCameraHeight);
+	fprintf(file, "\t\"maxCameraHeight\": %g,\n", defaultConfig.SkyViewAtlasMaxCameraHeight);
+	fprintf(file, "\t\"sweeps\": [");
+	for (uint32 s = 0; s < SweepCount; ++s)
+	{
+		fprintf(file, "%s{ \"name\": \"%s\", \"cameraHeights\": [", s > 0 ? ", " : "", sweeps[s].Name);
+		for (size_t i = 0; i < sweeps[s].CameraHeights.size(); ++i)
+		{
+			fprintf(file, "%s%g", i > 0 ? ", " : "", sweeps[s].CameraHeights[i]);
+		}
+		fprintf(file, "], \"sunElevationsDegrees\": [");
+		for (size_t i = 0; i < sweeps[s].SunElevations.size(); ++i)
+		{
+			fprintf(file, "%s%g", i > 0 ? ", " : "", sweeps[s].SunElevations[i]);
+		}
+		fprintf(file, "] }");
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t r = 0; r < results.size(); ++r)
+	{
+		const Result& result = results[r];
+		fprintf(file, "\t\t{ \"sunAngles\": %u, \"heightBands\": %u, \"megaBytes\": %.3f, \"bakeSeconds\": %.3f, \"blendBestMs\": %.6f, \"meanRelativeRmse\": [",
+			result.SunAngleCount, result.HeightBandCount, result.MegaBytes, result.BakeSeconds, result.BlendSeconds * 1000.0);
+		for (uint32 s = 0; s < SweepCount; ++s)
+		{
+			fprintf(file, "%s%.6e", s > 0 ? ", " : "", result.MeanErrors[s]);
+		}
+		fprintf(file, "], \"maxRelativeRmse\": [");
+		for (uint32 s = 0; s < SweepCount; ++s)
+		{
+			fprintf(file, "%s%.6e", s > 0 ? ", " : "", result.MaxErrors[s]);
+		}
+		fprintf(file, "] }%s\n", r + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return 0;
+}
+
+// Irradiance of the normals from DirectionCount ray marched directions, for the same setup as projectSkyRadianceSH.
+static void computeSkyIrradianceReference(const SkyRadianceLuts& luts, const SkyRadianceSettings& settings, float CameraHeight, float SunZenithCosAngle,
+	uint32 DirectionCount, const GlslVec3* normals, uint32 normalCount, GlslVec3* irradiances)
+{
+	const CpuAtmosphereParameters& Atmosphere = luts.Atmosphere;
+	const float8x3 SunDir = splat8x3(GlslVec3{ sqrtf(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle });
+	IntegrateScatteredLuminanceOptions Options;
+	Options.MultiScatLut = settings.MultipleScattering ? &luts.MultiScatLut : nullptr;
+	Options.VariableSampleCount = true;
+	Options.RayMarchMinMaxSPP[0] = settings.RayMarchMinMaxSPP[0];
+	Options.RayMarchMinMaxSPP[1] = settings.RayMarchMinMaxSPP[1];
+	const float weight = 4.0f * PI / float(DirectionCount);
+	for (uint32 n = 0; n < normalCount; ++n)
+	{
+		irradiances[n] = splat3(0.0f);
+	}
+	for (uint32 b = 0; b < DirectionCount / CPU_SIMD_WIDTH; ++b)
+	{
+		GlslVec3 dirs[CPU_SIMD_WIDTH];
+		float px[CPU_SIMD_WIDTH], py[CPU_SIMD_WIDTH], pz[CPU_SIMD_WIDTH], dx[CPU_SIMD_WIDTH], dy[CPU_SIMD_WIDTH], dz[CPU_SIMD_WIDTH];
+		for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+		{
+			const uint32 i = b * CPU_SIMD_WIDTH + l;
+			const float cosTheta = 1.0f - 2.0f * (float(i) + 0.5f) / float(DirectionCount);
+			const float sinTheta = sqrtf(saturate(1.0f - cosTheta * cosTheta));
+			const float phi = 2.39996323f * float(i);
+			dirs[l] = { sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta };
+			GlslVec3 WorldPos = { 0.0f, 0.0f, Atmosphere.BottomRadius + CameraHeight };
+			MoveToTopAtmosphere(WorldPos, dirs[l], Atmosphere.TopRadius);
+			px[l] = WorldPos.x; py[l] = WorldPos.y; pz[l] = WorldPos.z;
+			dx[l] = dirs[l].x; dy[l] = dirs[l].y; dz[l] = dirs[l].z;
+		}
+		const float8x3 WorldPos = { load8(px), load8(py), load8(pz) };
+		const float8x3 WorldDir = { load8(dx), load8(dy), load8(dz) };
+		const SingleScatteringResult8 ss = IntegrateScatteredLuminance8(Atmosphere, luts.TransmittanceLut, WorldPos, WorldDir, SunDir, true, 0.0f, true, Options);
+		float L[3][CPU_SIMD_WIDTH];
+		for (int c = 0; c < 3; ++c)
+		{
+			store8(L[c], ss.L[c]);
+		}
+		for (uint32 l = 0; l < CPU_SIMD_WIDTH; ++l)
+		{
+			for (uint32 n = 0; n < normalCount; ++n)
+			{
+				irradiances[n] += GlslVec3{ L[0][l], L[1][l], L[2][l] } * ((std::max)(0.0f, dot(normals[n], dirs[l])) * weight);
+			}
+		}
+	}
+}
+
+// Cost and accuracy of the sky luminance SH cache (SkyIrradianceCache). Reports the bake time of all the bins from the ray marcher and from
+// the time of day sky view LUT atlas, the probe update throughput, and the irradiance error against a 16384 directions ray marched
+// reference for order 2 and order 3 SH: projected at the exact height and sun angle, and blended by the cache.
+static int commandBenchSkyIrradianceSH(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_irradiance_sh.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+	const uint32 ProbeCount = 100000;
+	const uint32 ReferenceDirectionCount = 16384;
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	const SkyLutConfig config;
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	SkyRadianceSettings settings;
+
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+		{ "twilight",	0.5f,	-0.05f },
+		{ "altitude",	10.0f,	0.2f },
+	};
+	const uint32 ViewCount = uint32(sizeof(views) / sizeof(views[0]));
+	const GlslVec3 normals[] = {
+		{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+		normalize(GlslVec3{ 1.0f, 0.0f, 1.0f }), normalize(GlslVec3{ -1.0f, 0.0f, 1.0f }) };
+	const uint32 NormalCount = uint32(sizeof(normals) / sizeof(normals[0]));
+
+	// Bakes
+	SkyIrradianceCache rayMarchedCache;
+	const double rayMarchedBakeSeconds = timeBake(iterations, [&]()
+	{
+		rayMarchedCache.bake(pool, luts, settings, config);
+	}).BestSeconds;
+	SkyViewLutAtlasInputs atlasInputs;
+	bakeSkyViewLutAtlasInputs(pool, ctx.Atmosphere, config, 1.0f, atlasInputs);
+	CpuLut3D atlas;
+	bakeSkyViewLutAtlas(pool, ctx.Atmosphere, atlasInputs.TransmittanceLut, config, 30.0f, atlasInputs.Options, atlas);
+	SkyIrradianceCache atlasCache;
+	const double atlasBakeSeconds = timeBake(iterations, [&]()
+	{
+		atlasCache.bakeFromSkyViewLutAtlas(pool, luts.Atmosphere, atlas, config);
+	}).BestSeconds;
+
+	// Probe updates: random positions and sun directions, one cache lookup and one irradiance evaluation each
+	uint32 seed = 1;
+	auto random01 = [&seed]()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return float(seed >> 8) * (1.0f / 16777216.0f);
+	};
+	std::vector<GlslVec3> probePositions(ProbeCount);
+	std::vector<GlslVec3> probeSunDirs(ProbeCount);
+	for (uint32 p = 0; p < ProbeCount; ++p)
+	{
+		probePositions[p] = { 10.0f * random01() - 5.0f, 10.0f * random01() - 5.0f, 20.0f * random01() * random01() };
+		const float elevation = -0.2f + 1.7f * random01();
+		const float azimuth = 2.0f * PI * random01();
+		probeSunDirs[p] = { cosf(elevation) * cosf(azimuth), cosf(elevation) * sinf(azimuth), sinf(elevation) };
+	}
+	std::vector<GlslVec3> probeIrradiances(ProbeCount);
+	const BakeTimings lookupTimings = timeBake(iterations, [&]()
+	{
+		for (uint32 p = 0; p < ProbeCount; ++p)
+		{
+			SkyLuminanceSH sh;
+			rayMarchedCache.lookup(probePositions[p], probeSunDirs[p], sh);
+			probeIrradiances[p] = evaluateSHIrradiance(sh, GlslVec3{ 0.0f, 0.0f, 1.0f });
+		}
+	});
+	const double probesPerSecond = double(ProbeCount) / lookupTimings.BestSeconds;
+	size_t invalidCount = 0;
+	for (const GlslVec3& irradiance : probeIrradiances)
+	{
+		invalidCount += std::isfinite(irradiance.x + irradiance.y + irradiance.z) ? 0 : 1;
+	}
+
+	// Accuracy: absolute irradiance luminance errors summed over the normals, relative to the summed reference. Per normal relative errors
+	// would be dominated by the dark ground seen by the down normal.
+	enum { SHExactOrder2 = 0, SHExactOrder3, SHCacheOrder3, SHAtlasCacheOrder3, SHVariantCount };
+	const char* variantNames[SHVariantCount] = { "exact order 2", "exact order 3", "cache order 3", "atlas cache order 3" };
+	double errors[SHVariantCount][ViewCount] = {};
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		const float SunZenithCosAngle = sinf(views[v].SunElevation);
+		GlslVec3 reference[NormalCount];
+		computeSkyIrradianceReference(luts, settings, views[v].CameraHeight, SunZenithCosAngle, ReferenceDirectionCount, normals, NormalCount, reference);
+		SkyLuminanceSH exact, cached, atlasCached;
+		projectSkyRadianceSH(luts, settings, views[v].CameraHeight, SunZenithCosAngle, 256, true, exact);
+		const GlslVec3 probePos = { 0.0f, 0.0f, views[v].CameraHeight };
+		const GlslVec3 sunDir = { cosf(views[v].SunElevation), 0.0f, SunZenithCosAngle };
+		rayMarchedCache.lookup(probePos, sunDir, cached);
+		atlasCache.lookup(probePos, sunDir, atlasCached);
+		double referenceSum = 0.0;
+		for (uint32 n = 0; n < NormalCount; ++n)
+		{
+			const GlslVec3 irradiances[SHVariantCount] = {
+				evaluateSHIrradiance(exact, normals[n], 2), evaluateSHIrradiance(exact, normals[n], 3),
+				evaluateSHIrradiance(cached, normals[n], 3), evaluateSHIrradiance(atlasCached, normals[n], 3) };
+			referenceSum += double(mean(reference[n]));
+			for (uint32 i = 0; i < SHVariantCount; ++i)
+			{
+				errors[i][v] += fabs(double(mean(irradiances[i])) - double(mean(reference[n])));
+			}
+		}
+		for (uint32 i = 0; i < SHVariantCount; ++i)
+		{
+			errors[i][v] /= referenceSum;
+		}
+	}
+
+	printf("%u thread(s), %s, %u x %u bins of %u directions\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar",
+		config.SkyViewAtlasHeightBandCount, config.SkyViewAtlasSunAngleCount, 256);
+	printf("  Bake: %.3f ms ray marched, %.3f ms from the sky view LUT atlas\n", rayMarchedBakeSeconds * 1000.0, atlasBakeSeconds * 1000.0);
+	printf("  Probe updates: %.2f M/s on 1 thread (%zu invalid)\n", probesPerSecond / 1e6, invalidCount);
+	printf("  Irradiance relative error  ");
+	for (const SkyLutTuningView& view : views)
+	{
+		printf("  %8s", view.Name);
+	}
+	printf("\n");
+	for (uint32 i = 0; i < SHVariantCount; ++i)
+	{
+		printf("  %-26s", variantNames[i]);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			printf("  %8.4f", errors[i][v]);
+		}
+		printf("\n");
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"bins\": [%u, %u],\n", config.SkyViewAtlasHeightBandCount, config.SkyViewAtlasSunAngleCount);
+	fprintf(file, "\t\"rayMarchedBakeBestMs\": %.6f,\n", rayMarchedBakeSeconds * 1000.0);
+	fprintf(file, "\t\"atlasBakeBestMs\": %.6f,\n", atlasBakeSeconds * 1000.0);
+	fprintf(file, "\t\"probeUpdatesPerSecond\": %.1f,\n", probesPerSecond);
+	fprintf(file, "\t\"views\": [");
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		fprintf(file, "%s{ \"name\": \"%s\", \"cameraHeight\": %g, \"sunElevation\": %g }", v > 0 ? ", " : "",
+			views[v].Name, views[v].CameraHeight, views[v].SunElevation);
+	}
+	fprintf(file, "],\n");
+	fprintf(file, "\t\"relativeErrors\": [\n");
+	for (uint32 i = 0; i < SHVariantCount; ++i)
+	{
+		fprintf(file, "\t\t{ \"variant\": \"%s\", \"errors\": [", variantNames[i]);
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			fprintf(file, "%s%.6e", v > 0 ? ", " : "", errors[i][v]);
+		}
+		fprintf(file, "] }%s\n", i + 1 < SHVariantCount ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return invalidCount == 0 ? 0 : 1;
+}
+
+double getCubemapRelativeError(const CpuCubemap& cubemap, const CpuCubemap& reference, uint32 mip)
+{
+	double errorSum = 0.0;
+	double referenceSum = 0.0;
+	for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+	{
+		const std::vector<float>& data = cubemap.face(mip, f).Data;
+		const std::vector<float>& referenceData = reference.face(mip, f).Data;
+		for (size_t t = 0; t < data.size(); t += 4)
+		{
+			const double L = (double(data[t]) + data[t + 1] + data[t + 2]) / 3.0;
+			const double referenceL = (double(referenceData[t]) + referenceData[t + 1] + referenceData[t + 2]) / 3.0;
+			errorSum += fabs(L - referenceL);
+			referenceSum += referenceL;
+		}
+	}
+	return referenceSum > 0.0 ? errorSum / referenceSum : 0.0;
+}
+
+static bool parseSkyCubemapSource(const char* name, SkyCubemapSource& out)
+{
+	const char* names[SkyCubemapSourceCount] = { "lut", "raymarching" };
+	for (int s = 0; s < SkyCubemapSourceCount; ++s)
+	{
+		if (strcmp(name, names[s]) == 0)
+		{
+			out = SkyCubemapSource(s);
+			return true;
+		}
+	}
+	fprintf(stderr, "Unknown cubemap source %s (lut or raymarching)\n", name);
+	return false;
+}
+
+// Sky cubemap with its GGX prefiltered mips (SkyCubemapCapture) for a camera height (kilometers) and sun elevation (radians), the sun
+// being toward +x. Written as a DDS cubemap, and with exrPrefix as one EXR per mip, the six faces side by side in the D3D order.
+static int commandBakeSkyCubemap(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0);
+	if (!outFile)
+	{
+		fprintf(stderr, "bake-sky-cubemap: missing output file\n");
+		return 1;
+	}
+	SkyCubemapSettings cubemapSettings;
+	if (!parseSkyCubemapSource(ctx.arg(1, "lut"), cubemapSettings.Source))
+	{
+		return 1;
+	}
+	cubemapSettings.Size = uint32((std::max)(4, atoi(ctx.arg(2, "128"))));
+	const float cameraHeight = float(atof(ctx.arg(3, "0.5")));
+	const float sunElevation = float(atof(ctx.arg(4, "0.45")));
+	const char* exrPrefix = ctx.arg(5);
+	cubemapSettings.MipCount = 1;
+	while (cubemapSettings.MipCount < 6 && (cubemapSettings.Size >> cubemapSettings.MipCount) >= 4)
+	{
+		cubemapSettings.MipCount++;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	const SkyRadianceSettings settings;
+	SkyCubemapCapture capture;
+	const auto start = std::chrono::high_resolution_clock::now();
+	capture.update(pool, ctx.Atmosphere, luts, settings, cubemapSettings, GlslVec3{ 0.0f, 0.0f, cameraHeight },
+		GlslVec3{ cosf(sunElevation), 0.0f, sinf(sunElevation) });
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const CpuCubemap& cubemap = capture.getCubemap();
+	size_t invalidCount = 0;
+	for (const CpuLut2D& face : cubemap.Faces)
+	{
+		invalidCount += countInvalidValues(face.Data);
+	}
+	printf("Sky cubemap %u^2 x %u mips from the %s source in %.2f ms on %u thread(s), %zu invalid values\n", cubemap.Size, cubemap.MipCount,
+		getSkyCubemapSourceName(cubemapSettings.Source), seconds * 1000.0, pool.getThreadCount(), invalidCount);
+	if (!saveCubemapDds(cubemap, outFile))
+	{
+		return 1;
+	}
+	printf("Cubemap written to %s\n", outFile);
+	for (uint32 m = 0; exrPrefix && m < cubemap.MipCount; ++m)
+	{
+		const uint32 mipSize = cubemap.face(m, 0).Width;
+		CpuLut2D strip;
+		strip.Allocate(mipSize * SKY_CUBEMAP_FACE_COUNT, mipSize);
+		for (uint32 f = 0; f < SKY_CUBEMAP_FACE_COUNT; ++f)
+		{
+			for (uint32 y = 0; y < mipSize; ++y)
+			{
+				memcpy(strip.texel(f * mipSize, y), cubemap.face(m, f).texel(0, y), mipSize * 4 * sizeof(float));
+			}
+		}
+		const std::string filename = std::string(exrPrefix) + "_mip" + std::to_string(m) + ".exr";
+		if (!saveLutExr(strip, filename.c_str()))
+		{
+			return 1;
+		}
+		printf("Mip %u (roughness %.2f) written to %s\n", m, getSkyCubemapMipRoughness(m, cubemap.MipCount), filename.c_str());
+	}
+	return invalidCount == 0 ? 0 : 1;
+}
+
+// Cost and accuracy of the sky cubemap. Reports the render time of mip 0 from each source and the GGX prefilter time, the error of the
+// sky view LUT source against ray marching and of the prefilter against one with 16 times more samples, and a time of day sweep through
+// SkyCubemapCapture: how many frames render the cubemap again, and the error of the kept cubemap against the current sun.
+static int commandBenchSkyCubemap(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0, "sky_cubemap.json");
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "3")));
+	const uint32 SweepFrameCount = 300;
+	const uint32 ReferenceSampleCount = 1024;
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	SkyRadianceLuts luts;
+	bakeSkyRadianceLuts(pool, ctx.Atmosphere, ctx.LutInfo, ctx.MultiScatteringLUTRes, 1.0f, luts);
+	const SkyRadianceSettings settings;
+	const SkyCubemapSettings cubemapSettings;
+	IntegrateScatteredLuminanceOptions Options;
+	Options.MultiScatLut = &luts.MultiScatLut;
+	Options.VariableSampleCount = true;
+	Options.RayMarchMinMaxSPP[0] = settings.RayMarchMinMaxSPP[0];
+	Options.RayMarchMinMaxSPP[1] = settings.RayMarchMinMaxSPP[1];
+
+	const SkyLutTuningView views[] = {
+		{ "noon",		0.5f,	0.45f },
+		{ "sunset",		0.5f,	0.02f },
+		{ "twilight",	0.5f,	-0.05f },
+		{ "altitude",	10.0f,	0.2f },
+	};
+	const uint32 ViewCount = uint32(sizeof(views) / sizeof(views[0]));
+
+	// Timings, for the noon view
+	CpuCubemap lutCubemap, rayMarchedCubemap, referenceCubemap;
+	lutCubemap.Allocate(cubemapSettings.Size, cubemapSettings.MipCount);
+	rayMarchedCubemap.Allocate(cubemapSettings.Size, cubemapSettings.MipCount);
+	referenceCubemap.Allocate(cubemapSettings.Size, cubemapSettings.MipCount);
+	CpuLut2D skyViewLut;
+	auto renderLutCubemap = [&](const SkyLutTuningView& view)
+	{
+		const GlslVec3 sunDir = { cosf(view.SunElevation), 0.0f, sinf(view.SunElevation) };
+		bakeSkyViewLut(pool, ctx.Atmosphere, luts.TransmittanceLut, view.CameraHeight, sunDir.z, cubemapSettings.SkyViewWidth, cubemapSettings.SkyViewHeight, 0.0f, Options, skyViewLut);
+		renderSkyCubemapFromSkyViewLut(pool, luts.Atmosphere, skyViewLut, view.CameraHeight, sunDir, settings.SunIlluminance, lutCubemap);
+	};
+	auto renderRayMarchedCubemap = [&](const SkyLutTuningView& view)
+	{
+		renderSkyCubemapRayMarched(pool, luts, settings, view.CameraHeight, GlslVec3{ cosf(view.SunElevation), 0.0f, sinf(view.SunElevation) }, rayMarchedCubemap);
+	};
+	const double lutRenderSeconds = timeBake(iterations, [&]() { renderLutCubemap(views[0]); }).BestSeconds;
+	const double rayMarchedRenderSeconds = timeBake(iterations, [&]() { renderRayMarchedCubemap(views[0]); }).BestSeconds;
+	const double prefilterSeconds = timeBake(iterations, [&]() { prefilterSkyCubemapGGX(pool, cubemapSettings.SampleCount, lutCubemap); }).BestSeconds;
+
+	// Accuracy
+	double lutErrors[ViewCount];
+	std::vector<double> prefilterErrors(size_t(ViewCount) * cubemapSettings.MipCount, 0.0);
+	size_t invalidCount = 0;
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		renderLutCubemap(views[v]);
+		renderRayMarchedCubemap(views[v]);
+		lutErrors[v] = getCubemapRelativeError(lutCubemap, rayMarchedCubemap, 0);
+		referenceCubemap.Faces = rayMarchedCubemap.Faces;
+		prefilterSkyCubemapGGX(pool, cubemapSettings.SampleCount, rayMarchedCubemap);
+		prefilterSkyCubemapGGX(pool, ReferenceSampleCount, referenceCubemap);
+		for (uint32 m = 1; m < cubemapSettings.MipCount; ++m)
+		{
+			prefilterErrors[v * cubemapSettings.MipCount + m] = getCubemapRelativeError(rayMarchedCubemap, referenceCubemap, m);
+		}
+		for (const CpuLut2D& face : rayMarchedCubemap.Faces)
+		{
+			invalidCount += countInvalidValues(face.Data);
+		}
+	}
+
+	// Time of day sweep: the sun rises from below the horizon and turns a little, about 0.002 radians per frame
+	SkyCubemapCapture capture;
+	double sweepSeconds = 0.0;
+	double maxStaleError = 0.0;
+	for (uint32 frame = 0; frame < SweepFrameCount; ++frame)
+	{
+		const float t = float(frame) / float(SweepFrameCount - 1);
+		const float sunElevation = -0.1f + 0.6f * t;
+		const float sunAzimuth = 0.3f * t;
+		const GlslVec3 sunDir = { cosf(sunElevation) * cosf(sunAzimuth), cosf(sunElevation) * sinf(sunAzimuth), sinf(sunElevation) };
+		const auto start = std::chrono::high_resolution_clock::now();
+		const bool rendered = capture.update(pool, ctx.Atmosphere, luts, settings, cubemapSettings, GlslVec3{ 0.0f, 0.0f, 0.5f }, sunDir);
+		sweepSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		if (!rendered && frame % 10 == 0)
+		{
+			bakeSkyViewLut(pool, ctx.Atmosphere, luts.TransmittanceLut, 0.5f, sunDir.z, cubemapSettings.SkyViewWidth, cubemapSettings.SkyViewHeight, 0.0f, Options, skyViewLut);
+			renderSkyCubemapFromSkyViewLut(pool, luts.Atmosphere, skyViewLut, 0.5f, sunDir, settings.SunIlluminance, lutCubemap);
+			maxStaleError = (std::max)(maxStaleError, getCubemapRelativeError(capture.getCubemap(), lutCubemap, 0));
+		}
+	}
+	const uint32 renderCount = capture.getRenderCount();
+
+	printf("%u thread(s), %s, %u^2 x %u mips, %u GGX samples\n", pool.getThreadCount(), CPU_SIMD_AVX2 ? "AVX2" : "scalar",
+		cubemapSettings.Size, cubemapSettings.MipCount, cubemapSettings.SampleCount);
+	printf("  Mip 0: %.3f ms from a sky view LUT (bake included), %.3f ms ray marched\n", lutRenderSeconds * 1000.0, rayMarchedRenderSeconds * 1000.0);
+	printf("  GGX prefilter: %.3f ms\n", prefilterSeconds * 1000.0);
+	printf("  Sweep: %u renders over %u frames, %.3f ms per frame on average, stale cubemap error up to %.4f\n", renderCount, SweepFrameCount,
+		sweepSeconds * 1000.0 / SweepFrameCount, maxStaleError);
+	printf("  Relative error             ");
+	for (const SkyLutTuningView& view : views)
+	{
+		printf("  %8s", view.Name);
+	}
+	printf("\n  %-26s", "sky view LUT mip 0");
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		printf("  %8.4f", lutErrors[v]);
+	}
+	printf("\n");
+	for (uint32 m = 1; m < cubemapSettings.MipCount; ++m)
+	{
+		printf("  prefilter mip %u (r = %.1f)  ", m, getSkyCubemapMipRoughness(m, cubemapSettings.MipCount));
+		for (uint32 v = 0; v < ViewCount; ++v)
+		{
+			printf("  %8.4f", prefilterErrors[v * cubemapSettings.MipCount + m]);
+		}
+		printf("\n");
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"iterations\": %d,\n", iterations);
+	fprintf(file, "\t\"size\": %u,\n", cubemapSettings.Size);
+	fprintf(file, "\t\"mipCount\": %u,\n", cubemapSettings.MipCount);
+	fprintf(file, "\t\"sampleCount\": %u,\n", cubemapSettings.SampleCount);
+	fprintf(file, "\t\"lutRenderBestMs\": %.6f,\n", lutRenderSeconds * 1000.0);
+	fprintf(file, "\t\"rayMarchedRenderBestMs\": %.6f,\n", rayMarchedRenderSeconds * 1000.0);
+	fprintf(file, "\t\"prefilterBestMs\": %.6f,\n", prefilterSeconds * 1000.0);
+	fprintf(file, "\t\"sweep\": { \"frames\": %u, \"renders\": %u, \"avgFrameMs\": %.6f, \"maxStaleError\": %.6e },\n", SweepFrameCount, renderCount,
+		sweepSeconds * 1000.0 / SweepFrameCount, maxStaleError);
+	fprintf(file, "\t\"views\": [\n");
+	for (uint32 v = 0; v < ViewCount; ++v)
+	{
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"cameraHeight\": %g, \"sunElevation\": %g, \"lutError\": %.6e, \"prefilterErrors\": [", views[v].Name,
+			views[v].CameraHeight, views[v].SunElevation, lutErrors[v]);
+		for (uint32 m = 1; m < cubemapSettings.MipCount; ++m)
+		{
+			fprintf(file, "%s%.6e", m > 1 ? ", " : "", prefilterErrors[v * cubemapSettings.MipCount + m]);
+		}
+		fprintf(file, "] }%s\n", v + 1 < ViewCount ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return invalidCount == 0 ? 0 : 1;
+}
+
+CpuPathTracingSettings getDefaultPathTracingSettings(uint32 width, uint32 height)
+{
+	CpuPathTracingSettings settings;
+	settings.Width = width;
+	settings.Height = height;
+	settings.Camera = getGameCamera(0.0f, 0.0f, 0.5f, -1.0f);
+	settings.SunDir = getGameSunDirection(0.45f, 0.0f);
+	return settings;
+}
+
+// Path traced reference image from the application default view.
+static int commandRenderPathTracing(CpuSkyToolsContext& ctx)
+{
+	const char* outFile = ctx.arg(0);
+	if (!outFile)
+	{
+		fprintf(stderr, "render-pathtracing: missing output file\n");
+		return 1;
+	}
+	const char* transmittanceFile = ctx.arg(4);
+
+	CpuPathTracingSettings settings = getDefaultPathTracingSettings(uint32((std::max)(1, atoi(ctx.arg(2, "640")))), uint32((std::max)(1, atoi(ctx.arg(3, "360")))));
+	settings.SamplesPerPixel = uint32((std::max)(1, atoi(ctx.arg(1, "64"))));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+
+	CpuLut2D luminance;
+	CpuLut2D transmittance;
+	const auto start = std::chrono::high_resolution_clock::now();
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, luminance, transmittance);
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	const size_t invalidCount = countInvalidValues(luminance.Data) + countInvalidValues(transmittance.Data);
+	printf("Path traced %ux%u at %u spp in %.2f s on %u thread(s): %.2f Msamples/s, %zu invalid values\n", settings.Width, settings.Height,
+		settings.SamplesPerPixel, seconds, pool.getThreadCount(), double(settings.Width) * settings.Height * settings.SamplesPerPixel / seconds * 1e-6, invalidCount);
+	if (!saveLutExr(luminance, outFile) || (transmittanceFile && !saveLutExr(transmittance, transmittanceFile)))
+	{
+		return 1;
+	}
+	printf("Luminance written to %s\n", outFile);
+	if (transmittanceFile)
+	{
+		printf("Transmittance written to %s\n", transmittanceFile);
+	}
+	return invalidCount == 0 ? 0 : 1;
+}
+
+// RMSE of the default view against an independent sampling reference, for each sampler and 3 * 2^k samples per pixel.
+// Counts are multiples of 3 as the wavelength cycles over 3 consecutive samples.
+static int commandBenchSamplerConvergence(CpuSkyToolsContext& ctx)
+{
+	const uint32 maxSamplesPerPixel = uint32((std::max)(3, atoi(ctx.arg(0, "384"))));
+	const uint32 referenceSamplesPerPixel = uint32((std::max)(3, atoi(ctx.arg(1, "3072"))));
+	const uint32 width = uint32((std::max)(1, atoi(ctx.arg(2, "64"))));
+	const uint32 height = uint32((std::max)(1, atoi(ctx.arg(3, "36"))));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+
+	CpuPathTracingSettings settings = getDefaultPathTracingSettings(width, height);
+	settings.Sampler = CpuSamplerIndependent;
+	settings.Seed = 0x5eed;	// Not correlated with the measured independent sampler
+	settings.SamplesPerPixel = referenceSamplesPerPixel;
+	CpuLut2D reference, transmittance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, reference, transmittance);
+	settings.Seed = 0;
+
+	const char* samplerNames[CpuSamplerCount] = { "Hash", "Sobol Owen", "Rank-1 lattice", "Independent" };
+	std::vector<double> rmse[CpuSamplerCount];
+	for (int sampler = 0; sampler < CpuSamplerCount; ++sampler)
+	{
+		// Renders the samples missing to reach the next count only and keeps the running sum.
+		settings.Sampler = CpuSamplerType(sampler);
+		std::vector<double> sum(reference.Data.size(), 0.0);
+		uint32 renderedSamples = 0;
+		for (uint32 sampleCount = 3; sampleCount <= maxSamplesPerPixel; sampleCount *= 2)
+		{
+			CpuLut2D luminance;
+			settings.FirstSampleIndex = renderedSamples;
+			settings.SamplesPerPixel = sampleCount - renderedSamples;
+			renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, luminance, transmittance);
+			renderedSamples = sampleCount;
+
+			double squaredError = 0.0;
+			for (size_t t = 0; t < reference.Data.size(); t += 4)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					sum[t + c] += double(luminance.Data[t + c]) * settings.SamplesPerPixel;
+					const double error = sum[t + c] / sampleCount - reference.Data[t + c];
+					squaredError += error * error;
+				}
+			}
+			rmse[sampler].push_back(sqrt(squaredError / (3.0 * width * height)));
+		}
+	}
+
+	printf("Luminance RMSE, %ux%u, reference %u spp\n%6s", width, height, referenceSamplesPerPixel, "spp");
+	for (int sampler = 0; sampler < CpuSamplerCount; ++sampler)
+	{
+		printf(" %15s", samplerNames[sampler]);
+	}
+	printf("\n");
+	for (size_t i = 0; i < rmse[0].size(); ++i)
+	{
+		printf("%6u", 3u << i);
+		for (int sampler = 0; sampler < CpuSamplerCount; ++sampler)
+		{
+			printf(" %15.3e", rmse[sampler][i]);
+		}
+		printf("\n");
+	}
+
+	// Least squares slope of log(RMSE) against log(spp): -0.5 for plain Monte Carlo.
+	printf("%6s", "slope");
+	for (int sampler = 0; sampler < CpuSamplerCount; ++sampler)
+	{
+		double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+		const double n = double(rmse[sampler].size());
+		for (size_t i = 0; i < rmse[sampler].size(); ++i)
+		{
+			const double x = log(double(3u << i));
+			const double y = log((std::max)(rmse[sampler][i], 1e-30));
+			sx += x; sy += y; sxx += x * x; sxy += x * y;
+		}
+		printf(" %15.2f", n > 1.0 ? (n * sxy - sx * sy) / (n * sxx - sx * sx) : 0.0);
+	}
+	printf("\n");
+	return 0;
+}
+
+// Time to reach a relative error target on reference views, sampling all tiles until the last one converges versus adaptive sampling.
+// Tiles with rare but bright paths (e.g. forward Mie scattering close to the ground) may not converge within the sample budget:
+// both modes then stop at the budget and the speedup is the time saved by not sampling the tiles that did converge.
+static int commandBenchAdaptivePathTracing(CpuSkyToolsContext& ctx)
+{
+	CpuAdaptivePathTracingSettings adaptive;
+	adaptive.TargetRelativeError = float(atof(ctx.arg(0, "0.25")));
+	const uint32 maxSamplesPerPixel = uint32((std::max)(3, atoi(ctx.arg(1, "8192"))));
+	const uint32 width = uint32((std::max)(1, atoi(ctx.arg(2, "64"))));
+	const uint32 height = uint32((std::max)(1, atoi(ctx.arg(3, "36"))));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+
+	struct View
+	{
+		const char* Name;
+		float SunPitch;
+	};
+	const View views[] = { { "noon", 0.45f }, { "sunset", 0.02f }, { "twilight", -0.05f } };
+
+	printf("Target relative error %.3f, %ux%u, at most %u spp\n", adaptive.TargetRelativeError, width, height, maxSamplesPerPixel);
+	printf("%-10s %-9s %9s %9s %9s %10s %8s\n", "view", "mode", "seconds", "mean spp", "rounds", "converged", "speedup");
+	bool allValid = true;
+	for (const View& view : views)
+	{
+		CpuPathTracingSettings settings = getDefaultPathTracingSettings(width, height);
+		settings.SunDir = getGameSunDirection(view.SunPitch, 0.0f);
+		settings.SamplesPerPixel = maxSamplesPerPixel;
+
+		double uniformSeconds = 0.0;
+		for (int mode = 0; mode < 2; ++mode)
+		{
+			adaptive.SkipConvergedTiles = mode == 1;
+			CpuLut2D luminance, transmittance;
+			CpuAdaptivePathTracingStats stats;
+			renderPathTracingAdaptive(pool, ctx.Atmosphere, transmittanceLut, settings, adaptive, luminance, transmittance, stats);
+			allValid &= countInvalidValues(luminance.Data) == 0;
+			uniformSeconds = mode == 0 ? stats.Seconds : uniformSeconds;
+
+			char speedup[16] = "";
+			if (mode == 1)
+			{
+				snprintf(speedup, sizeof(speedup), "%.2fx", uniformSeconds / stats.Seconds);
+			}
+			printf("%-10s %-9s %9.2f %9.1f %9u %9.1f%%%s %8s\n", view.Name, mode == 0 ? "uniform" : "adaptive", stats.Seconds,
+				double(stats.SampleCount) / (double(width) * height), stats.Rounds, 100.0f * stats.ConvergedTileRatio, stats.TargetReached ? "" : "*", speedup);
+		}
+	}
+	printf("* target not reached within the sample budget, converged tiles as of the last round\n");
+	return allValid ? 0 : 1;
+}
+
+void getWavefrontPathTracingConfigs(uint32 width, uint32 height, uint32 samplesPerPixel, const CpuLut2D& multiScatLut, WavefrontPathTracingConfig configs[3])
+{
+	configs[0] = { "default", getDefaultPathTracingSettings(width, height) };
+	configs[1] = { "multiscat", getDefaultPathTracingSettings(width, height) };
+	configs[2] = { "ground_gi", getDefaultPathTracingSettings(width, height) };
+	for (int c = 0; c < 3; ++c)
+	{
+		configs[c].Settings.SamplesPerPixel = samplesPerPixel;
+	}
+	configs[1].Settings.MultiScatLut = &multiScatLut;
+	configs[2].Settings.SunDir = getGameSunDirection(0.1f, 0.0f);
+	configs[2].Settings.ScatteringMaxPathDepth = 8;
+	configs[2].Settings.GroundGlobalIllumination = true;
+	configs[2].Settings.MiePhaseImportanceSampling = true;
+	configs[2].Settings.TransmittanceMethod = CpuTransmittanceMethodDeltaTracking;
+}
+
+// Rays per second of the wavefront path tracer against the packet path tracer and a per path loop (packets of a single lane),
+// on the default view with the application settings and with ground bounces, Mie importance sampling and delta tracking shadow rays.
+// The per path loop and the wavefront trace the same paths. Packet lanes draw their random numbers together, so images are compared
+// by their mean luminance relative to the packet image.
+static int commandBenchWavefrontPathTracing(CpuSkyToolsContext& ctx)
+{
+	const uint32 samplesPerPixel = uint32((std::max)(1, atoi(ctx.arg(0, "16"))));
+	const uint32 width = uint32((std::max)(1, atoi(ctx.arg(1, "320"))));
+	const uint32 height = uint32((std::max)(1, atoi(ctx.arg(2, "180"))));
+	const char* outFile = ctx.arg(3, "wavefront_pathtracing.json");
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	CpuLut2D multiScatLut;
+	bakeMultiScatteringLut(pool, ctx.Atmosphere, transmittanceLut, ctx.MultiScatteringLUTRes, 1.0f, multiScatLut);
+
+	WavefrontPathTracingConfig configs[3];
+	getWavefrontPathTracingConfigs(width, height, samplesPerPixel, multiScatLut, configs);
+
+	enum { ModePerPath, ModePacket, ModeWavefront, ModeCount };
+	const char* modeNames[ModeCount] = { "per path", "packet", "wavefront" };
+	const CpuWavefrontSettings wavefront;
+	CpuPathTracingStats stats[3][ModeCount];
+	CpuWavefrontStats wavefrontStats[3];
+	double meanError[3][ModeCount] = {};
+	bool allValid = true;
+
+	printf("%ux%u at %u spp on %u thread(s), %s, wavefront of %u paths\n", width, height, samplesPerPixel, pool.getThreadCount(),
+		CPU_SIMD_AVX2 ? "AVX2" : "scalar", (std::min)(wavefront.WavefrontSize, width * height));
+	printf("%-10s %-10s %9s %11s %11s %9s %11s\n", "config", "mode", "seconds", "Mpaths/s", "Mrays/s", "speedup", "mean error");
+	for (int c = 0; c < 3; ++c)
+	{
+		double meanLuminance[ModeCount] = {};
+		for (int mode = 0; mode < ModeCount; ++mode)
+		{
+			CpuPathTracingSettings settings = configs[c].Settings;
+			settings.PacketLaneCount = mode == ModePerPath ? 1 : 8;
+			CpuLut2D luminance, transmittance;
+			if (mode == ModeWavefront)
+			{
+				renderPathTracingWavefront(pool, ctx.Atmosphere, transmittanceLut, settings, wavefront, luminance, transmittance, &stats[c][mode], &wavefrontStats[c]);
+			}
+			else
+			{
+				renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, luminance, transmittance, &stats[c][mode]);
+			}
+			allValid &= countInvalidValues(luminance.Data) == 0 && countInvalidValues(transmittance.Data) == 0;
+			for (uint32 i = 0; i < width * height; ++i)
+			{
+				meanLuminance[mode] += (double(luminance.Data[i * 4 + 0]) + luminance.Data[i * 4 + 1] + luminance.Data[i * 4 + 2]) / 3.0;
+			}
+		}
+
+		for (int mode = 0; mode < ModeCount; ++mode)
+		{
+			const CpuPathTracingStats& s = stats[c][mode];
+			meanError[c][mode] = meanLuminance[ModePacket] > 0.0 ? fabs(meanLuminance[mode] / meanLuminance[ModePacket] - 1.0) : 0.0;
+			printf("%-10s %-10s %9.3f %11.3f %11.3f %8.2fx %11.2e\n", configs[c].Name, modeNames[mode], s.Seconds, double(s.PathCount) / s.Seconds * 1e-6,
+				double(s.ExtendRayCount + s.ShadowRayCount) / s.Seconds * 1e-6, stats[c][ModePerPath].Seconds / s.Seconds, meanError[c][mode]);
+		}
+		printf("%-10s wavefront stages:", "");
+		for (int stage = 0; stage < CpuWavefrontStageCount; ++stage)
+		{
+			printf(" %s %.1f%%", getWavefrontStageName(CpuWavefrontStage(stage)), 100.0 * wavefrontStats[c].StageSeconds[stage] / stats[c][ModeWavefront].Seconds);
+		}
+		printf(", %u bounces over %u wavefronts\n", wavefrontStats[c].BounceCount, wavefrontStats[c].WavefrontCount);
+	}
+
+	FILE* file = fopen(outFile, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Cannot open %s\n", outFile);
+		return 1;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"threads\": %u,\n", pool.getThreadCount());
+	fprintf(file, "\t\"simd\": \"%s\",\n", CPU_SIMD_AVX2 ? "AVX2" : "scalar");
+	fprintf(file, "\t\"width\": %u,\n", width);
+	fprintf(file, "\t\"height\": %u,\n", height);
+	fprintf(file, "\t\"samplesPerPixel\": %u,\n", samplesPerPixel);
+	fprintf(file, "\t\"wavefrontSize\": %u,\n", wavefront.WavefrontSize);
+	fprintf(file, "\t\"pathsPerTask\": %u,\n", wavefront.PathsPerTask);
+	fprintf(file, "\t\"configs\": [\n");
+	for (int c = 0; c < 3; ++c)
+	{
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"modes\": [\n", configs[c].Name);
+		for (int mode = 0; mode < ModeCount; ++mode)
+		{
+			const CpuPathTracingStats& s = stats[c][mode];
+			fprintf(file, "\t\t\t{ \"mode\": \"%s\", \"seconds\": %.6f, \"paths\": %llu, \"extendRays\": %llu, \"shadowRays\": %llu, \"raysPerSecond\": %.1f, \"speedup\": %.4f, \"meanError\": %.6e }%s\n",
+				modeNames[mode], s.Seconds, (unsigned long long)s.PathCount, (unsigned long long)s.ExtendRayCount, (unsigned long long)s.ShadowRayCount,
+				double(s.ExtendRayCount + s.ShadowRayCount) / s.Seconds, stats[c][ModePerPath].Seconds / s.Seconds, meanError[c][mode], mode + 1 < ModeCount ? "," : "");
+		}
+		fprintf(file, "\t\t], \"wavefrontStageSeconds\": {");
+		for (int stage = 0; stage < CpuWavefrontStageCount; ++stage)
+		{
+			fprintf(file, "%s \"%s\": %.6f", stage > 0 ? "," : "", getWavefrontStageName(CpuWavefrontStage(stage)), wavefrontStats[c].StageSeconds[stage]);
+		}
+		fprintf(file, " }, \"wavefrontBounces\": %u }%s\n", wavefrontStats[c].BounceCount, c + 1 < 3 ? "," : "");
+	}
+	fprintf(file, "\t]\n");
+	fprintf(file, "}\n");
+	fclose(file);
+	printf("Results written to %s\n", outFile);
+	return allValid ? 0 : 1;
+}
+
+// HDR capture throughput: frames written synchronously by the calling thread, as the application used to, versus handed to
+// HdrCaptureWriter. The frame is a path traced image at 3 spp, noisy as progressive captures are, with the sample count in alpha.
+// Each submitted frame is first copied, as done from the mapped staging texture. Files are deleted afterwards.
+static int commandBenchHdrCapture(CpuSkyToolsContext& ctx)
+{
+	const uint32 frameCount = uint32((std::max)(1, atoi(ctx.arg(0, "30"))));
+	const uint32 width = uint32((std::max)(1, atoi(ctx.arg(1, "1280"))));
+	const uint32 height = uint32((std::max)(1, atoi(ctx.arg(2, "720"))));
+	const char* compressionName = ctx.arg(3, "none");
+	HdrCaptureCompression compression = HdrCaptureCompressionCount;
+	for (int c = 0; c < HdrCaptureCompressionCount; ++c)
+	{
+		std::string name = getHdrCaptureCompressionName(HdrCaptureCompression(c));
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		compression = name == compressionName ? HdrCaptureCompression(c) : compression;
+	}
+	if (compression == HdrCaptureCompressionCount)
+	{
+		fprintf(stderr, "bench-hdr-capture: unknown compression %s (none, zip or piz)\n", compressionName);
+		return 1;
+	}
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuLut2D transmittanceLut;
+	bakeTransmittanceLut(pool, ctx.Atmosphere, ctx.LutInfo, transmittanceLut);
+	CpuPathTracingSettings settings = getDefaultPathTracingSettings(width, height);
+	settings.SamplesPerPixel = 3;
+	CpuLut2D luminance, transmittance;
+	renderPathTracing(pool, ctx.Atmosphere, transmittanceLut, settings, luminance, transmittance);
+	for (size_t t = 0; t < luminance.Data.size(); ++t)
+	{
+		luminance.Data[t] *= float(settings.SamplesPerPixel);	// Accumulated as in the back buffer
+	}
+
+	auto getFilename = [](uint32 frame)
+	{
+		char filename[64];
+		snprintf(filename, sizeof(filename), "hdr_capture_bench_%05u.exr", frame);
+		return std::string(filename);
+	};
+	auto makeFrame = [&](uint32 frame)
+	{
+		HdrCaptureFrame captureFrame;
+		captureFrame.Filename = getFilename(frame);
+		captureFrame.Width = width;
+		captureFrame.Height = height;
+		captureFrame.Rgba = luminance.Data;
+		return captureFrame;
+	};
+
+	bool success = true;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32 frame = 0; frame < frameCount; ++frame)
+	{
+		success &= saveHdrCaptureExr(makeFrame(frame), compression);
+	}
+	const double syncSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	double submitSeconds = 0.0;
+	HdrCaptureWriter::Stats stats;
+	start = std::chrono::high_resolution_clock::now();
+	{
+		HdrCaptureWriter writer;
+		writer.setCompression(compression);
+		for (uint32 frame = 0; frame < frameCount; ++frame)
+		{
+			const auto submitStart = std::chrono::high_resolution_clock::now();
+			writer.submit(makeFrame(frame));
+			submitSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - submitStart).count();
+		}
+		writer.flush();
+		stats = writer.getStats();
+	}
+	const double asyncSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	success &= stats.FramesFailed == 0;
+
+	for (uint32 frame = 0; frame < frameCount; ++frame)
+	{
+		remove(getFilename(frame).c_str());
+	}
+
+	printf("%u frames of %ux%u, compression %s\n", frameCount, width, height, getHdrCaptureCompressionName(compression));
+	printf("Synchronous:  %.1f fps, %.2f ms per frame on the calling thread\n", frameCount / syncSeconds, 1000.0 * syncSeconds / frameCount);
+	printf("Asynchronous: %.1f fps, %.2f ms per frame on the calling thread (%.2f ms waiting for the queue), %.2f ms per frame on the writer thread\n",
+		frameCount / asyncSeconds, 1000.0 * submitSeconds / frameCount, 1000.0 * stats.SubmitWaitSeconds / frameCount, 1000.0 * stats.WriteSeconds / frameCount);
+	return success ? 0 : 1;
+}
+
+// Runs a capture script (see CaptureSequence.h) against a renderer without GPU to validate it and report when each capture
+// would be taken, LUTs being rebuilt in lutFrames frames and one path tracing sample being accumulated per frame.
+static int commandSimulateCaptureScript(CpuSkyToolsContext& ctx)
+{
+	const char* scriptPath = ctx.arg(0);
+	if (!scriptPath)
+	{
+		fprintf(stderr, "simulate-capture-script: missing script\n");
+		return 1;
+	}
+	const uint32 lutFrameCount = uint32((std::max)(0, atoi(ctx.arg(1, "1"))));
+
+	std::vector<CaptureShot> shots;
+	std::string error;
+	if (!loadCaptureScript(scriptPath, shots, error))
+	{
+		fprintf(stderr, "%s: %s\n", scriptPath, error.c_str());
+		return 1;
+	}
+
+	NullCaptureRenderer renderer(lutFrameCount);
+	CaptureState state;
+	buildCaptureState(shots, renderer, state);
+	do
+	{
+		renderer.renderFrame();
+	} while (updateCaptureState(state, renderer));
+
+	const char* methodNames[CaptureMethodCount] = { "bruneton2017", "pathtracing", "raymarching" };
+	for (const NullCaptureRenderer::Capture& capture : renderer.getCaptures())
+	{
+		printf("frame %5u  %-32s %-13s sun pitch %6.3f  %u path tracing samples\n", capture.Frame, capture.Filename.c_str(),
+			methodNames[capture.State.RenderingMethod], capture.State.SunPitch, capture.PathTracingSampleCount);
+	}
+	printf("%zu events, %u captures, %u timed out, %u frames\n", state.events.size(), state.capturedCount, state.timedOutCount, state.totalFrameCount);
+	return state.timedOutCount == 0 ? 0 : 1;
+}
+
+std::vector<SavedState> getStateRecordPresets(uint32 count)
+{
+	std::vector<SavedState> states(count);
+	for (uint32 s = 0; s < count; ++s)
+	{
+		SavedState& state = states[s];
+		const float t = float(s) / float(count);
+		state.Atmosphere.rayleigh_scattering = state.Atmosphere.rayleigh_scattering * (0.5f + t);
+		state.Atmosphere.mie_phase_function_g = 0.5f + 0.4f * t;
+		state.SunPitch = -0.2f + 1.7f * t;
+		state.SunYaw = 6.0f * t;
+		state.CamHeight = 0.5f + 100.0f * t;
+		state.NumScatteringOrder = 1 + s % 8;
+	}
+	return states;
+}
+
+bool isSameSavedState(const SavedState& a, const SavedState& b)
+{
+	return memcmp(&a, &b, sizeof(SavedState)) == 0;
+}
+
+// State file round trip and bulk loading: count presets written to a single file, then loaded through one memory mapping.
+static int commandBenchStateRecords(CpuSkyToolsContext& ctx)
+{
+	const uint32 count = uint32((std::max)(1, atoi(ctx.arg(0, "10000"))));
+	const int iterations = (std::max)(1, atoi(ctx.arg(1, "5")));
+	const char* filepath = "state_records_bench.bin";
+
+	const std::vector<SavedState> states = getStateRecordPresets(count);
+
+	if (!writeStateFile(filepath, states.data(), count))
+	{
+		fprintf(stderr, "Failed to write %s\n", filepath);
+		return 1;
+	}
+	FILE* file = fopen(filepath, "rb");
+	fseek(file, 0, SEEK_END);
+	const long fileSize = ftell(file);
+	fclose(file);
+
+	bool success = true;
+	std::vector<SavedState> loaded;
+	double totalSeconds = 0.0;
+	double bestSeconds = 1e30;
+	for (int i = 0; i < iterations; ++i)
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		success &= loadStateFile(filepath, loaded);
+		const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		totalSeconds += seconds;
+		bestSeconds = (std::min)(bestSeconds, seconds);
+	}
+	remove(filepath);
+	uint32 mismatchCount = loaded.size() == count ? 0 : count;
+	for (size_t s = 0; s < loaded.size() && s < count; ++s)
+	{
+		mismatchCount += isSameSavedState(loaded[s], states[s]) ? 0 : 1;
+	}
+	success &= mismatchCount == 0;
+	printf("%u states, %.1f bytes per state, loaded in avg %.2f ms best %.2f ms, %u mismatch(es)\n", count, double(fileSize) / count,
+		totalSeconds / iterations * 1000.0, bestSeconds * 1000.0, mismatchCount);
+	return success ? 0 : 1;
+}
+
+// CPU_SCOPED_TIMER cost per scope, against the same loop without timer, and collection while other threads record scopes.
+static int commandBenchCpuTimer(CpuSkyToolsContext& ctx)
+{
+	const uint32 scopeCount = uint32((std::max)(1, atoi(ctx.arg(0, "10000000"))));
+	const uint32 threadCount = uint32((std::max)(1, atoi(ctx.arg(1, "4"))));
+	std::vector<CpuTimerEvent> events;
+	events.reserve(CPU_TIMER_THREAD_EVENT_COUNT * 2);
+	volatile uint32 sink = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < scopeCount; ++i)
+	{
+		sink = sink + i;
+		if ((i & 1023) == 0)
+		{
+			events.clear();
+			CpuTimerProfiler::collectEvents(events);
+		}
+	}
+	const double emptySeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < scopeCount; ++i)
+	{
+		CPU_SCOPED_TIMER(BenchScope);
+		sink = sink + i;
+		if ((i & 1023) == 0)
+		{
+			events.clear();
+			CpuTimerProfiler::collectEvents(events);
+		}
+	}
+	const double timedSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	const uint64_t droppedBefore = CpuTimerProfiler::getDroppedEventCount();
+
+	// A scope reads the clock twice, which dominates its cost (reading the TSC is notably slower in virtual machines).
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < scopeCount; ++i)
+	{
+		sink = sink + uint32(CpuTimerProfiler::getTick());
+	}
+	const double tickSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() - emptySeconds;
+	printf("%u scopes: %.1f ns per scope (%.1f ns with the timer, %.1f ns without, %.1f ns per clock read), %llu dropped\n", scopeCount,
+		(timedSeconds - emptySeconds) * 1e9 / scopeCount, timedSeconds * 1e9 / scopeCount, emptySeconds * 1e9 / scopeCount, tickSeconds * 1e9 / scopeCount,
+		(unsigned long long)droppedBefore);
+
+	// Threads recording nested scopes while this thread collects: every event is either collected or counted as dropped.
+	const uint32 perThreadCount = (std::min)(scopeCount, 200000u);
+	events.clear();
+	CpuTimerProfiler::collectEvents(events);
+	events.clear();
+	std::vector<std::thread> threads;
+	std::atomic<uint32> runningCount(threadCount);
+	for (uint32 t = 0; t < threadCount; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "Bench %u", t);
+			CpuTimerProfiler::setThreadName(name);
+			for (uint32 i = 0; i < perThreadCount; i += 2)
+			{
+				CPU_SCOPED_TIMER(Outer);
+				CPU_SCOPED_TIMER(Inner);
+			}
+			runningCount--;
+		});
+	}
+	while (runningCount > 0)
+	{
+		CpuTimerProfiler::collectEvents(events);
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	CpuTimerProfiler::collectEvents(events);
+	const uint64_t dropped = CpuTimerProfiler::getDroppedEventCount() - droppedBefore;
+	uint32 badDepthCount = 0;
+	for (const CpuTimerEvent& event : events)
+	{
+		badDepthCount += event.depth == (strcmp(event.name, "Outer") == 0 ? 0 : 1) ? 0 : 1;
+	}
+	const bool success = events.size() + dropped == uint64_t(threadCount) * perThreadCount && badDepthCount == 0;
+	printf("%u threads: %zu events collected, %llu dropped, %u with a wrong depth: %s\n", threadCount, events.size(), (unsigned long long)dropped,
+		badDepthCount, success ? "ok" : "FAILED");
+	return success ? 0 : 1;
+}
+
+static int commandBakeBruneton(CpuSkyToolsContext& ctx)
+{
+	const int numScatteringOrder = (std::max)(1, atoi(ctx.arg(0, "4")));	// Same default as Game::NumScatteringOrder
+	const char* exrPrefix = ctx.arg(1);
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuBrunetonLuts luts;
+	auto start = std::chrono::high_resolution_clock::now();
+	bakeBrunetonLuts(pool, ctx.Atmosphere, ctx.LutInfo, numScatteringOrder, luts);
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("Bruneton 2017 LUTs baked in %.1f ms, %d scattering orders, %u thread(s)\n",
+		std::chrono::duration<double>(end - start).count() * 1000.0, numScatteringOrder, pool.getThreadCount());
+
+	const size_t invalidCount = countInvalidValues(luts.TransmittanceTex.Data) + countInvalidValues(luts.IrradianceTex.Data) + countInvalidValues(luts.ScatteringTex.Data);
+	if (invalidCount > 0)
+	{
+		fprintf(stderr, "%zu NaN, infinite or negative values found, the LUTs are not written\n", invalidCount);
+		return 1;
+	}
+
+	// Same entry as Game::saveSkyAtmosphereLUTsToCache, so the application loads it instead of running the GPU passes.
+	const uint32 LutFormat = 2;	// DXGI_FORMAT_R32G32B32A32_FLOAT, D_LUT_FORMAT with SKYHIGHQUALITY
+	LutCacheTextureDesc descs[3];
+	memset(descs, 0, sizeof(descs));
+	const CpuLut2D* textures2D[2] = { &luts.TransmittanceTex, &luts.IrradianceTex };
+	for (uint32 t = 0; t < 2; ++t)
+	{
+		descs[t].Width = textures2D[t]->Width;
+		descs[t].Height = textures2D[t]->Height;
+		descs[t].Depth = 1;
+	}
+	descs[2].Width = luts.ScatteringTex.Width;
+	descs[2].Height = luts.ScatteringTex.Height;
+	descs[2].Depth = luts.ScatteringTex.Depth;
+	for (LutCacheTextureDesc& desc : descs)
+	{
+		desc.Format = LutFormat;
+		desc.BytesPerTexel = 4 * sizeof(float);
+	}
+	const void* textureData[3] = { luts.TransmittanceTex.Data.data(), luts.IrradianceTex.Data.data(), luts.ScatteringTex.Data.data() };
+	const uint64 key = computeLutCacheKey(ctx.Atmosphere, ctx.LutInfo, numScatteringOrder);
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	if (!writeLutCacheEntry(filepath, key, 3, descs, textureData))
+	{
+		fprintf(stderr, "Failed to write %s\n", filepath);
+		return 1;
+	}
+	printf("LUT cache entry written to %s\n", filepath);
+
+	if (exrPrefix)
+	{
+		// The scattering volume is written as its slices stacked vertically.
+		CpuLut2D scatteringSlices;
+		scatteringSlices.Allocate(luts.ScatteringTex.Width, luts.ScatteringTex.Height * luts.ScatteringTex.Depth);
+		scatteringSlices.Data = luts.ScatteringTex.Data;
+
+		const std::string prefix = exrPrefix;
+		if (!saveLutExr(luts.TransmittanceTex, (prefix + "Transmittance.exr").c_str())
+			|| !saveLutExr(luts.IrradianceTex, (prefix + "Irradiance.exr").c_str())
+			|| !saveLutExr(scatteringSlices, (prefix + "Scattering.exr").c_str()))
+		{
+			return 1;
+		}
+		printf("EXR files written to %s*.exr\n", exrPrefix);
+	}
+	return 0;
+}
+
+static int commandBenchBruneton(CpuSkyToolsContext& ctx)
+{
+	const int iterations = (std::max)(1, atoi(ctx.arg(0, "3")));
+	const int numScatteringOrder = (std::max)(1, atoi(ctx.arg(1, "4")));
+
+	CpuThreadPool pool(ctx.ThreadCount);
+	CpuBrunetonLuts luts;
+	const double texelCount = double(ctx.LutInfo.SCATTERING_TEXTURE_WIDTH) * double(ctx.LutInfo.SCATTERING_TEXTURE_HEIGHT) * double(ctx.LutInfo.SCATTERING_TEXTURE_DEPTH);
+	benchmarkBake("Bruneton 2017 LUTs (scattering texels)", pool.getThreadCount(), iterations, texelCount, [&]()
+	{
+		bakeBrunetonLuts(pool, ctx.Atmosphere, ctx.LutInfo, numScatteringOrder, luts);
+	});
+	printf("  %d scattering orders, %llu task range(s) stolen\n", numScatteringOrder, pool.getStealCount());
+	return 0;
+}
+
+
+
+struct CpuSkyToolsCommand
+{
+	const char* Name;
+	const char* Usage;
+	int(*Run)(CpuSkyToolsContext& ctx);
+};
+
+static const CpuSkyToolsCommand CpuSkyToolsCommands[] =
+{
+	{ "bake-transmittance",		"<out.exr>",								commandBakeTransmittance },
+	{ "compare-transmittance",	"<golden.exr> [maxUlp=16] [maxAbsError=0]",	commandCompareTransmittance },
+	{ "bench-transmittance",	"[iterations=100]",							commandBenchTransmittance },
+	{ "report-analytic-transmittance",	"[referenceSamples=4096] [iterations=20]",	commandReportAnalyticTransmittance },
+	{ "check-analytic-transmittance",	"[maxAbsError=0.02]",						commandCheckAnalyticTransmittance },
+	{ "bake-multiscattering",	"<out.exr>",								commandBakeMultiScattering },
+	{ "bench-multiscattering",	"[iterations=20]",							commandBenchMultiScattering },
+	{ "check-multiscattering-determinism",	"[maxThreads=8]",				commandCheckMultiScatteringDeterminism },
+	{ "check-lut-dependency-graph",	"",									commandCheckLutDependencyGraph },
+	{ "bench-sky-radiance",		"[queryCount=1000000] [iterations=5]",		commandBenchSkyRadiance },
+	{ "check-sky-radiance",			"",										commandCheckSkyRadiance },
+	{ "bench-sky-pipeline",		"[out.json=sky_pipeline_bench.json] [iterations=5] [maxRelativeRmse=0.05]",	commandBenchSkyPipeline },
+	{ "tune-sky-luts",			"[out.json=sky_lut_tuning.json] [maxError=default] [presets.state]",	commandTuneSkyLuts },
+	{ "check-sky-lut-config",		"",										commandCheckSkyLutConfig },
+	{ "bench-sky-view-resolution",	"[out.json=sky_view_resolution.json] [iterations=5]",	commandBenchSkyViewResolution },
+	{ "check-sky-view-resolution",	"",									commandCheckSkyViewResolution },
+	{ "bench-sky-view-amortization",	"[out.json=sky_view_amortization.json] [frames=120] [heightThreshold=1] [sunAngleThreshold=0.02]",	commandBenchSkyViewAmortization },
+	{ "check-sky-view-amortization",	"",									commandCheckSkyViewAmortization },
+	{ "bench-camera-volume-prefix",	"[out.json=camera_volume_prefix.json] [iterations=5]",	commandBenchCameraVolumePrefix },
+	{ "check-camera-volume-prefix",	"",									commandCheckCameraVolumePrefix },
+	{ "bench-sun-inscatter-lut",	"[out.json=sun_inscatter_lut.json] [iterations=5]",	commandBenchSunInScatterLut },
+	{ "check-sun-inscatter-lut",	"",									commandCheckSunInScatterLut },
+	{ "bake-sky-view-atlas",	"[lutconfig.txt|-] [multipleScatteringFactor=1]",	commandBakeSkyViewAtlas },
+	{ "bench-sky-view-atlas",	"[out.json=sky_view_atlas.json] [iterations=5]",	commandBenchSkyViewAtlas },
+	{ "check-sky-view-atlas",		"",										commandCheckSkyViewAtlas },
+	{ "bench-sky-irradiance-sh",	"[out.json=sky_irradiance_sh.json] [iterations=5]",	commandBenchSkyIrradianceSH },
+	{ "check-sky-irradiance-sh",	"",									commandCheckSkyIrradianceSH },
+	{ "bake-sky-cubemap",		"<out.dds> [source=lut|raymarching] [size=128] [cameraHeight=0.5] [sunElevation=0.45] [exrPrefix]",	commandBakeSkyCubemap },
+	{ "bench-sky-cubemap",		"[out.json=sky_cubemap.json] [iterations=3]",	commandBenchSkyCubemap },
+	{ "check-sky-cubemap",			"",										commandCheckSkyCubemap },
+	{ "render-pathtracing",		"<out.exr> [samplesPerPixel=64] [width=640] [height=360] [transmittanceOut.exr]",	commandRenderPathTracing },
+	{ "check-pathtracing",			"",										commandCheckPathTracing },
+	{ "bench-sampler-convergence",	"[maxSamplesPerPixel=384] [referenceSamplesPerPixel=3072] [width=64] [height=36]",	commandBenchSamplerConvergence },
+	{ "check-samplers",				"",										commandCheckSamplers },
+	{ "bench-adaptive-pathtracing",	"[targetRelativeError=0.25] [maxSamplesPerPixel=8192] [width=64] [height=36]",	commandBenchAdaptivePathTracing },
+	{ "check-adaptive-pathtracing",	"",										commandCheckAdaptivePathTracing },
+	{ "bench-wavefront-pathtracing",	"[samplesPerPixel=16] [width=320] [height=180] [out.json]",	commandBenchWavefrontPathTracing },
+	{ "check-wavefront-pathtracing",	"",									commandCheckWavefrontPathTracing },
+	{ "bench-hdr-capture",		"[frames=30] [width=1280] [height=720] [compression=none|zip|piz]",	commandBenchHdrCapture },
+	{ "check-hdr-capture",			"",										commandCheckHdrCapture },
+	{ "simulate-capture-script",	"<script.txt> [lutFrames=1]",				commandSimulateCaptureScript },
+	{ "check-capture-script",		"",										commandCheckCaptureScript },
+	{ "bench-state-records",	"[count=10000] [iterations=5]",				commandBenchStateRecords },
+	{ "check-state-records",		"",										commandCheckStateRecords },
+	{ "check-timer-trace",		"[frames=240] [trace.json]",				commandCheckTimerTrace },
+	{ "bench-cpu-timer",		"[scopes=10000000] [threads=4]",			commandBenchCpuTimer },
+	{ "bake-bruneton",			"[scatteringOrder=4] [exrPrefix]",			commandBakeBruneton },
+	{ "bench-bruneton",			"[iterations=3] [scatteringOrder=4]",		commandBenchBruneton },
+	{ "check-bruneton",				"",										commandCheckBruneton },
+	{ "check-lut-cache",				"",										commandCheckLutCache },
+};
+
+static void printUsage()
+{
+	printf("Usage: SkyCpuTools [-threads N] <command> [arguments]\n");
+	printf("All commands use the default earth atmosphere (SetupEarthAtmosphere).\n");
+	for (const CpuSkyToolsCommand& command : CpuSkyToolsCommands)
+	{
+		printf("  %s %s\n", command.Name, command.Usage);
+	}
+}
+
+int runCpuSkyTools(int argc, char** argv)
+{
+	CpuSkyToolsContext ctx;
+	SetupEarthAtmosphere(ctx.Atmosphere);
+
+	const char* commandName = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+		{
+			ctx.ThreadCount = uint32((std::max)(0, atoi(argv[++i])));
+		}
+		else if (!commandName)
+		{
+			commandName = argv[i];
+		}
+		else
+		{
+			ctx.Args.push_back(argv[i]);
+		}
+	}
+
+	if (commandName)
+	{
+		for (const CpuSkyToolsCommand& command : CpuSkyToolsCommands)
+		{
+			if (strcmp(commandName, command.Name) == 0)
+			{
+				return command.Run(ctx);
+			}
+		}
+		fprintf(stderr, "Unknown command %s\n", commandName);
+	}
+	printUsage();
+	return 1;
+}
+
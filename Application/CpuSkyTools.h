@@ -0,0 +1,33 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "CpuSkyAtmosphere.h"
+
+// Helpers shared by the headless atmosphere tools (see SkyCpuTools).
+// EXR functions require tinyexr to be implemented (TINYEXR_IMPLEMENTATION) in one of the translation units of the executable.
+
+bool saveLutExr(const CpuLut2D& lut, const char* filename);
+bool loadLutExr(CpuLut2D& lut, const char* filename);
+
+// Distance between two floats in units in the last place. NaNs are considered infinitely far.
+uint32 floatUlpDistance(float a, float b);
+
+struct LutComparison
+{
+	uint32 TexelCount = 0;
+	uint32 FailingTexelCount = 0;
+	uint32 MaxUlpDistance = 0;
+	float MaxAbsError = 0.0f;
+	float MaxRelError = 0.0f;
+
+	bool passed() const { return TexelCount > 0 && FailingTexelCount == 0; }
+};
+
+// Compares RGB channels of two LUTs of the same size. A channel passes when it is within maxUlp or within maxAbsError of the reference.
+LutComparison compareLuts(const CpuLut2D& test, const CpuLut2D& reference, uint32 maxUlp, float maxAbsError);
+
+// Entry point of the command line tools, returns the process exit code.
+int runCpuSkyTools(int argc, char** argv);
+
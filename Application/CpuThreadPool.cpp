@@ -0,0 +1,150 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include "CpuThreadPool.h"
+
+
+CpuThreadPool::CpuThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::thread::hardware_concurrency();
+		threadCount = threadCount == 0 ? 1 : threadCount;
+	}
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		mRanges.emplace_back(new TaskRange());
+	}
+	for (unsigned int i = 1; i < threadCount; ++i)
+	{
+		mWorkers.emplace_back(&CpuThreadPool::workerLoop, this, i);
+	}
+}
+
+CpuThreadPool::~CpuThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mExit = true;
+	}
+	mWakeCondition.notify_all();
+	for (std::thread& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+void CpuThreadPool::parallelFor(unsigned int taskCount, const std::function<void(unsigned int taskIndex)>& task)
+{
+	if (mWorkers.empty() || taskCount <= 1)
+	{
+		for (unsigned int i = 0; i < taskCount; ++i)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		const unsigned int threadCount = getThreadCount();
+		for (unsigned int i = 0; i < threadCount; ++i)
+		{
+			std::lock_guard<std::mutex> rangeLock(mRanges[i]->Mutex);
+			mRanges[i]->Begin = (unsigned int)((unsigned long long)taskCount * i / threadCount);
+			mRanges[i]->End = (unsigned int)((unsigned long long)taskCount * (i + 1) / threadCount);
+		}
+		mBusyWorkers = (unsigned int)mWorkers.size();
+		mGeneration++;
+	}
+	mWakeCondition.notify_all();
+
+	runTasks(0);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDoneCondition.wait(lock, [&]() { return mBusyWorkers == 0; });
+	mTask = nullptr;
+}
+
+bool CpuThreadPool::popTask(unsigned int threadIndex, unsigned int& taskIndex)
+{
+	TaskRange& range = *mRanges[threadIndex];
+	std::lock_guard<std::mutex> lock(range.Mutex);
+	if (range.Begin < range.End)
+	{
+		taskIndex = range.Begin++;
+		return true;
+	}
+	return false;
+}
+
+bool CpuThreadPool::stealTasks(unsigned int threadIndex)
+{
+	const unsigned int threadCount = getThreadCount();
+	for (unsigned int i = 1; i < threadCount; ++i)
+	{
+		TaskRange& victim = *mRanges[(threadIndex + i) % threadCount];
+		unsigned int stolenBegin, stolenEnd;
+		{
+			std::lock_guard<std::mutex> lock(victim.Mutex);
+			const unsigned int remaining = victim.End - victim.Begin;
+			if (victim.Begin >= victim.End)
+			{
+				continue;
+			}
+			// Take the back half, rounded up so that a single remaining task can be stolen.
+			stolenEnd = victim.End;
+			stolenBegin = victim.End - (remaining + 1) / 2;
+			victim.End = stolenBegin;
+		}
+
+		TaskRange& range = *mRanges[threadIndex];
+		{
+			std::lock_guard<std::mutex> lock(range.Mutex);
+			range.Begin = stolenBegin;
+			range.End = stolenEnd;
+		}
+		mStealCount.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void CpuThreadPool::runTasks(unsigned int threadIndex)
+{
+	unsigned int taskIndex;
+	do
+	{
+		while (popTask(threadIndex, taskIndex))
+		{
+			(*mTask)(taskIndex);
+		}
+	} while (stealTasks(threadIndex));
+}
+
+void CpuThreadPool::workerLoop(unsigned int threadIndex)
+{
+	unsigned long long generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeCondition.wait(lock, [&]() { return mExit || mGeneration != generation; });
+			if (mExit)
+			{
+				return;
+			}
+			generation = mGeneration;
+		}
+
+		runTasks(threadIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mBusyWorkers--;
+		}
+		mDoneCondition.notify_one();
+	}
+}
+
@@ -0,0 +1,65 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size work-stealing pool of worker threads used by the CPU LUT bakers.
+// parallelFor splits the task range evenly between threads; a thread running out of work steals half of the
+// remaining range of another one. The calling thread takes part in parallelFor, so a pool created with a single
+// thread simply runs everything inline.
+// Tasks are only distributed, never split or merged: a task writing its own output gives the same result whatever the thread count.
+// parallelFor is not re-entrant: a task must not call parallelFor on the same pool.
+class CpuThreadPool
+{
+public:
+	// threadCount includes the calling thread. 0 means one thread per hardware thread.
+	explicit CpuThreadPool(unsigned int threadCount = 0);
+	~CpuThreadPool();
+
+	unsigned int getThreadCount() const { return (unsigned int)mWorkers.size() + 1; }
+
+	// Calls task(i) for each i in [0, taskCount) and returns once all tasks have completed.
+	void parallelFor(unsigned int taskCount, const std::function<void(unsigned int taskIndex)>& task);
+
+	// Number of task ranges stolen since the pool creation.
+	unsigned long long getStealCount() const { return mStealCount.load(std::memory_order_relaxed); }
+
+private:
+	CpuThreadPool(const CpuThreadPool&) = delete;
+	CpuThreadPool& operator=(const CpuThreadPool&) = delete;
+
+	// Remaining [Begin, End) tasks of a thread. The owner pops from the front, thieves take from the back.
+	struct TaskRange
+	{
+		std::mutex Mutex;
+		unsigned int Begin = 0;
+		unsigned int End = 0;
+	};
+
+	void workerLoop(unsigned int threadIndex);
+	void runTasks(unsigned int threadIndex);
+	bool popTask(unsigned int threadIndex, unsigned int& taskIndex);
+	bool stealTasks(unsigned int threadIndex);
+
+	std::vector<std::thread> mWorkers;
+	std::vector<std::unique_ptr<TaskRange>> mRanges;	/// One per thread, index 0 being the calling thread
+
+	std::mutex mMutex;
+	std::condition_variable mWakeCondition;
+	std::condition_variable mDoneCondition;
+	unsigned long long mGeneration = 0;				/// Incremented each time a new parallelFor is issued
+	unsigned int mBusyWorkers = 0;					/// Workers that have not finished the current parallelFor yet
+	std::atomic<unsigned long long> mStealCount{ 0 };	/// Statistics only, read while workers run
+	bool mExit = false;
+
+	const std::function<void(unsigned int)>* mTask = nullptr;
+};
+
@@ -3,57 +3,109 @@
 
 #include "Game.h"
 
-// basic file operations
-#include <iostream>
-#include <fstream>
+#include "StateRecord.h"
+
+#define STATE_FILE_PATH "state.txt"		// Kept from the raw dump format, which is migrated when loaded
 
 void Game::SaveState()
 {
-	std::ofstream myfile;
-	myfile.open("state.txt");
-	myfile.write(reinterpret_cast<const char*>(&AtmosphereInfos), sizeof(AtmosphereInfo));
-	myfile.write(reinterpret_cast<const char*>(&AtmosphereInfosSaved), sizeof(AtmosphereInfo));
-	myfile.write(reinterpret_cast<const char*>(&mCamPos), sizeof(float3));
-	myfile.write(reinterpret_cast<const char*>(&mCamPosFinal), sizeof(float3));
-	myfile.write(reinterpret_cast<const char*>(&mViewDir), sizeof(float3));
-	myfile.write(reinterpret_cast<const char*>(&mSunDir), sizeof(float3));
-	myfile.write(reinterpret_cast<const char*>(&mSunIlluminanceScale), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&viewPitch), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&viewYaw), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&uiCamHeight), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&uiCamForward), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&uiSunPitch), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&uiSunYaw), sizeof(float));
-	myfile.write(reinterpret_cast<const char*>(&NumScatteringOrder), sizeof(int));
-	myfile.close();
+	SavedState state;
+	state.Atmosphere = AtmosphereInfos;
+	state.AtmosphereSaved = AtmosphereInfosSaved;
+	memcpy(state.CamPos, &mCamPos, sizeof(float3));
+	memcpy(state.CamPosFinal, &mCamPosFinal, sizeof(float3));
+	memcpy(state.ViewDir, &mViewDir, sizeof(float3));
+	memcpy(state.SunDir, &mSunDir, sizeof(float3));
+	state.SunIlluminanceScale = mSunIlluminanceScale;
+	state.ViewPitch = viewPitch;
+	state.ViewYaw = viewYaw;
+	state.CamHeight = uiCamHeight;
+	state.CamForward = uiCamForward;
+	state.SunPitch = uiSunPitch;
+	state.SunYaw = uiSunYaw;
+	state.NumScatteringOrder = NumScatteringOrder;
+	if (!writeStateFile(STATE_FILE_PATH, &state, 1))
+	{
+		OutputDebugStringA("Failed to save " STATE_FILE_PATH "\n");
+	}
 }
 
 void Game::LoadState()
 {
-	std::ifstream myfile("state.txt");
-	if (myfile.is_open())
+	std::vector<SavedState> states;
+	if (loadStateFile(STATE_FILE_PATH, states) && !states.empty())
 	{
-		myfile.read(reinterpret_cast<char*>(&AtmosphereInfos), sizeof(AtmosphereInfo));
-		myfile.read(reinterpret_cast<char*>(&AtmosphereInfosSaved), sizeof(AtmosphereInfo));
-		myfile.read(reinterpret_cast<char*>(&mCamPos), sizeof(float3));
-		myfile.read(reinterpret_cast<char*>(&mCamPosFinal), sizeof(float3));
-		myfile.read(reinterpret_cast<char*>(&mViewDir), sizeof(float3));
-		myfile.read(reinterpret_cast<char*>(&mSunDir), sizeof(float3));
-		myfile.read(reinterpret_cast<char*>(&mSunIlluminanceScale), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&viewPitch), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&viewYaw), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&uiCamHeight), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&uiCamForward), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&uiSunPitch), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&uiSunYaw), sizeof(float));
-		myfile.read(reinterpret_cast<char*>(&NumScatteringOrder), sizeof(int));
-		myfile.close();
+		const SavedState& state = states[0];
+		AtmosphereInfos = state.Atmosphere;
+		AtmosphereInfosSaved = state.AtmosphereSaved;
+		memcpy(&mCamPos, state.CamPos, sizeof(float3));
+		memcpy(&mCamPosFinal, state.CamPosFinal, sizeof(float3));
+		memcpy(&mViewDir, state.ViewDir, sizeof(float3));
+		memcpy(&mSunDir, state.SunDir, sizeof(float3));
+		mSunIlluminanceScale = state.SunIlluminanceScale;
+		viewPitch = state.ViewPitch;
+		viewYaw = state.ViewYaw;
+		uiCamHeight = state.CamHeight;
+		uiCamForward = state.CamForward;
+		uiSunPitch = state.SunPitch;
+		uiSunYaw = state.SunYaw;
+		NumScatteringOrder = state.NumScatteringOrder;
 
 		ShouldClearPathTracedBuffer = true;
-		forceGenLut = true;
+		LutGraph.invalidateAll();
+		mSkyViewLutFullUpdateNeeded = true;
 		uiDataInitialised = false;
 	}
 }
 
 
 
+void Game::setSceneState(const CaptureSceneState& state)
+{
+	AtmosphereInfos = state.Atmosphere;
+	uiCamHeight = state.CamHeight;
+	uiCamForward = state.CamForward;
+	viewYaw = state.ViewYaw;
+	viewPitch = state.ViewPitch;
+	uiSunPitch = state.SunPitch;
+	uiSunYaw = state.SunYaw;
+	mSunIlluminanceScale = state.SunIlluminanceScale;
+	uiRenderingMethod = state.RenderingMethod;
+	currentMultipleScatteringFactor = state.MultipleScatteringFactor;
+	NumScatteringOrder = state.ScatteringOrders;
+
+	ShouldClearPathTracedBuffer = true;
+	mFrameId = 0;
+	uiDataInitialised = false;	// The UI values are converted back to AtmosphereInfos every frame
+}
+
+bool Game::startCaptureSequence(const char* scriptPath, bool exitWhenDone)
+{
+	std::vector<CaptureShot> shots;
+	std::string error;
+	if (!loadCaptureScript(scriptPath, shots, error))
+	{
+		OutputDebugStringA(("Capture script " + std::string(scriptPath) + ": " + error + "\n").c_str());
+		return false;
+	}
+	buildCaptureState(shots, *this, mCaptureState);
+	mExitWhenCaptureSequenceDone = exitWhenDone;
+	mExitRequested = exitWhenDone && !mCaptureState.active;
+	return true;
+}
+
+bool Game::loadSkyLutConfig(const char* filepath)
+{
+	SkyLutConfig config;
+	std::string error;
+	if (!config.load(filepath, error))
+	{
+		OutputDebugStringA(("LUT configuration " + std::string(filepath) + ": " + error + "\n").c_str());
+		return false;
+	}
+	mSkyLutConfig = config;
+	return true;
+}
+
+
+
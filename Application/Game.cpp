@@ -3,10 +3,12 @@
 
 #include "Game.h"
 #include "GpuDebugRenderer.h"
+#include "CpuPathTracer.h"
 
 #include "windows.h"
 
 #include <imgui.h>
+#include <chrono>
 
 #undef max
 #define TINYEXR_IMPLEMENTATION
@@ -16,6 +18,7 @@
 Game::Game()
 {
 	memset(&AtmosphereInfosSaved, 0, sizeof(AtmosphereInfos));
+	memset(&LutViewInputsSaved, 0, sizeof(LutViewInputsSaved));
 	SetupEarthAtmosphere(AtmosphereInfos);
 
 	// Offset along Z, looking towards Y
@@ -30,6 +33,8 @@ Game::~Game()
 
 void Game::loadShaders(bool firstTimeLoadShaders)
 {
+	CPU_SCOPED_TIMER(LoadShaders);
+
 	auto GetStringNumber = [](int i)
 	{
 		switch (i)
@@ -66,6 +71,7 @@ void Game::loadShaders(bool firstTimeLoadShaders)
 	success &= reloadShader(&mScreenVertexShader, L"Resources\\Common.hlsl", "ScreenTriangleVertexShader", firstTimeLoadShaders, nullptr, false);	// No lazy compilation because it is used to create a layout
 	success &= reload(&mPostProcessShader, L"Resources\\PostProcess.hlsl", "PostProcessPS", firstTimeLoadShaders, nullptr, lazyCompilation);
 	success &= reload(&mApplySkyAtmosphereShader, L"Resources\\PostProcess.hlsl", "ApplySkyAtmospherePS", firstTimeLoadShaders, nullptr, lazyCompilation);
+	success &= reload(&mPathTracingConvergenceShader, L"Resources\\PostProcess.hlsl", "PathTracingConvergencePS", firstTimeLoadShaders, nullptr, lazyCompilation);
 
 	success &= reload(&GeometryGS, L"Resources\\Common.hlsl", "LutGS", firstTimeLoadShaders, nullptr, lazyCompilation);
 
@@ -86,14 +92,27 @@ void Game::loadShaders(bool firstTimeLoadShaders)
 	success &= reload(&CameraVolumesPS, L"Resources\\RenderWithLuts.hlsl", "RenderCameraVolumesPS", firstTimeLoadShaders, nullptr, lazyCompilation);
 	
 	success &= reload(&RenderWithLutPS, L"Resources\\RenderWithLuts.hlsl", "RenderWithLutsPS", firstTimeLoadShaders, nullptr, lazyCompilation);	
-	success &= reload(&RenderTransmittanceLutPS, L"Resources\\RenderSkyRayMarching.hlsl", "RenderTransmittanceLutPS", firstTimeLoadShaders, nullptr, lazyCompilation);
-
-	for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+	for (int aod = AnalyticOpticalDepthDisabled; aod < AnalyticOpticalDepthCount; ++aod)
 	{
 		Macros macros;
-		ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
-		macros.push_back(macroDs);
-		success &= reload(&SkyViewLutPS[ds], L"Resources\\RenderSkyRayMarching.hlsl", "SkyViewLutPS", firstTimeLoadShaders, &macros, lazyCompilation);
+		ShaderMacro macroAod = { "ANALYTIC_OPTICAL_DEPTH_ENABLED", GetStringNumber(aod) };
+		macros.push_back(macroAod);
+		success &= reload(&RenderTransmittanceLutPS[aod], L"Resources\\RenderSkyRayMarching.hlsl", "RenderTransmittanceLutPS", firstTimeLoadShaders, &macros, lazyCompilation);
+	}
+
+	success &= reload(&SunInScatterLutPS, L"Resources\\RenderSkyRayMarching.hlsl", "SunInScatterLutPS", firstTimeLoadShaders, nullptr, lazyCompilation);
+	success &= reload(&SkyViewLutAtlasBlendPS, L"Resources\\RenderSkyRayMarching.hlsl", "SkyViewLutAtlasBlendPS", firstTimeLoadShaders, nullptr, lazyCompilation);
+	for (int sil = SunInScatterLutDisabled; sil < SunInScatterLutCount; ++sil)
+	{
+		for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+		{
+			Macros macros;
+			ShaderMacro macroSil = { "SUN_INSCATTER_LUT_ENABLED", GetStringNumber(sil) };
+			ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
+			macros.push_back(macroSil);
+			macros.push_back(macroDs);
+			success &= reload(&SkyViewLutPS[sil][ds], L"Resources\\RenderSkyRayMarching.hlsl", "SkyViewLutPS", firstTimeLoadShaders, &macros, lazyCompilation);
+		}
 	}
 
 	success &= reload(&mTerrainVertexShader, L"Resources\\Terrain.hlsl", "TerrainVertexShader", firstTimeLoadShaders, nullptr, lazyCompilation);
@@ -107,16 +126,21 @@ void Game::loadShaders(bool firstTimeLoadShaders)
 			{
 				for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
 				{
-					Macros macros;
-					ShaderMacro macroTrans = { "TRANSMITANCE_METHOD", GetStringNumber(trans) };
-					ShaderMacro macroGgi = { "GROUND_GI_ENABLED", GetStringNumber(ggi) };
-					ShaderMacro macroSm = { "SHADOWMAP_ENABLED", GetStringNumber(sm) };
-					ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
-					macros.push_back(macroTrans);
-					macros.push_back(macroGgi);
-					macros.push_back(macroSm);
-					macros.push_back(macroDs);
-					success &= reload(&RenderPathTracingPS[trans][ggi][sm][ds], L"Resources\\RenderSkyPathTracing.hlsl", "RenderPathTracingPS", firstTimeLoadShaders, &macros, lazyCompilation);
+					for (int smp = SamplerHash; smp < SamplerCount; ++smp)
+					{
+						Macros macros;
+						ShaderMacro macroTrans = { "TRANSMITANCE_METHOD", GetStringNumber(trans) };
+						ShaderMacro macroGgi = { "GROUND_GI_ENABLED", GetStringNumber(ggi) };
+						ShaderMacro macroSm = { "SHADOWMAP_ENABLED", GetStringNumber(sm) };
+						ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
+						ShaderMacro macroSmp = { "SAMPLER_TYPE", GetStringNumber(smp) };
+						macros.push_back(macroTrans);
+						macros.push_back(macroGgi);
+						macros.push_back(macroSm);
+						macros.push_back(macroDs);
+						macros.push_back(macroSmp);
+						success &= reload(&RenderPathTracingPS[trans][ggi][sm][ds][smp], L"Resources\\RenderSkyPathTracing.hlsl", "RenderPathTracingPS", firstTimeLoadShaders, &macros, lazyCompilation);
+					}
 				}
 			}
 		}
@@ -153,12 +177,18 @@ void Game::loadShaders(bool firstTimeLoadShaders)
 		}
 	}
 
-	for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+	for (int sil = SunInScatterLutDisabled; sil < SunInScatterLutCount; ++sil)
 	{
-		Macros macros;
-		ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
-		macros.push_back(macroDs);
-		success &= reload(&CameraVolumesRayMarchPS[ds], L"Resources\\RenderSkyRayMarching.hlsl", "RenderCameraVolumePS", firstTimeLoadShaders, &macros, lazyCompilation);
+		for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+		{
+			Macros macros;
+			ShaderMacro macroSil = { "SUN_INSCATTER_LUT_ENABLED", GetStringNumber(sil) };
+			ShaderMacro macroDs = { "MULTISCATAPPROX_ENABLED", GetStringNumber(ds) };
+			macros.push_back(macroSil);
+			macros.push_back(macroDs);
+			success &= reload(&CameraVolumesRayMarchPS[sil][ds], L"Resources\\RenderSkyRayMarching.hlsl", "RenderCameraVolumePS", firstTimeLoadShaders, &macros, lazyCompilation);
+			success &= reload(&CameraVolumesPrefixCS[sil][ds], L"Resources\\RenderSkyRayMarching.hlsl", "CameraVolumesPrefixCS", firstTimeLoadShaders, &macros, lazyCompilation);
+		}
 	}
 
 	InputLayoutDesc inputLayout;
@@ -167,6 +197,9 @@ void Game::loadShaders(bool firstTimeLoadShaders)
 	mVertexShader->createInputLayout(inputLayout, &mLayout);	// Have a layout object with vertex stride in it
 
 	ShouldClearPathTracedBuffer = true;
+	LutGraph.invalidateAll();
+	mSkyViewLutFullUpdateNeeded = true;
+	LutCacheSkipLoad = !firstTimeLoadShaders;
 }
 
 void Game::releaseShaders()
@@ -178,6 +211,7 @@ void Game::releaseShaders()
 
 	resetPtr(&mPostProcessShader);
 	resetPtr(&mApplySkyAtmosphereShader);
+	resetPtr(&mPathTracingConvergenceShader);
 
 	resetPtr(&TransmittanceLutPS);
 	resetPtr(&DirectIrradianceLutPS);
@@ -191,11 +225,19 @@ void Game::releaseShaders()
 	resetPtr(&CameraVolumesPS);
 
 	resetPtr(&RenderWithLutPS);
-	resetPtr(&RenderTransmittanceLutPS);
+	for (int aod = AnalyticOpticalDepthDisabled; aod < AnalyticOpticalDepthCount; ++aod)
+	{
+		resetPtr(&RenderTransmittanceLutPS[aod]);
+	}
 
-	for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+	resetPtr(&SunInScatterLutPS);
+	resetPtr(&SkyViewLutAtlasBlendPS);
+	for (int sil = SunInScatterLutDisabled; sil < SunInScatterLutCount; ++sil)
 	{
-		resetPtr(&SkyViewLutPS[ds]);
+		for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+		{
+			resetPtr(&SkyViewLutPS[sil][ds]);
+		}
 	}
 
 	resetPtr(&mTerrainVertexShader);
@@ -209,7 +251,10 @@ void Game::releaseShaders()
 			{
 				for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
 				{
-					resetPtr(&RenderPathTracingPS[trans][ggi][sm][ds]);
+					for (int smp = SamplerHash; smp < SamplerCount; ++smp)
+					{
+						resetPtr(&RenderPathTracingPS[trans][ggi][sm][ds][smp]);
+					}
 				}
 			}
 		}
@@ -232,9 +277,13 @@ void Game::releaseShaders()
 		}
 	}
 
-	for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+	for (int sil = SunInScatterLutDisabled; sil < SunInScatterLutCount; ++sil)
 	{
-		resetPtr(&CameraVolumesRayMarchPS[ds]);
+		for (int ds = MultiScatApproxDisabled; ds < MultiScatApproxCount; ++ds)
+		{
+			resetPtr(&CameraVolumesRayMarchPS[sil][ds]);
+			resetPtr(&CameraVolumesPrefixCS[sil][ds]);
+		}
 	}
 
 	resetPtr(&GeometryGS);
@@ -253,6 +302,10 @@ void Game::initialise()
 
 	////////// Create other resources
 
+	MultiScatteringLUTRes = mSkyLutConfig.MultiScatteringRes;
+	uiViewRayMarchMinSPP = int(mSkyLutConfig.RayMarchMinMaxSPP[0]);
+	uiViewRayMarchMaxSPP = int(mSkyLutConfig.RayMarchMinMaxSPP[1]);
+
 	D3dDevice* device = g_dx11Device->getDevice();
 	const D3dViewport& viewport = g_dx11Device->getBackBufferViewport();
 	allocateResolutionIndependentResources();
@@ -285,39 +338,64 @@ auto createTexture2dFromExr = [&](const char *filename)
 	return tex;
 };
 
-void Game::saveBackBufferHdr(const char* filepath)
+void Game::queueBackBufferHdrCapture(const char* filepath)
 {
-	const D3D11_TEXTURE2D_DESC& desc = mBackBufferHdrStagingTexture->mDesc;
-	ATLASSERT(desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT);
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+	if (mHdrCaptureRingPendingCount == HdrCaptureRingSize)
+	{
+		processHdrCaptureReadbacks(1);
+	}
+
+	HdrCaptureReadback& readback = mHdrCaptureRing[(mHdrCaptureRingHead + mHdrCaptureRingPendingCount) % HdrCaptureRingSize];
+	ATLASSERT(readback.StagingTexture->mDesc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT);
+	context->CopyResource(readback.StagingTexture->mTexture, mBackBufferHdr->mTexture);
+	context->End(readback.CopyDoneQuery);
+	readback.Filename = filepath;
+	mHdrCaptureRingPendingCount++;
+}
 
+void Game::processHdrCaptureReadbacks(uint32 waitCount)
+{
+	CPU_SCOPED_TIMER(HdrCaptureReadback);
 	D3dRenderContext* context = g_dx11Device->getDeviceContext();
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	HRESULT res = context->Map(mBackBufferHdrStagingTexture->mTexture, 0, D3D11_MAP_READ, 0, &mappedResource); // this will stall since we do not have proper staging textures to hide frame latency
-	ATLASSERT(res == S_OK);
-	if (res == S_OK)
+	while (mHdrCaptureRingPendingCount > 0)
 	{
-		const float* data = (float*)mappedResource.pData;
-		const int pixelCount = mBackBufferHdr->mDesc.Width * mBackBufferHdr->mDesc.Height;
-		float* dataResolved = new float[pixelCount * 4];
-		for (int p = 0; p < pixelCount; p++)
+		HdrCaptureReadback& readback = mHdrCaptureRing[mHdrCaptureRingHead];
+		const bool wait = waitCount > 0;
+		if (!wait && context->GetData(readback.CopyDoneQuery, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
 		{
-			int i = p * 4;
-			float sampleCount = data[i + 3];
-			sampleCount = sampleCount > 0.0f ? sampleCount : 1.0f;
-			dataResolved[i] = data[i] / sampleCount;
-			dataResolved[i + 1] = data[i + 1] / sampleCount;
-			dataResolved[i + 2] = data[i + 2] / sampleCount;
-			dataResolved[i + 3] = 1.0f;
+			break;	// Copies complete in order, the next ones cannot be done either
 		}
 
-		const char *err = nullptr;
-		SaveEXR(dataResolved, mBackBufferHdr->mDesc.Width, mBackBufferHdr->mDesc.Height, 4, 0, filepath, &err);
-		if (err != nullptr)
+		// When waiting, Map blocks in the driver until the copy is done rather than spinning on the query. Otherwise the copy is done
+		// and this does not stall. Only the texels are copied here, resolving and encoding happen on the writer thread.
+		const auto mapStart = std::chrono::steady_clock::now();
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT res = context->Map(readback.StagingTexture->mTexture, 0, D3D11_MAP_READ, 0, &mappedResource);
+		if (wait)
 		{
-			OutputDebugStringA(err);
+			mHdrCaptureRingWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mapStart).count();
+			waitCount--;
+		}
+		ATLASSERT(res == S_OK);
+		if (res == S_OK)
+		{
+			HdrCaptureFrame frame;
+			frame.Filename = readback.Filename;
+			frame.Width = uint32(readback.StagingTexture->mDesc.Width);
+			frame.Height = uint32(readback.StagingTexture->mDesc.Height);
+			frame.Rgba.resize(size_t(frame.Width) * frame.Height * 4);
+			const size_t rowSize = size_t(frame.Width) * 4 * sizeof(float);
+			for (uint32 y = 0; y < frame.Height; ++y)
+			{
+				memcpy(&frame.Rgba[size_t(y) * frame.Width * 4], (const uint8*)mappedResource.pData + y * mappedResource.RowPitch, rowSize);
+			}
+			context->Unmap(readback.StagingTexture->mTexture, 0);
+			mHdrCaptureWriter.submit(std::move(frame));
 		}
-		context->Unmap(mBackBufferHdrStagingTexture->mTexture, 0);
-		delete[] dataResolved;
+
+		mHdrCaptureRingHead = (mHdrCaptureRingHead + 1) % HdrCaptureRingSize;
+		mHdrCaptureRingPendingCount--;
 	}
 }
 
@@ -411,16 +489,25 @@ void Game::allocateResolutionIndependentResources()
 	TempLUTs.Allocate(LutsInfo);
 
 	{
-		D3dTexture3dDesc desc = Texture3D::initDefault(DXGI_FORMAT_R16G16B16A16_FLOAT, 32, 32, 32, true, true);
+		D3dTexture3dDesc desc = Texture3D::initDefault(DXGI_FORMAT_R16G16B16A16_FLOAT,
+			mSkyLutConfig.CameraVolumeWidth, mSkyLutConfig.CameraVolumeHeight, mSkyLutConfig.CameraVolumeSliceCount, true, true);
 		AtmosphereCameraScatteringVolume = new Texture3D(desc);
 		desc.Format = DXGI_FORMAT_R11G11B10_FLOAT;
 		AtmosphereCameraTransmittanceVolume = new Texture3D(desc);
+
+		D3dTexture2dDesc cullingDesc = Texture2D::initDefault(DXGI_FORMAT_R32G32_FLOAT, mSkyLutConfig.CameraVolumeWidth, mSkyLutConfig.CameraVolumeHeight, false, true);
+		mCameraVolumeCullingTex = new Texture2D(cullingDesc);
+		cullingDesc.BindFlags = 0;
+		cullingDesc.Usage = D3D11_USAGE_STAGING;
+		cullingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		mCameraVolumeCullingStagingTex = new Texture2D(cullingDesc);
 	}
 
 	mBlueNoise2dTex = createTexture2dFromExr("./Resources/bluenoise.exr");		// I do not remember where this noise texture comes from.
 	mTerrainHeightmapTex = createTexture2dFromExr("./Resources/heightmap1.exr");
 
-	D3dTexture2dDesc desc = Texture2D::initDefault(DXGI_FORMAT_R16G16B16A16_FLOAT, LutsInfo.TRANSMITTANCE_TEXTURE_WIDTH, LutsInfo.TRANSMITTANCE_TEXTURE_HEIGHT, true, true);
+	// Sized from the LUT configuration, LutsInfo keeps the Bruneton 2017 table sizes (and disk cache keys) unchanged.
+	D3dTexture2dDesc desc = Texture2D::initDefault(DXGI_FORMAT_R16G16B16A16_FLOAT, mSkyLutConfig.TransmittanceWidth, mSkyLutConfig.TransmittanceHeight, true, true);
 	mTransmittanceTex = new Texture2D(desc);
 
 	{
@@ -435,12 +522,20 @@ void Game::allocateResolutionIndependentResources()
 	}
 
 	{
-		D3dTexture2dDesc descSkyView = desc;
-		descSkyView.Width = 192;
-		descSkyView.Height = 108;
-		descSkyView.Format = DXGI_FORMAT_R11G11B10_FLOAT;
-		mSkyViewLutTex = new Texture2D(descSkyView);
+		D3dTexture2dDesc descSunInScatter = Texture2D::initDefault(DXGI_FORMAT_R16G16B16A16_FLOAT, mSkyLutConfig.SunInScatterWidth, mSkyLutConfig.SunInScatterHeight, true, false);
+		mSunInScatterTransmittanceTex = new Texture2D(descSunInScatter);
+		mSunInScatterMultiScatTex = new Texture2D(descSunInScatter);
 	}
+
+	allocateSkyViewLut(mSkyLutConfig.SkyViewWidth, mSkyLutConfig.SkyViewHeight);
+}
+
+void Game::allocateSkyViewLut(uint32 width, uint32 height)
+{
+	resetPtr(&mSkyViewLutTex);
+	D3dTexture2dDesc descSkyView = Texture2D::initDefault(DXGI_FORMAT_R11G11B10_FLOAT, width, height, true, true);
+	mSkyViewLutTex = new Texture2D(descSkyView);
+	mSkyViewLutFullUpdateNeeded = true;
 }
 
 void Game::releaseResolutionIndependentResources()
@@ -473,6 +568,8 @@ void Game::releaseResolutionIndependentResources()
 
 	resetPtr(&AtmosphereCameraScatteringVolume);
 	resetPtr(&AtmosphereCameraTransmittanceVolume);
+	resetPtr(&mCameraVolumeCullingTex);
+	resetPtr(&mCameraVolumeCullingStagingTex);
 
 	resetPtr(&mBlueNoise2dTex);
 	resetPtr(&mTerrainHeightmapTex);
@@ -480,7 +577,11 @@ void Game::releaseResolutionIndependentResources()
 	resetPtr(&mTransmittanceTex);
 	resetPtr(&MultiScattTex);
 	resetPtr(&MultiScattStep0Tex);
+	resetPtr(&mSunInScatterTransmittanceTex);
+	resetPtr(&mSunInScatterMultiScatTex);
 	resetPtr(&mSkyViewLutTex);
+	resetPtr(&mSkyViewLutAtlasTex);
+	mSkyViewLutAtlasKey = 0;
 }
 
 void Game::allocateResolutionDependentResources(uint32 newWidth, uint32 newHeight)
@@ -500,13 +601,30 @@ void Game::allocateResolutionDependentResources(uint32 newWidth, uint32 newHeigh
 		desc.BindFlags = 0;
 		desc.Usage = D3D11_USAGE_STAGING;
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-		mBackBufferHdrStagingTexture = new Texture2D(desc);
+		D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_EVENT, 0 };
+		for (uint32 i = 0; i < HdrCaptureRingSize; ++i)
+		{
+			mHdrCaptureRing[i].StagingTexture = new Texture2D(desc);
+			g_dx11Device->getDevice()->CreateQuery(&queryDesc, &mHdrCaptureRing[i].CopyDoneQuery);
+		}
+		mHdrCaptureRingHead = 0;
+		mHdrCaptureRingPendingCount = 0;
 	}
 	{
 		D3D11_TEXTURE2D_DESC pathTracingBufferDesc = backBufferHdrDesc;
 		pathTracingBufferDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;	// Could use 111110 if there is no count when used only for blur and accumulate
 		mPathTracingLuminanceBuffer = new Texture2D(pathTracingBufferDesc);
 		mPathTracingTransmittanceBuffer = new Texture2D(pathTracingBufferDesc);
+		mPathTracingLuminanceSquaredBuffer = new Texture2D(pathTracingBufferDesc);
+
+		D3D11_TEXTURE2D_DESC convergenceDesc = Texture2D::initDefault(DXGI_FORMAT_R32_FLOAT,
+			(newWidth + PathTracingTileSize - 1) / PathTracingTileSize, (newHeight + PathTracingTileSize - 1) / PathTracingTileSize, true, false);
+		mPathTracingConvergenceTex = new Texture2D(convergenceDesc);
+		convergenceDesc.BindFlags = 0;
+		convergenceDesc.Usage = D3D11_USAGE_STAGING;
+		convergenceDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		mPathTracingConvergenceStagingTex = new Texture2D(convergenceDesc);
+		mPathTracingConvergenceReadbackPending = false;
 	}
 	{
 		D3D11_TEXTURE2D_DESC FrameAtmosphereDesc = backBufferHdrDesc;
@@ -521,10 +639,18 @@ void Game::releaseResolutionDependentResources()
 {
 	resetPtr(&mBackBufferHdr);
 	resetPtr(&mBackBufferDepth);
-	resetPtr(&mBackBufferHdrStagingTexture);
+	processHdrCaptureReadbacks(mHdrCaptureRingPendingCount);	// Do not lose captures still in flight
+	for (uint32 i = 0; i < HdrCaptureRingSize; ++i)
+	{
+		resetPtr(&mHdrCaptureRing[i].StagingTexture);
+		resetComPtr(&mHdrCaptureRing[i].CopyDoneQuery);
+	}
 	resetPtr(&mPathTracingLuminanceBuffer);
 	resetPtr(&mFrameAtmosphereBuffer);
 	resetPtr(&mPathTracingTransmittanceBuffer);
+	resetPtr(&mPathTracingLuminanceSquaredBuffer);
+	resetPtr(&mPathTracingConvergenceTex);
+	resetPtr(&mPathTracingConvergenceStagingTex);
 	resetPtr(&mShadowMap);
 }
 
@@ -538,6 +664,7 @@ void Game::shutdown()
 
 	releaseResolutionIndependentResources();
 	releaseResolutionDependentResources();
+	mHdrCaptureWriter.flush();
 
 	////////// Release shaders
 
@@ -546,6 +673,8 @@ void Game::shutdown()
 
 void Game::update(const WindowInputData& inputData)
 {
+	CPU_SCOPED_TIMER(GameUpdate);
+
 	static int previousMouseX = inputData.mInputStatus.mouseX;
 	static int previousMouseY = inputData.mInputStatus.mouseY;
 	for (auto& event : inputData.mInputEvents)
@@ -613,6 +742,7 @@ void Game::update(const WindowInputData& inputData)
 		lastLoadTime = tickCount;
 	}
 
+	CPU_SCOPED_TIMER(CameraMatrices);
 	const D3dViewport& backBufferViewport = g_dx11Device->getBackBufferViewport();
 	float aspectRatioXOverY = backBufferViewport.Width / backBufferViewport.Height;
 	mCamPosFinal = { 0.0, 0.0f, 0.0f };
@@ -669,7 +799,6 @@ void Game::update(const WindowInputData& inputData)
 	}
 }
 
-auto EqualFloat3 = [](const GlslVec3& a, const GlslVec3& b) {return a.x == b.x && a.y == b.y && a.z == b.z; };
 auto CreateGlslVec3 = [](float x, float y, float z) {GlslVec3 vec = { x, y, z }; return vec; };
 auto length3 = [](GlslVec3& v) {return sqrtf(v.x*v.x + v.y*v.y + v.z*v.z); };
 auto normalize3 = [](GlslVec3& v, float l) {GlslVec3 r; r.x = v.x / l, r.y = v.y / l, r.z = v.z / l; return r; };
@@ -681,6 +810,7 @@ auto MaxZero3 = [](GlslVec3& a) {GlslVec3 r; r.x=a.x>0.0f?a.x:0.0f; r.y=a.y>0.0f
 
 void Game::updateSkyAtmosphereConstant()
 {
+	CPU_SCOPED_TIMER(UpdateSkyAtmosphereConstant);
 	D3dRenderContext* context = g_dx11Device->getDeviceContext();
 
 	// Constant buffer update
@@ -750,6 +880,25 @@ void Game::updateSkyAtmosphereConstant()
 	}
 }
 
+void Game::getLutViewInputs(LutViewInputs& inputs) const
+{
+	const D3dViewport& backBufferViewport = g_dx11Device->getBackBufferViewport();
+	memset(&inputs, 0, sizeof(LutViewInputs));	// Padding is compared too
+	inputs.ViewProjMat = mViewProjMat;
+	inputs.CamPos = mCamPosFinal;
+	inputs.SunDir = mSunDir;
+	inputs.SunIlluminance = mConstantBufferCPU.gSunIlluminance;
+	inputs.Resolution[0] = uint32(backBufferViewport.Width);
+	inputs.Resolution[1] = uint32(backBufferViewport.Height);
+	inputs.RayMarchMinMaxSPP[0] = mConstantBufferCPU.RayMarchMinMaxSPP[0];
+	inputs.RayMarchMinMaxSPP[1] = mConstantBufferCPU.RayMarchMinMaxSPP[1];
+	inputs.SkyViewLutResolution[0] = mSkyViewLutTex->mDesc.Width;
+	inputs.SkyViewLutResolution[1] = mSkyViewLutTex->mDesc.Height;
+	inputs.CameraVolumePrefix = uiCameraVolumePrefix ? 1 : 0;
+	inputs.SunInScatterLut = uiSunInScatterLut ? 1 : 0;
+	inputs.SkyViewLutAtlas = uiSkyViewLutAtlas && mSkyViewLutAtlasTex != nullptr ? 1 : 0;
+}
+
 static float MieScatteringLength;
 static GlslVec3 MieScatteringColor;
 static float MieAbsLength;
@@ -766,7 +915,6 @@ static GlslVec3 AbsorptionColor;
 static float AtmosphereHeight;
 
 static GlslVec3 uiGroundAbledo = {0.0f, 0.0f, 0.0f};
-static GlslVec3 uiGroundAbledoPrev;
 
 static float uiCamHeightPrev;
 static float uiCamForwardPrev;
@@ -777,12 +925,18 @@ static int uiRenderingMethodPrev = -1;
 static int NumScatteringOrderPrev = 0;
 
 static int transPermutationPrev = 0;
+static int samplerPermutationPrev = 0;
+static bool pathTracingAdaptivePrev = false;
+static float pathTracingTargetRelativeErrorPrev = 0.0f;
 static bool shadowPermutationPrev = 0;
 static bool RenderTerrainPrev = 0;
 static float multipleScatteringFactorPrev = 0;
+static bool analyticOpticalDepthPrev = false;
 
 void Game::render()
 {
+	CPU_SCOPED_TIMER(GameRender);
+
 	//  Menu/imgui
 	{
 		uiCamHeightPrev = uiCamHeight;
@@ -790,7 +944,7 @@ void Game::render()
 		uiSunYawPrev = uiSunYaw;
 		uiSunPitchPrev = uiSunPitch;
 		NumScatteringOrderPrev = NumScatteringOrder;
-		uiGroundAbledoPrev = uiGroundAbledo = AtmosphereInfos.ground_albedo;
+		uiGroundAbledo = AtmosphereInfos.ground_albedo;
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		ImGui::Begin("Scene");
@@ -804,6 +958,32 @@ void Game::render()
 		ImGui::Checkbox("PrintDebug", &mPrintDebug);
 		ImGui::Separator();
 
+		ImGui::Text("HDR capture (C for a screenshot)");
+		if (ImGui::Checkbox("Capture sequence", &uiCaptureSequence) && uiCaptureSequence)
+		{
+			mCaptureSequenceFrame = 0;
+			mHdrCaptureRingWaitSeconds = 0.0;
+			mHdrCaptureWriter.resetStats();
+		}
+		const char* listbox_compressions[HdrCaptureCompressionCount];
+		for (int c = 0; c < HdrCaptureCompressionCount; ++c)
+		{
+			listbox_compressions[c] = getHdrCaptureCompressionName(HdrCaptureCompression(c));
+		}
+		if (ImGui::Combo("EXR compression", &uiCaptureCompression, listbox_compressions, HdrCaptureCompressionCount))
+		{
+			mHdrCaptureWriter.setCompression(HdrCaptureCompression(uiCaptureCompression));
+		}
+		{
+			const HdrCaptureWriter::Stats captureStats = mHdrCaptureWriter.getStats();
+			sprintf_s(tmp, sizeof(tmp), "Written %llu (%.1f fps), queued %u, failed %llu", captureStats.FramesWritten, captureStats.FramesPerSecond,
+				captureStats.QueuedFrames + mHdrCaptureRingPendingCount, captureStats.FramesFailed);
+			ImGui::Text(tmp);
+			sprintf_s(tmp, sizeof(tmp), "Frame loop waits: GPU %.1f ms, writer %.1f ms", 1000.0 * mHdrCaptureRingWaitSeconds, 1000.0 * captureStats.SubmitWaitSeconds);
+			ImGui::Text(tmp);
+		}
+		ImGui::Separator();
+
 		ImGui::Text("View");
 		ImGui::SliderFloat("Height", &uiCamHeight, 0.001f, 2.0f*(AtmosphereInfos.top_radius - AtmosphereInfos.bottom_radius), "%.3f", 3.0f);
 		ImGui::SliderFloat("Forward", &uiCamForward, -3.0f*AtmosphereInfos.top_radius, -1.0f, "%.3f", 3.0f);
@@ -869,6 +1049,9 @@ void Game::render()
 		ImGui::Combo("Render method", &uiRenderingMethod, listbox_renderingMethods, MethodCount, 3);
 
 		transPermutationPrev = currentTransPermutation;
+		samplerPermutationPrev = currentSamplerPermutation;
+		pathTracingAdaptivePrev = uiPathTracingAdaptive;
+		pathTracingTargetRelativeErrorPrev = uiPathTracingTargetRelativeError;
 		shadowPermutationPrev = currentShadowPermutation;
 		RenderTerrainPrev = RenderTerrain;
 		if (uiRenderingMethod == MethodPathTracing || uiRenderingMethod == MethodRaymarching)
@@ -877,6 +1060,23 @@ void Game::render()
 			{
 				const char* listbox_transmittanceMethods[] = { "TransmittanceDeltaTracking", "TransmittanceRatioTracking", "TransmittanceLUT" };
 				ImGui::Combo("Trans method", &currentTransPermutation, listbox_transmittanceMethods, TransmittanceMethodCount, 3);
+				const char* listbox_samplers[] = { "Hash", "Sobol Owen", "Rank-1 lattice" };
+				ImGui::Combo("Sampler", &currentSamplerPermutation, listbox_samplers, SamplerCount, 3);
+				ImGui::Checkbox("Adaptive sampling", &uiPathTracingAdaptive);
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Stop sampling %ux%u tiles once the standard error of all their pixels is below the target, relative to the pixel luminance.", PathTracingTileSize, PathTracingTileSize);
+				if (uiPathTracingAdaptive)
+				{
+					ImGui::SliderFloat("Target rel. error", &uiPathTracingTargetRelativeError, 0.01f, 0.5f, "%.3f", 2.0f);
+					char tmp[128];
+					sprintf_s(tmp, sizeof(tmp), "Converged tiles %.1f%%", 100.0f * mPathTracingConvergedTileRatio);
+					ImGui::Text(tmp);
+					if (mPathTracingTargetReachedTimeSec >= 0.0f)
+					{
+						sprintf_s(tmp, sizeof(tmp), "Target reached at frame %u after %.2f s", mPathTracingTargetReachedFrame, mPathTracingTargetReachedTimeSec);
+						ImGui::Text(tmp);
+					}
+				}
 			}
 
 			ImGui::Checkbox("ShadowMap", &currentShadowPermutation);
@@ -888,7 +1088,66 @@ void Game::render()
 			ImGui::SliderInt("Min SPP", &uiViewRayMarchMinSPP, 1, 30);
 			ImGui::SliderInt("Max SPP", &uiViewRayMarchMaxSPP, 2, 31);
 			ImGui::Checkbox("FastSky",  &currentFastSky);
+			if (currentFastSky)
+			{
+				// The sky view LUT is reallocated and, through LutViewInputs, rebuilt
+				const char* listbox_skyViewLutTiers[SkyViewLutTierCount + 1] = { "Config" };
+				char tierNames[SkyViewLutTierCount][64];
+				for (int t = 0; t < SkyViewLutTierCount; ++t)
+				{
+					uint32 width, height;
+					getSkyViewLutTierResolution(SkyViewLutTier(t), width, height);
+					sprintf_s(tierNames[t], sizeof(tierNames[t]), "%s %ux%u", getSkyViewLutTierName(SkyViewLutTier(t)), width, height);
+					listbox_skyViewLutTiers[t + 1] = tierNames[t];
+				}
+				int comboIndex = uiSkyViewLutTier + 1;
+				if (ImGui::Combo("Sky view LUT", &comboIndex, listbox_skyViewLutTiers, SkyViewLutTierCount + 1))
+				{
+					uiSkyViewLutTier = comboIndex - 1;
+					uint32 width = mSkyLutConfig.SkyViewWidth;
+					uint32 height = mSkyLutConfig.SkyViewHeight;
+					if (uiSkyViewLutTier >= 0)
+					{
+						getSkyViewLutTierResolution(SkyViewLutTier(uiSkyViewLutTier), width, height);
+					}
+					allocateSkyViewLut(width, height);
+				}
+
+				const int texelCount = int(mSkyViewLutTex->mDesc.Width * mSkyViewLutTex->mDesc.Height);
+				int texelBudget = mSkyLutConfig.SkyViewTexelBudget > 0 ? int(mSkyLutConfig.SkyViewTexelBudget) : texelCount;
+				if (ImGui::SliderInt("Sky view texels/frame", &texelBudget, texelCount / SKY_VIEW_LUT_MAX_INTERLEAVE, texelCount))
+				{
+					mSkyLutConfig.SkyViewTexelBudget = texelBudget >= texelCount ? 0 : uint32(texelBudget);
+				}
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Amortized updates: each frame updates 1/%u of the texels, the others being kept.", getSkyViewLutInterleave(uint32(texelCount), mSkyLutConfig.SkyViewTexelBudget));
+				if (mSkyLutConfig.SkyViewTexelBudget > 0)
+				{
+					ImGui::SliderFloat("Full update height", &mSkyLutConfig.SkyViewRefreshHeight, 0.0f, 10.0f, "%.2f km");
+					ImGui::SliderFloat("Full update sun angle", &mSkyLutConfig.SkyViewRefreshSunAngle, 0.0f, 0.2f, "%.3f rad");
+				}
+			}
 			ImGui::Checkbox("FastAerialPersepctive",  &currentAerialPerspective);
+			ImGui::Checkbox("Prefix camera volume", &uiCameraVolumePrefix);
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("Integrates each froxel column front to back once instead of marching every slice from the camera.");
+			if (uiCameraVolumePrefix)
+			{
+				char tmp[128];
+				sprintf_s(tmp, sizeof(tmp), "Froxels: %.1f%% marched, %.1f%% below ground, %.1f%% outside", mCameraVolumeMarchedRatio * 100.0f,
+					mCameraVolumeGroundCulledRatio * 100.0f, mCameraVolumeSpaceCulledRatio * 100.0f);
+				ImGui::Text(tmp);
+			}
+			ImGui::Checkbox("Sun in-scatter LUT", &uiSunInScatterLut);
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("Sky view LUT and camera volume steps fetch the shadowed sun transmittance and the multiple scattering from a height x sun angle LUT.");
+			if (currentFastSky)
+			{
+				ImGui::Checkbox("Sky view LUT atlas", &uiSkyViewLutAtlas);
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("Blends the sky view LUT from a time of day atlas baked by SkyCpuTools bake-sky-view-atlas. %s",
+						mSkyViewLutAtlasTex ? "Atlas loaded." : "No atlas for this atmosphere and configuration in the LUT cache.");
+			}
 			if(!currentAerialPerspective)
 				ImGui::Checkbox("RGB Transmittance",  &currentColoredTransmittance);
 		}
@@ -900,6 +1159,23 @@ void Game::render()
 			if (ImGui::IsItemHovered())
 				ImGui::SetTooltip("If DualScattering>0, the path tracer will use it and stop at the first path depth.");
 		}
+		analyticOpticalDepthPrev = currentAnalyticOpticalDepth;
+		if (uiRenderingMethod != MethodBruneton2017)
+		{
+			ImGui::Checkbox("Analytic optical depth", &currentAnalyticOpticalDepth);
+			if (ImGui::IsItemHovered())
+				ImGui::SetTooltip("Transmittance LUT: Chapman approximation for the exponential Rayleigh and Mie densities, only ozone is ray marched.");
+		}
+
+		ImGui::Separator();
+		ImGui::Text("LUTs dirty/rebuild counts");
+		for (uint32 n = 0; n < LutNodeCount; ++n)
+		{
+			const LutNode Node = LutNode(n);
+			sprintf_s(tmp, sizeof(tmp), "%s%s: %u/%u", LutDependencyGraph::getNodeName(Node), LutGraph.needsRebuild(Node) ? " (stale)" : "",
+				LutGraph.getDirtyCount(Node), LutGraph.getRebuildCount(Node));
+			ImGui::Text(tmp);
+		}
 
 		ImGui::End();
 		////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -942,7 +1218,20 @@ void Game::render()
 		uiViewRayMarchMaxSPP = uiViewRayMarchMinSPP >= uiViewRayMarchMaxSPP ? uiViewRayMarchMinSPP + 1 : uiViewRayMarchMaxSPP;
 		mConstantBufferCPU.RayMarchMinMaxSPP[0] = float(uiViewRayMarchMinSPP);
 		mConstantBufferCPU.RayMarchMinMaxSPP[1] = float(uiViewRayMarchMaxSPP);
-		mConstantBufferCPU.gScreenshotCaptureActive = false; // Make sure the terrain or sundisk are not taken into account to focus on the most important part: atmosphere.
+		mConstantBufferCPU.gPathTracingTargetRelativeError = uiPathTracingAdaptive ? uiPathTracingTargetRelativeError : 0.0f;
+		mConstantBufferCPU.gPathTracingMinSamples = CPU_PATH_TRACING_MIN_SAMPLES;
+		mConstantBufferCPU.gSkyViewLutResolution[0] = float(mSkyViewLutTex->mDesc.Width);
+		mConstantBufferCPU.gSkyViewLutResolution[1] = float(mSkyViewLutTex->mDesc.Height);
+		mConstantBufferCPU.gSunInScatterLutResolution[0] = float(mSunInScatterTransmittanceTex->mDesc.Width);
+		mConstantBufferCPU.gSunInScatterLutResolution[1] = float(mSunInScatterTransmittanceTex->mDesc.Height);
+		mConstantBufferCPU.gTransmittanceLutResolution[0] = float(mTransmittanceTex->mDesc.Width);
+		mConstantBufferCPU.gTransmittanceLutResolution[1] = float(mTransmittanceTex->mDesc.Height);
+		mConstantBufferCPU.gCameraVolumeSliceCount = float(AtmosphereCameraScatteringVolume->mDesc.Depth);
+		mConstantBufferCPU.gCameraVolumeKmPerSlice = mSkyLutConfig.CameraVolumeKmPerSlice;
+		mConstantBufferCPU.gTransmittanceSampleCount = mSkyLutConfig.TransmittanceSampleCount;
+		mConstantBufferCPU.gMultiScatteringSampleCount = mSkyLutConfig.MultiScatteringSampleCount;
+		mConstantBufferCPU.gCameraVolumeSamplesPerSlice = mSkyLutConfig.CameraVolumeSamplesPerSlice;
+		mConstantBufferCPU.gScreenshotCaptureActive = mCaptureState.active ? 1.0f : 0.0f; // Make sure the terrain or sundisk are not taken into account to focus on the most important part: atmosphere.
 		ElapsedTimeSec += mConstantBufferCPU.gFrameTimeSec;
 		mConstantBuffer->update(mConstantBufferCPU);
 	}
@@ -966,6 +1255,14 @@ void Game::render()
 		{
 			context->ClearRenderTargetView(mPathTracingLuminanceBuffer->mRenderTargetView, &clearColor.r);
 			context->ClearRenderTargetView(mPathTracingTransmittanceBuffer->mRenderTargetView, &clearColor.r);
+			context->ClearRenderTargetView(mPathTracingLuminanceSquaredBuffer->mRenderTargetView, &clearColor.r);
+			D3DCOLORVALUE notConverged = { 0.0f, 0.0f, 0.0f, 0.0f };
+			context->ClearRenderTargetView(mPathTracingConvergenceTex->mRenderTargetView, &notConverged.r);
+			mPathTracingAccumulationIndex++;
+			mPathTracingAccumulatedFrames = 0;
+			mPathTracingStartTimeSec = mConstantBufferCPU.gTimeSec;
+			mPathTracingConvergedTileRatio = 0.0f;
+			mPathTracingTargetReachedTimeSec = -1.0f;
 		}
 	}
 
@@ -988,16 +1285,35 @@ void Game::render()
 
 	updateSkyAtmosphereConstant();
 
-	bool AtmosphereHasChanged = forceGenLut;
-	if (memcmp(&AtmosphereInfos, &AtmosphereInfosSaved, sizeof(AtmosphereInfo)) != 0 || uiRenderingMethodPrev != uiRenderingMethod
-		|| NumScatteringOrderPrev != NumScatteringOrder || !EqualFloat3(uiGroundAbledoPrev, uiGroundAbledo) || currentTransPermutation != transPermutationPrev
-		|| shadowPermutationPrev != currentShadowPermutation || multipleScatteringFactorPrev != currentMultipleScatteringFactor
-		|| RenderTerrainPrev != RenderTerrain)
+	// Only mark as stale the LUTs reading an input that changed, see LutDependencyGraph.
+	uint32 InvalidatedLuts = LutGraph.invalidateAtmosphere(AtmosphereInfosSaved, AtmosphereInfos);
+	memcpy(&AtmosphereInfosSaved, &AtmosphereInfos, sizeof(AtmosphereInfo));
+	if (NumScatteringOrderPrev != NumScatteringOrder)
+		InvalidatedLuts |= LutGraph.invalidate(LutInputScatteringOrder);
+	if (multipleScatteringFactorPrev != currentMultipleScatteringFactor)
+		InvalidatedLuts |= LutGraph.invalidate(LutInputMultipleScatteringFactor);
+	if (analyticOpticalDepthPrev != currentAnalyticOpticalDepth)
+		InvalidatedLuts |= LutGraph.invalidate(LutInputOpticalDepthMethod);
+	if (uiRenderingMethodPrev != uiRenderingMethod)
+		InvalidatedLuts |= LutGraph.invalidate(LutInputRenderingMethod);
+	{
+		LutViewInputs ViewInputs;
+		getLutViewInputs(ViewInputs);
+		if (memcmp(&ViewInputs, &LutViewInputsSaved, sizeof(LutViewInputs)) != 0)
+		{
+			LutGraph.invalidate(LutInputView);	// Camera moves do not reset the path tracer accumulation, see ShouldClearPathTracedBuffer above.
+			memcpy(&LutViewInputsSaved, &ViewInputs, sizeof(LutViewInputs));
+		}
+	}
+
+	mSkyViewLutFullUpdateNeeded |= (InvalidatedLuts & lutNodeBit(LutNodeSkyView)) != 0;	// Only view changes can be amortized
+	mFramesSinceLutInvalidation = InvalidatedLuts != 0 ? 0 : mFramesSinceLutInvalidation + 1;
+
+	if (InvalidatedLuts != 0 || uiRenderingMethodPrev != uiRenderingMethod || currentTransPermutation != transPermutationPrev || currentSamplerPermutation != samplerPermutationPrev
+		|| shadowPermutationPrev != currentShadowPermutation || RenderTerrainPrev != RenderTerrain
+		|| pathTracingAdaptivePrev != uiPathTracingAdaptive || pathTracingTargetRelativeErrorPrev != uiPathTracingTargetRelativeError)
 	{
-		forceGenLut |= true;
-		AtmosphereHasChanged = true;
 		ShouldClearPathTracedBuffer = true;
-		memcpy(&AtmosphereInfosSaved, &AtmosphereInfos, sizeof(AtmosphereInfo));
 		mFrameId = 0;
 	}
 
@@ -1006,36 +1322,81 @@ void Game::render()
 
 	{
 		GPU_SCOPED_TIMEREVENT(SkyRender, 255, 255, 255);
-		if (uiRenderingMethod != MethodBruneton2017)
+		if (uiRenderingMethod != MethodBruneton2017 && LutGraph.needsRebuild(LutNodeTransmittance))
 		{
 			renderTransmittanceLutPS();
+			LutGraph.markRebuilt(LutNodeTransmittance);
 		}
 
-		if(uiRenderingMethod == MethodRaymarching || (uiRenderingMethod == MethodPathTracing && currentMultipleScatteringFactor > 0.0f))
+		if ((uiRenderingMethod == MethodRaymarching || (uiRenderingMethod == MethodPathTracing && currentMultipleScatteringFactor > 0.0f))
+			&& LutGraph.needsRebuild(LutNodeMultiScattering))
 		{
 			renderNewMultiScattTexPS();
+			LutGraph.markRebuilt(LutNodeMultiScattering);
 		}
 
 		if (uiRenderingMethod == MethodPathTracing)
 		{
 			renderPathTracing();
+			mPathTracingAccumulatedFrames++;
 			RenderSkyAtmosphereOverOpaque();
 		}
 		else if (uiRenderingMethod == MethodRaymarching)
 		{
-			if (currentFastSky)
+			if (uiSunInScatterLut && LutGraph.needsRebuild(LutNodeSunInScatter))
+			{
+				renderSunInScatterLut();
+				LutGraph.markRebuilt(LutNodeSunInScatter);
+			}
+			if (currentFastSky && uiSkyViewLutAtlas && LutGraph.needsRebuild(LutNodeSkyView))
+			{
+				updateSkyViewLutAtlas();
+			}
+			if (currentFastSky && uiSkyViewLutAtlas && mSkyViewLutAtlasTex && LutGraph.needsRebuild(LutNodeSkyView))
+			{
+				renderSkyViewLutFromAtlas();
+				LutGraph.markRebuilt(LutNodeSkyView);
+			}
+			else if (currentFastSky && (LutGraph.needsRebuild(LutNodeSkyView) || mSkyViewLutPendingPhases > 0))
+			{
 				renderSkyViewLut();
-			generateSkyAtmosphereCameraVolumeWithRayMarch();
+				LutGraph.markRebuilt(LutNodeSkyView);
+			}
+			if (LutGraph.needsRebuild(LutNodeAerialPerspective))
+			{
+				generateSkyAtmosphereCameraVolumeWithRayMarch();
+				LutGraph.markRebuilt(LutNodeAerialPerspective);
+			}
+			readbackCameraVolumeCulling();
 			renderRayMarching();
 		}
 		else
 		{
-			if (AtmosphereHasChanged)
+			if (LutGraph.needsRebuild(LutNodeBruneton2017))
+			{
+				// Known atmospheres are loaded from the disk cache, see LutDiskCache.h
+				const uint64 LutCacheKey = computeLutCacheKey(AtmosphereInfos, LutsInfo, NumScatteringOrder);
+				LutCachePendingKey = 0;
+				if (LutCacheSkipLoad || !loadSkyAtmosphereLUTsFromCache(LutCacheKey))
+				{
+					generateSkyAtmosphereLUTs();
+					LutCachePendingKey = LutCacheKey;
+					LutCachePendingFrames = 0;
+				}
+				LutCacheSkipLoad = false;
+				LutGraph.markRebuilt(LutNodeBruneton2017);
+			}
+			else if (LutCachePendingKey != 0 && ++LutCachePendingFrames >= 30)
+			{
+				// Only save once the atmosphere stopped changing to not write an entry per frame while a slider is being dragged.
+				saveSkyAtmosphereLUTsToCache(LutCachePendingKey);
+				LutCachePendingKey = 0;
+			}
+			if (LutGraph.needsRebuild(LutNodeAerialPerspective))
 			{
-				generateSkyAtmosphereLUTs();
-				forceGenLut = false;
+				generateSkyAtmosphereCameraVolumes();
+				LutGraph.markRebuilt(LutNodeAerialPerspective);
 			}
-			generateSkyAtmosphereCameraVolumes();
 			renderSkyAtmosphereUsingLUTs();
 		}
 	}
@@ -1081,11 +1442,23 @@ void Game::render()
 	if (takeScreenShot)
 	{
 		const char* screenShotFilePath = "screenshot.exr";
-		D3dRenderContext* context = g_dx11Device->getDeviceContext();
-		context->CopyResource(mBackBufferHdrStagingTexture->mTexture, mBackBufferHdr->mTexture);
-		saveBackBufferHdr(screenShotFilePath);
+		queueBackBufferHdrCapture(screenShotFilePath);
 		takeScreenShot = false;
 	}
+	if (uiCaptureSequence)
+	{
+		char captureFilePath[64];
+		sprintf_s(captureFilePath, sizeof(captureFilePath), "capture_%05u.exr", mCaptureSequenceFrame++);
+		queueBackBufferHdrCapture(captureFilePath);
+	}
+	if (mCaptureState.active && !updateCaptureState(mCaptureState, *this))
+	{
+		char tmp[256];
+		sprintf_s(tmp, sizeof(tmp), "Capture sequence done: %u captures, %u timed out, %u frames\n", mCaptureState.capturedCount, mCaptureState.timedOutCount, mCaptureState.totalFrameCount);
+		OutputDebugStringA(tmp);
+		mExitRequested = mExitWhenCaptureSequenceDone;
+	}
+	processHdrCaptureReadbacks(0);
 	mFrameId++;
 
 }
@@ -8,27 +8,15 @@
 
 
 #include "SkyAtmosphereCommon.h"
+#include "LutDependencyGraph.h"
+#include "LutDiskCache.h"
 #include "GpuDebugRenderer.h"
+#include "HdrCaptureWriter.h"
+#include "CaptureSequence.h"
+#include "SkyLutConfig.h"
 #include <functional>
 
-struct CaptureEvent
-{
-	bool setupdone = false;
-	bool skipScreenshot = false;
-	char filename[256];
-	std::function<void(void)> stateSetup;
-	uint32 waitFrameCount = 3;
-};
-
-struct CaptureState
-{
-	bool active = false;
-	uint32 eventId = 0;
-	uint32 frame = 0;
-	std::vector<CaptureEvent> events;
-};
-
-class Game
+class Game : public CaptureSequenceRenderer
 {
 public:
 	Game();
@@ -41,6 +29,18 @@ public:
 	void update(const WindowInputData& inputData);
 	void render();
 
+	/// Runs a capture script (see CaptureSequence.h), one capture after the other. Returns false if the script could not be loaded.
+	bool startCaptureSequence(const char* scriptPath, bool exitWhenDone);
+	bool isExitRequested() const { return mExitRequested; }
+	/// Loads the LUT resolutions and sample counts (see SkyLutConfig.h), to be called before initialise. Returns false and keeps the defaults on error.
+	bool loadSkyLutConfig(const char* filepath);
+
+	// CaptureSequenceRenderer
+	void setSceneState(const CaptureSceneState& state) override;
+	bool areLutsReady() const override { return mFramesSinceLutInvalidation > 0; }
+	uint32 getPathTracingSampleCount() const override { return ShouldClearPathTracedBuffer ? 0 : mPathTracingAccumulatedFrames; }	// The accumulation is about to restart
+	void captureScreenshot(const char* filename) override { queueBackBufferHdrCapture(filename); }
+
 private:
 
 	/// Load/reload all shaders if compilation is succesful.
@@ -53,8 +53,15 @@ private:
 	void releaseResolutionIndependentResources();
 	void allocateResolutionDependentResources(uint32 newWidth, uint32 newHeight);
 	void releaseResolutionDependentResources();
+	/// (Re)creates mSkyViewLutTex, shaders reading its size from gSkyViewLutResolution.
+	void allocateSkyViewLut(uint32 width, uint32 height);
 
-	void saveBackBufferHdr(const char* filepath);
+	// HDR back buffer captures: the copy goes to a staging texture of a ring and is only mapped once its event query
+	// signaled, a few frames later. The frame loop thus never waits for the GPU unless all the ring slots are in flight.
+	// Texels are then handed to mHdrCaptureWriter that encodes the EXR on its own thread.
+	void queueBackBufferHdrCapture(const char* filepath);
+	/// Hands the completed readbacks to the writer, waiting for the waitCount oldest ones if they are not done yet.
+	void processHdrCaptureReadbacks(uint32 waitCount);
 
 	// Test vertex buffer
 	struct VertexType
@@ -87,7 +94,26 @@ private:
 		float gScreenshotCaptureActive;
 
 		float RayMarchMinMaxSPP[2];
-		float pad[2];
+		float gPathTracingTargetRelativeError;
+
+		float gSkyViewLutResolution[2];
+		float gCameraVolumeSliceCount;
+		float gCameraVolumeKmPerSlice;
+
+		float gTransmittanceSampleCount;
+		float gMultiScatteringSampleCount;
+		float gCameraVolumeSamplesPerSlice;
+		unsigned int gSkyViewLutInterleave;
+
+		unsigned int gSkyViewLutPhase;
+		float gSunInScatterLutResolution[2];
+		float gSkyViewLutAtlasBandBlend;
+
+		float gSkyViewLutAtlasW[2];
+		float gTransmittanceLutResolution[2];
+
+		unsigned int gPathTracingMinSamples;
+		float pad[3];
 	};
 	typedef ConstantBuffer<CommonConstantBufferStructure> CommonConstantBuffer;
 	CommonConstantBuffer* mConstantBuffer;
@@ -110,17 +136,33 @@ private:
 
 	PixelShader*  mApplySkyAtmosphereShader;
 	PixelShader*  mPostProcessShader;
+	PixelShader*  mPathTracingConvergenceShader;
 
 	D3dInputLayout* mLayout;
 
 	Texture2D* mPathTracingLuminanceBuffer;
 	Texture2D* mPathTracingTransmittanceBuffer;
+	Texture2D* mPathTracingLuminanceSquaredBuffer;		// Sum of squared samples, for the per pixel variance
+	Texture2D* mPathTracingConvergenceTex;				// One texel per tile, 1 once the tile reached the target relative error
+	Texture2D* mPathTracingConvergenceStagingTex;
 
 	Texture2D* mFrameAtmosphereBuffer;
 
 	Texture2D* mBackBufferHdr;
 	Texture2D* mBackBufferDepth;
-	Texture2D* mBackBufferHdrStagingTexture;
+
+	static const uint32 HdrCaptureRingSize = 4;
+	struct HdrCaptureReadback
+	{
+		Texture2D* StagingTexture = nullptr;
+		ID3D11Query* CopyDoneQuery = nullptr;
+		std::string Filename;
+	};
+	HdrCaptureReadback mHdrCaptureRing[HdrCaptureRingSize];
+	uint32 mHdrCaptureRingHead = 0;				// Oldest readback in flight, the others follow in issue order
+	uint32 mHdrCaptureRingPendingCount = 0;
+	double mHdrCaptureRingWaitSeconds = 0.0;	// Time the frame loop waited for the GPU because the ring was full
+	HdrCaptureWriter mHdrCaptureWriter;
 
 	Texture2D* mShadowMap;
 
@@ -129,8 +171,19 @@ private:
 
 	uint32 mFrameId = 0;
 	bool takeScreenShot = false;
+	bool uiCaptureSequence = false;				// Captures every frame to capture_<index>.exr
+	int uiCaptureCompression = HdrCaptureCompressionNone;
+	uint32 mCaptureSequenceFrame = 0;
+
+	CaptureState mCaptureState;
+	bool mExitWhenCaptureSequenceDone = false;
+	bool mExitRequested = false;
+	uint32 mFramesSinceLutInvalidation = 0;		// 0 when the last frame rebuilt a LUT
+	uint32 mPathTracingAccumulatedFrames = 0;	// Path tracing samples per pixel since the accumulation was last restarted
 
-	const uint32 MultiScatteringLUTRes = 32;
+	SkyLutConfig mSkyLutConfig;					// LUT resolutions and sample counts, set from -lutconfig before initialise
+	uint32 MultiScatteringLUTRes = 32;
+	const uint32 PathTracingTileSize = 16;	// Same as PATH_TRACING_TILE_SIZE
 
 	////////////////////////////////////////////////////////////////////////////////
 	// Sky and Atmosphere parameters
@@ -241,10 +294,16 @@ private:
 	LookUpTablesInfo LutsInfo;
 	AtmosphereInfo AtmosphereInfos;
 	AtmosphereInfo AtmosphereInfosSaved;
+	LutDependencyGraph LutGraph;
+	uint64 LutCachePendingKey = 0;		/// Key of the Bruneton 2017 tables baked but not saved to the disk cache yet
+	uint32 LutCachePendingFrames = 0;	/// Frames since LutCachePendingKey has been baked, saving waits for the atmosphere to stop changing
+	bool LutCacheSkipLoad = false;		/// Set on shader reload so that a cache entry baked by previous shaders is overwritten
 	LookUpTables LUTs;
 	TempLookUpTables TempLUTs;
 	Texture3D* AtmosphereCameraScatteringVolume;
 	Texture3D* AtmosphereCameraTransmittanceVolume;
+	Texture2D* mCameraVolumeCullingTex;				// Per froxel column marched and below ground froxel counts from CameraVolumesPrefixCS
+	Texture2D* mCameraVolumeCullingStagingTex;
 
 	const uint32 ShadowmapSize = 4096;
 	float4x4 mShadowmapViewProjMat;
@@ -300,23 +359,48 @@ private:
 		FastAerialPerspectiveEnabled,
 		FastAerialPerspectiveCount
 	};
-	PixelShader* RenderPathTracingPS[TransmittanceMethodCount][GroundGlobalIlluminationCount][ShadowmapCount][MultiScatApproxCount];
+	enum {
+		AnalyticOpticalDepthDisabled = 0,
+		AnalyticOpticalDepthEnabled,
+		AnalyticOpticalDepthCount
+	};
+	enum {
+		SunInScatterLutDisabled = 0,
+		SunInScatterLutEnabled,
+		SunInScatterLutCount
+	};
+	enum {
+		SamplerHash = 0,	// Same values as SAMPLER_TYPE
+		SamplerSobolOwen,
+		SamplerRank1Lattice,
+		SamplerCount
+	};
+	PixelShader* RenderPathTracingPS[TransmittanceMethodCount][GroundGlobalIlluminationCount][ShadowmapCount][MultiScatApproxCount][SamplerCount];
 	PixelShader* RenderRayMarchingPS[MultiScatApproxCount][FastSkyCount][ColoredTransmittanceCount][FastAerialPerspectiveCount][ShadowmapCount];
 	int currentTransPermutation = TransmittanceMethodLUT;
+	int currentSamplerPermutation = SamplerSobolOwen;
 	bool currentShadowPermutation = false;
 	float currentMultipleScatteringFactor = 1.0f;
 	bool currentFastSky = true;
 	bool currentAerialPerspective = true;
 	bool currentColoredTransmittance = false;
+	bool currentAnalyticOpticalDepth = false;
 	float currentAtmosphereHeight = -1.0f;
 
 	Texture2D* mTransmittanceTex;
 	Texture2D* MultiScattTex;
 	Texture2D* MultiScattStep0Tex;
-	Texture2D* mSkyViewLutTex;
-	PixelShader* RenderTransmittanceLutPS;
-	PixelShader* SkyViewLutPS[MultiScatApproxCount];
-	PixelShader* CameraVolumesRayMarchPS[MultiScatApproxCount];
+	Texture2D* mSkyViewLutTex = nullptr;
+	Texture2D* mSunInScatterTransmittanceTex;		// Transmittance to the sun with the earth shadow applied, see SunInScatterLutPS
+	Texture2D* mSunInScatterMultiScatTex;
+	Texture3D* mSkyViewLutAtlasTex = nullptr;		// Time of day sky view LUT atlas loaded from the LUT cache, see updateSkyViewLutAtlas
+	uint64 mSkyViewLutAtlasKey = 0;					// Key of the last cache lookup, successful or not
+	PixelShader* RenderTransmittanceLutPS[AnalyticOpticalDepthCount];
+	PixelShader* SunInScatterLutPS;
+	PixelShader* SkyViewLutPS[SunInScatterLutCount][MultiScatApproxCount];
+	PixelShader* SkyViewLutAtlasBlendPS;
+	PixelShader* CameraVolumesRayMarchPS[SunInScatterLutCount][MultiScatApproxCount];
+	ComputeShader* CameraVolumesPrefixCS[SunInScatterLutCount][MultiScatApproxCount];
 	ComputeShader*  NewMuliScattLutCS;
 
 	// UI
@@ -327,7 +411,31 @@ private:
 	int NumScatteringOrder = 4;
 
 	bool  ShouldClearPathTracedBuffer = true;
-	bool forceGenLut = false;
+
+	// Adaptive path tracing: tiles stop receiving samples once all their pixels reach the target relative error.
+	bool uiPathTracingAdaptive = false;
+	float uiPathTracingTargetRelativeError = 0.1f;
+	uint32 mPathTracingAccumulationIndex = 0;				// Incremented each time the accumulation restarts
+	float mPathTracingStartTimeSec = 0.0f;
+	float mPathTracingConvergedTileRatio = 0.0f;
+	float mPathTracingTargetReachedTimeSec = -1.0f;			// Seconds from the accumulation start to all tiles converged, -1 until then
+	uint32 mPathTracingTargetReachedFrame = 0;
+	bool mPathTracingConvergenceReadbackPending = false;
+	uint32 mPathTracingConvergenceReadbackAccumulationIndex = 0;
+	uint32 mPathTracingConvergenceReadbackFrame = 0;
+	float mPathTracingConvergenceReadbackTimeSec = 0.0f;
+
+	// Camera volume integrated front to back by CameraVolumesPrefixCS instead of per slice by RenderCameraVolumePS.
+	bool uiCameraVolumePrefix = true;
+	bool mCameraVolumeCullingCopyNeeded = false;
+	bool mCameraVolumeCullingReadbackPending = false;
+	float mCameraVolumeMarchedRatio = 0.0f;					// Froxel ratios of the last volume read back
+	float mCameraVolumeGroundCulledRatio = 0.0f;
+	float mCameraVolumeSpaceCulledRatio = 0.0f;
+	// Sky view LUT and camera volume steps read the sun transmittance, earth shadow and multiple scattering from the sun in-scatter LUT.
+	bool uiSunInScatterLut = true;
+	// Sky view LUT blended from the time of day atlas baked by "SkyCpuTools bake-sky-view-atlas" when the LUT cache has it.
+	bool uiSkyViewLutAtlas = true;
 	bool uiDataInitialised = false;
 
 	enum {
@@ -340,22 +448,57 @@ private:
 	bool MethodSwitchDebug = true;
 	int uiViewRayMarchMinSPP = 4;
 	int uiViewRayMarchMaxSPP = 14;
+	int uiSkyViewLutTier = -1;		// SkyViewLutTier, -1 for the SkyLutConfig resolution
+
+	// Amortized sky view LUT updates (SkyLutConfig::SkyViewTexelBudget): the LUT only depends on the camera height and the sun zenith
+	// angle, so texels not updated by a frame are kept as they are. A full update happens when any other input changed, or when the
+	// height or the sun angle moved past the thresholds since the last full update.
+	bool mSkyViewLutFullUpdateNeeded = true;
+	float mSkyViewLutFullUpdateHeight = 0.0f;
+	float mSkyViewLutFullUpdateSunAngle = 0.0f;
+	uint32 mSkyViewLutPendingPhases = 0;	// Phases left to update since the last view change
+	uint32 mSkyViewLutPhase = 0;
 
 	bool RenderTerrain = true;
 
+	// Inputs of the view dependent LUTs (sky view and camera volumes). Compared every frame to know if LutInputView changed.
+	struct LutViewInputs
+	{
+		float4x4 ViewProjMat;
+		float3 CamPos;
+		float3 SunDir;
+		float3 SunIlluminance;
+		uint32 Resolution[2];
+		float RayMarchMinMaxSPP[2];
+		uint32 SkyViewLutResolution[2];
+		uint32 CameraVolumePrefix;
+		uint32 SunInScatterLut;
+		uint32 SkyViewLutAtlas;
+	};
+	LutViewInputs LutViewInputsSaved;
+	void getLutViewInputs(LutViewInputs& inputs) const;
+
 	// Render functions
 	void updateSkyAtmosphereConstant();
 	void generateSkyAtmosphereLUTs();
+	bool loadSkyAtmosphereLUTsFromCache(uint64 key);
+	void saveSkyAtmosphereLUTsToCache(uint64 key);
 	void generateSkyAtmosphereCameraVolumes();
 	void renderSkyAtmosphereUsingLUTs();
 
 	void renderTransmittanceLutPS();
 	void renderNewMultiScattTexPS();
+	void renderSunInScatterLut();
 	void renderSkyViewLut();
+	void updateSkyViewLutAtlas();
+	void renderSkyViewLutFromAtlas();
 	void renderPathTracing();
+	void renderPathTracingConvergence();
+	void readbackPathTracingConvergence();
 	void RenderSkyAtmosphereOverOpaque();
 	void renderRayMarching();
 	void generateSkyAtmosphereCameraVolumeWithRayMarch();
+	void readbackCameraVolumeCulling();
 	void renderTerrain();
 	void renderShadowmap();
 
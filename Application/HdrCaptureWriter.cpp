@@ -0,0 +1,181 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <tinyexr/tinyexr.h>
+#include "HdrCaptureWriter.h"
+#include "DX11Base/CpuTimer.h"
+
+
+
+static double getCaptureTimeSec()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* getHdrCaptureCompressionName(HdrCaptureCompression compression)
+{
+	static const char* names[HdrCaptureCompressionCount] = { "None", "ZIP", "PIZ" };
+	return compression < HdrCaptureCompressionCount ? names[compression] : "Unknown";
+}
+
+bool saveHdrCaptureExr(const HdrCaptureFrame& frame, HdrCaptureCompression compression)
+{
+	CPU_SCOPED_TIMER(SaveHdrCaptureExr);
+
+	// EXR channels are stored in alphabetical order: A, B, G, R.
+	const size_t pixelCount = size_t(frame.Width) * frame.Height;
+	std::vector<float> channels[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		channels[c].resize(pixelCount);
+	}
+	for (size_t p = 0; p < pixelCount; ++p)
+	{
+		const float* rgba = &frame.Rgba[p * 4];
+		const float invSampleCount = rgba[3] > 0.0f ? 1.0f / rgba[3] : 1.0f;
+		channels[0][p] = 1.0f;
+		channels[1][p] = rgba[2] * invSampleCount;
+		channels[2][p] = rgba[1] * invSampleCount;
+		channels[3][p] = rgba[0] * invSampleCount;
+	}
+
+	EXRHeader header;
+	InitEXRHeader(&header);
+	EXRImage image;
+	InitEXRImage(&image);
+
+	float* imagePtrs[4] = { channels[0].data(), channels[1].data(), channels[2].data(), channels[3].data() };
+	image.images = (unsigned char**)imagePtrs;
+	image.num_channels = 4;
+	image.width = int(frame.Width);
+	image.height = int(frame.Height);
+
+	EXRChannelInfo channelInfos[4];
+	const char* channelNames[4] = { "A", "B", "G", "R" };
+	int pixelTypes[4];
+	int requestedPixelTypes[4];
+	for (int c = 0; c < 4; ++c)
+	{
+		memset(&channelInfos[c], 0, sizeof(EXRChannelInfo));
+		strncpy(channelInfos[c].name, channelNames[c], 255);
+		pixelTypes[c] = TINYEXR_PIXELTYPE_FLOAT;
+		requestedPixelTypes[c] = TINYEXR_PIXELTYPE_FLOAT;
+	}
+	header.num_channels = 4;
+	header.channels = channelInfos;
+	header.pixel_types = pixelTypes;
+	header.requested_pixel_types = requestedPixelTypes;
+	header.compression_type = compression == HdrCaptureCompressionZip ? TINYEXR_COMPRESSIONTYPE_ZIP
+		: compression == HdrCaptureCompressionPiz ? TINYEXR_COMPRESSIONTYPE_PIZ : TINYEXR_COMPRESSIONTYPE_NONE;
+
+	const char* err = nullptr;
+	int exrError = SaveEXRImageToFile(&image, &header, frame.Filename.c_str(), &err);
+	if (exrError != TINYEXR_SUCCESS)
+	{
+		fprintf(stderr, "Failed to save %s: %s\n", frame.Filename.c_str(), err ? err : "unknown error");
+		return false;
+	}
+	return true;
+}
+
+
+
+HdrCaptureWriter::HdrCaptureWriter(uint32 maxQueuedFrames)
+	: mMaxQueuedFrames(maxQueuedFrames > 0 ? maxQueuedFrames : 1)
+{
+	mThread = std::thread(&HdrCaptureWriter::writerLoop, this);
+}
+
+HdrCaptureWriter::~HdrCaptureWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mExit = true;
+	}
+	mQueueCondition.notify_all();
+	mThread.join();
+}
+
+void HdrCaptureWriter::setCompression(HdrCaptureCompression compression)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCompression = compression;
+}
+
+void HdrCaptureWriter::submit(HdrCaptureFrame&& frame)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	const double submitTimeSec = getCaptureTimeSec();
+	if (mFirstSubmitTimeSec < 0.0)
+	{
+		mFirstSubmitTimeSec = submitTimeSec;
+	}
+	if (mQueue.size() >= mMaxQueuedFrames)
+	{
+		mRoomCondition.wait(lock, [&] { return mQueue.size() < mMaxQueuedFrames; });
+		mStats.SubmitWaitSeconds += getCaptureTimeSec() - submitTimeSec;
+	}
+	mQueue.push_back(std::move(frame));
+	mQueueCondition.notify_one();
+}
+
+void HdrCaptureWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mRoomCondition.wait(lock, [&] { return mQueue.empty() && !mWriting; });
+}
+
+HdrCaptureWriter::Stats HdrCaptureWriter::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	Stats stats = mStats;
+	stats.QueuedFrames = uint32(mQueue.size()) + (mWriting ? 1 : 0);
+	const double elapsedSec = mLastWriteTimeSec - mFirstSubmitTimeSec;
+	stats.FramesPerSecond = mFirstSubmitTimeSec >= 0.0 && elapsedSec > 0.0 ? double(stats.FramesWritten) / elapsedSec : 0.0;
+	return stats;
+}
+
+void HdrCaptureWriter::resetStats()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats = Stats();
+	mFirstSubmitTimeSec = -1.0;
+	mLastWriteTimeSec = 0.0;
+}
+
+void HdrCaptureWriter::writerLoop()
+{
+	CpuTimerProfiler::setThreadName("HdrCaptureWriter");
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;)
+	{
+		mQueueCondition.wait(lock, [&] { return mExit || !mQueue.empty(); });
+		if (mQueue.empty())
+		{
+			return;	// Exit once everything has been written
+		}
+
+		HdrCaptureFrame frame = std::move(mQueue.front());
+		mQueue.pop_front();
+		const HdrCaptureCompression compression = mCompression;
+		mWriting = true;
+		lock.unlock();
+		mRoomCondition.notify_all();
+
+		const double startTimeSec = getCaptureTimeSec();
+		const bool success = saveHdrCaptureExr(frame, compression);
+		const double endTimeSec = getCaptureTimeSec();
+
+		lock.lock();
+		mWriting = false;
+		mStats.WriteSeconds += endTimeSec - startTimeSec;
+		mStats.FramesWritten += success ? 1 : 0;
+		mStats.FramesFailed += success ? 0 : 1;
+		mLastWriteTimeSec = endTimeSec;
+		mRoomCondition.notify_all();
+	}
+}
+
@@ -0,0 +1,83 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SkyAtmosphereCommon.h"
+
+// Background EXR writer for HDR captures. Frames read back from the GPU are queued and a dedicated thread resolves
+// them and encodes them, so the render thread only pays for a copy of the texels. This does not depend on D3D.
+// The EXR functions require tinyexr to be implemented (TINYEXR_IMPLEMENTATION) in one of the translation units of the executable.
+
+enum HdrCaptureCompression
+{
+	HdrCaptureCompressionNone = 0,
+	HdrCaptureCompressionZip,		// Lossless, zlib on blocks of 16 lines
+	HdrCaptureCompressionPiz,		// Lossless, wavelet, usually the best ratio on noisy images
+	HdrCaptureCompressionCount
+};
+
+const char* getHdrCaptureCompressionName(HdrCaptureCompression compression);
+
+struct HdrCaptureFrame
+{
+	std::string Filename;
+	uint32 Width = 0;
+	uint32 Height = 0;
+	std::vector<float> Rgba;		// Rows tightly packed. RGB are divided by alpha, the accumulated sample count, when it is positive.
+};
+
+// Writes a frame as a float RGBA EXR, alpha being 1. Returns false and prints the tinyexr error on failure.
+bool saveHdrCaptureExr(const HdrCaptureFrame& frame, HdrCaptureCompression compression);
+
+class HdrCaptureWriter
+{
+public:
+	// submit blocks while maxQueuedFrames frames are waiting to be written, which bounds the memory used by a long capture.
+	explicit HdrCaptureWriter(uint32 maxQueuedFrames = 8);
+	~HdrCaptureWriter();		// Writes all queued frames before returning
+
+	struct Stats
+	{
+		uint64_t FramesWritten = 0;
+		uint64_t FramesFailed = 0;
+		uint32 QueuedFrames = 0;
+		double WriteSeconds = 0.0;			// Resolve and encode time on the writer thread
+		double SubmitWaitSeconds = 0.0;		// Time submit spent waiting for the queue to have room
+		double FramesPerSecond = 0.0;		// Frames written per second since the first submit after the last reset
+	};
+
+	void setCompression(HdrCaptureCompression compression);
+	void submit(HdrCaptureFrame&& frame);
+	void flush();							// Returns once the queue is empty and the last frame written
+	Stats getStats() const;
+	void resetStats();
+
+private:
+	HdrCaptureWriter(const HdrCaptureWriter&) = delete;
+	HdrCaptureWriter& operator=(const HdrCaptureWriter&) = delete;
+
+	void writerLoop();
+
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	std::condition_variable mQueueCondition;	/// Signaled when a frame is queued or on exit
+	std::condition_variable mRoomCondition;		/// Signaled when a frame is taken from the queue or written
+	std::deque<HdrCaptureFrame> mQueue;
+	const uint32 mMaxQueuedFrames;
+	HdrCaptureCompression mCompression = HdrCaptureCompressionNone;
+	bool mWriting = false;
+	bool mExit = false;
+
+	Stats mStats;
+	double mFirstSubmitTimeSec = -1.0;
+	double mLastWriteTimeSec = 0.0;
+};
+
@@ -0,0 +1,158 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include "LutDependencyGraph.h"
+
+#include <string.h>
+
+
+#define INPUT_BIT(Input) (1u << (Input))
+
+// Inputs read by the transmittance integration (see sampleMediumRGB: extinction only, no phase function).
+static const uint32 TransmittanceInputs =
+	INPUT_BIT(LutInputBottomRadius) | INPUT_BIT(LutInputTopRadius)
+	| INPUT_BIT(LutInputRayleighDensity) | INPUT_BIT(LutInputRayleighScattering)
+	| INPUT_BIT(LutInputMieDensity) | INPUT_BIT(LutInputMieExtinction)
+	| INPUT_BIT(LutInputAbsorptionDensity) | INPUT_BIT(LutInputAbsorptionExtinction);
+
+// All the AtmosphereInfo fields, i.e. the inputs enumerated before LutInputMultipleScatteringFactor.
+static const uint32 AtmosphereInfoInputs = INPUT_BIT(LutInputMultipleScatteringFactor) - 1;
+
+struct LutNodeDesc
+{
+	const char* Name;
+	uint32 Inputs;			// Inputs directly read by the pass generating the LUT
+	uint32 Dependencies;	// LUTs sampled by that pass
+};
+
+static const LutNodeDesc LutNodeDescs[LutNodeCount] =
+{
+	// LutNodeTransmittance: RenderTransmittanceLutPS
+	{ "Transmittance", TransmittanceInputs | INPUT_BIT(LutInputOpticalDepthMethod), 0 },
+	// LutNodeMultiScattering: NewMultiScattCS, uniform phase and the only one integrating the ground bounce.
+	{ "MultiScattering", TransmittanceInputs | INPUT_BIT(LutInputMieScattering) | INPUT_BIT(LutInputGroundAlbedo) | INPUT_BIT(LutInputMultipleScatteringFactor),
+		lutNodeBit(LutNodeTransmittance) },
+	// LutNodeSunInScatter: SunInScatterLutPS, the radii for the parameterisation and the earth shadow.
+	{ "SunInScatter", INPUT_BIT(LutInputBottomRadius) | INPUT_BIT(LutInputTopRadius),
+		lutNodeBit(LutNodeTransmittance) | lutNodeBit(LutNodeMultiScattering) },
+	// LutNodeSkyView: SkyViewLutPS, or SkyViewLutAtlasBlendPS when the atlas of the atmosphere is in the LUT cache.
+	{ "SkyView", TransmittanceInputs | INPUT_BIT(LutInputMieScattering) | INPUT_BIT(LutInputMiePhaseG) | INPUT_BIT(LutInputView),
+		lutNodeBit(LutNodeTransmittance) | lutNodeBit(LutNodeMultiScattering) | lutNodeBit(LutNodeSunInScatter) },
+	// LutNodeAerialPerspective: RenderCameraVolumePS or the Bruneton 2017 CameraVolumesPS depending on the rendering method.
+	{ "AerialPerspective", TransmittanceInputs | INPUT_BIT(LutInputMieScattering) | INPUT_BIT(LutInputMiePhaseG) | INPUT_BIT(LutInputView) | INPUT_BIT(LutInputRenderingMethod),
+		lutNodeBit(LutNodeTransmittance) | lutNodeBit(LutNodeMultiScattering) | lutNodeBit(LutNodeSunInScatter) | lutNodeBit(LutNodeBruneton2017) },
+	// LutNodeBruneton2017: generateSkyAtmosphereLUTs reads every AtmosphereInfo field.
+	{ "Bruneton2017", AtmosphereInfoInputs | INPUT_BIT(LutInputScatteringOrder), 0 },
+};
+
+
+
+LutDependencyGraph::LutDependencyGraph()
+{
+	mStaleNodes = 0;
+	memset(mDirtyCount, 0, sizeof(mDirtyCount));
+	memset(mRebuildCount, 0, sizeof(mRebuildCount));
+	invalidateAll();
+}
+
+uint32 LutDependencyGraph::getInvalidatedNodes(LutInput input)
+{
+	uint32 nodes = 0;
+	for (uint32 n = 0; n < LutNodeCount; ++n)
+	{
+		if (LutNodeDescs[n].Inputs & INPUT_BIT(input))
+		{
+			nodes |= lutNodeBit(LutNode(n));
+		}
+	}
+
+	// Propagate to the LUTs sampling invalidated ones until nothing changes. The graph is tiny so this converges in a few iterations.
+	uint32 previousNodes;
+	do
+	{
+		previousNodes = nodes;
+		for (uint32 n = 0; n < LutNodeCount; ++n)
+		{
+			if (LutNodeDescs[n].Dependencies & nodes)
+			{
+				nodes |= lutNodeBit(LutNode(n));
+			}
+		}
+	} while (nodes != previousNodes);
+	return nodes;
+}
+
+uint32 LutDependencyGraph::getChangedInputs(const AtmosphereInfo& previous, const AtmosphereInfo& current)
+{
+	uint32 inputs = 0;
+#define COMPARE_FIELD(Field, Input) if (memcmp(&previous.Field, &current.Field, sizeof(previous.Field)) != 0) { inputs |= INPUT_BIT(Input); }
+	COMPARE_FIELD(solar_irradiance, LutInputSolarIrradiance);
+	COMPARE_FIELD(sun_angular_radius, LutInputSunAngularRadius);
+	COMPARE_FIELD(bottom_radius, LutInputBottomRadius);
+	COMPARE_FIELD(top_radius, LutInputTopRadius);
+	COMPARE_FIELD(rayleigh_density, LutInputRayleighDensity);
+	COMPARE_FIELD(rayleigh_scattering, LutInputRayleighScattering);
+	COMPARE_FIELD(mie_density, LutInputMieDensity);
+	COMPARE_FIELD(mie_scattering, LutInputMieScattering);
+	COMPARE_FIELD(mie_extinction, LutInputMieExtinction);
+	COMPARE_FIELD(mie_phase_function_g, LutInputMiePhaseG);
+	COMPARE_FIELD(absorption_density, LutInputAbsorptionDensity);
+	COMPARE_FIELD(absorption_extinction, LutInputAbsorptionExtinction);
+	COMPARE_FIELD(ground_albedo, LutInputGroundAlbedo);
+	COMPARE_FIELD(mu_s_min, LutInputMuSMin);
+#undef COMPARE_FIELD
+	return inputs;
+}
+
+const char* LutDependencyGraph::getNodeName(LutNode node)
+{
+	return LutNodeDescs[node].Name;
+}
+
+uint32 LutDependencyGraph::invalidate(LutInput input)
+{
+	const uint32 nodes = getInvalidatedNodes(input);
+	markStale(nodes);
+	return nodes;
+}
+
+uint32 LutDependencyGraph::invalidateInputs(uint32 inputMask)
+{
+	uint32 nodes = 0;
+	for (uint32 i = 0; i < LutInputCount; ++i)
+	{
+		if (inputMask & INPUT_BIT(i))
+		{
+			nodes |= getInvalidatedNodes(LutInput(i));
+		}
+	}
+	markStale(nodes);
+	return nodes;
+}
+
+void LutDependencyGraph::invalidateAll()
+{
+	markStale((1u << LutNodeCount) - 1);
+}
+
+void LutDependencyGraph::markRebuilt(LutNode node)
+{
+	mStaleNodes &= ~lutNodeBit(node);
+	mRebuildCount[node]++;
+}
+
+void LutDependencyGraph::markStale(uint32 nodeMask)
+{
+	for (uint32 n = 0; n < LutNodeCount; ++n)
+	{
+		const uint32 bit = lutNodeBit(LutNode(n));
+		if ((nodeMask & bit) && !(mStaleNodes & bit))
+		{
+			mDirtyCount[n]++;
+		}
+	}
+	mStaleNodes |= nodeMask;
+}
+
+#undef INPUT_BIT
+
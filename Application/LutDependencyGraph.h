@@ -0,0 +1,89 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include "SkyAtmosphereCommon.h"
+
+// Tracks which LUTs are stale so that only those need to be generated again.
+// Each input (an AtmosphereInfo field or a render setting) is mapped to the LUTs directly reading it, and a LUT
+// becoming stale also invalidates the LUTs sampling it (e.g. transmittance -> multiple scattering -> sky view).
+// This does not depend on D3D so that it can be used and checked from headless code.
+
+enum LutInput
+{
+	// AtmosphereInfo fields
+	LutInputSolarIrradiance = 0,
+	LutInputSunAngularRadius,
+	LutInputBottomRadius,
+	LutInputTopRadius,
+	LutInputRayleighDensity,
+	LutInputRayleighScattering,
+	LutInputMieDensity,
+	LutInputMieScattering,
+	LutInputMieExtinction,
+	LutInputMiePhaseG,
+	LutInputAbsorptionDensity,
+	LutInputAbsorptionExtinction,
+	LutInputGroundAlbedo,
+	LutInputMuSMin,
+
+	// Render settings
+	LutInputMultipleScatteringFactor,	// Baked into the multiple scattering LUT
+	LutInputScatteringOrder,			// Bruneton 2017 only
+	LutInputView,						// Camera, sun, sun illuminance, resolution and ray marching sample counts
+	LutInputRenderingMethod,			// The camera volumes are shared by the ray marching and Bruneton 2017 methods
+	LutInputOpticalDepthMethod,			// Marched or analytic optical depth in the transmittance LUT
+
+	LutInputCount
+};
+
+enum LutNode
+{
+	LutNodeTransmittance = 0,
+	LutNodeMultiScattering,
+	LutNodeSunInScatter,				// Shadowed transmittance to the sun and multiple scattering per height and sun zenith angle
+	LutNodeSkyView,
+	LutNodeAerialPerspective,
+	LutNodeBruneton2017,				// Transmittance, irradiance and scattering tables
+
+	LutNodeCount
+};
+
+inline uint32 lutNodeBit(LutNode node) { return 1u << node; }
+
+class LutDependencyGraph
+{
+public:
+	// Everything is stale at creation as nothing has been generated yet.
+	LutDependencyGraph();
+
+	// Returns the LUTs invalidated by a change of the input, including the ones depending on them through other LUTs.
+	static uint32 getInvalidatedNodes(LutInput input);
+	// Returns the mask of inputs that differ between the two atmospheres (bit i being LutInput i).
+	static uint32 getChangedInputs(const AtmosphereInfo& previous, const AtmosphereInfo& current);
+	static const char* getNodeName(LutNode node);
+
+	// Marks as stale all the LUTs depending on the input. Returns the invalidated LUTs mask, whether they were already stale or not.
+	uint32 invalidate(LutInput input);
+	uint32 invalidateInputs(uint32 inputMask);
+	uint32 invalidateAtmosphere(const AtmosphereInfo& previous, const AtmosphereInfo& current) { return invalidateInputs(getChangedInputs(previous, current)); }
+	void invalidateAll();
+
+	bool needsRebuild(LutNode node) const { return (mStaleNodes & lutNodeBit(node)) != 0; }
+	void markRebuilt(LutNode node);
+	uint32 getStaleNodes() const { return mStaleNodes; }
+
+	// Number of times a LUT went from up to date to stale, and number of times it has been generated.
+	uint32 getDirtyCount(LutNode node) const { return mDirtyCount[node]; }
+	uint32 getRebuildCount(LutNode node) const { return mRebuildCount[node]; }
+
+private:
+	void markStale(uint32 nodeMask);
+
+	uint32 mStaleNodes;
+	uint32 mDirtyCount[LutNodeCount];
+	uint32 mRebuildCount[LutNodeCount];
+};
+
+
@@ -0,0 +1,152 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "LutDiskCache.h"
+
+
+
+uint64 fnv1aHash64(const void* data, size_t size, uint64 hash)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+uint64 computeLutCacheKey(const AtmosphereInfo& atmosphere, const LookUpTablesInfo& lutInfo, int scatteringOrder)
+{
+	// Both structures only contain 32 bits values so there is no padding to worry about.
+	uint64 hash = fnv1aHash64(&atmosphere, sizeof(AtmosphereInfo));
+	hash = fnv1aHash64(&lutInfo, sizeof(LookUpTablesInfo), hash);
+	hash = fnv1aHash64(&scatteringOrder, sizeof(int), hash);
+	return hash;
+}
+
+uint64 computeSkyViewLutAtlasKey(const AtmosphereInfo& atmosphere, const SkyLutConfig& config, float multipleScatteringFactor)
+{
+	// Tagged so that it never matches a Bruneton 2017 entry. Only 32 bits values are hashed.
+	const char tag[] = "SkyViewLutAtlas";
+	uint64 hash = fnv1aHash64(tag, sizeof(tag));
+	hash = fnv1aHash64(&atmosphere, sizeof(AtmosphereInfo), hash);
+	const float values[] = {
+		float(config.TransmittanceWidth), float(config.TransmittanceHeight), config.TransmittanceSampleCount,
+		float(config.MultiScatteringRes), config.MultiScatteringSampleCount, multipleScatteringFactor,
+		float(config.SkyViewWidth), float(config.SkyViewHeight), config.RayMarchMinMaxSPP[0], config.RayMarchMinMaxSPP[1],
+		float(config.SkyViewAtlasSunAngleCount), float(config.SkyViewAtlasHeightBandCount),
+		config.SkyViewAtlasMinSunElevation, config.SkyViewAtlasMinCameraHeight, config.SkyViewAtlasMaxCameraHeight };
+	return fnv1aHash64(values, sizeof(values), hash);
+}
+
+void getLutCacheFilePath(uint64 key, char* path, size_t pathSize)
+{
+	snprintf(path, pathSize, "%s/%016llx.lut", LUT_CACHE_DIRECTORY, key);
+}
+
+bool writeLutCacheEntry(const char* filepath, uint64 key, uint32 textureCount, const LutCacheTextureDesc* descs, const void* const* textureData)
+{
+	if (textureCount > LUT_CACHE_MAX_TEXTURES)
+	{
+		return false;
+	}
+
+	LutCacheHeader header;
+	memset(&header, 0, sizeof(LutCacheHeader));
+	header.Magic = LUT_CACHE_MAGIC;
+	header.Version = LUT_CACHE_VERSION;
+	header.Key = key;
+	header.TextureCount = textureCount;
+	uint64 offset = sizeof(LutCacheHeader);
+	for (uint32 t = 0; t < textureCount; ++t)
+	{
+		LutCacheTextureDesc& desc = header.Textures[t];
+		desc = descs[t];
+		desc.Pad = 0;
+		desc.Offset = (offset + LUT_CACHE_DATA_ALIGNMENT - 1) / LUT_CACHE_DATA_ALIGNMENT * LUT_CACHE_DATA_ALIGNMENT;
+		desc.Size = uint64(desc.getDepthPitch()) * desc.Depth;
+		offset = desc.Offset + desc.Size;
+	}
+	header.FileSize = offset;
+
+#ifdef _WIN32
+	_mkdir(LUT_CACHE_DIRECTORY);
+#else
+	mkdir(LUT_CACHE_DIRECTORY, 0755);
+#endif
+
+	char tempFilepath[512];
+	snprintf(tempFilepath, sizeof(tempFilepath), "%s.tmp", filepath);
+	FILE* file = fopen(tempFilepath, "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool success = fwrite(&header, sizeof(LutCacheHeader), 1, file) == 1;
+	uint64 position = sizeof(LutCacheHeader);
+	const unsigned char zeros[LUT_CACHE_DATA_ALIGNMENT] = {};
+	for (uint32 t = 0; t < textureCount && success; ++t)
+	{
+		const LutCacheTextureDesc& desc = header.Textures[t];
+		success &= fwrite(zeros, 1, size_t(desc.Offset - position), file) == size_t(desc.Offset - position);
+		success &= fwrite(textureData[t], 1, size_t(desc.Size), file) == size_t(desc.Size);
+		position = desc.Offset + desc.Size;
+	}
+	success &= fclose(file) == 0;
+
+	// Replace any previous entry.
+	remove(filepath);
+	success = success && rename(tempFilepath, filepath) == 0;
+	if (!success)
+	{
+		remove(tempFilepath);
+	}
+	return success;
+}
+
+
+
+bool MappedLutCacheEntry::open(const char* filepath, uint64 key, uint32 textureCount, const LutCacheTextureDesc* expectedDescs)
+{
+	if (!mFile.open(filepath) || mFile.getSize() < sizeof(LutCacheHeader))
+	{
+		mFile.close();
+		return false;
+	}
+	const size_t fileSize = mFile.getSize();
+
+	// Validate the header so that the texture data can be used as is.
+	const LutCacheHeader& header = getHeader();
+	bool valid = header.Magic == LUT_CACHE_MAGIC && header.Version == LUT_CACHE_VERSION && header.Key == key
+		&& header.FileSize == fileSize && header.TextureCount == textureCount;
+	for (uint32 t = 0; t < textureCount && valid; ++t)
+	{
+		const LutCacheTextureDesc& desc = header.Textures[t];
+		const LutCacheTextureDesc& expected = expectedDescs[t];
+		valid &= desc.Width == expected.Width && desc.Height == expected.Height && desc.Depth == expected.Depth
+			&& desc.Format == expected.Format && desc.BytesPerTexel == expected.BytesPerTexel
+			&& desc.Size == uint64(desc.getDepthPitch()) * desc.Depth && desc.Offset % LUT_CACHE_DATA_ALIGNMENT == 0
+			&& desc.Offset >= sizeof(LutCacheHeader) && desc.Offset + desc.Size <= fileSize;
+	}
+	if (!valid)
+	{
+		close();
+	}
+	return valid;
+}
+
+void MappedLutCacheEntry::close()
+{
+	mFile.close();
+}
+
+
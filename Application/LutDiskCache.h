@@ -0,0 +1,89 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <stddef.h>
+#include "SkyAtmosphereCommon.h"
+#include "MappedFile.h"
+#include "SkyLutConfig.h"
+
+// Content addressed on disk cache of baked LUTs.
+// An entry is named after a hash of everything its LUTs depend on and is made of a LutCacheHeader followed by the
+// raw texels of each texture, rows tightly packed. The file can thus be memory mapped and the texels handed to the
+// texture upload without any parsing. This does not depend on D3D.
+
+typedef unsigned long long uint64;
+
+#define LUT_CACHE_DIRECTORY		"LutCache"
+#define LUT_CACHE_MAGIC			0x4354554C	// "LUTC"
+#define LUT_CACHE_VERSION		1			// Increment when the layout or the content of the LUTs changes
+#define LUT_CACHE_MAX_TEXTURES	4
+#define LUT_CACHE_DATA_ALIGNMENT	64
+
+struct LutCacheTextureDesc
+{
+	uint32 Width;
+	uint32 Height;
+	uint32 Depth;			// 1 for 2D textures
+	uint32 Format;			// DXGI_FORMAT of the texture
+	uint32 BytesPerTexel;
+	uint32 Pad;
+	uint64 Offset;			// From the start of the file, aligned to LUT_CACHE_DATA_ALIGNMENT
+	uint64 Size;
+
+	uint32 getRowPitch() const { return Width * BytesPerTexel; }
+	uint32 getDepthPitch() const { return Width * Height * BytesPerTexel; }
+};
+
+struct LutCacheHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint64 Key;
+	uint64 FileSize;		// Used to detect truncated files
+	uint32 TextureCount;
+	uint32 Pad;
+	LutCacheTextureDesc Textures[LUT_CACHE_MAX_TEXTURES];
+};
+
+uint64 fnv1aHash64(const void* data, size_t size, uint64 hash = 0xCBF29CE484222325ull);
+
+// Key of the Bruneton 2017 tables: they depend on the atmosphere, the table resolutions and the number of scattering orders.
+uint64 computeLutCacheKey(const AtmosphereInfo& atmosphere, const LookUpTablesInfo& lutInfo, int scatteringOrder);
+
+// Key of the time of day sky view LUT atlas: one R11G11B10 volume depending on the atmosphere, the multiple scattering factor (0 without the
+// multiple scattering approximation) and the LUT resolutions, sample counts and atlas layout of config. The sky view resolution and the
+// sample counts must be the ones in use, so a runtime resolution change simply misses the cache.
+uint64 computeSkyViewLutAtlasKey(const AtmosphereInfo& atmosphere, const SkyLutConfig& config, float multipleScatteringFactor);
+
+// Returns LUT_CACHE_DIRECTORY/<key>.lut
+void getLutCacheFilePath(uint64 key, char* path, size_t pathSize);
+
+// Writes a complete entry. Only Width, Height, Depth, Format and BytesPerTexel of the descs are read, offsets and sizes are computed.
+// The file is written under a temporary name and renamed once complete, so a crash never leaves a partial entry behind.
+bool writeLutCacheEntry(const char* filepath, uint64 key, uint32 textureCount, const LutCacheTextureDesc* descs, const void* const* textureData);
+
+// Read only memory mapping of a cache entry.
+class MappedLutCacheEntry
+{
+public:
+	MappedLutCacheEntry() {}
+	~MappedLutCacheEntry() { close(); }
+
+	// Fails if the file is missing, truncated, from another version, for another key or if the textures do not match
+	// the expected ones (only Width, Height, Depth, Format and BytesPerTexel are compared).
+	bool open(const char* filepath, uint64 key, uint32 textureCount, const LutCacheTextureDesc* expectedDescs);
+	void close();
+
+	const LutCacheHeader& getHeader() const { return *reinterpret_cast<const LutCacheHeader*>(mFile.getData()); }
+	const void* getTextureData(uint32 t) const { return mFile.getData() + getHeader().Textures[t].Offset; }
+
+private:
+	MappedLutCacheEntry(const MappedLutCacheEntry&) = delete;
+	MappedLutCacheEntry& operator=(const MappedLutCacheEntry&) = delete;
+
+	MappedFile mFile;
+};
+
+
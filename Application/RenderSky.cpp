@@ -14,7 +14,7 @@ void Game::renderTransmittanceLutPS()
 	D3dRenderContext* context = g_dx11Device->getDeviceContext();
 	GPU_SCOPED_TIMEREVENT(TransLUT, 230, 230, 76);
 
-	D3dViewport LutViewPort = { 0.0f, 0.0f, float(LutsInfo.TRANSMITTANCE_TEXTURE_WIDTH), float(LutsInfo.TRANSMITTANCE_TEXTURE_HEIGHT), 0.0f, 1.0f };
+	D3dViewport LutViewPort = { 0.0f, 0.0f, float(mTransmittanceTex->mDesc.Width), float(mTransmittanceTex->mDesc.Height), 0.0f, 1.0f };
 	context->RSSetViewports(1, &LutViewPort);
 
 	const uint32* initialCount = 0;
@@ -26,7 +26,7 @@ void Game::renderTransmittanceLutPS()
 
 	// Final view
 	mScreenVertexShader->setShader(*context);
-	RenderTransmittanceLutPS->setShader(*context);
+	RenderTransmittanceLutPS[currentAnalyticOpticalDepth ? AnalyticOpticalDepthEnabled : AnalyticOpticalDepthDisabled]->setShader(*context);
 
 	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
 	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
@@ -83,8 +83,70 @@ void Game::renderNewMultiScattTexPS()
 }
 
 
+void Game::renderSunInScatterLut()
+{
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+	GPU_SCOPED_TIMEREVENT(SunInScatterLut, 230, 230, 76);
+
+	D3dViewport LutViewPort = { 0.0f, 0.0f, float(mSunInScatterTransmittanceTex->mDesc.Width), float(mSunInScatterTransmittanceTex->mDesc.Height), 0.0f, 1.0f };
+	context->RSSetViewports(1, &LutViewPort);
+
+	const uint32* initialCount = 0;
+	D3dRenderTargetView* RtViews[2] = { mSunInScatterTransmittanceTex->mRenderTargetView, mSunInScatterMultiScatTex->mRenderTargetView };
+	context->OMSetRenderTargetsAndUnorderedAccessViews(2, RtViews, nullptr, 0, 0, nullptr, initialCount);
+
+	// Set null input assembly and layout
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->IASetInputLayout(nullptr);
+
+	// Final view
+	mScreenVertexShader->setShader(*context);
+	SunInScatterLutPS->setShader(*context);
+
+	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+	context->PSSetConstantBuffers(1, 1, &SkyAtmosphereBuffer->mBuffer);
+
+	context->PSSetSamplers(0, 1, &SamplerLinear->mSampler);
+
+	context->PSSetShaderResources(2, 1, &mTransmittanceTex->mShaderResourceView);
+	context->PSSetShaderResources(6, 1, &MultiScattTex->mShaderResourceView);
+
+	context->Draw(3, 0);
+	g_dx11Device->setNullPsResources(context);
+	g_dx11Device->setNullRenderTarget(context);
+}
+
+
 void Game::renderSkyViewLut()
 {
+	// Amortized updates, see mSkyViewLutFullUpdateNeeded. Captures always get a full update.
+	const float3 CamPosPlanet = { mCamPosFinal.x, mCamPosFinal.y, mCamPosFinal.z + AtmosphereInfos.bottom_radius };
+	const float CamPosLength = sqrtf(CamPosPlanet.x * CamPosPlanet.x + CamPosPlanet.y * CamPosPlanet.y + CamPosPlanet.z * CamPosPlanet.z);
+	const float viewHeight = CamPosLength - AtmosphereInfos.bottom_radius;
+	const float sunZenithCosAngle = (CamPosPlanet.x * mSunDir.x + CamPosPlanet.y * mSunDir.y + CamPosPlanet.z * mSunDir.z) / CamPosLength;
+	const float sunZenithAngle = acosf(sunZenithCosAngle < -1.0f ? -1.0f : (sunZenithCosAngle > 1.0f ? 1.0f : sunZenithCosAngle));
+	const uint32 interleave = mCaptureState.active ? 1 : getSkyViewLutInterleave(mSkyViewLutTex->mDesc.Width * mSkyViewLutTex->mDesc.Height, mSkyLutConfig.SkyViewTexelBudget);
+	const bool fullUpdate = mSkyViewLutFullUpdateNeeded || interleave <= 1
+		|| fabsf(viewHeight - mSkyViewLutFullUpdateHeight) > mSkyLutConfig.SkyViewRefreshHeight
+		|| fabsf(sunZenithAngle - mSkyViewLutFullUpdateSunAngle) > mSkyLutConfig.SkyViewRefreshSunAngle;
+	if (fullUpdate)
+	{
+		mSkyViewLutFullUpdateNeeded = false;
+		mSkyViewLutFullUpdateHeight = viewHeight;
+		mSkyViewLutFullUpdateSunAngle = sunZenithAngle;
+		mSkyViewLutPendingPhases = 0;
+	}
+	else
+	{
+		// A view change restarts the update of all the phases, otherwise the remaining ones are updated
+		mSkyViewLutPendingPhases = LutGraph.needsRebuild(LutNodeSkyView) ? interleave - 1 : mSkyViewLutPendingPhases - 1;
+		mSkyViewLutPhase = (mSkyViewLutPhase + 1) % interleave;
+	}
+	mConstantBufferCPU.gSkyViewLutInterleave = fullUpdate ? 1 : interleave;
+	mConstantBufferCPU.gSkyViewLutPhase = mSkyViewLutPhase;
+	mConstantBuffer->update(mConstantBufferCPU);
+
 	D3dRenderContext* context = g_dx11Device->getDeviceContext();
 	GPU_SCOPED_TIMEREVENT(SkyViewLut, 230, 230, 76);
 
@@ -100,7 +162,7 @@ void Game::renderSkyViewLut()
 
 	// Final view
 	mScreenVertexShader->setShader(*context);
-	SkyViewLutPS[currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
+	SkyViewLutPS[uiSunInScatterLut ? 1 : 0][currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
 
 	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
 	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
@@ -117,12 +179,112 @@ void Game::renderSkyViewLut()
 
 	context->PSSetShaderResources(6, 1, &MultiScattTex->mShaderResourceView);
 
+	context->PSSetShaderResources(9, 1, &mSunInScatterTransmittanceTex->mShaderResourceView);
+	context->PSSetShaderResources(10, 1, &mSunInScatterMultiScatTex->mShaderResourceView);
+
 	context->Draw(3, 0);
 	g_dx11Device->setNullPsResources(context);
 	g_dx11Device->setNullRenderTarget(context);
 }
 
 
+void Game::updateSkyViewLutAtlas()
+{
+	// The atlas must have been baked for the LUTs, sample counts and sky view LUT resolution in use. The CPU bake only
+	// covers the ray marched transmittance.
+	SkyLutConfig config = mSkyLutConfig;
+	config.TransmittanceWidth = mTransmittanceTex->mDesc.Width;
+	config.TransmittanceHeight = mTransmittanceTex->mDesc.Height;
+	config.MultiScatteringRes = MultiScatteringLUTRes;
+	config.SkyViewWidth = mSkyViewLutTex->mDesc.Width;
+	config.SkyViewHeight = mSkyViewLutTex->mDesc.Height;
+	config.RayMarchMinMaxSPP[0] = mConstantBufferCPU.RayMarchMinMaxSPP[0];
+	config.RayMarchMinMaxSPP[1] = mConstantBufferCPU.RayMarchMinMaxSPP[1];
+	const uint64 key = currentAnalyticOpticalDepth ? 0 : computeSkyViewLutAtlasKey(AtmosphereInfos, config, currentMultipleScatteringFactor);
+	if (key == mSkyViewLutAtlasKey)
+	{
+		return;
+	}
+	mSkyViewLutAtlasKey = key;
+	resetPtr(&mSkyViewLutAtlasTex);
+	if (key == 0)
+	{
+		return;
+	}
+
+	CPU_SCOPED_TIMER(SkyViewLutAtlasLoad);
+	LutCacheTextureDesc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.Width = config.SkyViewWidth;
+	desc.Height = config.SkyViewHeight;
+	desc.Depth = config.SkyViewAtlasSunAngleCount * config.SkyViewAtlasHeightBandCount;
+	desc.Format = DXGI_FORMAT_R11G11B10_FLOAT;
+	desc.BytesPerTexel = sizeof(uint32);
+	if (desc.Depth > D3D11_REQ_TEXTURE3D_U_V_OR_W_DIMENSION)
+	{
+		return;
+	}
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	MappedLutCacheEntry entry;
+	if (!entry.open(filepath, key, 1, &desc))
+	{
+		return;
+	}
+
+	// Texels are uploaded straight from the file mapping.
+	D3dTexture3dDesc atlasDesc = Texture3D::initDefault(DXGI_FORMAT_R11G11B10_FLOAT, desc.Width, desc.Height, desc.Depth, false, false);
+	D3dSubResourceData initialData = { entry.getTextureData(0), desc.getRowPitch(), desc.getDepthPitch() };
+	mSkyViewLutAtlasTex = new Texture3D(atlasDesc, &initialData);
+}
+
+void Game::renderSkyViewLutFromAtlas()
+{
+	// Ray marched updates restart from scratch when the atlas stops being used.
+	mSkyViewLutFullUpdateNeeded = true;
+	mSkyViewLutPendingPhases = 0;
+
+	const float3 CamPosPlanet = { mCamPosFinal.x, mCamPosFinal.y, mCamPosFinal.z + AtmosphereInfos.bottom_radius };
+	const float CamPosLength = sqrtf(CamPosPlanet.x * CamPosPlanet.x + CamPosPlanet.y * CamPosPlanet.y + CamPosPlanet.z * CamPosPlanet.z);
+	const float viewHeight = CamPosLength - AtmosphereInfos.bottom_radius;
+	const float sunZenithCosAngle = (CamPosPlanet.x * mSunDir.x + CamPosPlanet.y * mSunDir.y + CamPosPlanet.z * mSunDir.z) / CamPosLength;
+	const float sunElevation = asinf(sunZenithCosAngle < -1.0f ? -1.0f : (sunZenithCosAngle > 1.0f ? 1.0f : sunZenithCosAngle));
+	SkyViewLutAtlasCoord coord;
+	getSkyViewLutAtlasCoord(mSkyLutConfig, viewHeight, sunElevation, coord);
+	mConstantBufferCPU.gSkyViewLutAtlasBandBlend = coord.BandBlend;
+	mConstantBufferCPU.gSkyViewLutAtlasW[0] = coord.W[0];
+	mConstantBufferCPU.gSkyViewLutAtlasW[1] = coord.W[1];
+	mConstantBuffer->update(mConstantBufferCPU);
+
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+	GPU_SCOPED_TIMEREVENT(SkyViewLutAtlas, 230, 230, 76);
+
+	D3dViewport LutViewPort = { 0.0f, 0.0f, float(mSkyViewLutTex->mDesc.Width), float(mSkyViewLutTex->mDesc.Height), 0.0f, 1.0f };
+	context->RSSetViewports(1, &LutViewPort);
+
+	const uint32* initialCount = 0;
+	context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mSkyViewLutTex->mRenderTargetView, nullptr, 0, 0, nullptr, initialCount);
+
+	// Set null input assembly and layout
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->IASetInputLayout(nullptr);
+
+	mScreenVertexShader->setShader(*context);
+	SkyViewLutAtlasBlendPS->setShader(*context);
+
+	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+	context->PSSetConstantBuffers(1, 1, &SkyAtmosphereBuffer->mBuffer);
+
+	context->PSSetSamplers(0, 1, &SamplerLinear->mSampler);
+
+	context->PSSetShaderResources(11, 1, &mSkyViewLutAtlasTex->mShaderResourceView);
+
+	context->Draw(3, 0);
+	g_dx11Device->setNullPsResources(context);
+	g_dx11Device->setNullRenderTarget(context);
+}
+
 
 void Game::renderPathTracing()
 {
@@ -151,13 +313,13 @@ void Game::renderPathTracing()
 		UINT const uavInitCounts[2] = { -1, -1 };
 		if (GameMode)
 		{
-			context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mFrameAtmosphereBuffer->mRenderTargetView, nullptr, 2, 2, uavs, uavInitCounts);
+			context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mFrameAtmosphereBuffer->mRenderTargetView, nullptr, 3, 2, uavs, uavInitCounts);
 			context->OMSetBlendState(mDefaultBlendState->mState, nullptr, 0xffffffff);
 		}
 		else
 		{
-			D3dRenderTargetView* const rtvs[2] = { mPathTracingLuminanceBuffer->mRenderTargetView, mPathTracingTransmittanceBuffer->mRenderTargetView };
-			context->OMSetRenderTargetsAndUnorderedAccessViews(2, rtvs, nullptr, 2, 2, uavs, uavInitCounts);
+			D3dRenderTargetView* const rtvs[3] = { mPathTracingLuminanceBuffer->mRenderTargetView, mPathTracingTransmittanceBuffer->mRenderTargetView, mPathTracingLuminanceSquaredBuffer->mRenderTargetView };
+			context->OMSetRenderTargetsAndUnorderedAccessViews(3, rtvs, nullptr, 3, 2, uavs, uavInitCounts);
 			context->OMSetBlendState(BlendAddRGBA->mState, nullptr, 0xffffffff);
 		}
 		context->OMSetDepthStencilState(mDisabledDepthStencilState->mState, 0);
@@ -168,7 +330,7 @@ void Game::renderPathTracing()
 
 		// Final view
 		mScreenVertexShader->setShader(*context);
-		RenderPathTracingPS[currentTransPermutation][GroundGiPermutation][currentShadowPermutation ? 1 : 0][currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
+		RenderPathTracingPS[currentTransPermutation][GroundGiPermutation][currentShadowPermutation ? 1 : 0][currentMultipleScatteringFactor>0.0f ? 1 : 0][currentSamplerPermutation]->setShader(*context);
 
 		context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
 		context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
@@ -184,12 +346,108 @@ void Game::renderPathTracing()
 		context->PSSetShaderResources(5, 1, &mShadowMap->mShaderResourceView);
 
 		context->PSSetShaderResources(6, 1, &MultiScattTex->mShaderResourceView);
+		if (!GameMode)
+		{
+			context->PSSetShaderResources(8, 1, &mPathTracingConvergenceTex->mShaderResourceView);
+		}
 
 		context->Draw(3, 0);
 		g_dx11Device->setNullPsResources(context);
 		g_dx11Device->setNullRenderTarget(context);
 		context->OMSetBlendState(mDefaultBlendState->mState, nullptr, 0xffffffff);
 	}
+
+	if (!GameMode && uiPathTracingAdaptive)
+	{
+		renderPathTracingConvergence();
+		readbackPathTracingConvergence();
+	}
+}
+
+void Game::renderPathTracingConvergence()
+{
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+
+	GPU_SCOPED_TIMEREVENT(PathTracingConvergence, 255, 255, 200);
+
+	D3dViewport TileViewPort = { 0.0f, 0.0f, float(mPathTracingConvergenceTex->mDesc.Width), float(mPathTracingConvergenceTex->mDesc.Height), 0.0f, 1.0f };
+	context->RSSetViewports(1, &TileViewPort);
+
+	context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mPathTracingConvergenceTex->mRenderTargetView, nullptr, 0, 0, nullptr, nullptr);
+	context->OMSetBlendState(mDefaultBlendState->mState, nullptr, 0xffffffff);
+	context->OMSetDepthStencilState(mDisabledDepthStencilState->mState, 0);
+
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->IASetInputLayout(nullptr);
+
+	mScreenVertexShader->setShader(*context);
+	mPathTracingConvergenceShader->setShader(*context);
+
+	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+
+	context->PSSetShaderResources(2, 1, &mPathTracingLuminanceBuffer->mShaderResourceView);
+	context->PSSetShaderResources(4, 1, &mPathTracingLuminanceSquaredBuffer->mShaderResourceView);
+
+	context->Draw(3, 0);
+	g_dx11Device->setNullPsResources(context);
+	g_dx11Device->setNullRenderTarget(context);
+
+	const D3dViewport& backBufferViewport = g_dx11Device->getBackBufferViewport();
+	context->RSSetViewports(1, &backBufferViewport);
+}
+
+void Game::readbackPathTracingConvergence()
+{
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+
+	// Never stall on the GPU: the previous copy is only read once it is available, otherwise it is retried next frame.
+	// The statistics thus lag a few frames behind, and the target is reached at the frame the copy was issued.
+	if (mPathTracingConvergenceReadbackPending)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT res = context->Map(mPathTracingConvergenceStagingTex->mTexture, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+		if (res == DXGI_ERROR_WAS_STILL_DRAWING)
+		{
+			return;
+		}
+		mPathTracingConvergenceReadbackPending = false;
+		if (res == S_OK)
+		{
+			const uint32 width = uint32(mPathTracingConvergenceStagingTex->mDesc.Width);
+			const uint32 height = uint32(mPathTracingConvergenceStagingTex->mDesc.Height);
+			uint32 convergedTileCount = 0;
+			for (uint32 y = 0; y < height; ++y)
+			{
+				const float* row = (const float*)((const uint8*)mappedResource.pData + y * mappedResource.RowPitch);
+				for (uint32 x = 0; x < width; ++x)
+				{
+					convergedTileCount += row[x] > 0.0f ? 1 : 0;
+				}
+			}
+			context->Unmap(mPathTracingConvergenceStagingTex->mTexture, 0);
+
+			// Results of a copy issued before the accumulation restarted are meaningless.
+			if (mPathTracingConvergenceReadbackAccumulationIndex == mPathTracingAccumulationIndex)
+			{
+				mPathTracingConvergedTileRatio = float(convergedTileCount) / float(width * height);
+				if (convergedTileCount == width * height && mPathTracingTargetReachedTimeSec < 0.0f)
+				{
+					mPathTracingTargetReachedFrame = mPathTracingConvergenceReadbackFrame;
+					mPathTracingTargetReachedTimeSec = mPathTracingConvergenceReadbackTimeSec - mPathTracingStartTimeSec;
+				}
+			}
+		}
+	}
+
+	if (mPathTracingTargetReachedTimeSec < 0.0f)
+	{
+		context->CopyResource(mPathTracingConvergenceStagingTex->mTexture, mPathTracingConvergenceTex->mTexture);
+		mPathTracingConvergenceReadbackPending = true;
+		mPathTracingConvergenceReadbackAccumulationIndex = mPathTracingAccumulationIndex;
+		mPathTracingConvergenceReadbackFrame = mFrameId;
+		mPathTracingConvergenceReadbackTimeSec = mConstantBufferCPU.gTimeSec;
+	}
 }
 
 
@@ -219,7 +477,7 @@ void Game::renderRayMarching()
 		GpuDebugState& gds = mUpdateDebugState ? mDebugState : mDummyDebugState;
 		D3dUnorderedAccessView* const uavs[2] = { gds.gpuDebugLineBufferUAV, gds.gpuDebugLineDispatchIndUAV };
 		UINT const uavInitCounts[2] = { -1, -1 };
-		context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mBackBufferHdr->mRenderTargetView, nullptr, 2, 2, uavs, uavInitCounts);
+		context->OMSetRenderTargetsAndUnorderedAccessViews(1, &mBackBufferHdr->mRenderTargetView, nullptr, 3, 2, uavs, uavInitCounts);
 		context->OMSetDepthStencilState(mDisabledDepthStencilState->mState, 0);
 
 		if (ColoredTransmittance)
@@ -327,11 +585,38 @@ void Game::generateSkyAtmosphereCameraVolumeWithRayMarch()
 	D3dRenderContext* context = g_dx11Device->getDeviceContext();
 	GPU_SCOPED_TIMEREVENT(CameraVolumes, 177, 34, 76);
 
+	if (uiCameraVolumePrefix)
+	{
+		// One thread per froxel column, see CameraVolumesPrefixCS
+		g_dx11Device->setNullRenderTarget(context);
+		g_dx11Device->setNullCsResources(context);
+		g_dx11Device->setNullCsUnorderedAccessViews(context);
+
+		CameraVolumesPrefixCS[uiSunInScatterLut ? 1 : 0][currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
+		context->CSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
+		context->CSSetConstantBuffers(1, 1, &SkyAtmosphereBuffer->mBuffer);
+		context->CSSetSamplers(0, 1, &SamplerLinear->mSampler);
+		context->CSSetSamplers(1, 1, &SamplerShadow->mSampler);
+		context->CSSetShaderResources(1, 1, &mBlueNoise2dTex->mShaderResourceView);
+		context->CSSetShaderResources(2, 1, &mTransmittanceTex->mShaderResourceView);
+		context->CSSetShaderResources(6, 1, &MultiScattTex->mShaderResourceView);
+		context->CSSetShaderResources(9, 1, &mSunInScatterTransmittanceTex->mShaderResourceView);
+		context->CSSetShaderResources(10, 1, &mSunInScatterMultiScatTex->mShaderResourceView);
+		context->CSSetUnorderedAccessViews(2, 1, &AtmosphereCameraScatteringVolume->mUnorderedAccessView, nullptr);
+		context->CSSetUnorderedAccessViews(5, 1, &mCameraVolumeCullingTex->mUnorderedAccessView, nullptr);
+
+		context->Dispatch(divRoundUp(AtmosphereCameraScatteringVolume->mDesc.Width, 8), divRoundUp(AtmosphereCameraScatteringVolume->mDesc.Height, 8), 1);
+		g_dx11Device->setNullCsResources(context);
+		g_dx11Device->setNullCsUnorderedAccessViews(context);
+		mCameraVolumeCullingCopyNeeded = true;
+		return;
+	}
+
 	const uint32* initialCount = 0;
 	D3dRenderTargetView* RtViews[1] = { AtmosphereCameraScatteringVolume->mRenderTargetView };
 	context->OMSetRenderTargetsAndUnorderedAccessViews(1, RtViews, nullptr, 0, 0, nullptr, initialCount);
 
-	D3dViewport CameraVolumeViewPort = { 0,0,32,32,0.0f,1.0f };
+	D3dViewport CameraVolumeViewPort = { 0.0f, 0.0f, float(AtmosphereCameraScatteringVolume->mDesc.Width), float(AtmosphereCameraScatteringVolume->mDesc.Height), 0.0f, 1.0f };
 	context->RSSetViewports(1, &CameraVolumeViewPort);
 
 	// Set null input assembly and layout
@@ -341,7 +626,7 @@ void Game::generateSkyAtmosphereCameraVolumeWithRayMarch()
 	// Final view
 	mScreenVertexShader->setShader(*context);
 	GeometryGS->setShader(*context);
-	CameraVolumesRayMarchPS[currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
+	CameraVolumesRayMarchPS[uiSunInScatterLut ? 1 : 0][currentMultipleScatteringFactor>0.0f ? 1 : 0]->setShader(*context);
 
 	context->VSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
 	context->PSSetConstantBuffers(0, 1, &mConstantBuffer->mBuffer);
@@ -359,9 +644,58 @@ void Game::generateSkyAtmosphereCameraVolumeWithRayMarch()
 
 	context->PSSetShaderResources(6, 1, &MultiScattTex->mShaderResourceView);
 
+	context->PSSetShaderResources(9, 1, &mSunInScatterTransmittanceTex->mShaderResourceView);
+	context->PSSetShaderResources(10, 1, &mSunInScatterMultiScatTex->mShaderResourceView);
+
 	context->DrawInstanced(3, AtmosphereCameraScatteringVolume->mDesc.Depth, 0, 0);
 	context->GSSetShader(nullptr, nullptr, 0);
 	g_dx11Device->setNullPsResources(context);
 	g_dx11Device->setNullRenderTarget(context);
 }
 
+void Game::readbackCameraVolumeCulling()
+{
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+
+	// Never stall on the GPU, as for readbackPathTracingConvergence: the statistics lag a few frames behind the volume.
+	if (mCameraVolumeCullingReadbackPending)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT res = context->Map(mCameraVolumeCullingStagingTex->mTexture, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource);
+		if (res == DXGI_ERROR_WAS_STILL_DRAWING)
+		{
+			return;
+		}
+		mCameraVolumeCullingReadbackPending = false;
+		if (res == S_OK)
+		{
+			const uint32 width = uint32(mCameraVolumeCullingStagingTex->mDesc.Width);
+			const uint32 height = uint32(mCameraVolumeCullingStagingTex->mDesc.Height);
+			float marchedCount = 0.0f;
+			float groundCulledCount = 0.0f;
+			for (uint32 y = 0; y < height; ++y)
+			{
+				const float* row = (const float*)((const uint8*)mappedResource.pData + y * mappedResource.RowPitch);
+				for (uint32 x = 0; x < width; ++x)
+				{
+					marchedCount += row[x * 2 + 0];
+					groundCulledCount += row[x * 2 + 1];
+				}
+			}
+			context->Unmap(mCameraVolumeCullingStagingTex->mTexture, 0);
+
+			const float froxelCount = float(width * height * AtmosphereCameraScatteringVolume->mDesc.Depth);
+			mCameraVolumeMarchedRatio = marchedCount / froxelCount;
+			mCameraVolumeGroundCulledRatio = groundCulledCount / froxelCount;
+			mCameraVolumeSpaceCulledRatio = 1.0f - mCameraVolumeMarchedRatio - mCameraVolumeGroundCulledRatio;
+		}
+	}
+
+	if (mCameraVolumeCullingCopyNeeded)
+	{
+		context->CopyResource(mCameraVolumeCullingStagingTex->mTexture, mCameraVolumeCullingTex->mTexture);
+		mCameraVolumeCullingCopyNeeded = false;
+		mCameraVolumeCullingReadbackPending = true;
+	}
+}
+
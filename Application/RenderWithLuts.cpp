@@ -267,6 +267,126 @@ void Game::generateSkyAtmosphereLUTs()
 }
 
 
+
+static const uint32 SkyAtmosphereLutCacheTextureCount = 3;
+
+static void getSkyAtmosphereLutCacheTextures(const LookUpTables& LUTs, LutCacheTextureDesc* descs, ID3D11Resource** resources)
+{
+	auto setDesc = [](LutCacheTextureDesc& desc, uint32 width, uint32 height, uint32 depth, DXGI_FORMAT format)
+	{
+		memset(&desc, 0, sizeof(LutCacheTextureDesc));
+		desc.Width = width;
+		desc.Height = height;
+		desc.Depth = depth;
+		desc.Format = format;
+		desc.BytesPerTexel = format == DXGI_FORMAT_R32G32B32A32_FLOAT ? 16 : 8;
+		ATLASSERT(format == DXGI_FORMAT_R32G32B32A32_FLOAT || format == DXGI_FORMAT_R16G16B16A16_FLOAT);
+	};
+	setDesc(descs[0], LUTs.TransmittanceTex->mDesc.Width, LUTs.TransmittanceTex->mDesc.Height, 1, LUTs.TransmittanceTex->mDesc.Format);
+	setDesc(descs[1], LUTs.IrradianceTex->mDesc.Width, LUTs.IrradianceTex->mDesc.Height, 1, LUTs.IrradianceTex->mDesc.Format);
+	setDesc(descs[2], LUTs.ScatteringTex->mDesc.Width, LUTs.ScatteringTex->mDesc.Height, LUTs.ScatteringTex->mDesc.Depth, LUTs.ScatteringTex->mDesc.Format);
+	resources[0] = LUTs.TransmittanceTex->mTexture;
+	resources[1] = LUTs.IrradianceTex->mTexture;
+	resources[2] = LUTs.ScatteringTex->mTexture;
+}
+
+bool Game::loadSkyAtmosphereLUTsFromCache(uint64 key)
+{
+	CPU_SCOPED_TIMER(LutCacheLoad);
+	LutCacheTextureDesc descs[SkyAtmosphereLutCacheTextureCount];
+	ID3D11Resource* resources[SkyAtmosphereLutCacheTextureCount];
+	getSkyAtmosphereLutCacheTextures(LUTs, descs, resources);
+
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	MappedLutCacheEntry entry;
+	if (!entry.open(filepath, key, SkyAtmosphereLutCacheTextureCount, descs))
+	{
+		return false;
+	}
+
+	// Texels are uploaded straight from the file mapping.
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+	GPU_SCOPED_TIMEREVENT(LutCacheUpload, 177, 34, 76);
+	for (uint32 t = 0; t < SkyAtmosphereLutCacheTextureCount; ++t)
+	{
+		context->UpdateSubresource(resources[t], 0, nullptr, entry.getTextureData(t), descs[t].getRowPitch(), descs[t].getDepthPitch());
+	}
+	return true;
+}
+
+void Game::saveSkyAtmosphereLUTsToCache(uint64 key)
+{
+	CPU_SCOPED_TIMER(LutCacheSave);
+	LutCacheTextureDesc descs[SkyAtmosphereLutCacheTextureCount];
+	ID3D11Resource* resources[SkyAtmosphereLutCacheTextureCount];
+	getSkyAtmosphereLutCacheTextures(LUTs, descs, resources);
+
+	// Read back through staging copies. This stalls but only happens once per atmosphere.
+	D3dRenderContext* context = g_dx11Device->getDeviceContext();
+	std::vector<unsigned char> textureData[SkyAtmosphereLutCacheTextureCount];
+	const void* textureDataPtrs[SkyAtmosphereLutCacheTextureCount];
+	for (uint32 t = 0; t < SkyAtmosphereLutCacheTextureCount; ++t)
+	{
+		Texture2D* staging2d = nullptr;
+		Texture3D* staging3d = nullptr;
+		ID3D11Resource* stagingResource;
+		if (descs[t].Depth == 1)
+		{
+			D3dTexture2dDesc desc = t == 0 ? LUTs.TransmittanceTex->mDesc : LUTs.IrradianceTex->mDesc;
+			desc.BindFlags = 0;
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			staging2d = new Texture2D(desc);
+			stagingResource = staging2d->mTexture;
+		}
+		else
+		{
+			D3dTexture3dDesc desc = LUTs.ScatteringTex->mDesc;
+			desc.BindFlags = 0;
+			desc.Usage = D3D11_USAGE_STAGING;
+			desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+			staging3d = new Texture3D(desc);
+			stagingResource = staging3d->mTexture;
+		}
+		context->CopyResource(stagingResource, resources[t]);
+
+		const LutCacheTextureDesc& desc = descs[t];
+		textureData[t].resize(size_t(desc.getDepthPitch()) * desc.Depth);
+		textureDataPtrs[t] = textureData[t].data();
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		HRESULT res = context->Map(stagingResource, 0, D3D11_MAP_READ, 0, &mappedResource);
+		ATLASSERT(res == S_OK);
+		if (res == S_OK)
+		{
+			// Remove the driver row and slice padding.
+			for (uint32 z = 0; z < desc.Depth; ++z)
+			{
+				for (uint32 y = 0; y < desc.Height; ++y)
+				{
+					const unsigned char* src = (const unsigned char*)mappedResource.pData + size_t(z) * mappedResource.DepthPitch + size_t(y) * mappedResource.RowPitch;
+					memcpy(&textureData[t][size_t(z) * desc.getDepthPitch() + size_t(y) * desc.getRowPitch()], src, desc.getRowPitch());
+				}
+			}
+			context->Unmap(stagingResource, 0);
+		}
+		resetPtr(&staging2d);
+		resetPtr(&staging3d);
+		if (res != S_OK)
+		{
+			return;
+		}
+	}
+
+	char filepath[256];
+	getLutCacheFilePath(key, filepath, sizeof(filepath));
+	if (!writeLutCacheEntry(filepath, key, SkyAtmosphereLutCacheTextureCount, descs, textureDataPtrs))
+	{
+		OutputDebugStringA("Failed to write the LUT cache entry\n");
+	}
+}
+
+
 void Game::generateSkyAtmosphereCameraVolumes()
 {
 	mConstantBufferCPU.gResolution[0] = AtmosphereCameraScatteringVolume->mDesc.Width;
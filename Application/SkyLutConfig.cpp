@@ -0,0 +1,227 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "SkyLutConfig.h"
+
+
+
+struct SkyLutConfigKey
+{
+	const char* Key;
+	size_t Offset;
+	bool IsFloat;
+	float MinValue;
+	float MaxValue;
+};
+
+#define SKY_LUT_CONFIG_KEY(key, member, isFloat, minValue, maxValue) { key, offsetof(SkyLutConfig, member), isFloat, minValue, maxValue }
+static const SkyLutConfigKey SkyLutConfigKeys[] = {
+	SKY_LUT_CONFIG_KEY("transmittanceWidth",			TransmittanceWidth,				false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("transmittanceHeight",			TransmittanceHeight,			false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("transmittanceSampleCount",		TransmittanceSampleCount,		true,	1.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("multiScatteringRes",			MultiScatteringRes,				false,	2.0f,	1024.0f),
+	SKY_LUT_CONFIG_KEY("multiScatteringSampleCount",	MultiScatteringSampleCount,		true,	1.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("sunInScatterWidth",				SunInScatterWidth,				false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("sunInScatterHeight",			SunInScatterHeight,				false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("skyViewWidth",					SkyViewWidth,					false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("skyViewHeight",					SkyViewHeight,					false,	2.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("rayMarchMinSPP",				RayMarchMinMaxSPP[0],			true,	1.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("rayMarchMaxSPP",				RayMarchMinMaxSPP[1],			true,	1.0f,	4096.0f),
+	SKY_LUT_CONFIG_KEY("skyViewTexelBudget",			SkyViewTexelBudget,				false,	0.0f,	16777216.0f),
+	SKY_LUT_CONFIG_KEY("skyViewRefreshHeight",			SkyViewRefreshHeight,			true,	0.0f,	1000.0f),
+	SKY_LUT_CONFIG_KEY("skyViewRefreshSunAngle",		SkyViewRefreshSunAngle,			true,	0.0f,	3.15f),
+	SKY_LUT_CONFIG_KEY("skyViewAtlasSunAngleCount",		SkyViewAtlasSunAngleCount,		false,	2.0f,	1024.0f),
+	SKY_LUT_CONFIG_KEY("skyViewAtlasHeightBandCount",	SkyViewAtlasHeightBandCount,	false,	1.0f,	256.0f),
+	SKY_LUT_CONFIG_KEY("skyViewAtlasMinSunElevation",	SkyViewAtlasMinSunElevation,	true,	-1.5f,	1.5f),
+	SKY_LUT_CONFIG_KEY("skyViewAtlasMinCameraHeight",	SkyViewAtlasMinCameraHeight,	true,	0.001f,	1000.0f),
+	SKY_LUT_CONFIG_KEY("skyViewAtlasMaxCameraHeight",	SkyViewAtlasMaxCameraHeight,	true,	0.001f,	1000.0f),
+	SKY_LUT_CONFIG_KEY("cameraVolumeWidth",				CameraVolumeWidth,				false,	1.0f,	1024.0f),
+	SKY_LUT_CONFIG_KEY("cameraVolumeHeight",			CameraVolumeHeight,				false,	1.0f,	1024.0f),
+	SKY_LUT_CONFIG_KEY("cameraVolumeSliceCount",		CameraVolumeSliceCount,			false,	1.0f,	1024.0f),
+	SKY_LUT_CONFIG_KEY("cameraVolumeKmPerSlice",		CameraVolumeKmPerSlice,			true,	0.001f,	1000.0f),
+	SKY_LUT_CONFIG_KEY("cameraVolumeSamplesPerSlice",	CameraVolumeSamplesPerSlice,	true,	0.001f,	1024.0f),
+};
+#undef SKY_LUT_CONFIG_KEY
+
+const char* getSkyViewLutTierName(SkyViewLutTier tier)
+{
+	static const char* names[SkyViewLutTierCount] = { "Low", "Medium", "High", "Cinematic" };
+	return tier < SkyViewLutTierCount ? names[tier] : "Unknown";
+}
+
+void getSkyViewLutTierResolution(SkyViewLutTier tier, uint32& outWidth, uint32& outHeight)
+{
+	static const uint32 widths[SkyViewLutTierCount] = { 96, 128, 192, 384 };
+	outWidth = widths[tier < SkyViewLutTierCount ? tier : SkyViewLutTierHigh];
+	outHeight = outWidth * 9 / 16;
+}
+
+
+uint32 getSkyViewLutInterleave(uint32 texelCount, uint32 texelBudget)
+{
+	uint32 interleave = 1;
+	while (texelBudget > 0 && interleave < SKY_VIEW_LUT_MAX_INTERLEAVE && texelCount > texelBudget * interleave)
+	{
+		interleave *= 2;
+	}
+	return interleave;
+}
+
+
+
+// Height bands have a geometric distribution: the sky view LUT changes quickly close to the ground, where the horizon moves the most.
+float getSkyViewLutAtlasCameraHeight(const SkyLutConfig& config, uint32 band)
+{
+	const float x = config.SkyViewAtlasHeightBandCount > 1 ? float(band) / float(config.SkyViewAtlasHeightBandCount - 1) : 0.0f;
+	const float heightRatio = (std::max)(config.SkyViewAtlasMaxCameraHeight / config.SkyViewAtlasMinCameraHeight, 1.0f);
+	return config.SkyViewAtlasMinCameraHeight * powf(heightRatio, x);
+}
+
+// Sun angles are uniform in sign(e) * sqrt(|e| / (PI / 2)), e being the elevation: the spacing is a fraction of a degree around the horizon,
+// where the twilight colors change the fastest, and gets coarser towards the zenith. Blending errors grow with the spacing squared.
+static float getSkyViewLutAtlasSunParam(float sunElevation)
+{
+	const float param = sqrtf(fabsf(sunElevation) / 1.5707963f);
+	return sunElevation < 0.0f ? -param : param;
+}
+
+float getSkyViewLutAtlasSunElevation(const SkyLutConfig& config, uint32 angle)
+{
+	const float minParam = getSkyViewLutAtlasSunParam(config.SkyViewAtlasMinSunElevation);
+	const float param = minParam + (1.0f - minParam) * float(angle) / float(config.SkyViewAtlasSunAngleCount - 1);
+	return 1.5707963f * param * fabsf(param);
+}
+
+void getSkyViewLutAtlasCoord(const SkyLutConfig& config, float cameraHeight, float sunElevation, SkyViewLutAtlasCoord& out)
+{
+	const uint32 BandCount = config.SkyViewAtlasHeightBandCount;
+	const uint32 AngleCount = config.SkyViewAtlasSunAngleCount;
+
+	const float heightRatio = (std::max)(config.SkyViewAtlasMaxCameraHeight / config.SkyViewAtlasMinCameraHeight, 1.0f);
+	const float heightParam = heightRatio > 1.0f ? logf((std::max)(cameraHeight, config.SkyViewAtlasMinCameraHeight) / config.SkyViewAtlasMinCameraHeight) / logf(heightRatio) : 0.0f;
+	const float band = (std::min)(heightParam, 1.0f) * float(BandCount - 1);
+	out.Bands[0] = (std::min)(uint32(band), BandCount - 1);
+	out.Bands[1] = (std::min)(out.Bands[0] + 1, BandCount - 1);
+	out.BandBlend = out.Bands[1] != out.Bands[0] ? band - float(out.Bands[0]) : 0.0f;
+
+	const float minParam = getSkyViewLutAtlasSunParam(config.SkyViewAtlasMinSunElevation);
+	const float angle = (getSkyViewLutAtlasSunParam(sunElevation) - minParam) / (1.0f - minParam) * float(AngleCount - 1);
+	out.SunAngle = (std::max)(0.0f, (std::min)(angle, float(AngleCount - 1)));
+	for (int b = 0; b < 2; ++b)
+	{
+		out.W[b] = (float(out.Bands[b] * AngleCount) + out.SunAngle + 0.5f) / float(BandCount * AngleCount);
+	}
+}
+
+
+
+bool SkyLutConfig::applySetting(const std::string& key, const std::string& value, std::string& error)
+{
+	for (const SkyLutConfigKey& configKey : SkyLutConfigKeys)
+	{
+		if (key != configKey.Key)
+		{
+			continue;
+		}
+		char* end = nullptr;
+		const float number = strtof(value.c_str(), &end);
+		const bool validType = configKey.IsFloat || float(int(number)) == number;
+		if (value.empty() || *end != 0 || !validType || !(number >= configKey.MinValue && number <= configKey.MaxValue))
+		{
+			error = "invalid value for " + key + ": " + value;
+			return false;
+		}
+		unsigned char* member = reinterpret_cast<unsigned char*>(this) + configKey.Offset;
+		if (configKey.IsFloat)
+		{
+			*reinterpret_cast<float*>(member) = number;
+		}
+		else
+		{
+			*reinterpret_cast<uint32*>(member) = uint32(number);
+		}
+		return true;
+	}
+	error = "unknown key " + key;
+	return false;
+}
+
+bool SkyLutConfig::load(const char* filepath, std::string& error)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+	{
+		error = std::string("cannot open ") + filepath;
+		return false;
+	}
+
+	std::string line;
+	uint32 lineIndex = 0;
+	while (std::getline(file, line))
+	{
+		lineIndex++;
+		const size_t comment = line.find('#');
+		if (comment != std::string::npos)
+		{
+			line.resize(comment);
+		}
+		std::istringstream tokens(line);
+		std::string setting;
+		while (tokens >> setting)
+		{
+			const size_t equal = setting.find('=');
+			std::string settingError = "expected key=value, got " + setting;
+			if (equal == std::string::npos || !applySetting(setting.substr(0, equal), setting.substr(equal + 1), settingError))
+			{
+				error = "line " + std::to_string(lineIndex) + ": " + settingError;
+				return false;
+			}
+		}
+	}
+	if (RayMarchMinMaxSPP[1] < RayMarchMinMaxSPP[0])
+	{
+		error = "rayMarchMaxSPP is lower than rayMarchMinSPP";
+		return false;
+	}
+	return true;
+}
+
+bool SkyLutConfig::save(const char* filepath) const
+{
+	FILE* file = fopen(filepath, "wb");
+	if (!file)
+	{
+		return false;
+	}
+	const std::string content = toString();
+	const bool success = fwrite(content.data(), 1, content.size(), file) == content.size();
+	return fclose(file) == 0 && success;
+}
+
+std::string SkyLutConfig::toString() const
+{
+	std::string content;
+	for (const SkyLutConfigKey& configKey : SkyLutConfigKeys)
+	{
+		const unsigned char* member = reinterpret_cast<const unsigned char*>(this) + configKey.Offset;
+		char line[128];
+		if (configKey.IsFloat)
+		{
+			snprintf(line, sizeof(line), "%s=%g\n", configKey.Key, *reinterpret_cast<const float*>(member));
+		}
+		else
+		{
+			snprintf(line, sizeof(line), "%s=%u\n", configKey.Key, *reinterpret_cast<const uint32*>(member));
+		}
+		content += line;
+	}
+	return content;
+}
+
@@ -0,0 +1,90 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <string>
+#include "SkyAtmosphereCommon.h"
+
+// Resolutions and sample counts of the LUTs of the ray marching technique, and the amortization of the sky view LUT updates. The defaults are the values the shaders
+// used to have compiled in. Configurations are chosen offline with "SkyCpuTools tune-sky-luts" and given to the
+// application with -lutconfig <file>. This does not depend on D3D.
+//
+// File syntax: key=value settings separated by spaces or lines, # starting a comment. Missing keys keep their default.
+// Keys are the member names starting with a lower case letter, rayMarchMinSPP and rayMarchMaxSPP being the two RayMarchMinMaxSPP.
+
+// Sky view LUT resolutions selectable at runtime, all 16:9. High is the SkyLutConfig default.
+enum SkyViewLutTier
+{
+	SkyViewLutTierLow = 0,
+	SkyViewLutTierMedium,
+	SkyViewLutTierHigh,
+	SkyViewLutTierCinematic,
+	SkyViewLutTierCount
+};
+
+const char* getSkyViewLutTierName(SkyViewLutTier tier);
+void getSkyViewLutTierResolution(SkyViewLutTier tier, uint32& outWidth, uint32& outHeight);
+
+// Amortized sky view LUT updates render one of interleave phases per frame, interleave being the power of two up to
+// SKY_VIEW_LUT_MAX_INTERLEAVE keeping the texels of a phase within texelBudget. A budget of 0 updates every texel.
+#define SKY_VIEW_LUT_MAX_INTERLEAVE 16
+uint32 getSkyViewLutInterleave(uint32 texelCount, uint32 texelBudget);
+
+struct SkyLutConfig;
+
+// Time of day sky view LUT atlas: SkyViewAtlasHeightBandCount camera height bands of SkyViewAtlasSunAngleCount sky view LUTs each,
+// LUT (band, angle) being the slice band * SkyViewAtlasSunAngleCount + angle of a SkyViewWidth x SkyViewHeight x LUT count volume.
+// It is baked offline by "SkyCpuTools bake-sky-view-atlas" and replaces the sky view LUT ray marching by a blend of the nearest LUTs.
+float getSkyViewLutAtlasCameraHeight(const SkyLutConfig& config, uint32 band);
+float getSkyViewLutAtlasSunElevation(const SkyLutConfig& config, uint32 angle);
+
+struct SkyViewLutAtlasCoord
+{
+	uint32 Bands[2];		// Height bands around the camera, the same one twice outside of the atlas range
+	float BandBlend;		// Weight of Bands[1]
+	float SunAngle;			// Fractional sun angle index, clamped to the atlas range
+	float W[2];				// Volume w coordinate of each band, the sun angles being blended by the linear filtering
+};
+void getSkyViewLutAtlasCoord(const SkyLutConfig& config, float cameraHeight, float sunElevation, SkyViewLutAtlasCoord& out);
+
+struct SkyLutConfig
+{
+	uint32 TransmittanceWidth = 256;			// Ray marching transmittance LUT only, Bruneton 2017 keeps LookUpTablesInfo
+	uint32 TransmittanceHeight = 64;
+	float TransmittanceSampleCount = 40.0f;		// Can go as low as 10 but the energy lost starts to be visible
+
+	uint32 MultiScatteringRes = 32;
+	float MultiScatteringSampleCount = 20.0f;	// A minimum set of steps is required for accuracy
+
+	uint32 SunInScatterWidth = 256;				// Sun zenith cosines of the sun in-scatter LUT, see bakeSunInScatterLut
+	uint32 SunInScatterHeight = 64;				// Heights
+
+	uint32 SkyViewWidth = 192;
+	uint32 SkyViewHeight = 108;
+	float RayMarchMinMaxSPP[2] = { 4.0f, 14.0f };	// Variable sample count of the sky view LUT and of the ray marched view
+	uint32 SkyViewTexelBudget = 0;				// Texels updated per frame, see getSkyViewLutInterleave
+	float SkyViewRefreshHeight = 1.0f;			// Camera height change, in kilometers, forcing a full update of an amortized LUT
+	float SkyViewRefreshSunAngle = 0.02f;		// Same for the sun zenith angle, in radians
+
+	uint32 SkyViewAtlasSunAngleCount = 32;		// Time of day sky view LUT atlas, see getSkyViewLutAtlasCoord
+	uint32 SkyViewAtlasHeightBandCount = 8;
+	float SkyViewAtlasMinSunElevation = -0.2f;	// Radians, the sun angles going from there to the zenith, denser around the horizon
+	float SkyViewAtlasMinCameraHeight = 0.1f;	// Kilometers, the height bands having a geometric distribution between the two
+	float SkyViewAtlasMaxCameraHeight = 60.0f;
+
+	uint32 CameraVolumeWidth = 32;
+	uint32 CameraVolumeHeight = 32;
+	uint32 CameraVolumeSliceCount = 32;			// AP_SLICE_COUNT
+	float CameraVolumeKmPerSlice = 4.0f;		// AP_KM_PER_SLICE
+	float CameraVolumeSamplesPerSlice = 2.0f;	// Slice i is marched with (i + 1) * CameraVolumeSamplesPerSlice samples
+
+	// Applies a single key=value, returns false with an error message for unknown keys or invalid values.
+	bool applySetting(const std::string& key, const std::string& value, std::string& error);
+
+	// Returns false with an error message, prefixed with the line number, if the file cannot be read or holds an invalid line.
+	bool load(const char* filepath, std::string& error);
+	bool save(const char* filepath) const;
+	std::string toString() const;				// File content, all keys included
+};
+
@@ -0,0 +1,298 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "StateRecord.h"
+#include "MappedFile.h"
+
+
+
+static_assert(sizeof(float) == 4 && sizeof(int) == 4, "State fields are stored as 32 bits values");
+static_assert(sizeof(DensityProfile) == 10 * sizeof(float), "DensityProfile is stored as 10 floats");
+
+struct StateFieldDesc
+{
+	uint32 Offset;			// In SavedState
+	uint32 ValueCount;		// 0 for unused ids
+};
+
+// Field id to SavedState member. Every member being a float or an int, fields are copied as 32 bits values.
+struct StateFieldTable
+{
+	StateFieldDesc Fields[StateFieldIdCount];
+
+	StateFieldTable()
+	{
+		memset(Fields, 0, sizeof(Fields));
+		for (uint32 a = 0; a < 2; ++a)
+		{
+			const uint32 base = a == 0 ? 0 : StateFieldSavedAtmosphere;
+			const size_t atmosphere = a == 0 ? offsetof(SavedState, Atmosphere) : offsetof(SavedState, AtmosphereSaved);
+			add(base + StateFieldSolarIrradiance,		atmosphere + offsetof(AtmosphereInfo, solar_irradiance), 3);
+			add(base + StateFieldSunAngularRadius,		atmosphere + offsetof(AtmosphereInfo, sun_angular_radius), 1);
+			add(base + StateFieldBottomRadius,			atmosphere + offsetof(AtmosphereInfo, bottom_radius), 1);
+			add(base + StateFieldTopRadius,				atmosphere + offsetof(AtmosphereInfo, top_radius), 1);
+			add(base + StateFieldRayleighDensity,		atmosphere + offsetof(AtmosphereInfo, rayleigh_density), 10);
+			add(base + StateFieldRayleighScattering,	atmosphere + offsetof(AtmosphereInfo, rayleigh_scattering), 3);
+			add(base + StateFieldMieDensity,			atmosphere + offsetof(AtmosphereInfo, mie_density), 10);
+			add(base + StateFieldMieScattering,			atmosphere + offsetof(AtmosphereInfo, mie_scattering), 3);
+			add(base + StateFieldMieExtinction,			atmosphere + offsetof(AtmosphereInfo, mie_extinction), 3);
+			add(base + StateFieldMiePhaseG,				atmosphere + offsetof(AtmosphereInfo, mie_phase_function_g), 1);
+			add(base + StateFieldAbsorptionDensity,		atmosphere + offsetof(AtmosphereInfo, absorption_density), 10);
+			add(base + StateFieldAbsorptionExtinction,	atmosphere + offsetof(AtmosphereInfo, absorption_extinction), 3);
+			add(base + StateFieldGroundAlbedo,			atmosphere + offsetof(AtmosphereInfo, ground_albedo), 3);
+			add(base + StateFieldMuSMin,				atmosphere + offsetof(AtmosphereInfo, mu_s_min), 1);
+		}
+		add(StateFieldCamPos,				offsetof(SavedState, CamPos), 3);
+		add(StateFieldCamPosFinal,			offsetof(SavedState, CamPosFinal), 3);
+		add(StateFieldViewDir,				offsetof(SavedState, ViewDir), 3);
+		add(StateFieldSunDir,				offsetof(SavedState, SunDir), 3);
+		add(StateFieldSunIlluminanceScale,	offsetof(SavedState, SunIlluminanceScale), 1);
+		add(StateFieldViewPitch,			offsetof(SavedState, ViewPitch), 1);
+		add(StateFieldViewYaw,				offsetof(SavedState, ViewYaw), 1);
+		add(StateFieldCamHeight,			offsetof(SavedState, CamHeight), 1);
+		add(StateFieldCamForward,			offsetof(SavedState, CamForward), 1);
+		add(StateFieldSunPitch,				offsetof(SavedState, SunPitch), 1);
+		add(StateFieldSunYaw,				offsetof(SavedState, SunYaw), 1);
+		add(StateFieldNumScatteringOrder,	offsetof(SavedState, NumScatteringOrder), 1);
+	}
+
+	void add(uint32 id, size_t offset, uint32 valueCount)
+	{
+		Fields[id].Offset = uint32(offset);
+		Fields[id].ValueCount = valueCount;
+	}
+};
+
+static const StateFieldTable& getStateFieldTable()
+{
+	static const StateFieldTable table;
+	return table;
+}
+
+SavedState::SavedState()
+{
+	SetupEarthAtmosphere(Atmosphere);
+	SetupEarthAtmosphere(AtmosphereSaved);
+}
+
+
+
+static void appendLe16(std::vector<unsigned char>& out, uint32 value)
+{
+	out.push_back((unsigned char)(value));
+	out.push_back((unsigned char)(value >> 8));
+}
+
+static void appendLe32(std::vector<unsigned char>& out, uint32 value)
+{
+	appendLe16(out, value & 0xFFFF);
+	appendLe16(out, value >> 16);
+}
+
+static uint32 readLe16(const unsigned char* data)
+{
+	return uint32(data[0]) | (uint32(data[1]) << 8);
+}
+
+static uint32 readLe32(const unsigned char* data)
+{
+	return readLe16(data) | (readLe16(data + 2) << 16);
+}
+
+static void writeLe32(unsigned char* data, uint32 value)
+{
+	data[0] = (unsigned char)(value);
+	data[1] = (unsigned char)(value >> 8);
+	data[2] = (unsigned char)(value >> 16);
+	data[3] = (unsigned char)(value >> 24);
+}
+
+void encodeSavedState(const SavedState& state, std::vector<unsigned char>& out)
+{
+	const StateFieldTable& table = getStateFieldTable();
+	const size_t recordStart = out.size();
+	appendLe32(out, 0);		// Patched once the size is known
+	for (uint32 id = 0; id < StateFieldIdCount; ++id)
+	{
+		const StateFieldDesc& field = table.Fields[id];
+		if (field.ValueCount == 0)
+		{
+			continue;
+		}
+		appendLe16(out, id);
+		appendLe16(out, field.ValueCount * 4);
+		const unsigned char* values = reinterpret_cast<const unsigned char*>(&state) + field.Offset;
+		for (uint32 v = 0; v < field.ValueCount; ++v)
+		{
+			uint32 value;
+			memcpy(&value, values + v * 4, 4);
+			appendLe32(out, value);
+		}
+	}
+	writeLe32(&out[recordStart], uint32(out.size() - recordStart - 4));
+}
+
+// Record parsing: known fields are copied, unknown ones skipped. Returns false if the record is malformed.
+static bool decodeSavedState(const unsigned char* data, size_t size, SavedState& state)
+{
+	const StateFieldTable& table = getStateFieldTable();
+	unsigned char* stateBytes = reinterpret_cast<unsigned char*>(&state);
+	size_t position = 0;
+	while (position + 4 <= size)
+	{
+		const uint32 id = readLe16(data + position);
+		const uint32 payloadSize = readLe16(data + position + 2);
+		position += 4;
+		if (position + payloadSize > size)
+		{
+			return false;
+		}
+		if (id < StateFieldIdCount && table.Fields[id].ValueCount > 0)
+		{
+			// Values missing from a shorter field keep their default, extra ones are ignored.
+			const StateFieldDesc& field = table.Fields[id];
+			const uint32 valueCount = payloadSize / 4 < field.ValueCount ? payloadSize / 4 : field.ValueCount;
+			for (uint32 v = 0; v < valueCount; ++v)
+			{
+				const uint32 value = readLe32(data + position + v * 4);
+				memcpy(stateBytes + field.Offset + v * 4, &value, 4);
+			}
+		}
+		position += payloadSize;
+	}
+	return position == size;
+}
+
+// Brings a record written with an older version to the current meaning of the fields.
+static void migrateSavedState(SavedState& state, uint32 fromVersion)
+{
+	// Nothing yet: version 1 is the first tagged version and raw dumps are decoded straight into the current fields.
+	(void)state;
+	(void)fromVersion;
+}
+
+// Layout written by the original SaveState: both atmospheres, 4 float3 and 7 floats followed by NumScatteringOrder.
+static const size_t StateRawDumpSize = 2 * sizeof(AtmosphereInfo) + 4 * 3 * sizeof(float) + 7 * sizeof(float) + sizeof(int);
+
+static bool decodeRawStateDump(const unsigned char* data, size_t size, SavedState& state)
+{
+	if (size != StateRawDumpSize)
+	{
+		return false;
+	}
+	void* members[] = { &state.Atmosphere, &state.AtmosphereSaved, state.CamPos, state.CamPosFinal, state.ViewDir, state.SunDir,
+		&state.SunIlluminanceScale, &state.ViewPitch, &state.ViewYaw, &state.CamHeight, &state.CamForward, &state.SunPitch, &state.SunYaw,
+		&state.NumScatteringOrder };
+	const size_t sizes[] = { sizeof(AtmosphereInfo), sizeof(AtmosphereInfo), 12, 12, 12, 12, 4, 4, 4, 4, 4, 4, 4, 4 };
+	for (size_t m = 0; m < sizeof(sizes) / sizeof(sizes[0]); ++m)
+	{
+		memcpy(members[m], data, sizes[m]);
+		data += sizes[m];
+	}
+	return true;
+}
+
+bool decodeStateFile(const unsigned char* data, size_t size, std::vector<SavedState>& outStates, uint32* outVersion)
+{
+	outStates.clear();
+	if (size < sizeof(StateFileHeader) || readLe32(data) != STATE_FILE_MAGIC)
+	{
+		SavedState state;
+		if (!decodeRawStateDump(data, size, state))
+		{
+			return false;
+		}
+		migrateSavedState(state, STATE_FILE_VERSION_RAW);
+		outStates.push_back(state);
+		if (outVersion)
+		{
+			*outVersion = STATE_FILE_VERSION_RAW;
+		}
+		return true;
+	}
+
+	const uint32 version = readLe32(data + 4);
+	const uint32 recordCount = readLe32(data + 8);
+	const uint32 headerSize = readLe32(data + 12);
+	if (version == STATE_FILE_VERSION_RAW || version > STATE_FILE_VERSION || headerSize < sizeof(StateFileHeader) || headerSize > size
+		|| recordCount > (size - headerSize) / 4)
+	{
+		return false;
+	}
+	if (outVersion)
+	{
+		*outVersion = version;
+	}
+
+	outStates.resize(recordCount);
+	size_t position = headerSize;
+	for (uint32 r = 0; r < recordCount; ++r)
+	{
+		if (position + 4 > size)
+		{
+			return false;
+		}
+		const uint32 recordSize = readLe32(data + position);
+		position += 4;
+		if (recordSize > size - position || !decodeSavedState(data + position, recordSize, outStates[r]))
+		{
+			outStates.clear();
+			return false;
+		}
+		if (version < STATE_FILE_VERSION)
+		{
+			migrateSavedState(outStates[r], version);
+		}
+		position += recordSize;
+	}
+	return true;
+}
+
+bool writeStateFile(const char* filepath, const SavedState* states, uint32 stateCount)
+{
+	std::vector<unsigned char> data;
+	appendLe32(data, STATE_FILE_MAGIC);
+	appendLe32(data, STATE_FILE_VERSION);
+	appendLe32(data, stateCount);
+	appendLe32(data, sizeof(StateFileHeader));
+	for (uint32 s = 0; s < stateCount; ++s)
+	{
+		encodeSavedState(states[s], data);
+	}
+
+	char tempFilepath[512];
+	snprintf(tempFilepath, sizeof(tempFilepath), "%s.tmp", filepath);
+	FILE* file = fopen(tempFilepath, "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool success = fwrite(data.data(), 1, data.size(), file) == data.size();
+	success &= fclose(file) == 0;
+
+	// Replace any previous file.
+	remove(filepath);
+	success = success && rename(tempFilepath, filepath) == 0;
+	if (!success)
+	{
+		remove(tempFilepath);
+	}
+	return success;
+}
+
+bool loadStateFile(const char* filepath, std::vector<SavedState>& outStates, uint32* outVersion)
+{
+	MappedFile file;
+	if (!file.open(filepath))
+	{
+		outStates.clear();
+		return false;
+	}
+	return decodeStateFile(file.getData(), file.getSize(), outStates, outVersion);
+}
+
+
@@ -0,0 +1,99 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "SkyAtmosphereCommon.h"
+
+// Versioned binary format of the application states saved with F5, also used for preset files holding many states.
+// A state file is a StateFileHeader followed by StateFileHeader::RecordCount records. A record is its byte size
+// followed by tagged fields: uint16 field id, uint16 payload byte size and the payload, 32 bits values. Everything is
+// little endian whatever the platform. Readers skip unknown fields and keep the default value of missing ones, so
+// fields can be added without changing the version. Ids are never reused. This does not depend on D3D.
+//
+// Files written before this format are a raw dump of a single state (STATE_FILE_VERSION_RAW) and are migrated when loaded.
+
+#define STATE_FILE_MAGIC		0x53594B53	// "SKYS"
+#define STATE_FILE_VERSION		1			// Increment when the meaning of an existing field changes and migrate older records in migrateSavedState
+#define STATE_FILE_VERSION_RAW	0
+
+struct StateFileHeader
+{
+	uint32 Magic;
+	uint32 Version;
+	uint32 RecordCount;
+	uint32 HeaderSize;		// Records start at this offset
+};
+
+enum StateFieldId
+{
+	// AtmosphereInfo members, for the current and the saved atmosphere (StateFieldSavedAtmosphere + same order)
+	StateFieldSolarIrradiance = 1,
+	StateFieldSunAngularRadius,
+	StateFieldBottomRadius,
+	StateFieldTopRadius,
+	StateFieldRayleighDensity,
+	StateFieldRayleighScattering,
+	StateFieldMieDensity,
+	StateFieldMieScattering,
+	StateFieldMieExtinction,
+	StateFieldMiePhaseG,
+	StateFieldAbsorptionDensity,
+	StateFieldAbsorptionExtinction,
+	StateFieldGroundAlbedo,
+	StateFieldMuSMin,
+
+	StateFieldSavedAtmosphere = 32,
+
+	StateFieldCamPos = 64,
+	StateFieldCamPosFinal,
+	StateFieldViewDir,
+	StateFieldSunDir,
+	StateFieldSunIlluminanceScale,
+	StateFieldViewPitch,
+	StateFieldViewYaw,
+	StateFieldCamHeight,
+	StateFieldCamForward,
+	StateFieldSunPitch,
+	StateFieldSunYaw,
+	StateFieldNumScatteringOrder,
+
+	StateFieldIdCount
+};
+
+// Everything Game::SaveState records, with the application startup values.
+struct SavedState
+{
+	AtmosphereInfo Atmosphere;
+	AtmosphereInfo AtmosphereSaved;		// Game::AtmosphereInfosSaved
+	float CamPos[3] = { 0.0f, 0.0f, 0.0f };
+	float CamPosFinal[3] = { 0.0f, 0.0f, 0.0f };
+	float ViewDir[3] = { 0.0f, 1.0f, 0.0f };
+	float SunDir[3] = { 0.0f, 0.0f, 1.0f };
+	float SunIlluminanceScale = 1.0f;
+	float ViewPitch = 0.0f;
+	float ViewYaw = 0.0f;
+	float CamHeight = 0.5f;
+	float CamForward = -1.0f;
+	float SunPitch = 0.45f;
+	float SunYaw = 0.0f;
+	int NumScatteringOrder = 4;
+
+	SavedState();
+};
+
+// Appends the record of a state.
+void encodeSavedState(const SavedState& state, std::vector<unsigned char>& out);
+
+// Writes a complete state file under a temporary name and renames it once complete.
+bool writeStateFile(const char* filepath, const SavedState* states, uint32 stateCount);
+
+// Decodes all the records of a state file in memory, a raw dump being migrated. outVersion receives the version the file was written with.
+bool decodeStateFile(const unsigned char* data, size_t size, std::vector<SavedState>& outStates, uint32* outVersion = nullptr);
+
+// Memory maps a state file and decodes all its records.
+bool loadStateFile(const char* filepath, std::vector<SavedState>& outStates, uint32* outVersion = nullptr);
+
+
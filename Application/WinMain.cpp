@@ -41,6 +41,7 @@ int WINAPI WinMain(HINSTANCE hInstance,
 	// Create the d3d device (a singleton since we only consider a single window)
 	Dx11Device::initialise(win.getHwnd());
 	DxGpuPerformance::initialise();
+	CpuTimerProfiler::setThreadName("Main");
 
 	// Initialise imgui
 	ImGuiContext* imguiContext = ImGui::CreateContext();
@@ -53,8 +54,27 @@ int WINAPI WinMain(HINSTANCE hInstance,
 
 	// Create the game
 	Game game;
+
+	// -lutconfig <file>: LUT resolutions and sample counts (see SkyLutConfig.h), for instance as written by SkyCpuTools tune-sky-luts.
+	const char* lutConfigOption = strstr(lpCmdLine, "-lutconfig ");
+	if (lutConfigOption)
+	{
+		char lutConfigPath[MAX_PATH] = { 0 };
+		sscanf_s(lutConfigOption + strlen("-lutconfig "), "%259s", lutConfigPath, (unsigned)_countof(lutConfigPath));
+		game.loadSkyLutConfig(lutConfigPath);
+	}
 	game.initialise();
 
+	// -capture <script>: runs a capture script (see CaptureSequence.h) unattended and exits once the last capture has been taken.
+	bool captureScriptFailed = false;
+	const char* captureOption = strstr(lpCmdLine, "-capture ");
+	if (captureOption)
+	{
+		char scriptPath[MAX_PATH] = { 0 };
+		sscanf_s(captureOption + strlen("-capture "), "%259s", scriptPath, (unsigned)_countof(scriptPath));
+		captureScriptFailed = !game.startCaptureSequence(scriptPath, true);
+	}
+
 
 	auto windowResizedCallback = [&](LPARAM lParam) 
 	{
@@ -73,7 +93,7 @@ int WINAPI WinMain(HINSTANCE hInstance,
 
 
 	MSG msg = { 0 };
-	while (true)
+	while (!captureScriptFailed)
 	{
 		bool msgValid = win.translateSingleMessage(msg);
 
@@ -126,6 +146,15 @@ int WINAPI WinMain(HINSTANCE hInstance,
 
 					ImGui::Checkbox("VSync", &sVSyncEnable);
 					ImGui::SliderFloat("TimerGraphWidth (ms)", &sTimerGraphWidth, 1.0, 60.0);
+					if (ImGui::Button(DxGpuPerformance::isTraceCapturing() ? "Stop trace capture" : "Start trace capture"))
+					{
+						if (DxGpuPerformance::isTraceCapturing())
+							DxGpuPerformance::stopTraceCapture();
+						else
+							DxGpuPerformance::startTraceCapture("gpu_trace.json");
+					}
+					if (ImGui::IsItemHovered())
+						ImGui::SetTooltip("Writes gpu_trace.json, to open in chrome://tracing or https://ui.perfetto.dev");
 
 					// Lambda function parsing the timer graph and displaying it using horizontal bars
 					static bool(*imguiPrintTimerGraphRecurse)(const DxGpuPerformance::TimerGraphNode*, int, int)
@@ -199,8 +228,13 @@ int WINAPI WinMain(HINSTANCE hInstance,
 						unsigned int levelShift = 16 - 2 * level - 1;
 						char* levelOffsetPtr = levelOffset + (levelShift<0 ? 0 : levelShift); // cheap way to add shifting to a printf
 
-						char debugStr[128];
-						sprintf_s(debugStr, 128, "%s%s %.3f ms\n", levelOffsetPtr, node->name.c_str(), node->mLastDurationMs);
+						// Rolling statistics over the last frames
+						TimerStats stats;
+						DxGpuPerformance::getTimerStatistics().getStats(node->name, stats);
+
+						char debugStr[256];
+						sprintf_s(debugStr, 256, "%s%s %.3f ms (min %.3f avg %.3f max %.3f p95 %.3f)\n", levelOffsetPtr, node->name.c_str(), node->mLastDurationMs,
+							stats.minMs, stats.avgMs, stats.maxMs, stats.p95Ms);
 					#if 0
 						OutputDebugStringA(debugStr);
 					#else
@@ -217,6 +251,20 @@ int WINAPI WinMain(HINSTANCE hInstance,
 						textPrintTimerGraphRecurse(node, 0);
 					}
 
+					// CPU_SCOPED_TIMER scopes of all threads
+					static std::vector<std::string> cpuTimerNames;
+					DxGpuPerformance::getCpuTimerStatistics().getTimerNames(cpuTimerNames);
+					if (!cpuTimerNames.empty() && ImGui::TreeNode("CPU timers"))
+					{
+						for (const std::string& name : cpuTimerNames)
+						{
+							TimerStats stats;
+							DxGpuPerformance::getCpuTimerStatistics().getStats(name, stats);
+							ImGui::Text("%s min %.3f avg %.3f max %.3f p95 %.3f ms", name.c_str(), stats.minMs, stats.avgMs, stats.maxMs, stats.p95Ms);
+						}
+						ImGui::TreePop();
+					}
+
 					//////////////////////////////////////////////////////////////
 
 					ImGui::End();
@@ -234,6 +282,9 @@ int WINAPI WinMain(HINSTANCE hInstance,
 
 			// Events have all been processed in this path by the game
 			win.clearInputEvents();
+
+			if (game.isExitRequested())
+				break;
 		}
 	}
 
@@ -0,0 +1,176 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#ifdef _WIN32
+#include "windows.h"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CPU_TIMER_RDTSC 1
+#endif
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+#include "CpuTimer.h"
+
+
+
+static_assert((CPU_TIMER_THREAD_EVENT_COUNT & (CPU_TIMER_THREAD_EVENT_COUNT - 1)) == 0, "The event count must be a power of two");
+
+// Single producer (the owning thread), single consumer (collectEvents) ring buffer.
+struct CpuTimerThreadBuffer
+{
+	CpuTimerEvent events[CPU_TIMER_THREAD_EVENT_COUNT];
+	std::atomic<uint32_t> writeIndex{ 0 };
+	std::atomic<uint32_t> readIndex{ 0 };
+	std::atomic<uint32_t> droppedCount{ 0 };
+	uint32_t depth = 0;
+	uint16_t threadIndex = 0;
+	char name[64];
+};
+
+// Buffers are only added, under the mutex, and live until the process exits so that events of finished threads can
+// still be collected.
+static std::mutex sThreadBuffersMutex;
+static std::vector<std::unique_ptr<CpuTimerThreadBuffer>> sThreadBuffers;
+static std::atomic<uint32_t> sFrameId{ 0 };
+static thread_local CpuTimerThreadBuffer* tThreadBuffer = nullptr;
+
+static CpuTimerThreadBuffer* getThreadBuffer()
+{
+	if (!tThreadBuffer)
+	{
+		std::lock_guard<std::mutex> lock(sThreadBuffersMutex);
+		sThreadBuffers.emplace_back(new CpuTimerThreadBuffer());
+		tThreadBuffer = sThreadBuffers.back().get();
+		tThreadBuffer->threadIndex = uint16_t(sThreadBuffers.size() - 1);
+		snprintf(tThreadBuffer->name, sizeof(tThreadBuffer->name), "Thread %u", unsigned(tThreadBuffer->threadIndex));
+	}
+	return tThreadBuffer;
+}
+
+uint32_t CpuTimerProfiler::beginFrame()
+{
+	return sFrameId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+uint32_t CpuTimerProfiler::getFrameId()
+{
+	return sFrameId.load(std::memory_order_relaxed);
+}
+
+// Raw counters: converting std::chrono::steady_clock to nanoseconds alone costs a good part of the scope budget.
+uint64_t CpuTimerProfiler::getTick()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return uint64_t(counter.QuadPart);
+#elif CPU_TIMER_RDTSC
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+double CpuTimerProfiler::getTicksPerSecond()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return double(frequency.QuadPart);
+#elif CPU_TIMER_RDTSC
+	// Invariant TSC, measured once against the steady clock
+	static const double ticksPerSecond = []()
+	{
+		const auto clockStart = std::chrono::steady_clock::now();
+		const uint64_t tickStart = __rdtsc();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clockStart).count();
+		return double(__rdtsc() - tickStart) / seconds;
+	}();
+	return ticksPerSecond;
+#else
+	return double(std::chrono::steady_clock::period::den) / double(std::chrono::steady_clock::period::num);
+#endif
+}
+
+void CpuTimerProfiler::setThreadName(const char* name)
+{
+	CpuTimerThreadBuffer* buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(sThreadBuffersMutex);	// getThreadName can read it from another thread
+	strncpy(buffer->name, name, sizeof(buffer->name) - 1);
+	buffer->name[sizeof(buffer->name) - 1] = 0;
+}
+
+const char* CpuTimerProfiler::getThreadName(uint32_t threadIndex)
+{
+	std::lock_guard<std::mutex> lock(sThreadBuffersMutex);
+	return threadIndex < sThreadBuffers.size() ? sThreadBuffers[threadIndex]->name : "";
+}
+
+uint32_t CpuTimerProfiler::getThreadCount()
+{
+	std::lock_guard<std::mutex> lock(sThreadBuffersMutex);
+	return uint32_t(sThreadBuffers.size());
+}
+
+void CpuTimerProfiler::collectEvents(std::vector<CpuTimerEvent>& outEvents)
+{
+	std::lock_guard<std::mutex> lock(sThreadBuffersMutex);
+	for (auto& buffer : sThreadBuffers)
+	{
+		const uint32_t readIndex = buffer->readIndex.load(std::memory_order_relaxed);
+		const uint32_t writeIndex = buffer->writeIndex.load(std::memory_order_acquire);
+		for (uint32_t i = readIndex; i != writeIndex; ++i)
+		{
+			outEvents.push_back(buffer->events[i & (CPU_TIMER_THREAD_EVENT_COUNT - 1)]);
+		}
+		buffer->readIndex.store(writeIndex, std::memory_order_release);
+	}
+}
+
+uint64_t CpuTimerProfiler::getDroppedEventCount()
+{
+	std::lock_guard<std::mutex> lock(sThreadBuffersMutex);
+	uint64_t droppedCount = 0;
+	for (auto& buffer : sThreadBuffers)
+	{
+		droppedCount += buffer->droppedCount.load(std::memory_order_relaxed);
+	}
+	return droppedCount;
+}
+
+uint64_t CpuTimerProfiler::beginScope()
+{
+	getThreadBuffer()->depth++;
+	return getTick();
+}
+
+void CpuTimerProfiler::endScope(const char* name, uint64_t beginTick, uint32_t frameId)
+{
+	const uint64_t endTick = getTick();
+	CpuTimerThreadBuffer* buffer = tThreadBuffer;	// Created by beginScope
+	buffer->depth--;
+
+	const uint32_t writeIndex = buffer->writeIndex.load(std::memory_order_relaxed);
+	if (writeIndex - buffer->readIndex.load(std::memory_order_acquire) >= CPU_TIMER_THREAD_EVENT_COUNT)
+	{
+		buffer->droppedCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	CpuTimerEvent& event = buffer->events[writeIndex & (CPU_TIMER_THREAD_EVENT_COUNT - 1)];
+	event.name = name;
+	event.beginTick = beginTick;
+	event.endTick = endTick;
+	event.frameId = frameId;
+	event.depth = uint16_t(buffer->depth);
+	event.threadIndex = buffer->threadIndex;
+	buffer->writeIndex.store(writeIndex + 1, std::memory_order_release);
+}
+
+
@@ -0,0 +1,85 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// CPU counterpart of GPU_SCOPED_TIMER. Each thread appends its timer events to its own ring buffer without any lock and
+// a single consumer (DxGpuPerformance::endFrame) collects them. Events are tagged with the frame id of
+// CpuTimerProfiler::beginFrame, shared with the GPU timers, so both line up in the same trace. This does not depend on D3D.
+// Set CPU_TIMER_ENABLED to 0 to compile the timers out.
+
+#ifndef CPU_TIMER_ENABLED
+#define CPU_TIMER_ENABLED 1
+#endif
+
+/// Events a thread can have pending collection, new events being dropped while the consumer does not keep up.
+#define CPU_TIMER_THREAD_EVENT_COUNT 4096
+
+struct CpuTimerEvent
+{
+	const char* name;			///! Must outlive the event, the macros use string literals
+	uint64_t beginTick;
+	uint64_t endTick;
+	uint32_t frameId;			///! Frame during which the scope started
+	uint16_t depth;				///! Number of enclosing scopes on the same thread
+	uint16_t threadIndex;
+};
+
+class CpuTimerProfiler
+{
+public:
+	/// Starts a new frame: following events are tagged with the returned frame id.
+	static uint32_t beginFrame();
+	static uint32_t getFrameId();
+
+	static uint64_t getTick();
+	static double getTicksPerSecond();
+
+	/// Names the track of the calling thread in traces.
+	static void setThreadName(const char* name);
+	static const char* getThreadName(uint32_t threadIndex);
+	static uint32_t getThreadCount();
+
+	/// Appends the events completed since the last call, from all the threads. Must always be called from the same thread.
+	static void collectEvents(std::vector<CpuTimerEvent>& outEvents);
+	static uint64_t getDroppedEventCount();
+
+	/// Used by ScopedCpuTimer
+	static uint64_t beginScope();
+	static void endScope(const char* name, uint64_t beginTick, uint32_t frameId);
+
+private:
+	CpuTimerProfiler() = delete;
+};
+
+class ScopedCpuTimer
+{
+public:
+	explicit ScopedCpuTimer(const char* name)
+		: mName(name)
+		, mFrameId(CpuTimerProfiler::getFrameId())
+		, mBeginTick(CpuTimerProfiler::beginScope())
+	{
+	}
+	~ScopedCpuTimer()
+	{
+		CpuTimerProfiler::endScope(mName, mBeginTick, mFrameId);
+	}
+private:
+	ScopedCpuTimer() = delete;
+	ScopedCpuTimer(ScopedCpuTimer&) = delete;
+	const char* mName;
+	uint32_t mFrameId;
+	uint64_t mBeginTick;
+};
+
+#if CPU_TIMER_ENABLED
+#define CPU_SCOPED_TIMER(timerName) ScopedCpuTimer cpuTimer##timerName(#timerName)
+#else
+#define CPU_SCOPED_TIMER(timerName)
+#endif
+
+
@@ -1041,6 +1041,19 @@ int32 DxGpuPerformance::mAllocatedTimerGraphNodes[V_GPU_TIMER_FRAMECOUNT];
 DxGpuPerformance::GpuTimerGraph DxGpuPerformance::mTimerGraphs[V_GPU_TIMER_FRAMECOUNT];
 DxGpuPerformance::TimerGraphNode* DxGpuPerformance::mCurrentTimeGraph = nullptr;
 
+TimerFrame DxGpuPerformance::mReadTimerFrame;
+TimerStatistics DxGpuPerformance::mTimerStatistics;
+std::vector<CpuTimerEvent> DxGpuPerformance::mCpuTimerEvents;
+TimerStatistics DxGpuPerformance::mCpuTimerStatistics;
+uint32 DxGpuPerformance::mFrameIds[V_GPU_TIMER_FRAMECOUNT];
+uint64_t DxGpuPerformance::mFrameBeginTicks[V_GPU_TIMER_FRAMECOUNT];
+ChromeTraceWriter DxGpuPerformance::mTraceWriter;
+uint64_t DxGpuPerformance::mTraceCpuOriginTick = 0;
+UINT64 DxGpuPerformance::mTraceGpuStartTick = 0;
+double DxGpuPerformance::mTraceGpuStartUs = 0.0;
+bool DxGpuPerformance::mTraceGpuStarted = false;
+uint32 DxGpuPerformance::mTracedThreadCount = 0;
+
 void DxGpuPerformance::initialise()
 {
 	mTimers.clear();
@@ -1052,6 +1065,7 @@ void DxGpuPerformance::initialise()
 }
 void DxGpuPerformance::shutdown()
 {
+	stopTraceCapture();
 	for (int32 i = 0; i < mAllocatedTimers; ++i)
 		mTimerArray[i].release();
 	mTimers.clear();
@@ -1059,6 +1073,9 @@ void DxGpuPerformance::shutdown()
 
 void DxGpuPerformance::startFrame()
 {
+	mFrameIds[mMeasureTimerFrameId] = CpuTimerProfiler::beginFrame();
+	mFrameBeginTicks[mMeasureTimerFrameId] = CpuTimerProfiler::getTick();
+
 	// Clear the frame we are going to measure and append root timer node
 	for (int32 i = 0, cnt = mAllocatedTimerGraphNodes[mMeasureTimerFrameId]; i < cnt; ++i)
 		mTimerGraphNodeArray[mMeasureTimerFrameId][i].subGraph.clear();
@@ -1217,6 +1234,34 @@ void DxGpuPerformance::endFrame()
 			node->mLastDurationMs += (lastDurationMs - node->mLastDurationMs) * lerpFactor;
 #endif
 		}
+
+		// Statistics and trace of the frame that has just been read
+		mReadTimerFrame.clear();
+		const TimerGraphNode* root = *mTimerGraphs[localReadTimerFrameId].begin();
+		for (auto& node : root->subGraph)
+		{
+			flattenTimerGraph(node, -1, mReadTimerFrame);
+		}
+		mTimerStatistics.addFrame(mReadTimerFrame);
+
+		UINT64 frequency = 0;
+		for (auto& node : root->subGraph)
+		{
+			frequency = node->disjointData.Disjoint == FALSE ? node->disjointData.Frequency : frequency;
+		}
+		// Frames whose commands were recorded before the trace started are skipped
+		const bool frameTraced = mFrameBeginTicks[localReadTimerFrameId] >= mTraceCpuOriginTick;
+		if (mTraceWriter.isOpen() && frequency != 0 && !mReadTimerFrame.empty() && frameTraced)
+		{
+			if (!mTraceGpuStarted)
+			{
+				mTraceGpuStarted = true;
+				mTraceGpuStartTick = minBeginTime;
+				mTraceGpuStartUs = double(mFrameBeginTicks[localReadTimerFrameId] - mTraceCpuOriginTick) * 1000000.0 / CpuTimerProfiler::getTicksPerSecond();
+			}
+			const double frameBeginUs = mTraceGpuStartUs + double(INT64(minBeginTime - mTraceGpuStartTick)) * 1000000.0 / double(frequency);
+			mTraceWriter.writeFrame(mReadTimerFrame, frameBeginUs, mFrameIds[localReadTimerFrameId]);
+		}
 	}
 	else
 	{
@@ -1230,6 +1275,24 @@ void DxGpuPerformance::endFrame()
 		}
 	}
 
+	// CPU timers, available as soon as their scope ends
+	mCpuTimerEvents.clear();
+	CpuTimerProfiler::collectEvents(mCpuTimerEvents);
+	const double cpuTickToUs = 1000000.0 / CpuTimerProfiler::getTicksPerSecond();
+	for (const CpuTimerEvent& event : mCpuTimerEvents)
+	{
+		const double durationUs = double(event.endTick - event.beginTick) * cpuTickToUs;
+		mCpuTimerStatistics.addSample(event.name, durationUs * 0.001);
+		if (mTraceWriter.isOpen() && event.beginTick >= mTraceCpuOriginTick)
+		{
+			for (; mTracedThreadCount <= event.threadIndex; ++mTracedThreadCount)
+			{
+				mTraceWriter.setTrackName(1 + mTracedThreadCount, CpuTimerProfiler::getThreadName(mTracedThreadCount));
+			}
+			mTraceWriter.writeSlice(event.name, double(event.beginTick - mTraceCpuOriginTick) * cpuTickToUs, durationUs, event.frameId, 1 + event.threadIndex);
+		}
+	}
+
 	// Move onto next frame
 	mReadTimerFrameId++;
 	mMeasureTimerFrameId = (mMeasureTimerFrameId + 1) % V_GPU_TIMER_FRAMECOUNT;
@@ -1245,6 +1308,38 @@ const DxGpuPerformance::TimerGraphNode* DxGpuPerformance::getLastUpdatedTimerGra
 	return nullptr;
 }
 
+void DxGpuPerformance::flattenTimerGraph(const TimerGraphNode* node, int parent, TimerFrame& frame)
+{
+	if (!node->timer || node->disjointData.Disjoint != FALSE)
+		return;					// Not measured or not valid this frame
+
+	TimerSample sample;
+	sample.name = node->name;
+	sample.parent = parent;
+	sample.beginMs = node->mBeginMs;
+	sample.durationMs = node->mLastDurationMs;
+	frame.push_back(sample);
+
+	const int index = int(frame.size()) - 1;
+	for (auto& subNode : node->subGraph)
+	{
+		flattenTimerGraph(subNode, index, frame);
+	}
+}
+
+bool DxGpuPerformance::startTraceCapture(const char* filepath)
+{
+	mTraceCpuOriginTick = CpuTimerProfiler::getTick();
+	mTraceGpuStarted = false;
+	mTracedThreadCount = 0;
+	return mTraceWriter.open(filepath, "UnrealEngineSkyAtmosphere", "GPU");
+}
+
+void DxGpuPerformance::stopTraceCapture()
+{
+	mTraceWriter.close();
+}
+
 DxGpuPerformance::DxGpuTimer::DxGpuTimer()
 {
 }
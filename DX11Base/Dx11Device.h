@@ -18,6 +18,8 @@
 #include <d3d11_2.h>
 
 #include "DxMath.h"
+#include "TimerTrace.h"
+#include "CpuTimer.h"
 
 // include the Direct3D Library file
 #pragma comment (lib, "d3d11.lib")
@@ -515,6 +517,18 @@ public:
 	/// Returns the root node of the performance timer graph. This first root node contains nothing valid appart from childrens sub graphs.
 	static const TimerGraphNode* getLastUpdatedTimerGraphRootNode();
 
+	/// Rolling min/avg/max/p95 of each timer over the last read frames.
+	static const TimerStatistics& getTimerStatistics() { return mTimerStatistics; }
+	/// Same for the CPU_SCOPED_TIMER scopes, collected from all threads by endFrame.
+	static const TimerStatistics& getCpuTimerStatistics() { return mCpuTimerStatistics; }
+
+	/// Streams the timer graph of every read frame to a Chrome trace file (chrome://tracing, Perfetto) until stopTraceCapture is called.
+	/// CPU timers get a track per thread. GPU timestamps are aligned with the CPU clock on the first traced frame, and all slices
+	/// have the frame id of CpuTimerProfiler as argument.
+	static bool startTraceCapture(const char* filepath);
+	static void stopTraceCapture();
+	static bool isTraceCapturing() { return mTraceWriter.isOpen(); }
+
 private:
 	DxGpuPerformance() = delete;
 	DxGpuPerformance(DxGpuPerformance&) = delete;
@@ -555,6 +569,23 @@ private:
 	static int32 mAllocatedTimers;
 	static TimerGraphNode mTimerGraphNodeArray[V_GPU_TIMER_FRAMECOUNT][V_TIMER_MAX_COUNT];
 	static int32 mAllocatedTimerGraphNodes[V_GPU_TIMER_FRAMECOUNT];
+
+	/// Appends a node and its valid sub graph in depth first order.
+	static void flattenTimerGraph(const TimerGraphNode* node, int parent, TimerFrame& frame);
+
+	static TimerFrame mReadTimerFrame;				///! Flattened graph of the last read frame, kept to reuse its allocations
+	static TimerStatistics mTimerStatistics;
+	static std::vector<CpuTimerEvent> mCpuTimerEvents;
+	static TimerStatistics mCpuTimerStatistics;
+	static uint32 mFrameIds[V_GPU_TIMER_FRAMECOUNT];			///! CpuTimerProfiler frame id of each measured frame
+	static uint64_t mFrameBeginTicks[V_GPU_TIMER_FRAMECOUNT];	///! CPU tick at the start of each measured frame
+
+	static ChromeTraceWriter mTraceWriter;
+	static uint64_t mTraceCpuOriginTick;			///! CPU tick when the trace started, the origin of the trace timeline
+	static UINT64 mTraceGpuStartTick;				///! GPU timestamp of the first traced frame
+	static double mTraceGpuStartUs;					///! Position of the first traced GPU frame on the timeline
+	static bool mTraceGpuStarted;
+	static uint32 mTracedThreadCount;				///! CPU tracks named so far
 };
 
 struct ScopedGpuTimer
@@ -0,0 +1,174 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#include <algorithm>
+#include <cmath>
+
+#include "TimerTrace.h"
+
+
+
+void TimerStatistics::addFrame(const TimerFrame& frame)
+{
+	for (const TimerSample& sample : frame)
+	{
+		addSample(sample.name, sample.durationMs);
+	}
+}
+
+void TimerStatistics::addSample(const std::string& name, double durationMs)
+{
+	Window& window = mWindows[name];
+	if (window.samples.size() < mWindowSize)
+	{
+		window.samples.push_back(float(durationMs));
+		return;
+	}
+	window.samples[window.next] = float(durationMs);
+	window.next = (window.next + 1) % mWindowSize;
+}
+
+bool TimerStatistics::getStats(const std::string& name, TimerStats& outStats) const
+{
+	auto it = mWindows.find(name);
+	if (it == mWindows.end() || it->second.samples.empty())
+	{
+		outStats = TimerStats();
+		return false;
+	}
+
+	std::vector<float> sorted = it->second.samples;
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (float sample : sorted)
+	{
+		sum += sample;
+	}
+	const size_t count = sorted.size();
+	outStats.minMs = sorted.front();
+	outStats.maxMs = sorted.back();
+	outStats.avgMs = float(sum / double(count));
+	outStats.p95Ms = sorted[size_t(std::ceil(0.95 * double(count))) - 1];
+	outStats.sampleCount = (unsigned int)count;
+	return true;
+}
+
+
+void TimerStatistics::getTimerNames(std::vector<std::string>& outNames) const
+{
+	outNames.clear();
+	for (auto& window : mWindows)
+	{
+		outNames.push_back(window.first);
+	}
+}
+
+
+
+static void writeJsonString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (; *str; ++str)
+	{
+		const unsigned char c = (unsigned char)*str;
+		if (c == '"' || c == '\\')
+		{
+			fputc('\\', file);
+			fputc(c, file);
+		}
+		else if (c < 0x20)
+		{
+			fprintf(file, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool ChromeTraceWriter::open(const char* filepath, const char* processName, const char* trackName)
+{
+	close();
+	mFile = fopen(filepath, "wb");
+	if (!mFile)
+	{
+		return false;
+	}
+	mEventCount = 0;
+	fputs("[", mFile);
+
+	beginEvent();
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":", mFile);
+	writeJsonString(mFile, processName);
+	fputs("}}", mFile);
+	setTrackName(0, trackName);
+	return true;
+}
+
+void ChromeTraceWriter::close()
+{
+	if (mFile)
+	{
+		fputs("\n]\n", mFile);
+		fclose(mFile);
+		mFile = nullptr;
+	}
+}
+
+void ChromeTraceWriter::beginEvent()
+{
+	fputs(mEventCount > 0 ? ",\n" : "\n", mFile);
+	mEventCount++;
+}
+
+void ChromeTraceWriter::setTrackName(int trackId, const char* trackName)
+{
+	if (!mFile)
+	{
+		return;
+	}
+	beginEvent();
+	fprintf(mFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", trackId);
+	writeJsonString(mFile, trackName);
+	fputs("}}", mFile);
+}
+
+void ChromeTraceWriter::writeFrame(const TimerFrame& frame, double frameBeginUs, unsigned long long frameId, int trackId)
+{
+	if (!mFile)
+	{
+		return;
+	}
+	mBeginUs.resize(frame.size());
+	mEndUs.resize(frame.size());
+	for (size_t s = 0; s < frame.size(); ++s)
+	{
+		const TimerSample& sample = frame[s];
+		double beginUs = frameBeginUs + sample.beginMs * 1000.0;
+		double endUs = beginUs + (std::max)(sample.durationMs, 0.0) * 1000.0;
+		if (sample.parent >= 0 && size_t(sample.parent) < s)
+		{
+			beginUs = (std::min)((std::max)(beginUs, mBeginUs[sample.parent]), mEndUs[sample.parent]);
+			endUs = (std::min)((std::max)(endUs, beginUs), mEndUs[sample.parent]);
+		}
+		mBeginUs[s] = beginUs;
+		mEndUs[s] = endUs;
+		writeSlice(sample.name.c_str(), beginUs, endUs - beginUs, frameId, trackId);
+	}
+}
+
+void ChromeTraceWriter::writeSlice(const char* name, double beginUs, double durationUs, unsigned long long frameId, int trackId)
+{
+	if (!mFile)
+	{
+		return;
+	}
+	beginEvent();
+	fputs("{\"name\":", mFile);
+	writeJsonString(mFile, name);
+	fprintf(mFile, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}", trackId, beginUs, durationUs, frameId);
+}
+
+
@@ -0,0 +1,90 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+#pragma once
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Backend independent timer statistics and export of timer graphs as Chrome trace events (JSON array format), which
+// can be opened in chrome://tracing or https://ui.perfetto.dev. DxGpuPerformance feeds them from its timer graphs,
+// but they only work on timestamps so they can be fed synthetic data.
+
+/// A timer measured during a frame
+struct TimerSample
+{
+	std::string name;
+	int parent = -1;			///! Index of the parent sample in the frame, -1 for top level timers. Parents come before their children.
+	double beginMs = 0.0;		///! From the start of the frame
+	double durationMs = 0.0;
+};
+typedef std::vector<TimerSample> TimerFrame;
+
+struct TimerStats
+{
+	float minMs = 0.0f;
+	float avgMs = 0.0f;
+	float maxMs = 0.0f;
+	float p95Ms = 0.0f;			///! Nearest rank 95th percentile
+	unsigned int sampleCount = 0;
+};
+
+/// Rolling statistics over the last windowSize samples of each timer, timers being identified by their name.
+class TimerStatistics
+{
+public:
+	explicit TimerStatistics(unsigned int windowSize = 120) : mWindowSize(windowSize > 0 ? windowSize : 1) {}
+
+	void addFrame(const TimerFrame& frame);
+	void addSample(const std::string& name, double durationMs);
+	bool getStats(const std::string& name, TimerStats& outStats) const;
+	void getTimerNames(std::vector<std::string>& outNames) const;
+	void reset() { mWindows.clear(); }
+
+private:
+	struct Window
+	{
+		std::vector<float> samples;
+		unsigned int next = 0;		///! Oldest sample once the window is full
+	};
+	std::map<std::string, Window> mWindows;
+	const unsigned int mWindowSize;
+};
+
+/// Streams frames to a trace file as complete ("X") events, nested timers becoming nested slices.
+/// The array is only closed by close(), which the format allows to omit so a trace from a crashed run still loads.
+class ChromeTraceWriter
+{
+public:
+	ChromeTraceWriter() {}
+	~ChromeTraceWriter() { close(); }
+
+	/// processName and trackName label the timeline of the frames written to track 0.
+	bool open(const char* filepath, const char* processName, const char* trackName);
+	void close();
+	bool isOpen() const { return mFile != nullptr; }
+
+	/// frameBeginUs positions the frame on the trace timeline, in microseconds. Samples are clamped to their parent so that
+	/// rounding never breaks the nesting.
+	void writeFrame(const TimerFrame& frame, double frameBeginUs, unsigned long long frameId, int trackId = 0);
+	/// A single slice, slices of a track nesting according to their time range.
+	void writeSlice(const char* name, double beginUs, double durationUs, unsigned long long frameId, int trackId);
+	void setTrackName(int trackId, const char* trackName);
+
+	unsigned long long getWrittenEventCount() const { return mEventCount; }
+
+private:
+	ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+	ChromeTraceWriter& operator=(const ChromeTraceWriter&) = delete;
+
+	void beginEvent();
+
+	FILE* mFile = nullptr;
+	unsigned long long mEventCount = 0;
+	std::vector<double> mBeginUs;	///! Clamped sample ranges of the frame being written
+	std::vector<double> mEndUs;
+};
+
+
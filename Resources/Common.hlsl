@@ -20,7 +20,27 @@ cbuffer CONSTANT_BUFFER : register(b0)
 	float gScreenshotCaptureActive;
 
 	float2 RayMarchMinMaxSPP;
-	float2 pad;
+	float gPathTracingTargetRelativeError;	// Adaptive path tracing stops sampling tiles below this relative error. 0 when disabled.
+
+	// LUT configuration, see Application/SkyLutConfig.h
+	float2 gSkyViewLutResolution;
+	float gCameraVolumeSliceCount;
+	float gCameraVolumeKmPerSlice;
+
+	float gTransmittanceSampleCount;
+	float gMultiScatteringSampleCount;
+	float gCameraVolumeSamplesPerSlice;
+	uint gSkyViewLutInterleave;			// Amortized sky view LUT updates: only the texels of gSkyViewLutPhase are rendered when above 1
+
+	uint gSkyViewLutPhase;
+	float2 gSunInScatterLutResolution;
+	float gSkyViewLutAtlasBandBlend;	// Time of day sky view LUT atlas, see SkyViewLutAtlasBlendPS
+
+	float2 gSkyViewLutAtlasW;
+	float2 gTransmittanceLutResolution;	// Ray marching transmittance LUT, TRANSMITTANCE_TEXTURE_WIDTH/HEIGHT are the Bruneton 2017 sizes
+
+	uint gPathTracingMinSamples;		// Adaptive path tracing, see CPU_PATH_TRACING_MIN_SAMPLES
+	float3 pad;
 };
 
 Texture2D<float4>  texture2d							: register(t0);
@@ -31,6 +51,8 @@ RWTexture2D<float4> rwTexture2d							: register(u0);
 SamplerState samplerLinearClamp : register(s0);
 SamplerComparisonState  samplerShadow : register(s1);
 
+#define PATH_TRACING_TILE_SIZE 16	// Same as Game::PathTracingTileSize
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -6,6 +6,7 @@
 
 Texture2D<float4> PathtracingLuminanceTexture				: register(t2);
 Texture2D<float4> PathtracingTransmittanceTexture			: register(t3);
+Texture2D<float4> PathtracingLuminanceSquaredTexture		: register(t4);
 
 float sRGB(float x)
 {
@@ -47,6 +48,39 @@ PixelOutputStruct ApplySkyAtmospherePS(VertexOutput input)
 }
 
 
+// Standard error of the pixel mean relative to its brightest channel. A frame only samples one wavelength, so the variance is that of
+// the estimates of whole cycles of 3 frames: SumSquared holds the squared unweighted samples, see RenderPathTracingPS.
+float pathTracingRelativeError(float4 Sum, float4 SumSquared)
+{
+	const float CycleCount = float(uint(Sum.w) / 3);
+	const float3 Mean = Sum.rgb / Sum.w;
+	const float3 Variance = max(0.0f, SumSquared.rgb - CycleCount * Mean * Mean) / (CycleCount - 1.0f);
+	const float3 StandardError = sqrt(Variance / CycleCount);
+	return max(StandardError.r, max(StandardError.g, StandardError.b)) / max(1e-6f, max(Mean.r, max(Mean.g, Mean.b)));
+}
+
+// Rendered at tile resolution: 1 when all the pixels of the tile reached gPathTracingTargetRelativeError, 0 otherwise.
+// Converged tiles stop receiving samples, so their statistics and this result do not change anymore.
+float PathTracingConvergencePS(VertexOutput input) : SV_TARGET
+{
+	const uint2 tileMin = uint2(input.position.xy) * PATH_TRACING_TILE_SIZE;
+	const uint2 tileMax = min(tileMin + PATH_TRACING_TILE_SIZE, gResolution);
+	for (uint y = tileMin.y; y < tileMax.y; ++y)
+	{
+		for (uint x = tileMin.x; x < tileMax.x; ++x)
+		{
+			const float4 Sum = PathtracingLuminanceTexture.Load(uint3(x, y, 0));
+			const uint n = uint(Sum.w);
+			if (n < gPathTracingMinSamples || (n % 3) != 0 || pathTracingRelativeError(Sum, PathtracingLuminanceSquaredTexture.Load(uint3(x, y, 0))) > gPathTracingTargetRelativeError)
+			{
+				return 0.0f;
+			}
+		}
+	}
+	return 1.0f;
+}
+
+
 float4 PostProcessPS(VertexOutput input) : SV_TARGET
 {
 	uint2 texCoord = input.position.xy;
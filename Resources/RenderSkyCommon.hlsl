@@ -4,8 +4,8 @@
 #include "./Resources/SkyAtmosphereCommon.hlsl"
 
 #define GPUDEBUG_CLIENT
-#define GPU_DEBUG_LINEBUFFER_UAV      u2
-#define GPU_DEBUG_LINEDISPATCHIND_UAV u3
+#define GPU_DEBUG_LINEBUFFER_UAV      u3
+#define GPU_DEBUG_LINEDISPATCHIND_UAV u4
 #include "./Resources/GpuDebugPrimitives.hlsl"
 
 
@@ -18,6 +18,10 @@ Texture2D<float4>  ShadowmapTexture						: register(t5);
 Texture2D<float4>  MultiScatTexture						: register(t6);
 Texture3D<float4>  AtmosphereCameraScatteringVolume		: register(t7);
 
+Texture2D<float4>  SunInScatterTransmittanceTexture		: register(t9);
+Texture2D<float4>  SunInScatterMultiScatTexture			: register(t10);
+Texture3D<float4>  SkyViewLutAtlasTexture				: register(t11);
+
 RWTexture2D<float4>  OutputTexture						: register(u0);
 RWTexture2D<float4>  OutputTexture1						: register(u1);
 
@@ -51,9 +55,15 @@ RWTexture2D<float4>  OutputTexture1						: register(u1);
 #ifndef SHADOWMAP_ENABLED 
 #define SHADOWMAP_ENABLED 0 
 #endif
+#ifndef ANALYTIC_OPTICAL_DEPTH_ENABLED 
+#define ANALYTIC_OPTICAL_DEPTH_ENABLED 0 
+#endif
 #ifndef MEAN_ILLUM_MODE 
 #define MEAN_ILLUM_MODE 0 
 #endif
+#ifndef SUN_INSCATTER_LUT_ENABLED 
+#define SUN_INSCATTER_LUT_ENABLED 0 
+#endif
 
 #define RENDER_SUN_DISK 1
 
@@ -122,7 +132,7 @@ void UvToLutTransmittanceParams(AtmosphereParameters Atmosphere, out float viewH
 void UvToSkyViewLutParams(AtmosphereParameters Atmosphere, out float viewZenithCosAngle, out float lightViewCosAngle, in float viewHeight, in float2 uv)
 {
 	// Constrain uvs to valid sub texel range (avoid zenith derivative issue making LUT usage visible)
-	uv = float2(fromSubUvsToUnit(uv.x, 192.0f), fromSubUvsToUnit(uv.y, 108.0f));
+	uv = float2(fromSubUvsToUnit(uv.x, gSkyViewLutResolution.x), fromSubUvsToUnit(uv.y, gSkyViewLutResolution.y));
 
 	float Vhorizon = sqrt(viewHeight * viewHeight - Atmosphere.BottomRadius * Atmosphere.BottomRadius);
 	float CosBeta = Vhorizon / viewHeight;				// GroundToHorizonCos
@@ -186,7 +196,7 @@ void SkyViewLutParamsToUv(AtmosphereParameters Atmosphere, in bool IntersectGrou
 	}
 
 	// Constrain uvs to valid sub texel range (avoid zenith derivative issue making LUT usage visible)
-	uv = float2(fromUnitToSubUvs(uv.x, 192.0f), fromUnitToSubUvs(uv.y, 108.0f));
+	uv = float2(fromUnitToSubUvs(uv.x, gSkyViewLutResolution.x), fromUnitToSubUvs(uv.y, gSkyViewLutResolution.y));
 }
 
 
@@ -228,15 +238,21 @@ struct MediumSampleRGB
 	float3 albedo;
 };
 
+// Ozone tent profile
+float getAbsorptionDensity(in AtmosphereParameters Atmosphere, float viewHeight)
+{
+	return saturate(viewHeight < Atmosphere.AbsorptionDensity0LayerWidth ?
+		Atmosphere.AbsorptionDensity0LinearTerm * viewHeight + Atmosphere.AbsorptionDensity0ConstantTerm :
+		Atmosphere.AbsorptionDensity1LinearTerm * viewHeight + Atmosphere.AbsorptionDensity1ConstantTerm);
+}
+
 MediumSampleRGB sampleMediumRGB(in float3 WorldPos, in AtmosphereParameters Atmosphere)
 {
 	const float viewHeight = length(WorldPos) - Atmosphere.BottomRadius;
 
 	const float densityMie = exp(Atmosphere.MieDensityExpScale * viewHeight);
 	const float densityRay = exp(Atmosphere.RayleighDensityExpScale * viewHeight);
-	const float densityOzo = saturate(viewHeight < Atmosphere.AbsorptionDensity0LayerWidth ?
-		Atmosphere.AbsorptionDensity0LinearTerm * viewHeight + Atmosphere.AbsorptionDensity0ConstantTerm :
-		Atmosphere.AbsorptionDensity1LinearTerm * viewHeight + Atmosphere.AbsorptionDensity1ConstantTerm);
+	const float densityOzo = getAbsorptionDensity(Atmosphere, viewHeight);
 
 	MediumSampleRGB s;
 
@@ -262,6 +278,55 @@ MediumSampleRGB sampleMediumRGB(in float3 WorldPos, in AtmosphereParameters Atmo
 
 
 
+////////////////////////////////////////////////////////////
+// Analytic optical depth
+////////////////////////////////////////////////////////////
+
+
+
+// Approximation of the Chapman function ch(x, chi) for x = r / H (H being the scale height) and cos(chi) >= 0.
+// With a parabolic height along the ray, ch = c * erfcx(c * cos(chi) / sqrt(PI)) where c = sqrt(PI * x / 2), and erfcx uses
+// the Ren and MacKenzie 2007 approximation. Relative error is below 1% for the earth Rayleigh and Mie scale heights.
+// The simpler c / ((c - 1) * cos(chi) + 1) from Schuler (GPU Pro 3) is exact at 0 and 90 degrees but is 15% off in between.
+float ChapmanApprox(float x, float cosChi)
+{
+	const float a = 2.7889f;
+	const float c = sqrt(0.5f * PI * x);
+	const float cMu = c * cosChi;
+	return c * a / ((a - 1.0f) * cMu + sqrt(cMu * cMu + a * a));
+}
+
+// Integral of exp(DensityExpScale * height) from radius r along zenith cosine mu to infinity. DensityExpScale must be negative.
+// A ray going down goes through its tangent point at radius r0 first: ch(x, chi) = 2 ch(x0, 90deg) exp(x - x0) - ch(x, 180deg - chi).
+float ExponentialOpticalLengthToInfinity(float r, float mu, float BottomRadius, float DensityExpScale)
+{
+	const float H = -1.0f / DensityExpScale;
+	const float density = exp(DensityExpScale * (r - BottomRadius));
+	if (mu >= 0.0f)
+	{
+		return H * density * ChapmanApprox(r / H, mu);
+	}
+	const float r0 = r * sqrt(1.0f - mu * mu);
+	return H * (2.0f * exp(DensityExpScale * (r0 - BottomRadius)) * sqrt(0.5f * PI * r0 / H) - density * ChapmanApprox(r / H, -mu));
+}
+
+// Integral of exp(DensityExpScale * height) over [0, t] along the ray starting at radius r with zenith cosine mu.
+float ExponentialOpticalLength(float r, float mu, float t, float BottomRadius, float DensityExpScale)
+{
+	const float rEnd = sqrt(t * t + 2.0f * r * mu * t + r * r);
+	const float muEnd = (r * mu + t) / rEnd;
+	if (muEnd < 0.0f)
+	{
+		// The segment ends before the tangent point, e.g. on the ground: integrate it backward as the tangent point can be deep below the ground.
+		return max(0.0f, ExponentialOpticalLengthToInfinity(rEnd, -muEnd, BottomRadius, DensityExpScale)
+			- ExponentialOpticalLengthToInfinity(r, -mu, BottomRadius, DensityExpScale));
+	}
+	return max(0.0f, ExponentialOpticalLengthToInfinity(r, mu, BottomRadius, DensityExpScale)
+		- ExponentialOpticalLengthToInfinity(rEnd, muEnd, BottomRadius, DensityExpScale));
+}
+
+
+
 ////////////////////////////////////////////////////////////
 // Sampling functions
 ////////////////////////////////////////////////////////////
@@ -416,6 +481,23 @@ float3 GetMultipleScattering(AtmosphereParameters Atmosphere, float3 scattering,
 	return multiScatteredLuminance;
 }
 
+// Sun in-scatter LUT parameterisation, same as SunInScatterLutParamsToUv in Application/CpuSkyLuts.h.
+// Square root mappings put more texels around the horizon and close to the ground, where the earth shadow and the transmittance change quickly.
+void SunInScatterLutParamsToUv(AtmosphereParameters Atmosphere, in float viewHeight, in float SunZenithCosAngle, out float2 uv)
+{
+	const float x = sqrt(abs(SunZenithCosAngle));
+	uv = float2(saturate(0.5f + 0.5f * (SunZenithCosAngle < 0.0f ? -x : x)), sqrt(saturate((viewHeight - Atmosphere.BottomRadius) / (Atmosphere.TopRadius - Atmosphere.BottomRadius))));
+	uv = float2(fromUnitToSubUvs(uv.x, gSunInScatterLutResolution.x), fromUnitToSubUvs(uv.y, gSunInScatterLutResolution.y));
+}
+
+void UvToSunInScatterLutParams(AtmosphereParameters Atmosphere, out float viewHeight, out float SunZenithCosAngle, in float2 uv)
+{
+	uv = float2(fromSubUvsToUnit(uv.x, gSunInScatterLutResolution.x), fromSubUvsToUnit(uv.y, gSunInScatterLutResolution.y));
+	const float x = uv.x * 2.0f - 1.0f;
+	SunZenithCosAngle = x < 0.0f ? -x * x : x * x;
+	viewHeight = Atmosphere.BottomRadius + uv.y * uv.y * (Atmosphere.TopRadius - Atmosphere.BottomRadius);
+}
+
 float getShadow(in AtmosphereParameters Atmosphere, float3 P)
 {
 	// First evaluate opaque shadow
@@ -1,6 +1,11 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "./Resources/RenderSkyCommon.hlsl"
+#include "./Resources/RenderSkySampling.hlsl"
+
+
+
+Texture2D<float>  PathTracingConvergenceTexture		: register(t8);	// 1 for tiles that reached gPathTracingTargetRelativeError
 
 
 
@@ -24,7 +29,10 @@ struct PathTracingContext
 	float3 wavelengthMask;	// light source mask
 
 	uint2 screenPixelPos;
-	float randomState;
+	float randomState;		// SAMPLER_HASH state
+	uint sampleIndex;		// Low discrepancy sequence index
+	uint pixelSeed;
+	uint sampleDimension;	// Incremented by each random01 and random2D
 
 	int lastSurfaceIntersection;
 
@@ -38,6 +46,7 @@ struct PathTracingContext
 
 float random01(inout PathTracingContext ptc)
 {
+#if SAMPLER_TYPE == SAMPLER_HASH
 	// Trying to do the best noise here with simple function.
 	// See https://www.shadertoy.com/view/ldjczd.
 	float rnd = whangHashNoise(ptc.randomState, ptc.screenPixelPos.x, ptc.screenPixelPos.y);
@@ -56,6 +65,30 @@ float random01(inout PathTracingContext ptc)
 #endif
 
 	return rnd;
+#else
+	const uint seed = samplerHashCombine(ptc.pixelSeed, ptc.sampleDimension++);
+#if SAMPLER_TYPE == SAMPLER_SOBOL_OWEN
+	return sampleSobolOwen1D(ptc.sampleIndex, seed);
+#else
+	return sampleRank1Lattice1D(ptc.sampleIndex, seed);
+#endif
+#endif
+}
+
+// Two dimensions stratified together, e.g. for a direction.
+float2 random2D(inout PathTracingContext ptc)
+{
+#if SAMPLER_TYPE == SAMPLER_HASH
+	const float u = random01(ptc);
+	return float2(u, random01(ptc));
+#else
+	const uint seed = samplerHashCombine(ptc.pixelSeed, ptc.sampleDimension++);
+#if SAMPLER_TYPE == SAMPLER_SOBOL_OWEN
+	return sampleSobolOwen2D(ptc.sampleIndex, seed);
+#else
+	return sampleRank1Lattice2D(ptc.sampleIndex, seed);
+#endif
+#endif
 }
 
 
@@ -269,14 +302,16 @@ void phaseGenerateSample(inout PathTracingContext ptc, out float3 newDirection,
 	if (ScatteringType == D_SCATT_TYPE_RAY)
 	{
 		// Evaluate a random direction
-		newDirection = getUniformSphereSample(random01(ptc), random01(ptc));
+		const float2 rnd = random2D(ptc);
+		newDirection = getUniformSphereSample(rnd.x, rnd.y);
 	}
 	else //if (ScatteringType == D_SCATT_TYPE_MIE)
 	{
 #if MIE_PHASE_IMPORTANCE_SAMPLING
 		// Evaluate a random direction with importance sampling
-		float phi = 2.0f * PI * random01(ptc);
-		float cosTheta = calcHgPhaseInvertcdf(ptc, random01(ptc));
+		const float2 rnd = random2D(ptc);
+		float phi = 2.0f * PI * rnd.x;
+		float cosTheta = calcHgPhaseInvertcdf(ptc, rnd.y);
 		float sinTheta = sqrt(max(0.0f, 1.0f - cosTheta * cosTheta));	// max to make sqrt safe. Can make the GPU hang otherwise...
 
 		const float3 wo = ptc.V;
@@ -299,7 +334,8 @@ void phaseGenerateSample(inout PathTracingContext ptc, out float3 newDirection,
 		newDirection = sinTheta * sin(phi) * t0 + sinTheta * cos(phi) * t1 + cosTheta * mainDir;
 		//newDirection = normalize(newDirection);
 #else
-		newDirection = getUniformSphereSample(random01(ptc), random01(ptc));
+		const float2 rnd = random2D(ptc);
+		newDirection = getUniformSphereSample(rnd.x, rnd.y);
 #endif
 	}
 	//else // D_SCATT_TYPE_UNI
@@ -689,7 +725,8 @@ float LightIntegratorInner(
 			float SunTransmittance = TransmittanceEstimation(ptc, sunDir);
 
 			// Generate a new up direction assuming a diffuse surface (incorrectly as it would need to follow a cosine distribution with matching pdf, but ok as it is not used for comparison images)
-			float3 newDirection = getUniformSphereSample(random01(ptc), random01(ptc));
+			const float2 rnd = random2D(ptc);
+			float3 newDirection = getUniformSphereSample(rnd.x, rnd.y);
 			const float dotVec = dot(newDirection, UpVector);
 			if (dotVec < 0.0f)
 			{
@@ -839,7 +876,8 @@ float LightIntegratorInner(
 					phaseGenerateSample(ptc, nextRay.d, ScatteringType, phaseValue, phasePdf);
 					throughput *= phaseValue / phasePdf;
 #else
-					nextRay.d = getUniformSphereSample(random01(ptc), random01(ptc));	// Simple uniform distribution.
+					const float2 rnd = random2D(ptc);
+					nextRay.d = getUniformSphereSample(rnd.x, rnd.y);	// Simple uniform distribution.
 #endif
 				}
 			} 
@@ -894,12 +932,21 @@ struct PixelOutputStruct
 	float4 Luminance		: SV_TARGET0;
 #if GAMEMODE_ENABLED==0
 	float4 Transmittance	: SV_TARGET1;
+	float4 LuminanceSquared	: SV_TARGET2;	// For the per pixel variance over wavelength cycles, see pathTracingRelativeError
 #endif
 };
 PixelOutputStruct RenderPathTracingPS(VertexOutput Input)
 {
 	float2 pixPos = Input.position.xy;
 
+#if GAMEMODE_ENABLED==0
+	// Adaptive sampling: tiles that converged do not get any new sample.
+	if (gPathTracingTargetRelativeError > 0.0f && PathTracingConvergenceTexture.Load(uint3(uint2(pixPos) / PATH_TRACING_TILE_SIZE, 0)) > 0.0f)
+	{
+		discard;
+	}
+#endif
+
 	const float NumSample = 1.0f;
 	float3 OutputLuminance = 0.0f;
 
@@ -916,6 +963,9 @@ PixelOutputStruct RenderPathTracingPS(VertexOutput Input)
 	ptc.ray = createRay(0.0f, 0.0f);
 	ptc.screenPixelPos = pixPos;
 	ptc.randomState = (pixPos.x + pixPos.y*float(gResolution.x)) + uint(gFrameId * 123u) % 32768u;
+	ptc.sampleIndex = gFrameId / 3;	// The wavelength cycles over 3 frames, see below: each one sees consecutive sequence indices.
+	ptc.pixelSeed = samplerHash(uint(pixPos.x) + uint(pixPos.y) * gResolution.x);
+	ptc.sampleDimension = 0;
 	ptc.singleScatteringRay = true;
 	ptc.opaqueHit = false;
 	ptc.transmittance = 1.0f;	// initialise to 1 for above atmosphere transmittance to be 1..
@@ -974,6 +1024,9 @@ PixelOutputStruct RenderPathTracingPS(VertexOutput Input)
 #else
 	output.Luminance = float4(OutputLuminance   * wavelengthWeight, 1.0f);
 	output.Transmittance = float4(ptc.transmittance * wavelengthWeight, 1.0f);
+	// Unweighted: each channel gets one sample per cycle of 3 frames, whose estimate for that channel is this value.
+	const float3 CycleLuminance = OutputLuminance * ptc.wavelengthMask;
+	output.LuminanceSquared = float4(CycleLuminance * CycleLuminance, 1.0f);
 #endif
 	return output;
 }
@@ -24,7 +24,7 @@ struct SingleScatteringResult
 SingleScatteringResult IntegrateScatteredLuminance(
 	in float2 pixPos, in float3 WorldPos, in float3 WorldDir, in float3 SunDir, in AtmosphereParameters Atmosphere,
 	in bool ground, in float SampleCountIni, in float DepthBufferValue, in bool VariableSampleCount,
-	in bool MieRayPhase, in float tMaxMax = 9000000.0f)
+	in bool MieRayPhase, in float tMaxMax = 9000000.0f, in bool FullSegments = false)
 {
 	const bool debugEnabled = all(uint2(pixPos.xx) == gMouseLastDownPos.xx) && uint(pixPos.y) % 10 == 0 && DepthBufferValue != -1.0f;
 	SingleScatteringResult result = (SingleScatteringResult)0;
@@ -135,6 +135,12 @@ SingleScatteringResult IntegrateScatteredLuminance(
 			t = t0 + (t1 - t0)*SampleSegmentT;
 			dt = t1 - t0;
 		}
+		else if (FullSegments)
+		{
+			// Step s covers [s, s + 1] * tMax / SampleCount and is sampled at its middle, so the march ends on tMax.
+			t = tMax * (s + 0.5f) / SampleCount;
+			dt = tMax / SampleCount;
+		}
 		else
 		{
 			//t = tMax * (s + SampleSegmentT) / SampleCount;
@@ -164,8 +170,14 @@ SingleScatteringResult IntegrateScatteredLuminance(
 		const float3 UpVector = P / pHeight;
 		float SunZenithCosAngle = dot(SunDir, UpVector);
 		float2 uv;
+#if SUN_INSCATTER_LUT_ENABLED
+		// Earth shadow already applied, and multiple scattering at the same uv, see SunInScatterLutPS
+		SunInScatterLutParamsToUv(Atmosphere, pHeight, SunZenithCosAngle, uv);
+		float3 TransmittanceToSun = SunInScatterTransmittanceTexture.SampleLevel(samplerLinearClamp, uv, 0).rgb;
+#else
 		LutTransmittanceParamsToUv(Atmosphere, pHeight, SunZenithCosAngle, uv);
 		float3 TransmittanceToSun = TransmittanceLutTexture.SampleLevel(samplerLinearClamp, uv, 0).rgb;
+#endif
 
 		float3 PhaseTimesScattering;
 		if (MieRayPhase)
@@ -178,13 +190,19 @@ SingleScatteringResult IntegrateScatteredLuminance(
 		}
 
 		// Earth shadow 
+#if SUN_INSCATTER_LUT_ENABLED
+		const float earthShadow = 1.0f;
+#else
 		float tEarth = raySphereIntersectNearest(P, SunDir, earthO + PLANET_RADIUS_OFFSET * UpVector, Atmosphere.BottomRadius);
 		float earthShadow = tEarth >= 0.0f ? 0.0f : 1.0f;
+#endif
 
 		// Dual scattering for multi scattering 
 
 		float3 multiScatteredLuminance = 0.0f;
-#if MULTISCATAPPROX_ENABLED
+#if MULTISCATAPPROX_ENABLED && SUN_INSCATTER_LUT_ENABLED
+		multiScatteredLuminance = SunInScatterMultiScatTexture.SampleLevel(samplerLinearClamp, uv, 0).rgb;
+#elif MULTISCATAPPROX_ENABLED
 		multiScatteredLuminance = GetMultipleScattering(Atmosphere, medium.scattering, medium.extinction, P, SunZenithCosAngle);
 #endif
 
@@ -267,8 +285,8 @@ SingleScatteringResult IntegrateScatteredLuminance(
 
 
 
-#define AP_SLICE_COUNT 32.0f
-#define AP_KM_PER_SLICE 4.0f
+#define AP_SLICE_COUNT gCameraVolumeSliceCount
+#define AP_KM_PER_SLICE gCameraVolumeKmPerSlice
 
 float AerialPerspectiveDepthToSlice(float depth)
 {
@@ -435,7 +453,7 @@ void NewMultiScattCS(uint3 ThreadId : SV_DispatchThreadID)
 
 
 	const bool ground = true;
-	const float SampleCountIni = 20;// a minimum set of step is required for accuracy unfortunately
+	const float SampleCountIni = gMultiScatteringSampleCount;// a minimum set of step is required for accuracy unfortunately
 	const float DepthBufferValue = -1.0;
 	const bool VariableSampleCount = false;
 	const bool MieRayPhase = false;
@@ -544,13 +562,53 @@ void NewMultiScattCS(uint3 ThreadId : SV_DispatchThreadID)
 
 
 
+// Same optical depth as IntegrateScatteredLuminance without depth buffer, but with the exponential Rayleigh and Mie layers
+// integrated analytically. Only the ozone tent profile is still ray marched, using the same sample placement.
+float3 IntegrateOpticalDepthAnalytic(in float3 WorldPos, in float3 WorldDir, in AtmosphereParameters Atmosphere, in float SampleCount)
+{
+	// Compute next intersection with atmosphere or ground 
+	float3 earthO = float3(0.0f, 0.0f, 0.0f);
+	float tBottom = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.BottomRadius);
+	float tTop = raySphereIntersectNearest(WorldPos, WorldDir, earthO, Atmosphere.TopRadius);
+	float tMax = 0.0f;
+	if (tBottom < 0.0f)
+	{
+		if (tTop < 0.0f)
+		{
+			return 0.0f;
+		}
+		tMax = tTop;
+	}
+	else if (tTop > 0.0f)
+	{
+		tMax = min(tTop, tBottom);
+	}
+
+	const float r = length(WorldPos);
+	const float mu = dot(WorldPos, WorldDir) / r;
+	float3 OpticalDepth = Atmosphere.RayleighScattering * ExponentialOpticalLength(r, mu, tMax, Atmosphere.BottomRadius, Atmosphere.RayleighDensityExpScale)
+		+ Atmosphere.MieExtinction * ExponentialOpticalLength(r, mu, tMax, Atmosphere.BottomRadius, Atmosphere.MieDensityExpScale);
+
+	float t = 0.0f;
+	const float SampleSegmentT = 0.3f;
+	for (float s = 0.0f; s < SampleCount; s += 1.0f)
+	{
+		float NewT = tMax * (s + SampleSegmentT) / SampleCount;
+		float dt = NewT - t;
+		t = NewT;
+		float3 P = WorldPos + t * WorldDir;
+		OpticalDepth += getAbsorptionDensity(Atmosphere, length(P) - Atmosphere.BottomRadius) * Atmosphere.AbsorptionExtinction * dt;
+	}
+	return OpticalDepth;
+}
+
 float4 RenderTransmittanceLutPS(VertexOutput Input) : SV_TARGET
 {
 	float2 pixPos = Input.position.xy;
 	AtmosphereParameters Atmosphere = GetAtmosphereParameters();
 
 	// Compute camera position from LUT coords
-	float2 uv = (pixPos) / float2(TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+	float2 uv = (pixPos) / gTransmittanceLutResolution;
 	float viewHeight;
 	float viewZenithCosAngle;
 	UvToLutTransmittanceParams(Atmosphere, viewHeight, viewZenithCosAngle, uv);
@@ -559,12 +617,16 @@ float4 RenderTransmittanceLutPS(VertexOutput Input) : SV_TARGET
 	float3 WorldPos = float3(0.0f, 0.0f, viewHeight);
 	float3 WorldDir = float3(0.0f, sqrt(1.0 - viewZenithCosAngle * viewZenithCosAngle), viewZenithCosAngle);
 
+	const float SampleCountIni = gTransmittanceSampleCount;	// Can go a low as 10 sample but energy lost starts to be visible.
+#if ANALYTIC_OPTICAL_DEPTH_ENABLED
+	float3 transmittance = exp(-IntegrateOpticalDepthAnalytic(WorldPos, WorldDir, Atmosphere, SampleCountIni));
+#else
 	const bool ground = false;
-	const float SampleCountIni = 40.0f;	// Can go a low as 10 sample but energy lost starts to be visible.
 	const float DepthBufferValue = -1.0;
 	const bool VariableSampleCount = false;
 	const bool MieRayPhase = false;
 	float3 transmittance = exp(-IntegrateScatteredLuminance(pixPos, WorldPos, WorldDir, sun_direction, Atmosphere, ground, SampleCountIni, DepthBufferValue, VariableSampleCount, MieRayPhase).OpticalDepth);
+#endif
 
 	// Opetical depth to transmittance
 	return float4(transmittance, 1.0f);
@@ -572,23 +634,70 @@ float4 RenderTransmittanceLutPS(VertexOutput Input) : SV_TARGET
 
 
 
+struct SunInScatterLutOutputStruct
+{
+	float4 Transmittance	: SV_TARGET0;	// Transmittance to the sun with the earth shadow applied
+	float4 MultiScattering	: SV_TARGET1;
+};
+
+// The per step sun terms of IntegrateScatteredLuminance only depend on the height and the sun zenith angle:
+// they are gathered here so that SUN_INSCATTER_LUT_ENABLED steps do not test the earth shadow.
+SunInScatterLutOutputStruct SunInScatterLutPS(VertexOutput Input)
+{
+	float2 pixPos = Input.position.xy;
+	AtmosphereParameters Atmosphere = GetAtmosphereParameters();
+
+	float viewHeight;
+	float SunZenithCosAngle;
+	UvToSunInScatterLutParams(Atmosphere, viewHeight, SunZenithCosAngle, pixPos / gSunInScatterLutResolution);
+
+	float3 P = float3(0.0f, 0.0f, viewHeight);
+	float3 SunDir = float3(sqrt(saturate(1.0f - SunZenithCosAngle * SunZenithCosAngle)), 0.0f, SunZenithCosAngle);
+
+	float2 uv;
+	LutTransmittanceParamsToUv(Atmosphere, viewHeight, SunZenithCosAngle, uv);
+	float3 TransmittanceToSun = TransmittanceLutTexture.SampleLevel(samplerLinearClamp, uv, 0).rgb;
+
+	// Earth shadow 
+	float tEarth = raySphereIntersectNearest(P, SunDir, float3(0.0f, 0.0f, PLANET_RADIUS_OFFSET), Atmosphere.BottomRadius);
+	float earthShadow = tEarth >= 0.0f ? 0.0f : 1.0f;
+
+	SunInScatterLutOutputStruct output;
+	output.Transmittance = float4(earthShadow * TransmittanceToSun, 1.0f);
+	output.MultiScattering = float4(GetMultipleScattering(Atmosphere, 0.0f, 0.0f, P, SunZenithCosAngle), 1.0f);
+	return output;
+}
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
 
 
+// Phase of a texel for amortized updates: Bayer rank in a 4x4 tile, each phase being spread over the whole LUT. Same as getSkyViewLutInterleavePhase in Application/CpuSkyLuts.h.
+uint SkyViewLutInterleavePhase(uint2 texel)
+{
+	const uint BayerRanks[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+	return BayerRanks[(texel.y & 3) * 4 + (texel.x & 3)] * gSkyViewLutInterleave / 16;
+}
+
 float4 SkyViewLutPS(VertexOutput Input) : SV_TARGET
 {
 	float2 pixPos = Input.position.xy;
+	if (gSkyViewLutInterleave > 1 && SkyViewLutInterleavePhase(uint2(pixPos)) != gSkyViewLutPhase)
+	{
+		discard;	// Keeps the texel of a previous update
+	}
 	AtmosphereParameters Atmosphere = GetAtmosphereParameters();
 
-	float3 ClipSpace = float3((pixPos / float2(192.0,108.0))*float2(2.0, -2.0) - float2(1.0, -1.0), 1.0);
+	float3 ClipSpace = float3((pixPos / gSkyViewLutResolution)*float2(2.0, -2.0) - float2(1.0, -1.0), 1.0);
 	float4 HViewPos = mul(gSkyInvProjMat, float4(ClipSpace, 1.0));
 	float3 WorldDir = normalize(mul((float3x3)gSkyInvViewMat, HViewPos.xyz / HViewPos.w));
 	float3 WorldPos = camera + float3(0, 0, Atmosphere.BottomRadius);
 
-	float2 uv = pixPos / float2(192.0, 108.0);
+	float2 uv = pixPos / gSkyViewLutResolution;
 
 	float viewHeight = length(WorldPos);
 
@@ -634,6 +743,16 @@ float4 SkyViewLutPS(VertexOutput Input) : SV_TARGET
 	return float4(L, 1);
 }
 
+// Sky view LUT from the time of day atlas baked by "SkyCpuTools bake-sky-view-atlas", same as blendSkyViewLutAtlas.
+// The two nearest sun angles of a height band are blended by the linear filtering along w, then the two nearest bands are blended.
+float4 SkyViewLutAtlasBlendPS(VertexOutput Input) : SV_TARGET
+{
+	float2 uv = Input.position.xy / gSkyViewLutResolution;
+	float3 band0 = SkyViewLutAtlasTexture.SampleLevel(samplerLinearClamp, float3(uv, gSkyViewLutAtlasW.x), 0).rgb;
+	float3 band1 = SkyViewLutAtlasTexture.SampleLevel(samplerLinearClamp, float3(uv, gSkyViewLutAtlasW.y), 0).rgb;
+	return float4(lerp(band0, band1, gSkyViewLutAtlasBandBlend), 1);
+}
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -704,7 +823,7 @@ float4 RenderCameraVolumePS(GeometryOutput Input) : SV_TARGET0
 
 
 	const bool ground = false;
-	const float SampleCountIni = max(1.0, float(Input.sliceId + 1.0) * 2.0f);
+	const float SampleCountIni = max(1.0, float(Input.sliceId + 1.0) * gCameraVolumeSamplesPerSlice);
 	const float DepthBufferValue = -1.0;
 	const bool VariableSampleCount = false;
 	const bool MieRayPhase = true;
@@ -717,6 +836,131 @@ float4 RenderCameraVolumePS(GeometryOutput Input) : SV_TARGET0
 
 
 
+RWTexture3D<float4> CameraVolumeOutput					: register(u2);
+RWTexture2D<float2> CameraVolumeCullingOutput			: register(u5);	// Marched and below ground froxel counts per column, u3 and u4 being the GPU debug buffers
+
+// Part of the view ray within the atmosphere, tExit stopping at the ground. Same as getCameraVolumeColumnInterval in Application/CpuSkyLuts.cpp.
+// Sphere terms are factored as (r - R) * (r + R) to keep the precision of grazing rays at planet scale.
+bool CameraVolumeColumnInterval(in float3 camPos, in float3 WorldDir, in AtmosphereParameters Atmosphere, out float tEnter, out float tExit, out bool hitsGround)
+{
+	const float viewHeight = length(camPos);
+	const float b = dot(camPos, WorldDir);
+	const float topDelta = b * b - (viewHeight - Atmosphere.TopRadius) * (viewHeight + Atmosphere.TopRadius);
+	tEnter = 0.0f;
+	tExit = 0.0f;
+	hitsGround = false;
+	if (topDelta < 0.0f)
+	{
+		return false;
+	}
+	tEnter = max(0.0f, -b - sqrt(topDelta));
+	tExit = -b + sqrt(topDelta);
+	if (tExit <= 0.0f)
+	{
+		tEnter = 0.0f;
+		tExit = 0.0f;
+		return false;
+	}
+	const float bottomDelta = b * b - (viewHeight - Atmosphere.BottomRadius) * (viewHeight + Atmosphere.BottomRadius);
+	const float tGround = bottomDelta >= 0.0f ? -b - sqrt(bottomDelta) : -1.0f;
+	if (tGround >= 0.0f && tGround < tExit)
+	{
+		tExit = tGround;
+		hitsGround = true;
+	}
+	return true;
+}
+
+// Same froxels as RenderCameraVolumePS, integrated front to back by one thread per froxel column: slice i only marches from slice i - 1
+// with gCameraVolumeSamplesPerSlice samples and is composited behind it, instead of marching again from the camera.
+// Froxels before the atmosphere, past it or past the ground are not marched and copy the previous slice. The first slice past the
+// ground is extrapolated through the ground hit so that the lookup between it and the previous slice is linear up to the ground.
+[numthreads(8, 8, 1)]
+void CameraVolumesPrefixCS(uint3 ThreadId : SV_DispatchThreadID)
+{
+	uint3 VolumeSize;
+	CameraVolumeOutput.GetDimensions(VolumeSize.x, VolumeSize.y, VolumeSize.z);
+	if (any(ThreadId.xy >= VolumeSize.xy))
+	{
+		return;
+	}
+
+	float2 pixPos = float2(ThreadId.xy) + 0.5f;
+	AtmosphereParameters Atmosphere = GetAtmosphereParameters();
+
+	float3 ClipSpace = float3((pixPos / float2(gResolution))*float2(2.0, -2.0) - float2(1.0, -1.0), 0.5);
+	float4 HViewPos = mul(gSkyInvProjMat, float4(ClipSpace, 1.0));
+	float3 WorldDir = normalize(mul((float3x3)gSkyInvViewMat, HViewPos.xyz / HViewPos.w));
+
+	float earthR = Atmosphere.BottomRadius;
+	float3 camPos = camera + float3(0, 0, earthR);
+	float3 SunDir = sun_direction;
+
+	float tEnter, tExit;
+	bool hitsGround;
+	CameraVolumeColumnInterval(camPos, WorldDir, Atmosphere, tEnter, tExit, hitsGround);
+
+	const bool ground = false;
+	const float SampleCountIni = max(1.0, gCameraVolumeSamplesPerSlice);
+	const float DepthBufferValue = -1.0;
+	const bool VariableSampleCount = false;
+	const bool MieRayPhase = true;
+	const bool FullSegments = true;	// No gap between the segments of consecutive slices
+
+	float3 L = 0.0f;
+	float3 Throughput = 1.0f;
+	float tPrev = 0.0f;
+	float4 PrevOutput = 0.0f;
+	float2 FroxelCounts = 0.0f;
+	for (uint sliceId = 0; sliceId < VolumeSize.z; ++sliceId)
+	{
+		const float tSliceStart = tPrev;
+		float Slice = ((float(sliceId) + 0.5f) / AP_SLICE_COUNT);
+		Slice *= Slice;	// squared distribution
+		Slice *= AP_SLICE_COUNT;
+		const float tSlice = AerialPerspectiveSliceToDepth(Slice);
+
+		const float t0 = max(tPrev, tEnter);
+		const float t1 = min(tSlice, tExit);
+		if (t1 > t0)
+		{
+			float3 WorldPos = camPos + t0 * WorldDir;
+			if (t0 == tEnter && tEnter > 0.0f)
+			{
+				// Entering from space: start just below the atmosphere top as MoveToTopAtmosphere does.
+				WorldPos -= normalize(camPos) * PLANET_RADIUS_OFFSET;
+			}
+			SingleScatteringResult ss = IntegrateScatteredLuminance(pixPos, WorldPos, WorldDir, SunDir, Atmosphere, ground, SampleCountIni, DepthBufferValue, VariableSampleCount, MieRayPhase, t1 - t0, FullSegments);
+			L += Throughput * ss.L;
+			Throughput *= ss.Transmittance;
+			FroxelCounts.x += 1.0f;
+		}
+		else if (hitsGround && tPrev >= tExit)
+		{
+			FroxelCounts.y += 1.0f;
+		}
+		tPrev = tSlice;
+
+		const float Transmittance = dot(Throughput, float3(1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f));
+		float4 Output = float4(L, 1.0 - Transmittance);
+		if (hitsGround && tSliceStart >= tExit)
+		{
+			Output = PrevOutput;
+		}
+		else if (hitsGround && tSliceStart >= tEnter && tSlice > tExit)
+		{
+			// First slice past the ground: extrapolated from the previous slice through the ground hit.
+			Output = PrevOutput + (Output - PrevOutput) * ((tSlice - tSliceStart) / (tExit - tSliceStart));
+			Output.a = saturate(Output.a);
+		}
+		PrevOutput = Output;
+		CameraVolumeOutput[uint3(ThreadId.xy, sliceId)] = Output;
+	}
+	CameraVolumeCullingOutput[ThreadId.xy] = FroxelCounts;
+}
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
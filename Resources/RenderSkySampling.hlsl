@@ -0,0 +1,101 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+// Sample generators for the path tracer, indexed by pixel, sample and dimension. Mirrored on the CPU by Application/CpuSampler.h.
+// Padded sampling: each dimension (1D or 2D) gets its own Owen scrambling and its own shuffling of the sample indices,
+// as in "Practical Hash-based Owen Scrambling", Burley 2020. Both keep power of two prefixes well distributed.
+
+
+
+#define SAMPLER_HASH			0		// whangHashNoise with a state advanced by the frame id, the original path tracer noise.
+#define SAMPLER_SOBOL_OWEN		1		// Sobol dimensions 0 and 1, Owen scrambled.
+#define SAMPLER_RANK1_LATTICE	2		// Rank-1 lattice sequence with a Cranley-Patterson rotation.
+
+#ifndef SAMPLER_TYPE
+#define SAMPLER_TYPE SAMPLER_SOBOL_OWEN
+#endif
+
+// Second component of the rank-1 lattice generating vector, the first one being 1.
+// Odd value below 2^20 maximising the worst minimum distance between points, normalised by sqrt(N), over all N = 2^m with m in [4, 20] (0.76).
+#define RANK1_LATTICE_GENERATOR 17939u
+
+
+
+uint samplerHash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint samplerHashCombine(uint seed, uint v)
+{
+	return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Each output bit only depends on the same and lower input bits.
+uint laineKarrasPermutation(uint x, uint seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// Owen scrambling of a 32 bits fixed point value in [0, 1): each bit is flipped depending on the more significant ones.
+uint nestedUniformScramble(uint x, uint seed)
+{
+	return reversebits(laineKarrasPermutation(reversebits(x), seed));
+}
+
+// Sobol dimension 1 (primitive polynomial x + 1), dimension 0 being reversebits(index).
+uint sobolDimension1(uint index)
+{
+	uint result = 0;
+	for (uint v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+	{
+		result ^= (index & 1) ? v : 0;
+	}
+	return result;
+}
+
+float samplerToFloat(uint x)
+{
+	return float(x >> 8) * (1.0f / 16777216.0f);	// [0, 1)
+}
+
+// seed is unique to the pixel and the dimension.
+float sampleSobolOwen1D(uint sampleIndex, uint seed)
+{
+	const uint index = nestedUniformScramble(sampleIndex, seed);
+	return samplerToFloat(nestedUniformScramble(reversebits(index), samplerHashCombine(seed, 1)));
+}
+
+float2 sampleSobolOwen2D(uint sampleIndex, uint seed)
+{
+	const uint index = nestedUniformScramble(sampleIndex, seed);
+	return float2(
+		samplerToFloat(nestedUniformScramble(reversebits(index), samplerHashCombine(seed, 1))),
+		samplerToFloat(nestedUniformScramble(sobolDimension1(index), samplerHashCombine(seed, 2))));
+}
+
+// Points are frac(radicalInverse(index) * (1, g) + shift). Fixed point arithmetic wraps around, which is the frac.
+float sampleRank1Lattice1D(uint sampleIndex, uint seed)
+{
+	const uint index = nestedUniformScramble(sampleIndex, seed);
+	return samplerToFloat(reversebits(index) + samplerHash(samplerHashCombine(seed, 1)));
+}
+
+float2 sampleRank1Lattice2D(uint sampleIndex, uint seed)
+{
+	const uint index = nestedUniformScramble(sampleIndex, seed);
+	const uint phi = reversebits(index);
+	return float2(
+		samplerToFloat(phi + samplerHash(samplerHashCombine(seed, 1))),
+		samplerToFloat(phi * RANK1_LATTICE_GENERATOR + samplerHash(samplerHashCombine(seed, 2))));
+}
+
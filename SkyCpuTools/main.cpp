@@ -0,0 +1,16 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+
+// Headless atmosphere tools: LUT baking, validation and benchmarks on the CPU only.
+// No D3D device is created, so this can run on machines without a GPU.
+
+#define TINYEXR_IMPLEMENTATION
+#include <tinyexr/tinyexr.h>
+
+#include "Application/CpuSkyTools.h"
+
+
+int main(int argc, char** argv)
+{
+	return runCpuSkyTools(argc, argv);
+}